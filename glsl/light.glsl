@@ -1,27 +1,55 @@
+/* see phong.glsl */
+layout (std140) uniform camera_block {
+    mat4 u_view;
+    mat4 u_projection;
+    vec3 u_view_pos;
+};
+
+/* see phong.glsl, the gizmos are drawn in the color of their light */
+#define MAX_MATERIALS 256
+
+struct material_params {
+    vec3 color;
+    float shininess;
+    bool packed;
+};
+
+layout (std140) uniform material_block {
+    material_params u_materials[MAX_MATERIALS];
+};
+
 #ifdef COMPILE_VS
 
 layout (location = 0) in vec3 attr_pos;
 
-uniform mat4 u_model;
-uniform mat4 u_view;
-uniform mat4 u_projection;
+/* per instance, see phong.glsl */
+layout (location = 3) in mat4 attr_model;
+layout (location = 10) in uint attr_material;
+
+flat out uint frag_material;
+
+/* dequantizes compact positions, see phong.glsl */
+uniform vec3 u_position_scale;
+uniform vec3 u_position_bias;
 
 void main()
 {
-    gl_Position = u_projection * u_view * u_model * vec4(attr_pos, 1.0);
+    vec3 pos = attr_pos * u_position_scale + u_position_bias;
+    gl_Position = u_projection * u_view * attr_model * vec4(pos, 1.0);
+    frag_material = attr_material;
 }
 
 #endif /* COMPILE_VS */
 
 #ifdef COMPILE_FS
 
-uniform vec3 u_color;
+flat in uint frag_material;
 
 out vec4 out_color;
 
 void main()
 {
-    out_color = vec4(u_color, 1.0);
+    out_color = vec4(u_materials[frag_material].color, 1.0);
 }
 
 #endif /* COMPILE_FS */
@@ -1,37 +1,79 @@
+/* Written once a frame for every shader, laid out like struct camera_block
+   of camera.h */
+layout (std140) uniform camera_block {
+    mat4 u_view;
+    mat4 u_projection;
+    vec3 u_view_pos;
+};
+
+/* INSTANCE_MAX_MATERIALS of instance_buffer.h */
+#define MAX_MATERIALS 256
+
+/* The parameters of the materials drawn in a frame, instances index them.
+   Laid out like struct instance_material of instance_buffer.h */
+struct material_params {
+    vec3 color;
+    float shininess;
+    /* the specular map holds the specular mask in r & the ambient occlusion
+       in g, instead of an rgb mask */
+    bool packed;
+};
+
+layout (std140) uniform material_block {
+    material_params u_materials[MAX_MATERIALS];
+};
+
 #ifdef COMPILE_VS
 
 layout (location = 0) in vec3 attr_pos;
 layout (location = 1) in vec3 attr_normal;
 layout (location = 2) in vec2 attr_uv;
 
-uniform mat4 u_model;
-uniform mat4 u_view;
-uniform mat4 u_projection;
-/* uniform mat3 u_normal_matrix; */
+/* per instance, see struct model_instance of instance_buffer.h */
+layout (location = 3) in mat4 attr_model;
+layout (location = 7) in mat3 attr_normal_matrix;
+layout (location = 10) in uint attr_material;
+
+/* Compact vertex formats (see enum vertex_format in mesh.h) store positions
+   quantized against the bounds of the mesh, and normals octahedral encoded
+   in the xy of attr_normal as integers in [-32767, 32767] */
+uniform vec3 u_position_scale;
+uniform vec3 u_position_bias;
+uniform bool u_octahedral_normals;
+
+vec3 oct_decode(vec2 encoded)
+{
+    vec2 e = clamp(encoded / 32767.0, -1.0, 1.0);
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+
+    /* unfolds the lower hemisphere back from the corners of the square */
+    float t = max(-n.z, 0.0);
+    n.x += (n.x >= 0.0) ? -t : t;
+    n.y += (n.y >= 0.0) ? -t : t;
+
+    return normalize(n);
+}
 
 out vec3 frag_pos;
 out vec3 frag_normal;
 out vec2 frag_uv;
+flat out uint frag_material;
 
 void main()
 {
-    gl_Position = u_projection * u_view * u_model * vec4(attr_pos, 1.0);
-
-
-    /* This is very costly, it's much better to do it on the CPU first. The
-       for doing this is because we want to account for any transformations done
-       to the vertex by the model matrix, thus the normal matrix is simply the
-       inverse of the model matrix to remove any discreptencies then transposing
-       it or getting the upper-left 3x3 to remove the translation part.
-      
-       NOTE: I said model because we're representing the vertex in world space,
-       but we can optimize by also converting this in view space to reduce one
-       variable needed (view position) for calculating specular */
-
-    mat3 normal_mat = mat3(transpose(inverse(u_model)));
-    frag_pos = vec3(u_model * vec4(attr_pos, 1.0));
-    frag_normal = normal_mat * attr_normal;
+    vec3 pos = attr_pos * u_position_scale + u_position_bias;
+    vec3 normal = u_octahedral_normals ? oct_decode(attr_normal.xy) : attr_normal;
+
+    vec4 world_pos = attr_model * vec4(pos, 1.0);
+    gl_Position = u_projection * u_view * world_pos;
+
+    /* The normal matrix is the inverse transpose of the model matrix, so
+       normals stay perpendicular to the surface under non uniform scaling.
+       It comes computed with the instance instead of inverting per vertex */
+    frag_pos = vec3(world_pos);
+    frag_normal = attr_normal_matrix * normal;
     frag_uv = attr_uv;
+    frag_material = attr_material;
 }
 
 #endif /* COMPILE_VS */
@@ -41,11 +83,12 @@ void main()
 in vec3 frag_pos;
 in vec3 frag_normal;
 in vec2 frag_uv;
+flat in uint frag_material;
 
+/* the parameters are in u_materials, the textures differ between draws */
 struct material {
     sampler2D diffuse;
     sampler2D specular;
-    float shininess;
 };
 uniform material u_material;
 
@@ -56,30 +99,50 @@ struct directional_light {
     vec3 diffuse;
     vec3 specular;
 };
-uniform directional_light u_directional_light;
 
+/* The scalars fill the padding after each vec3 under std140, see struct
+   lighting_block_point_light of lighting.h */
 struct point_light {
     vec3 pos;
+    float constant;
 
     vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
     float linear;
+    vec3 diffuse;
     float quadratic;
+    vec3 specular;
     bool visible;
 };
+/* LIGHTING_MAX_POINT_LIGHTS of lighting.h */
 #define MAX_SCENE_POINT_LIGHT 8
-uniform int u_num_point_lights;
-uniform point_light u_point_lights[MAX_SCENE_POINT_LIGHT];
 
-uniform vec3 u_view_pos;
+/* Written once a frame, laid out like struct lighting_block of lighting.h */
+layout (std140) uniform lighting_block {
+    directional_light u_directional_light;
+    point_light u_point_lights[MAX_SCENE_POINT_LIGHT];
+    int u_num_point_lights;
+};
 
 out vec4 out_color;
 
 vec3 point_light_calculate(point_light light, vec3 normal, vec3 view_direction);
 vec3 directional_light_calculate(directional_light light);
+vec3 material_specular();
+float material_occlusion();
+
+/* Packed masks are single channels, spread over rgb like a gray mask */
+vec3 material_specular()
+{
+    vec4 mask = texture(u_material.specular, frag_uv);
+    return u_materials[frag_material].packed ? vec3(mask.r) : mask.rgb;
+}
+
+/* How much of the ambient light reaches the fragment, only packed materials
+   have an occlusion map */
+float material_occlusion()
+{
+    return u_materials[frag_material].packed ? texture(u_material.specular, frag_uv).g : 1.0;
+}
 
 vec3 point_light_calculate(point_light light, vec3 normal, vec3 view_direction)
 {
@@ -115,7 +178,7 @@ vec3 point_light_calculate(point_light light, vec3 normal, vec3 view_direction)
 
        Calculating it is very easy by simply multiplying 2 constants from the
        lighting equation, the material's color, & the light's ambience */
-    vec3 ambient = light.ambient * vec3(texture(u_material.diffuse, frag_uv));
+    vec3 ambient = light.ambient * vec3(texture(u_material.diffuse, frag_uv)) * material_occlusion();
 
     /* Diffuse reflection, also known as Lambertian reflection, based on
        Lambert's cosine law simply calculates how much light is a particular
@@ -149,8 +212,8 @@ vec3 point_light_calculate(point_light light, vec3 normal, vec3 view_direction)
         The specular also contains a phong exponent that controls the shininess
         of the material */
     vec3 reflect_direction = reflect(-light_direction, normal);
-    float specular_factor = pow(max(dot(reflect_direction, view_direction), 0.0), u_material.shininess);
-    vec3 specular = light.specular * specular_factor * vec3(texture(u_material.specular, frag_uv));
+    float specular_factor = pow(max(dot(reflect_direction, view_direction), 0.0), u_materials[frag_material].shininess);
+    vec3 specular = light.specular * specular_factor * material_specular();
 
     /* Applying the light's luminostiy (strength) based on the attenuation
        factors so that the brightness of the light on the fragment decreases
@@ -173,14 +236,14 @@ vec3 directional_light_calculate(directional_light light, vec3 normal, vec3 view
 {
     vec3 light_direction = normalize(-light.direction);
 
-    vec3 ambient = light.ambient * vec3(texture(u_material.diffuse, frag_uv));
+    vec3 ambient = light.ambient * vec3(texture(u_material.diffuse, frag_uv)) * material_occlusion();
 
     float diffuse_factor = max(dot(normal, light_direction), 0.0);
     vec3 diffuse = light.diffuse * diffuse_factor * vec3(texture(u_material.diffuse, frag_uv));
 
     vec3 reflect_direction = reflect(-light_direction, normal);
-    float specular_factor = pow(max(dot(reflect_direction, view_direction), 0.0), u_material.shininess);
-    vec3 specular = light.specular * specular_factor * vec3(texture(u_material.specular, frag_uv));
+    float specular_factor = pow(max(dot(reflect_direction, view_direction), 0.0), u_materials[frag_material].shininess);
+    vec3 specular = light.specular * specular_factor * material_specular();
 
     return (ambient + diffuse + specular);
 }
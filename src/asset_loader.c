@@ -0,0 +1,436 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "asset_loader.h"
+#include "mesh_cache.h"
+#include "obj_loader.h"
+#include "texture.h"
+#include "texture_cache.h"
+#include "texture_stream.h"
+#include "texture_residency.h"
+#include "file_batch.h"
+#include "darray.h"
+#include "logger.h"
+
+/* Upper bound on the workers, parsing a single .obj is threaded already */
+#define ASSET_LOADER_MAX_THREADS 8
+
+enum asset_job_type {
+    ASSET_JOB_MESH = 1,
+    ASSET_JOB_TEXTURE,
+    ASSET_JOB_CUBEMAP_FACE,
+};
+
+enum asset_job_state {
+    ASSET_JOB_QUEUED = 1,   /* waiting for or being worked on by a worker */
+    ASSET_JOB_LOADED,       /* waiting for its upload */
+    ASSET_JOB_FAILED,
+    ASSET_JOB_UPLOADED,
+};
+
+struct asset_job_data {
+    enum asset_job_type type;
+    enum asset_job_state state;     /* guarded by the lock */
+    char path[MESH_PATH_MAX_SIZE];
+
+    /* textures, what the levels are uploaded into */
+    uint32_t texture;
+    uint32_t face;
+    uint32_t flags;                 /* STEX_* the image is built with */
+    struct texture_cache_file levels;
+    double load_ms;                 /* the worker spent decoding or mapping it */
+
+    /* meshes, either mapped out of the cache or parsed & prepared */
+    bool cached;
+    struct mesh_cache_file cache;
+    struct mesh_pending pending;
+    struct mesh mesh;               /* once uploaded */
+    bool delivered;                 /* handed to a model by asset_loader_mesh() */
+};
+
+struct asset_loader {
+    bool active;
+    bool stopping;
+    pthread_t threads[ASSET_LOADER_MAX_THREADS];
+    uint32_t n_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+
+    /* every job ever queued, job ids are their index + 1. Only the render
+       thread pushes, under the lock since the workers read the array */
+    darray *jobs;           /* struct asset_job_data * */
+    size_t next;            /* first job no worker picked up yet */
+    darray *loaded;         /* asset_job, in the order the workers finished */
+    size_t next_upload;     /* first of 'loaded' not uploaded yet */
+    uint32_t pending;
+
+    struct mesh placeholder;
+    struct timespec start;  /* of the first job, for logging how long it all took */
+
+    /* of the textures uploaded so far, for the throughput once it's all done */
+    uint32_t n_textures;
+    uint64_t texture_bytes;
+    double texture_load_ms;
+};
+
+static struct asset_loader loader;
+
+static void *asset_loader_worker(void *arg);
+static void asset_loader_load(struct asset_job_data *job);
+static bool asset_loader_upload(struct asset_job_data *job);
+static asset_job asset_loader_queue(const struct asset_job_data *job);
+static void asset_loader_free_job(struct asset_job_data *job);
+static void asset_loader_batch_file(const struct asset_job_data *job);
+static double asset_loader_elapsed_ms(struct timespec start);
+
+void asset_loader_init(uint32_t n_threads)
+{
+    if (loader.active) return;
+
+    if (n_threads == 0) {
+        long n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = (n_cores > 1) ? (uint32_t) (n_cores - 1) : 1;
+    }
+    if (n_threads > ASSET_LOADER_MAX_THREADS) n_threads = ASSET_LOADER_MAX_THREADS;
+
+    loader.jobs = darray_alloc(sizeof(struct asset_job_data *), 64);
+    loader.loaded = darray_alloc(sizeof(asset_job), 64);
+    if (loader.jobs == NULL || loader.loaded == NULL) {
+        SERROR("Failed to alloc memory for the asset loader, loading synchronously");
+        if (loader.jobs) darray_free(loader.jobs);
+        if (loader.loaded) darray_free(loader.loaded);
+        return;
+    }
+
+    pthread_mutex_init(&loader.lock, NULL);
+    pthread_cond_init(&loader.wake, NULL);
+    loader.stopping = false;
+    loader.next = 0;
+    loader.next_upload = 0;
+    loader.pending = 0;
+
+    loader.n_threads = 0;
+    for (uint32_t i = 0; i < n_threads; i++) {
+        if (pthread_create(&loader.threads[loader.n_threads], NULL, asset_loader_worker, NULL) == 0)
+            loader.n_threads++;
+    }
+
+    if (loader.n_threads == 0) {
+        SERROR("Failed to start the asset loader threads, loading synchronously");
+        pthread_cond_destroy(&loader.wake);
+        pthread_mutex_destroy(&loader.lock);
+        darray_free(loader.jobs);
+        darray_free(loader.loaded);
+        return;
+    }
+
+    loader.n_textures = 0;
+    loader.texture_bytes = 0;
+    loader.texture_load_ms = 0.0;
+
+    loader.placeholder = mesh_geometry_create_cube();
+    texture_stream_init();
+    loader.active = true;
+    SINFO("Streaming assets with %u threads", loader.n_threads);
+}
+
+bool asset_loader_active(void)
+{
+    return loader.active;
+}
+
+void asset_loader_shutdown(void)
+{
+    if (!loader.active) return;
+
+    /* workers finish the job they're on, the rest is dropped */
+    pthread_mutex_lock(&loader.lock);
+    loader.stopping = true;
+    pthread_cond_broadcast(&loader.wake);
+    pthread_mutex_unlock(&loader.lock);
+
+    for (uint32_t i = 0; i < loader.n_threads; i++)
+        pthread_join(loader.threads[i], NULL);
+
+    struct asset_job_data **jobs = loader.jobs->items;
+    for (size_t i = 0; i < loader.jobs->len; i++)
+        asset_loader_free_job(jobs[i]);
+
+    darray_free(loader.jobs);
+    darray_free(loader.loaded);
+    pthread_cond_destroy(&loader.wake);
+    pthread_mutex_destroy(&loader.lock);
+    mesh_destroy(&loader.placeholder);
+    texture_stream_shutdown();
+
+    loader.active = false;
+}
+
+asset_job asset_loader_queue_mesh(const char *path)
+{
+    struct asset_job_data job = { .type = ASSET_JOB_MESH };
+    strncpy(job.path, path, MESH_PATH_MAX_SIZE - 1);
+    return asset_loader_queue(&job);
+}
+
+void asset_loader_queue_texture(const char *path, uint32_t id, uint32_t flags)
+{
+    struct asset_job_data job = { .type = ASSET_JOB_TEXTURE, .texture = id, .flags = flags };
+    strncpy(job.path, path, MESH_PATH_MAX_SIZE - 1);
+    asset_loader_queue(&job);
+}
+
+void asset_loader_queue_cubemap_face(const char *path, uint32_t id, uint32_t face, uint32_t flags)
+{
+    struct asset_job_data job = {
+        .type = ASSET_JOB_CUBEMAP_FACE, .texture = id, .face = face, .flags = flags
+    };
+    strncpy(job.path, path, MESH_PATH_MAX_SIZE - 1);
+    asset_loader_queue(&job);
+}
+
+void asset_loader_update(double budget_ms)
+{
+    if (!loader.active || loader.pending == 0) return;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (uint32_t n_uploads = 0; ; n_uploads++) {
+        if (n_uploads > 0 && asset_loader_elapsed_ms(start) >= budget_ms) break;
+
+        struct asset_job_data *job = NULL;
+        pthread_mutex_lock(&loader.lock);
+        if (loader.next_upload < loader.loaded->len) {
+            asset_job id = *(asset_job *) darray_at(loader.loaded, loader.next_upload++);
+            job = *(struct asset_job_data **) darray_at(loader.jobs, id - 1);
+        }
+        pthread_mutex_unlock(&loader.lock);
+
+        if (job == NULL) break;
+
+        /* only the render thread touches a job once it's loaded. One that
+           can't be uploaded yet is the first tried next frame */
+        if (!asset_loader_upload(job)) {
+            pthread_mutex_lock(&loader.lock);
+            loader.next_upload--;
+            pthread_mutex_unlock(&loader.lock);
+            break;
+        }
+        loader.pending--;
+    }
+
+    if (loader.pending > 0) return;
+
+    SINFO("Finished streaming %zu assets in %.2f ms",
+          loader.jobs->len, asset_loader_elapsed_ms(loader.start));
+
+    struct texture_stream_stats stats = texture_stream_stats();
+    if (loader.n_textures > 0 && loader.texture_load_ms > 0.0 && stats.ms > 0.0) {
+        double mb = (double) loader.texture_bytes / (1024.0 * 1024.0);
+        double uploaded_mb = (double) stats.bytes / (1024.0 * 1024.0);
+        SINFO("Loaded %u textures, %.2f MB at %.1f MB/s per worker", loader.n_textures, mb,
+              mb / (loader.texture_load_ms / 1000.0));
+        SINFO("Uploaded them in %.2f ms at %.1f MB/s, %u of %u through pixel buffers, "
+              "%u put off while the ring was busy", stats.ms, uploaded_mb / (stats.ms / 1000.0),
+              stats.n_buffered, stats.n_uploads, stats.n_deferred);
+    }
+}
+
+bool asset_loader_mesh(asset_job job, struct mesh *mesh)
+{
+    if (!loader.active || job == 0 || job > loader.jobs->len) return false;
+
+    struct asset_job_data *data = *(struct asset_job_data **) darray_at(loader.jobs, job - 1);
+    pthread_mutex_lock(&loader.lock);
+    bool uploaded = (data->state == ASSET_JOB_UPLOADED);
+    pthread_mutex_unlock(&loader.lock);
+    if (!uploaded) return false;
+
+    *mesh = data->mesh;
+    data->delivered = true;
+    return true;
+}
+
+struct mesh asset_loader_placeholder_mesh(void)
+{
+    return loader.placeholder;
+}
+
+uint32_t asset_loader_pending(void)
+{
+    return loader.active ? loader.pending : 0;
+}
+
+static void *asset_loader_worker(void *arg)
+{
+    (void) arg;
+
+    pthread_mutex_lock(&loader.lock);
+    for (;;) {
+        while (!loader.stopping && loader.next == loader.jobs->len)
+            pthread_cond_wait(&loader.wake, &loader.lock);
+        if (loader.stopping) break;
+
+        struct asset_job_data *job = *(struct asset_job_data **) darray_at(loader.jobs, loader.next);
+        asset_job id = (asset_job) ++loader.next;
+        pthread_mutex_unlock(&loader.lock);
+
+        asset_loader_load(job);
+
+        pthread_mutex_lock(&loader.lock);
+        darray_push(loader.loaded, &id);
+    }
+    pthread_mutex_unlock(&loader.lock);
+
+    return NULL;
+}
+
+/* Everything that doesn't need GL, on a worker. The state is set by the
+   worker under the lock right after */
+static void asset_loader_load(struct asset_job_data *job)
+{
+    enum asset_job_state state = ASSET_JOB_LOADED;
+
+    switch (job->type) {
+    case ASSET_JOB_MESH:
+        job->cached = mesh_cache_open(job->path, &job->cache);
+        if (!job->cached) {
+            darray *vertices = NULL;
+            darray *indices = NULL;
+            darray *submeshes = NULL;
+            char material_library[MESH_PATH_MAX_SIZE];
+            obj_load_model(job->path, &vertices, &indices, &submeshes, material_library);
+
+            job->pending = mesh_prepare(vertices, indices, submeshes->items, submeshes->len);
+            memcpy(job->pending.mesh.material_library, material_library, MESH_PATH_MAX_SIZE);
+            darray_free(submeshes);
+
+            mesh_cache_store(job->path, &job->pending.mesh);
+        }
+        break;
+
+    case ASSET_JOB_TEXTURE:
+    case ASSET_JOB_CUBEMAP_FACE: {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (!texture_cache_load(job->path, job->flags, &job->levels)) {
+            SERROR("Texture '%s' failed to load", job->path);
+            state = ASSET_JOB_FAILED;
+        }
+        job->load_ms = asset_loader_elapsed_ms(start);
+        break;
+    }
+    }
+
+    pthread_mutex_lock(&loader.lock);
+    job->state = state;
+    pthread_mutex_unlock(&loader.lock);
+}
+
+/* Creates the GL objects of a loaded job, on the render thread. False if it
+   has to wait for a pixel buffer, the job is left as it is then */
+static bool asset_loader_upload(struct asset_job_data *job)
+{
+    pthread_mutex_lock(&loader.lock);
+    enum asset_job_state state = job->state;
+    pthread_mutex_unlock(&loader.lock);
+    if (state != ASSET_JOB_LOADED) return true;
+
+    size_t texture_size = job->levels.file.size;
+    switch (job->type) {
+    case ASSET_JOB_MESH:
+        job->mesh = job->cached ? mesh_cache_upload(&job->cache) : mesh_upload(&job->pending);
+        break;
+    case ASSET_JOB_TEXTURE:
+        /* only the smallest mips if the residency manager takes it */
+        if (texture_residency_manage(&job->levels, job->texture)) break;
+        if (!texture_stream_upload(&job->levels, job->texture)) return false;
+        break;
+    case ASSET_JOB_CUBEMAP_FACE:
+        if (!texture_stream_upload_face(&job->levels, job->texture, job->face)) return false;
+        break;
+    }
+
+    if (job->type != ASSET_JOB_MESH) {
+        loader.n_textures++;
+        loader.texture_bytes += texture_size;
+        loader.texture_load_ms += job->load_ms;
+    }
+
+    pthread_mutex_lock(&loader.lock);
+    job->state = ASSET_JOB_UPLOADED;
+    pthread_mutex_unlock(&loader.lock);
+    return true;
+}
+
+static asset_job asset_loader_queue(const struct asset_job_data *job)
+{
+    if (!loader.active) return 0;
+
+    struct asset_job_data *queued = malloc(sizeof(struct asset_job_data));
+    if (queued == NULL) {
+        SERROR("Failed to alloc memory for loading '%s'", job->path);
+        return 0;
+    }
+    *queued = *job;
+    queued->state = ASSET_JOB_QUEUED;
+
+    if (loader.jobs->len == 0) clock_gettime(CLOCK_MONOTONIC, &loader.start);
+
+    asset_loader_batch_file(queued);
+
+    pthread_mutex_lock(&loader.lock);
+    size_t index = darray_push(loader.jobs, &queued);
+    pthread_cond_signal(&loader.wake);
+    pthread_mutex_unlock(&loader.lock);
+
+    loader.pending++;
+    return (asset_job) index + 1;
+}
+
+/* Adds the file the worker reads first to the file batch if one is open, for
+   meshes that's their cache when there is one */
+static void asset_loader_batch_file(const struct asset_job_data *job)
+{
+    if (!file_batch_active()) return;
+
+    char cache_path[SMESH_PATH_BUFFER_SIZE];
+    struct file_info info;
+    if (job->type == ASSET_JOB_MESH && mesh_cache_path(job->path, cache_path) &&
+        file_stat(cache_path, &info))
+        file_batch_add(cache_path);
+    else
+        file_batch_add(job->path);
+}
+
+/* Frees whatever the job still holds, the workers are stopped by now */
+static void asset_loader_free_job(struct asset_job_data *job)
+{
+    if (job->state == ASSET_JOB_LOADED) {
+        if (job->type == ASSET_JOB_MESH && job->cached)
+            mesh_cache_close(&job->cache);
+        else if (job->type == ASSET_JOB_MESH)
+            mesh_pending_destroy(&job->pending);
+        else
+            texture_cache_close(&job->levels);
+    }
+
+    /* meshes handed to models are destroyed along with them */
+    if (job->state == ASSET_JOB_UPLOADED && job->type == ASSET_JOB_MESH && !job->delivered)
+        mesh_destroy(&job->mesh);
+
+    free(job);
+}
+
+static double asset_loader_elapsed_ms(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start.tv_sec) * 1000.0 +
+           (double) (now.tv_nsec - start.tv_nsec) / 1000000.0;
+}
@@ -0,0 +1,59 @@
+#ifndef SAGE_ASSET_LOADER_H
+#define SAGE_ASSET_LOADER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "mesh.h"
+
+/*
+ * Asynchronous asset loading
+ *
+ * Worker threads do everything that doesn't need the GL context: mapping the
+ * mesh cache or parsing & preparing the mesh, mapping the texture cache or
+ * decoding images. What they finish waits until asset_loader_update() creates
+ * the GL objects on the render thread, which stops starting new uploads once
+ * the budget of the frame is spent so loading never hitches a frame by more
+ * than a single upload.
+ *
+ * Textures are uploaded into the placeholder they were queued with, so every
+ * copy of the texture picks the image up by itself. Their levels go through
+ * the pixel buffers of texture_stream.h, an upload waiting on a busy buffer is
+ * retried the next frame. Meshes have to be swapped
+ * into the models that wait on them, see asset_loader_mesh().
+ */
+
+/* Handle of a queued mesh, 0 is no job */
+typedef uint32_t asset_job;
+
+/* Starts the workers, 0 threads picks one less than the cores */
+void asset_loader_init(uint32_t n_threads);
+/* Whether the loader is running, loads are synchronous when it isn't */
+bool asset_loader_active(void);
+/* Stops the workers & frees everything that was never handed out */
+void asset_loader_shutdown(void);
+
+/* Queues a .obj, returns 0 if it couldn't be */
+asset_job asset_loader_queue_mesh(const char *path);
+/* Queues an image to be uploaded into the texture 'id' once it's decoded,
+   built with the STEX_* 'flags' of texture_cache.h */
+void asset_loader_queue_texture(const char *path, uint32_t id, uint32_t flags);
+/* Same for a face (0 to 5, +x -x +y -y +z -z) of a cubemap */
+void asset_loader_queue_cubemap_face(const char *path, uint32_t id, uint32_t face, uint32_t flags);
+
+/* Uploads what the workers finished until 'budget_ms' is spent, always
+   atleast one upload per call so loading keeps going on slow frames */
+void asset_loader_update(double budget_ms);
+
+/* Mesh of a finished job, false while it's still loading. Every model waiting
+   on the job gets the same mesh like copies of a model share theirs, whoever
+   destroys the models destroys it */
+bool asset_loader_mesh(asset_job job, struct mesh *mesh);
+/* Placeholder drawn by models whose mesh is still loading, owned by the
+   loader */
+struct mesh asset_loader_placeholder_mesh(void);
+
+/* Jobs that haven't been uploaded yet */
+uint32_t asset_loader_pending(void);
+
+#endif /* SAGE_ASSET_LOADER_H */
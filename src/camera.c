@@ -1,5 +1,6 @@
 #include "camera.h"
 #include <math.h>
+#include <string.h>
 #include "mnf/mnf_matrix.h"
 #include "mnf/mnf_vector.h"
 #include "mnf/mnf_util.h"
@@ -127,6 +128,14 @@ void camera_update(struct camera *cam)
                            cam->far);
 }
 
+void camera_uniform_block(const struct camera *cam, struct camera_block *block)
+{
+    memset(block, 0, sizeof(*block));
+    memcpy(block->view, cam->view, sizeof(mat4));
+    memcpy(block->projection, cam->projection, sizeof(mat4));
+    memcpy(block->view_pos, cam->pos, sizeof(vec3));
+}
+
 void view_lookat(mat4 view, vec3 pos, vec3 target, vec3 up)
 {
     vec3 distance = {
@@ -51,8 +51,18 @@ struct camera {
     mat4 projection;
 };
 
+/* std140 layout of camera_block in phong.glsl & light.glsl */
+struct camera_block {
+    mat4 view;
+    mat4 projection;
+    vec3 view_pos;
+    float pad;
+};
+
 void camera_init(struct camera *cam, vec3 pos, vec3 forward, vec3 world_up);
 void camera_update(struct camera *cam);
+/* What the camera writes into its uniform block, see uniform_buffer.h */
+void camera_uniform_block(const struct camera *cam, struct camera_block *block);
 
 void camera_mouse(struct camera *cam, 
                  float dx, 
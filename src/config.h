@@ -23,4 +23,65 @@
 #define SAGE_INITIAL_VIEWPORT_WIDTH 640
 #define SAGE_INITIAL_VIEWPORT_HEIGHT 480
 
+/* GPU layout of the vertices of meshes loaded from files, one of the
+   VERTEX_FORMAT_* in mesh.h. Quantized halves the memory of struct vertex,
+   packed keeps float positions for meshes that need the precision */
+#define SAGE_VERTEX_FORMAT VERTEX_FORMAT_QUANTIZED
+
+/* Models are drawn with their coarsest LOD whose error, projected onto the
+   screen, stays under this fraction of the screen height (~1 pixel at 1080p) */
+#define SAGE_LOD_MAX_SCREEN_ERROR 0.001f
+
+/* Directory for data derived from the assets, like parsed meshes. Safe to
+   delete, it is rebuilt on the next launch */
+#define SAGE_CACHE_DIR "cache"
+
+/* Textures are stored block compressed (BC1 & BC3 for colors, BC4 for masks
+   like specular maps) when the GPU supports it, 0 keeps them RGBA8 */
+#define SAGE_TEXTURE_COMPRESSION 1
+/* Threads compressing a single image, 0 picks one per core */
+#define SAGE_TEXTURE_COMPRESS_THREADS 0
+
+/* Archive written by `make cook`, the assets in it are loaded from it instead
+   of their files. Missing is fine, everything loads from the files then */
+#define SAGE_PAK_PATH "scene.sagepak"
+
+/* Loads the assets of the scene on worker threads & streams them in while
+   rendering, 0 loads everything before the first frame */
+#define SAGE_ASYNC_LOADING 1
+
+/* Workers of the asset loader, 0 picks one less than the cores */
+#define SAGE_ASSET_LOADER_THREADS 0
+
+/* Milliseconds of a frame spent creating the GL objects of streamed assets */
+#define SAGE_ASSET_UPLOAD_BUDGET_MS 2.0
+
+/* Streamed textures are uploaded through a ring of this many pixel buffers of
+   SAGE_TEXTURE_PBO_SIZE_MB each, bigger textures are uploaded directly */
+#define SAGE_TEXTURE_PBO_COUNT 4
+#define SAGE_TEXTURE_PBO_SIZE_MB 8
+
+/* Textures start out with only their mips of atmost SAGE_TEXTURE_RESIDENT_SIZE
+   pixels, finer ones are streamed in as they're seen up close. Once they'd
+   take more than SAGE_TEXTURE_BUDGET_MB of VRAM the least recently seen
+   textures give theirs back. 0 uploads every mip right away */
+#define SAGE_TEXTURE_BUDGET_MB 512
+#define SAGE_TEXTURE_RESIDENT_SIZE 64
+/* Megabytes of mips streamed in per frame, always atleast one texture */
+#define SAGE_TEXTURE_STREAM_MB_PER_FRAME 16
+
+/* The files of the scene are read as one io_uring batch on Linux, 0 reads
+   them with pread() on SAGE_FILE_BATCH_THREADS threads like other systems */
+#define SAGE_IO_URING 1
+#define SAGE_FILE_BATCH_THREADS 4
+
+/* Asks for a debug context & logs what the driver reports through KHR_debug,
+   which is how the state tracking of gl_state.h going wrong shows up. Off in
+   release builds, where GL errors go unchecked */
+#ifdef SAGE_RELEASE
+#define SAGE_GL_DEBUG 0
+#else
+#define SAGE_GL_DEBUG 1
+#endif
+
 #endif /* SAGE_CONFIG_H */
@@ -41,6 +41,31 @@ size_t darray_push(darray *arr, void *item)
     return index;
 }
 
+bool darray_reserve(darray *arr, size_t capacity)
+{
+    if (capacity <= arr->capacity) return true;
+
+    void *items = realloc(arr->items, capacity * arr->item_size);
+    if (items == NULL) {
+        SERROR("Failed to reserve %zu items for a darray", capacity);
+        return false;
+    }
+    arr->items = items;
+    arr->capacity = capacity;
+
+    return true;
+}
+
+void darray_shrink(darray *arr)
+{
+    if (arr->len == arr->capacity || arr->len == 0) return;
+
+    void *items = realloc(arr->items, arr->len * arr->item_size);
+    if (items == NULL) return; /* the old allocation is still valid */
+    arr->items = items;
+    arr->capacity = arr->len;
+}
+
 void *darray_pop(darray *arr)
 {
     SASSERT(arr->len > 0);
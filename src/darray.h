@@ -2,6 +2,7 @@
 #define SAGE_DARRAY_H
 
 #include <stddef.h>
+#include <stdbool.h>
 
 #define DARRAY_RESIZE_FACTOR 2
 
@@ -18,6 +19,11 @@ darray *darray_alloc(size_t n_size, size_t initial_size);
    store the reference to that item, but to copy the bytes at tat location
    over to the darray. (You can store items from the stack over to the darray) */
 size_t darray_push(darray *arr, void *item);
+/* Grows the capacity so that atleast 'capacity' items fit without another
+   realloc. Useful when the amount of items is known up front */
+bool darray_reserve(darray *arr, size_t capacity);
+/* Releases the capacity that isn't used by any item */
+void darray_shrink(darray *arr);
 void *darray_pop_at(darray *arr,  size_t index);
 void *darray_pop(darray *arr);
 void *darray_at(darray *arr, size_t index);
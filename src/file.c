@@ -0,0 +1,127 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "file.h"
+#include "logger.h"
+
+#define FILE_PATH_BUFFER_SIZE 1024
+#define FILE_MAX_SOURCES 4
+
+/* only added to while the engine starts, before any thread maps files */
+static file_source sources[FILE_MAX_SOURCES];
+static uint32_t n_sources = 0;
+
+void file_add_source(file_source source)
+{
+    for (uint32_t i = 0; i < n_sources; i++)
+        if (sources[i] == source) return;
+
+    if (n_sources == FILE_MAX_SOURCES) {
+        SERROR("Failed to add a source of files, only %d are supported", FILE_MAX_SOURCES);
+        return;
+    }
+    sources[n_sources++] = source;
+}
+
+bool file_map(const char *path, struct mapped_file *file)
+{
+    file->data = NULL;
+    file->size = 0;
+    file->copied = false;
+    file->borrowed = false;
+
+    for (uint32_t i = 0; i < n_sources; i++)
+        if (sources[i](path, file)) return true;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        close(fd);
+        return false;
+    }
+
+    /* mmap refuses zero-length mappings */
+    if (info.st_size == 0) {
+        close(fd);
+        return true;
+    }
+
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    posix_madvise(data, info.st_size, POSIX_MADV_SEQUENTIAL);
+
+    file->data = data;
+    file->size = info.st_size;
+
+    return true;
+}
+
+void file_unmap(struct mapped_file *file)
+{
+    if (file->copied) free((void *) file->data);
+    else if (file->data && !file->borrowed) munmap((void *) file->data, file->size);
+    file->data = NULL;
+    file->copied = false;
+    file->borrowed = false;
+    file->size = 0;
+}
+
+bool file_stat(const char *path, struct file_info *info)
+{
+    struct stat st;
+    if (stat(path, &st) < 0) return false;
+
+    info->size = st.st_size;
+#ifdef __APPLE__
+    info->mtime_sec = st.st_mtimespec.tv_sec;
+    info->mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+    info->mtime_sec = st.st_mtim.tv_sec;
+    info->mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+
+    return true;
+}
+
+bool file_make_dir(const char *path)
+{
+    if (mkdir(path, 0755) == 0 || errno == EEXIST) return true;
+
+    SERROR("Failed to create directory '%s': %s", path, strerror(errno));
+    return false;
+}
+
+bool file_write_atomic(const char *path, const void *data, size_t size)
+{
+    /* the buffer tells apart threads of the process writing the same path */
+    char tmp_path[FILE_PATH_BUFFER_SIZE];
+    int n = snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.%lx.tmp",
+                     path, (long) getpid(), (unsigned long) (uintptr_t) data);
+    if (n < 0 || (size_t) n >= sizeof(tmp_path)) return false;
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (file == NULL) goto err;
+
+    size_t written = fwrite(data, 1, size, file);
+    if (fclose(file) != 0 || written != size) goto err;
+
+    if (rename(tmp_path, path) != 0) goto err;
+
+    return true;
+
+err:
+    SERROR("Failed to write '%s': %s", path, strerror(errno));
+    remove(tmp_path);
+    return false;
+}
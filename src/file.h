@@ -0,0 +1,50 @@
+#ifndef SAGE_FILE_H
+#define SAGE_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* A read-only memory mapping of a whole file */
+struct mapped_file {
+    const void *data;
+    size_t size;
+    bool copied;    /* a heap buffer instead of a mapping, freed when unmapped */
+    bool borrowed;  /* points into the mounted .sagepak, nothing to unmap */
+};
+
+/* What file_stat() reports about a file */
+struct file_info {
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+};
+
+/* Hands out a file before it's looked up on disk, like one in the mounted
+   .sagepak or read by the open batch. Returns false if it doesn't have it */
+typedef bool (*file_source)(const char *path, struct mapped_file *file);
+
+/* Adds a source file_map() asks first, in the order they were added. Only the
+   engine adds them, so the tools link this file without the layers behind
+   them */
+void file_add_source(file_source source);
+
+/* Maps a whole file into memory, an empty file succeeds with a NULL mapping
+   of size 0. Returns false if the file can't be opened or mapped. A file held
+   by one of the sources added is handed over instead, see pak.h & file_batch.h */
+bool file_map(const char *path, struct mapped_file *file);
+
+/* Wrapper around munmap(), frees the buffer of a batched file */
+void file_unmap(struct mapped_file *file);
+
+/* Wrapper around stat(), returns false if the file doesn't exist */
+bool file_stat(const char *path, struct file_info *info);
+
+/* Creates a directory if it doesn't exist yet, returns false on failure */
+bool file_make_dir(const char *path);
+
+/* Writes size bytes to a temporary file that is then renamed onto path, so
+   readers never see a partially written file */
+bool file_write_atomic(const char *path, const void *data, size_t size);
+
+#endif /* SAGE_FILE_H */
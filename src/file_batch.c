@@ -0,0 +1,541 @@
+/* syscall() for io_uring, which glibc has no wrappers for */
+#define _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "file_batch.h"
+#include "config.h"
+#include "darray.h"
+#include "pak.h"
+#include "logger.h"
+
+#if defined(__linux__) && SAGE_IO_URING
+#define FILE_BATCH_URING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#else
+#define FILE_BATCH_URING 0
+#endif
+
+#define FILE_BATCH_PATH_SIZE 1024
+#define FILE_BATCH_MAX_THREADS 8
+/* reads in flight at once, the kernel queues them for the device */
+#define FILE_BATCH_RING_ENTRIES 64
+/* a read is capped well below what the length of a request holds, longer
+   files take a few */
+#define FILE_BATCH_MAX_READ (1u << 30)
+
+enum file_batch_state {
+    FILE_BATCH_COLLECTED = 1,   /* waiting for the batch to be submitted */
+    FILE_BATCH_READING,
+    FILE_BATCH_READ,
+    FILE_BATCH_FAILED,          /* or dropped, whoever needs it maps it */
+    FILE_BATCH_TAKEN,
+};
+
+struct file_batch_entry {
+    char path[FILE_BATCH_PATH_SIZE];
+    enum file_batch_state state;    /* guarded by the lock */
+    int fd;
+    uint8_t *data;
+    size_t size;
+    size_t read;                    /* bytes read so far */
+};
+
+struct file_batch {
+    bool open;
+    bool submitted;
+    pthread_t owner;                /* thread that submits the batch */
+    pthread_mutex_t lock;
+    pthread_cond_t progress;        /* an entry finished or the batch changed */
+
+    /* only the owner pushes, before the batch is submitted */
+    darray *entries;                /* struct file_batch_entry */
+    size_t remaining;               /* entries still being read */
+    size_t files;                   /* entries submitted for reading */
+    size_t bytes;
+
+    pthread_t threads[FILE_BATCH_MAX_THREADS];
+    uint32_t n_threads;
+    size_t next;                    /* pread: first entry no thread picked up */
+    bool uring;
+    struct timespec start;
+};
+
+static struct file_batch batch = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .progress = PTHREAD_COND_INITIALIZER,
+};
+
+#if FILE_BATCH_URING
+/* The rings shared with the kernel, set up by hand since liburing isn't a
+   dependency of sage */
+struct file_ring {
+    int fd;
+    uint32_t entries;
+
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    struct io_uring_sqe *sqes;
+
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;
+    size_t cq_map_size;
+    size_t sqes_size;
+};
+
+static struct file_ring ring;
+
+static bool file_ring_init(struct file_ring *ring, uint32_t entries);
+static void file_ring_destroy(struct file_ring *ring);
+static void file_ring_push_read(struct file_ring *ring, struct file_batch_entry *entry, size_t index);
+static void *file_batch_uring_thread(void *arg);
+#endif
+
+static struct file_batch_entry *file_batch_find(const char *path);
+static bool file_batch_open_entry(struct file_batch_entry *entry);
+static void file_batch_finish(struct file_batch_entry *entry, bool read);
+static void *file_batch_pread_thread(void *arg);
+static bool file_batch_pread(struct file_batch_entry *entry);
+static double file_batch_elapsed_ms(struct timespec start);
+
+void file_batch_begin(void)
+{
+    if (batch.open) return;
+
+    darray *entries = darray_alloc(sizeof(struct file_batch_entry), 64);
+    if (entries == NULL) {
+        SERROR("Failed to alloc memory for the file batch, reading files one by one");
+        return;
+    }
+
+    pthread_mutex_lock(&batch.lock);
+    batch.entries = entries;
+    batch.owner = pthread_self();
+    batch.submitted = false;
+    batch.remaining = 0;
+    batch.files = 0;
+    batch.bytes = 0;
+    batch.n_threads = 0;
+    batch.next = 0;
+    batch.open = true;
+    pthread_mutex_unlock(&batch.lock);
+}
+
+void file_batch_add(const char *path)
+{
+    size_t len = strlen(path);
+    if (len >= FILE_BATCH_PATH_SIZE || pak_contains(path)) return;
+
+    pthread_mutex_lock(&batch.lock);
+    if (batch.open && !batch.submitted && file_batch_find(path) == NULL) {
+        struct file_batch_entry entry = { .state = FILE_BATCH_COLLECTED, .fd = -1 };
+        memcpy(entry.path, path, len + 1);
+        darray_push(batch.entries, &entry);
+    }
+    pthread_mutex_unlock(&batch.lock);
+}
+
+void file_batch_submit(void)
+{
+    if (!batch.open || batch.submitted) return;
+
+    clock_gettime(CLOCK_MONOTONIC, &batch.start);
+
+    /* opening & sizing is only metadata, done here so the I/O threads never
+       touch an entry that has nothing to read */
+    pthread_mutex_lock(&batch.lock);
+    struct file_batch_entry *entries = batch.entries->items;
+    for (size_t i = 0; i < batch.entries->len; i++) {
+        struct file_batch_entry *entry = &entries[i];
+        if (entry->state != FILE_BATCH_COLLECTED) continue;
+
+        if (!file_batch_open_entry(entry)) {
+            entry->state = FILE_BATCH_FAILED;
+        } else if (entry->size == 0) {
+            close(entry->fd);
+            entry->fd = -1;
+            entry->state = FILE_BATCH_READ;
+        } else {
+            entry->state = FILE_BATCH_READING;
+            batch.remaining++;
+            batch.files++;
+            batch.bytes += entry->size;
+        }
+    }
+    batch.submitted = true;
+    pthread_cond_broadcast(&batch.progress);
+    pthread_mutex_unlock(&batch.lock);
+
+    if (batch.remaining == 0) return;
+
+#if FILE_BATCH_URING
+    uint32_t ring_entries = FILE_BATCH_RING_ENTRIES;
+    while (ring_entries / 2 >= batch.remaining && ring_entries > 1) ring_entries /= 2;
+
+    if (file_ring_init(&ring, ring_entries)) {
+        batch.uring = true;
+        if (pthread_create(&batch.threads[0], NULL, file_batch_uring_thread, NULL) == 0) {
+            batch.n_threads = 1;
+            return;
+        }
+        file_ring_destroy(&ring);
+    } else {
+        SDEBUG("io_uring isn't available (%s), reading with pread", strerror(errno));
+    }
+#endif
+
+    batch.uring = false;
+    uint32_t n_threads = SAGE_FILE_BATCH_THREADS;
+    if (n_threads > FILE_BATCH_MAX_THREADS) n_threads = FILE_BATCH_MAX_THREADS;
+    if (n_threads > batch.remaining) n_threads = (uint32_t) batch.remaining;
+
+    for (uint32_t i = 0; i < n_threads; i++) {
+        if (pthread_create(&batch.threads[batch.n_threads], NULL, file_batch_pread_thread, NULL) == 0)
+            batch.n_threads++;
+    }
+
+    /* without threads the files are read right here */
+    if (batch.n_threads == 0) file_batch_pread_thread(NULL);
+}
+
+void file_batch_end(void)
+{
+    if (!batch.open) return;
+
+    for (uint32_t i = 0; i < batch.n_threads; i++)
+        pthread_join(batch.threads[i], NULL);
+    batch.n_threads = 0;
+
+    pthread_mutex_lock(&batch.lock);
+    struct file_batch_entry *entries = batch.entries->items;
+    size_t unused = 0;
+    for (size_t i = 0; i < batch.entries->len; i++) {
+        if (entries[i].state == FILE_BATCH_READ && entries[i].size > 0) unused++;
+        if (entries[i].fd >= 0) close(entries[i].fd);
+        free(entries[i].data);
+    }
+    if (unused > 0) SDEBUG("%zu batched files were never used", unused);
+
+    darray_free(batch.entries);
+    batch.entries = NULL;
+    batch.open = false;
+    batch.submitted = false;
+    pthread_cond_broadcast(&batch.progress);
+    pthread_mutex_unlock(&batch.lock);
+}
+
+bool file_batch_active(void)
+{
+    return batch.open;
+}
+
+bool file_batch_take(const char *path, struct mapped_file *file)
+{
+    pthread_mutex_lock(&batch.lock);
+
+    struct file_batch_entry *entry = file_batch_find(path);
+    while (entry != NULL &&
+           (entry->state == FILE_BATCH_COLLECTED || entry->state == FILE_BATCH_READING)) {
+        if (entry->state == FILE_BATCH_COLLECTED &&
+            pthread_equal(pthread_self(), batch.owner)) {
+            entry->state = FILE_BATCH_FAILED;
+            break;
+        }
+
+        pthread_cond_wait(&batch.progress, &batch.lock);
+        /* the batch may have ended meanwhile */
+        entry = file_batch_find(path);
+    }
+
+    bool taken = (entry != NULL && entry->state == FILE_BATCH_READ);
+    if (taken) {
+        file->data = entry->data;
+        file->size = entry->size;
+        file->copied = true;
+        entry->data = NULL;
+        entry->state = FILE_BATCH_TAKEN;
+    }
+
+    pthread_mutex_unlock(&batch.lock);
+    return taken;
+}
+
+/* Linear since a scene has a few dozen files, called with the lock held */
+static struct file_batch_entry *file_batch_find(const char *path)
+{
+    if (!batch.open) return NULL;
+
+    struct file_batch_entry *entries = batch.entries->items;
+    for (size_t i = 0; i < batch.entries->len; i++) {
+        if (strcmp(entries[i].path, path) == 0) return &entries[i];
+    }
+
+    return NULL;
+}
+
+static bool file_batch_open_entry(struct file_batch_entry *entry)
+{
+    entry->fd = open(entry->path, O_RDONLY);
+    if (entry->fd < 0) return false;
+
+    struct stat info;
+    if (fstat(entry->fd, &info) < 0 || !S_ISREG(info.st_mode)) goto err;
+
+    entry->size = (size_t) info.st_size;
+    if (entry->size == 0) return true;
+
+    entry->data = malloc(entry->size);
+    if (entry->data == NULL) {
+        SERROR("Failed to alloc memory for reading '%s'", entry->path);
+        goto err;
+    }
+
+    return true;
+
+err:
+    close(entry->fd);
+    entry->fd = -1;
+    return false;
+}
+
+/* Publishes a read to whoever waits on it, logs once the batch is done */
+static void file_batch_finish(struct file_batch_entry *entry, bool read)
+{
+    close(entry->fd);
+    entry->fd = -1;
+    if (!read) SWARN("Failed to read '%s' in the file batch", entry->path);
+
+    pthread_mutex_lock(&batch.lock);
+    entry->state = read ? FILE_BATCH_READ : FILE_BATCH_FAILED;
+    bool done = (--batch.remaining == 0);
+    pthread_cond_broadcast(&batch.progress);
+    pthread_mutex_unlock(&batch.lock);
+
+    if (done) {
+        double ms = file_batch_elapsed_ms(batch.start);
+        double mb = (double) batch.bytes / (1024.0 * 1024.0);
+        SINFO("Read %zu files (%.2f MB) in %.2f ms with %s: %.1f MB/s",
+              batch.files, mb, ms, batch.uring ? "io_uring" : "pread",
+              ms > 0.0 ? mb / (ms / 1000.0) : 0.0);
+    }
+}
+
+static void *file_batch_pread_thread(void *arg)
+{
+    (void) arg;
+
+    pthread_mutex_lock(&batch.lock);
+    while (batch.next < batch.entries->len) {
+        struct file_batch_entry *entry = darray_at(batch.entries, batch.next++);
+        if (entry->state != FILE_BATCH_READING) continue;
+        pthread_mutex_unlock(&batch.lock);
+
+        file_batch_finish(entry, file_batch_pread(entry));
+
+        pthread_mutex_lock(&batch.lock);
+    }
+    pthread_mutex_unlock(&batch.lock);
+
+    return NULL;
+}
+
+static bool file_batch_pread(struct file_batch_entry *entry)
+{
+    while (entry->read < entry->size) {
+        ssize_t n = pread(entry->fd, entry->data + entry->read,
+                          entry->size - entry->read, (off_t) entry->read);
+        if (n < 0 && errno == EINTR) continue;
+        /* 0 is a file that shrank since it was sized */
+        if (n <= 0) return false;
+        entry->read += (size_t) n;
+    }
+
+    return true;
+}
+
+static double file_batch_elapsed_ms(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start.tv_sec) * 1000.0 +
+           (double) (now.tv_nsec - start.tv_nsec) / 1000000.0;
+}
+
+#if FILE_BATCH_URING
+
+/* Keeps the ring full, refilling it with the next files & the rest of short
+   reads as completions come in, until every entry is read */
+static void *file_batch_uring_thread(void *arg)
+{
+    (void) arg;
+
+    /* the entries are fixed once submitted, their state only changes from
+       reading to anything else on this thread */
+    struct file_batch_entry *entries = batch.entries->items;
+    size_t n_entries = batch.entries->len;
+    size_t next = 0;
+    uint32_t queued = 0;        /* pushed but not submitted yet */
+    uint32_t in_flight = 0;
+
+    for (;;) {
+        for (; next < n_entries && queued + in_flight < ring.entries; next++) {
+            pthread_mutex_lock(&batch.lock);
+            bool reading = (entries[next].state == FILE_BATCH_READING);
+            pthread_mutex_unlock(&batch.lock);
+
+            if (!reading) continue;
+            file_ring_push_read(&ring, &entries[next], next);
+            queued++;
+        }
+
+        if (queued + in_flight == 0) break;
+
+        int submitted = (int) syscall(__NR_io_uring_enter, ring.fd, queued, 1,
+                                      IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            /* requests in flight still write into their buffers, so nothing
+               is freed before the ring is gone */
+            SERROR("io_uring_enter failed: %s", strerror(errno));
+            break;
+        }
+        queued -= (uint32_t) submitted;
+        in_flight += (uint32_t) submitted;
+
+        uint32_t head = *ring.cq_head;
+        uint32_t tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+            struct file_batch_entry *entry = &entries[cqe->user_data];
+            int32_t result = cqe->res;
+            in_flight--;
+
+            if (result == -EINTR || result == -EAGAIN) {
+                file_ring_push_read(&ring, entry, cqe->user_data);
+                queued++;
+                continue;
+            }
+            if (result <= 0) {
+                file_batch_finish(entry, false);
+                continue;
+            }
+
+            entry->read += (size_t) result;
+            if (entry->read < entry->size) {
+                file_ring_push_read(&ring, entry, cqe->user_data);
+                queued++;
+            } else {
+                file_batch_finish(entry, true);
+            }
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    /* entries are only left reading when io_uring_enter failed, they're read
+       with pread once the ring is gone */
+    file_ring_destroy(&ring);
+    for (size_t i = 0; i < n_entries; i++) {
+        pthread_mutex_lock(&batch.lock);
+        bool reading = (entries[i].state == FILE_BATCH_READING);
+        pthread_mutex_unlock(&batch.lock);
+        if (reading) file_batch_finish(&entries[i], file_batch_pread(&entries[i]));
+    }
+
+    return NULL;
+}
+
+static bool file_ring_init(struct file_ring *ring, uint32_t entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) return false;
+
+    ring->entries = params.sq_entries;
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    /* newer kernels map both rings at once */
+    bool single_map = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_map && ring->cq_map_size > ring->sq_map_size)
+        ring->sq_map_size = ring->cq_map_size;
+
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_map = single_map ? ring->sq_map :
+                   mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sq_map == MAP_FAILED || ring->cq_map == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        int error = errno;
+        if (ring->sq_map != MAP_FAILED) munmap(ring->sq_map, ring->sq_map_size);
+        if (!single_map && ring->cq_map != MAP_FAILED) munmap(ring->cq_map, ring->cq_map_size);
+        if (ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+        close(ring->fd);
+        errno = error;
+        return false;
+    }
+
+    uint8_t *sq = ring->sq_map;
+    ring->sq_tail = (uint32_t *) (sq + params.sq_off.tail);
+    ring->sq_mask = (uint32_t *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (uint32_t *) (sq + params.sq_off.array);
+
+    uint8_t *cq = ring->cq_map;
+    ring->cq_head = (uint32_t *) (cq + params.cq_off.head);
+    ring->cq_tail = (uint32_t *) (cq + params.cq_off.tail);
+    ring->cq_mask = (uint32_t *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    return true;
+}
+
+static void file_ring_destroy(struct file_ring *ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map != ring->sq_map) munmap(ring->cq_map, ring->cq_map_size);
+    munmap(ring->sq_map, ring->sq_map_size);
+    close(ring->fd);
+}
+
+/* Queues a read of what's left of the entry, the caller keeps the number of
+   requests under the size of the ring */
+static void file_ring_push_read(struct file_ring *ring, struct file_batch_entry *entry, size_t index)
+{
+    size_t left = entry->size - entry->read;
+
+    uint32_t tail = *ring->sq_tail;
+    uint32_t slot = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = entry->fd;
+    sqe->off = entry->read;
+    sqe->addr = (uint64_t) (uintptr_t) (entry->data + entry->read);
+    sqe->len = (uint32_t) (left < FILE_BATCH_MAX_READ ? left : FILE_BATCH_MAX_READ);
+    sqe->user_data = index;
+
+    ring->sq_array[slot] = slot;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* FILE_BATCH_URING */
@@ -0,0 +1,42 @@
+#ifndef SAGE_FILE_BATCH_H
+#define SAGE_FILE_BATCH_H
+
+#include <stdbool.h>
+
+#include "file.h"
+
+/*
+ * Batched file reads
+ *
+ * Reading the files of a scene one after another makes startup on a cold page
+ * cache wait on the latency of every single read. A batch collects the paths
+ * the scene needs while it's set up, then reads all of them at once: as one
+ * io_uring submission on Linux, or spread over a few threads doing pread()
+ * where io_uring isn't available. The device sees every request together &
+ * loading is bound by its throughput instead.
+ *
+ * file_map() hands out the buffer of a batched file instead of mapping it,
+ * waiting until its read completes, so the loaders consume the files as they
+ * arrive without knowing about the batch. The thread that submits the batch
+ * never waits on it, a batched file it maps before submitting is mapped as
+ * usual & dropped from the batch. The engine adds file_batch_take() as a
+ * source of file_map() for that, see file.h.
+ */
+
+/* Starts collecting paths, on the thread that submits the batch later */
+void file_batch_begin(void);
+/* Adds a file to the batch, ignored unless one is collecting or if the file
+   is in the mounted .sagepak */
+void file_batch_add(const char *path);
+/* Starts reading every collected file & returns right away */
+void file_batch_submit(void);
+/* Waits for the reads & frees the files that were never mapped */
+void file_batch_end(void);
+/* Whether a batch was begun & not ended yet */
+bool file_batch_active(void);
+
+/* Hands the buffer of a batched file over to 'file', waiting for its read.
+   False if the file isn't in the batch, was handed out already or failed */
+bool file_batch_take(const char *path, struct mapped_file *file);
+
+#endif /* SAGE_FILE_BATCH_H */
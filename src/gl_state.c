@@ -0,0 +1,259 @@
+#include <string.h>
+
+#include "gl_state.h"
+#include "logger.h"
+#include "config.h"
+
+/* Shadowed values that must be issued since what GL has isn't known */
+#define GL_STATE_UNKNOWN UINT32_MAX
+
+enum gl_state_buffer {
+    GL_STATE_ARRAY_BUFFER,
+    GL_STATE_UNIFORM_BUFFER,
+    GL_STATE_PIXEL_UNPACK_BUFFER,
+    GL_STATE_BUFFER_COUNT,
+};
+
+enum gl_state_cap {
+    GL_STATE_DEPTH_TEST,
+    GL_STATE_BLEND,
+    GL_STATE_CULL_FACE,
+    GL_STATE_CAP_COUNT,
+};
+
+struct gl_state {
+    uint32_t program;
+    uint32_t vao;
+    uint32_t buffers[GL_STATE_BUFFER_COUNT];
+    uint32_t active_unit;
+    uint32_t textures[GL_STATE_MAX_TEXTURE_UNITS][2];  /* 2D & cube map of each unit */
+
+    uint32_t caps[GL_STATE_CAP_COUNT];  /* 0, 1 or unknown */
+    uint32_t depth_func;
+    uint32_t depth_mask;
+    uint32_t blend_src;
+    uint32_t blend_dst;
+
+    struct gl_state_stats stats;
+};
+
+static struct gl_state state;
+
+static bool gl_state_set(uint32_t *shadow, uint32_t value);
+static int32_t gl_state_buffer_index(GLenum target);
+static int32_t gl_state_cap_index(GLenum cap);
+#if SAGE_GL_DEBUG
+static void GLAD_API_PTR gl_state_debug_callback(GLenum source, GLenum type, GLuint id,
+                                                 GLenum severity, GLsizei length,
+                                                 const GLchar *message, const void *user);
+#endif
+
+void gl_state_init(void)
+{
+    gl_state_invalidate();
+
+#if SAGE_GL_DEBUG
+    if (!GLAD_GL_KHR_debug) {
+        SWARN("KHR_debug isn't supported, GL errors are checked after every call instead");
+        return;
+    }
+
+    /* the driver reports errors as they happen, glad doesn't have to ask */
+    gladUninstallGLDebug();
+    glEnable(GL_DEBUG_OUTPUT);
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    glDebugMessageCallback(gl_state_debug_callback, NULL);
+    SINFO("Reporting GL errors through KHR_debug");
+#else
+    /* release builds don't check for errors at all */
+    gladUninstallGLDebug();
+#endif
+}
+
+void gl_state_invalidate(void)
+{
+    struct gl_state_stats stats = state.stats;
+    memset(&state, 0xff, sizeof(state));
+    state.stats = stats;
+}
+
+void gl_state_use_program(uint32_t program)
+{
+    if (gl_state_set(&state.program, program)) glUseProgram(program);
+}
+
+void gl_state_bind_vertex_array(uint32_t vao)
+{
+    if (gl_state_set(&state.vao, vao)) glBindVertexArray(vao);
+}
+
+void gl_state_bind_buffer(GLenum target, uint32_t buffer)
+{
+    int32_t index = gl_state_buffer_index(target);
+    if (index < 0) {
+        state.stats.n_issued++;
+        glBindBuffer(target, buffer);
+        return;
+    }
+
+    if (gl_state_set(&state.buffers[index], buffer)) glBindBuffer(target, buffer);
+}
+
+void gl_state_bind_buffer_base(GLenum target, uint32_t index, uint32_t buffer)
+{
+    /* the indexed binding isn't shadowed, the generic one changes with it */
+    state.stats.n_issued++;
+    glBindBufferBase(target, index, buffer);
+
+    int32_t generic = gl_state_buffer_index(target);
+    if (generic >= 0) state.buffers[generic] = buffer;
+}
+
+void gl_state_active_texture(uint32_t unit)
+{
+    if (gl_state_set(&state.active_unit, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void gl_state_bind_texture(GLenum target, uint32_t texture)
+{
+    if (state.active_unit >= GL_STATE_MAX_TEXTURE_UNITS) {
+        state.stats.n_issued++;
+        glBindTexture(target, texture);
+        return;
+    }
+
+    uint32_t *bound = &state.textures[state.active_unit][target == GL_TEXTURE_CUBE_MAP];
+    if (gl_state_set(bound, texture)) glBindTexture(target, texture);
+}
+
+void gl_state_enable(GLenum cap, bool enabled)
+{
+    int32_t index = gl_state_cap_index(cap);
+    if (index >= 0 && !gl_state_set(&state.caps[index], enabled)) return;
+    if (index < 0) state.stats.n_issued++;
+
+    if (enabled)
+        glEnable(cap);
+    else
+        glDisable(cap);
+}
+
+void gl_state_depth_func(GLenum func)
+{
+    if (gl_state_set(&state.depth_func, func)) glDepthFunc(func);
+}
+
+void gl_state_depth_mask(bool write)
+{
+    if (gl_state_set(&state.depth_mask, write)) glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void gl_state_blend_func(GLenum src, GLenum dst)
+{
+    if (state.blend_src == src && state.blend_dst == dst) {
+        state.stats.n_avoided++;
+        return;
+    }
+
+    state.blend_src = src;
+    state.blend_dst = dst;
+    state.stats.n_issued++;
+    glBlendFunc(src, dst);
+}
+
+uint32_t gl_state_vertex_array(void)
+{
+    return state.vao;
+}
+
+void gl_state_forget_program(uint32_t program)
+{
+    /* a program in use is only deleted once another one is used */
+    if (state.program == program) state.program = GL_STATE_UNKNOWN;
+}
+
+void gl_state_forget_vertex_array(uint32_t vao)
+{
+    if (state.vao == vao) state.vao = 0;
+}
+
+void gl_state_forget_buffer(uint32_t buffer)
+{
+    for (uint32_t i = 0; i < GL_STATE_BUFFER_COUNT; i++)
+        if (state.buffers[i] == buffer) state.buffers[i] = 0;
+}
+
+void gl_state_forget_texture(uint32_t texture)
+{
+    for (uint32_t i = 0; i < GL_STATE_MAX_TEXTURE_UNITS; i++) {
+        if (state.textures[i][0] == texture) state.textures[i][0] = 0;
+        if (state.textures[i][1] == texture) state.textures[i][1] = 0;
+    }
+}
+
+struct gl_state_stats gl_state_stats(void)
+{
+    return state.stats;
+}
+
+/* Updates the shadow, false if it already held 'value' & the call is skipped */
+static bool gl_state_set(uint32_t *shadow, uint32_t value)
+{
+    if (*shadow == value) {
+        state.stats.n_avoided++;
+        return false;
+    }
+
+    *shadow = value;
+    state.stats.n_issued++;
+    return true;
+}
+
+/* -1 for targets that aren't shadowed */
+static int32_t gl_state_buffer_index(GLenum target)
+{
+    switch (target) {
+        case GL_ARRAY_BUFFER: return GL_STATE_ARRAY_BUFFER;
+        case GL_UNIFORM_BUFFER: return GL_STATE_UNIFORM_BUFFER;
+        case GL_PIXEL_UNPACK_BUFFER: return GL_STATE_PIXEL_UNPACK_BUFFER;
+        default: return -1;
+    }
+}
+
+static int32_t gl_state_cap_index(GLenum cap)
+{
+    switch (cap) {
+        case GL_DEPTH_TEST: return GL_STATE_DEPTH_TEST;
+        case GL_BLEND: return GL_STATE_BLEND;
+        case GL_CULL_FACE: return GL_STATE_CULL_FACE;
+        default: return -1;
+    }
+}
+
+#if SAGE_GL_DEBUG
+static void GLAD_API_PTR gl_state_debug_callback(GLenum source, GLenum type, GLuint id,
+                                                 GLenum severity, GLsizei length,
+                                                 const GLchar *message, const void *user)
+{
+    (void) source;
+    (void) id;
+    (void) length;
+    (void) user;
+
+    switch (severity) {
+        case GL_DEBUG_SEVERITY_HIGH:
+            SERROR("GL: %s", message);
+            break;
+        case GL_DEBUG_SEVERITY_MEDIUM:
+            SWARN("GL: %s", message);
+            break;
+        case GL_DEBUG_SEVERITY_LOW:
+            SDEBUG("GL: %s", message);
+            break;
+        default:
+            /* notifications, like where buffers live, are too chatty */
+            if (type == GL_DEBUG_TYPE_ERROR) SERROR("GL: %s", message);
+            break;
+    }
+}
+#endif
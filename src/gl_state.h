@@ -0,0 +1,66 @@
+#ifndef SAGE_GL_STATE_H
+#define SAGE_GL_STATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <glad/gl.h>
+
+/*
+ * GL state
+ *
+ * A shadow of the bindings & fixed function state sage changes, so calls that
+ * wouldn't change anything are never issued & what's bound is known without
+ * asking the driver with glGet. Every bind of a program, VAO, buffer or
+ * texture & every change of the depth & blend state goes through here, calling
+ * GL directly leaves the shadow wrong.
+ *
+ * Code that doesn't go through it, like the Nuklear backend, must be followed
+ * by gl_state_invalidate() which makes the next call of each issue again. Only
+ * the render thread uses it since the state is of its context.
+ *
+ * With SAGE_GL_DEBUG the driver reports errors through KHR_debug, which is how
+ * a wrong shadow shows up, instead of glad checking glGetError after each call.
+ */
+
+/* Texture units whose bindings are shadowed, higher ones are always bound */
+#define GL_STATE_MAX_TEXTURE_UNITS 16
+
+struct gl_state_stats {
+    uint64_t n_issued;      /* calls that went to GL */
+    uint64_t n_avoided;     /* calls skipped since the state was already set */
+};
+
+/* Sets up KHR_debug when it's on, after the functions of GL are loaded */
+void gl_state_init(void);
+/* Forgets the shadow, after something else changed the state of GL */
+void gl_state_invalidate(void);
+
+void gl_state_use_program(uint32_t program);
+void gl_state_bind_vertex_array(uint32_t vao);
+/* The element array buffer is state of the bound VAO, it's never skipped */
+void gl_state_bind_buffer(GLenum target, uint32_t buffer);
+/* Binds 'buffer' to the binding point 'index' of 'target', always issued */
+void gl_state_bind_buffer_base(GLenum target, uint32_t index, uint32_t buffer);
+void gl_state_active_texture(uint32_t unit);
+/* Binds on the active unit, 'target' is GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP */
+void gl_state_bind_texture(GLenum target, uint32_t texture);
+
+/* 'cap' is GL_DEPTH_TEST, GL_BLEND or GL_CULL_FACE */
+void gl_state_enable(GLenum cap, bool enabled);
+void gl_state_depth_func(GLenum func);
+void gl_state_depth_mask(bool write);
+void gl_state_blend_func(GLenum src, GLenum dst);
+
+/* What's bound, for checks that would otherwise glGet it */
+uint32_t gl_state_vertex_array(void);
+
+/* Deleting a bound object binds 0 in its place, called before deleting them */
+void gl_state_forget_program(uint32_t program);
+void gl_state_forget_vertex_array(uint32_t vao);
+void gl_state_forget_buffer(uint32_t buffer);
+void gl_state_forget_texture(uint32_t texture);
+
+struct gl_state_stats gl_state_stats(void);
+
+#endif /* SAGE_GL_STATE_H */
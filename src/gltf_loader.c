@@ -0,0 +1,1024 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#include "gltf_loader.h"
+#include "json.h"
+#include "darray.h"
+#include "file.h"
+#include "texture.h"
+#include "logger.h"
+#include "mnf/mnf_matrix.h"
+#include "mnf/mnf_vector.h"
+
+#define GLB_MAGIC      0x46546C67 /* "glTF" */
+#define GLB_CHUNK_JSON 0x4E4F534A /* "JSON" */
+#define GLB_CHUNK_BIN  0x004E4942 /* "BIN\0" */
+#define GLB_HEADER_SIZE 12
+#define GLB_CHUNK_HEADER_SIZE 8
+
+/* componentType of an accessor, glTF uses the values of the GL enums */
+#define GLTF_BYTE           5120
+#define GLTF_UNSIGNED_BYTE  5121
+#define GLTF_SHORT          5122
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT   5125
+#define GLTF_FLOAT          5126
+
+/* mode of a primitive */
+#define GLTF_TRIANGLES 4
+
+/* Deepest node hierarchy walked, also stops cycles in broken files */
+#define GLTF_MAX_NODE_DEPTH 64
+
+/* A buffer of the file, either a chunk of the mapping, a mapped .bin or a
+   decoded data uri */
+struct gltf_buffer {
+    const uint8_t *data;
+    size_t size;
+    struct mapped_file file;    /* external .bin, unmapped once loaded */
+    uint8_t *decoded;           /* data uri, freed once loaded */
+};
+
+struct gltf_view {
+    uint32_t buffer;
+    size_t offset;
+    size_t length;
+    size_t stride;      /* 0 when the elements are tightly packed */
+    int32_t blob;       /* index in the blobs once a primitive uses it, -1 until then */
+};
+
+struct gltf_accessor {
+    uint32_t view;
+    size_t offset;      /* bytes into the view */
+    uint32_t component_type;
+    uint32_t components;
+    size_t count;
+    size_t stride;      /* bytes between elements */
+    bool normalized;
+    bool has_bounds;
+    vec3 min;
+    vec3 max;
+};
+
+/* Normals the loader generated, a mesh instanced by several nodes only gets
+   them once */
+struct gltf_normals {
+    int32_t positions;  /* accessors they were generated from */
+    int32_t indices;
+    uint32_t blob;
+    float (*data)[3];
+};
+
+struct gltf_loader {
+    const char *path;
+    struct json json;
+    int32_t root;
+    struct gltf_buffer *buffers;
+    size_t n_buffers;
+    struct gltf_view *views;
+    size_t n_views;
+    darray *blobs;      /* struct mesh_blob */
+    darray *generated;  /* struct gltf_normals, blobs the loader allocated */
+    darray *sources;    /* struct mesh_stream_source */
+    darray *submeshes;  /* struct mesh_submesh */
+    size_t n_skipped;   /* primitives that couldn't be drawn */
+};
+
+static bool gltf_split_glb(const struct mapped_file *file,
+                           const char **json, size_t *json_size,
+                           const uint8_t **bin, size_t *bin_size);
+static bool gltf_load_buffers(struct gltf_loader *loader, const uint8_t *bin, size_t bin_size);
+static bool gltf_load_views(struct gltf_loader *loader);
+static void gltf_load_scene(struct gltf_loader *loader);
+static void gltf_load_node(struct gltf_loader *loader, int32_t node, mat4 parent, uint32_t depth);
+static void gltf_node_matrix(const struct json *json, int32_t node, mat4 out);
+static void gltf_load_mesh(struct gltf_loader *loader, int32_t mesh, mat4 transform);
+static bool gltf_load_primitive(struct gltf_loader *loader,
+                                int32_t primitive,
+                                const char *name,
+                                mat4 transform);
+static bool gltf_accessor(const struct gltf_loader *loader, int32_t index, struct gltf_accessor *out);
+static bool gltf_attribute(struct gltf_loader *loader,
+                           const struct gltf_accessor *accessor,
+                           struct mesh_attribute *out);
+static bool gltf_check_indices(const struct gltf_loader *loader,
+                               const struct gltf_accessor *indices,
+                               size_t n_vertices);
+static const uint8_t *gltf_accessor_data(const struct gltf_loader *loader,
+                                         const struct gltf_accessor *accessor);
+static uint32_t gltf_read_index(const uint8_t *data, uint32_t component_type, size_t i);
+static void gltf_accessor_bounds(const struct gltf_loader *loader,
+                                 const struct gltf_accessor *positions,
+                                 struct aabb *out);
+static bool gltf_generate_normals(struct gltf_loader *loader,
+                                  int32_t position_index,
+                                  int32_t indices_index,
+                                  const struct gltf_accessor *positions,
+                                  const struct gltf_accessor *indices,
+                                  struct mesh_attribute *out);
+static void gltf_load_materials(struct gltf_loader *loader, struct mtl_library *library);
+static struct texture gltf_load_image(struct gltf_loader *loader,
+                                      struct mtl_library *library,
+                                      int32_t texture,
+                                      const float fallback[3]);
+static size_t gltf_component_size(uint32_t component_type);
+static uint32_t gltf_type_components(const struct json *json, int32_t type);
+static bool gltf_resolve_uri(const char *base, const char *uri, char out[MESH_PATH_MAX_SIZE]);
+static uint8_t *gltf_decode_data_uri(const char *uri, size_t *size);
+static void gltf_free(struct gltf_loader *loader);
+static double gltf_elapsed_ms(struct timespec start);
+
+bool gltf_load(const char *path, struct mesh *mesh, struct mtl_library *library)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    library->materials = NULL;
+    library->textures = NULL;
+
+    struct mapped_file file;
+    if (!file_map(path, &file)) {
+        SERROR("Failed to open glTF file '%s'", path);
+        return false;
+    }
+
+    /* a .glb is a JSON chunk followed by an optional BIN chunk, a .gltf is
+       only the JSON */
+    const char *json_text = file.data;
+    size_t json_size = file.size;
+    const uint8_t *bin = NULL;
+    size_t bin_size = 0;
+    if (file.size >= 4 && *(const uint32_t *) file.data == GLB_MAGIC &&
+        !gltf_split_glb(&file, &json_text, &json_size, &bin, &bin_size)) {
+        SERROR("'%s' isn't a valid GLB file", path);
+        file_unmap(&file);
+        return false;
+    }
+
+    struct gltf_loader loader;
+    memset(&loader, 0, sizeof(loader));
+    loader.path = path;
+    loader.root = 0;
+
+    bool loaded = false;
+    if (!json_parse(json_text, json_size, &loader.json)) {
+        SERROR("Failed to parse the JSON of '%s'", path);
+        goto out;
+    }
+
+    char version[16] = "";
+    json_string(&loader.json, json_get(&loader.json, json_get(&loader.json, 0, "asset"), "version"),
+                version, sizeof(version));
+    if (version[0] != '2') {
+        SERROR("'%s' is glTF '%s', only 2.x is supported", path, version);
+        goto out;
+    }
+
+    loader.blobs = darray_alloc(sizeof(struct mesh_blob), 8);
+    loader.generated = darray_alloc(sizeof(struct gltf_normals), 4);
+    loader.sources = darray_alloc(sizeof(struct mesh_stream_source), 8);
+    loader.submeshes = darray_alloc(sizeof(struct mesh_submesh), 8);
+    if (loader.blobs == NULL || loader.generated == NULL ||
+        loader.sources == NULL || loader.submeshes == NULL) {
+        SERROR("Failed to alloc memory for loading '%s'", path);
+        goto out;
+    }
+
+    if (!gltf_load_buffers(&loader, bin, bin_size) || !gltf_load_views(&loader))
+        goto out;
+
+    gltf_load_scene(&loader);
+    if (loader.submeshes->len == 0) {
+        SERROR("'%s' has nothing that can be drawn", path);
+        goto out;
+    }
+
+    /* the only time the vertex & index data is read is by the GL upload */
+    *mesh = mesh_create_from_streams(loader.blobs->items,
+                                     loader.blobs->len,
+                                     loader.sources->items,
+                                     loader.submeshes->items,
+                                     loader.submeshes->len);
+
+    if (mtl_library_init(library))
+        gltf_load_materials(&loader, library);
+    else
+        SERROR("Failed to alloc memory for the materials of '%s'", path);
+
+    size_t uploaded = 0;
+    const struct mesh_blob *blobs = loader.blobs->items;
+    for (size_t i = 0; i < loader.blobs->len; i++)
+        uploaded += blobs[i].size;
+
+    if (loader.n_skipped > 0)
+        SWARN("Skipped %zu primitives of '%s' that can't be drawn", loader.n_skipped, path);
+
+    double ms = gltf_elapsed_ms(start);
+    double mb = (double) uploaded / (1024.0 * 1024.0);
+    SINFO("Loaded '%s' in %.2f ms: %zu submeshes, %.2f MB of buffers at %.1f MB/s",
+          path, ms, loader.submeshes->len, mb, (ms > 0.0) ? mb / (ms / 1000.0) : 0.0);
+
+    loaded = true;
+
+out:
+    gltf_free(&loader);
+    file_unmap(&file);
+    return loaded;
+}
+
+/* Finds the JSON & BIN chunks of a GLB, the header is 12 bytes (magic,
+   version & length) & every chunk starts with its length & type */
+static bool gltf_split_glb(const struct mapped_file *file,
+                           const char **json, size_t *json_size,
+                           const uint8_t **bin, size_t *bin_size)
+{
+    const uint8_t *data = file->data;
+    if (file->size < GLB_HEADER_SIZE + GLB_CHUNK_HEADER_SIZE) return false;
+
+    uint32_t header[3];
+    memcpy(header, data, sizeof(header));
+    if (header[1] != 2) return false;
+
+    size_t length = (header[2] < file->size) ? header[2] : file->size;
+    size_t offset = GLB_HEADER_SIZE;
+    bool has_json = false;
+
+    while (offset + GLB_CHUNK_HEADER_SIZE <= length) {
+        uint32_t chunk[2];
+        memcpy(chunk, data + offset, sizeof(chunk));
+        offset += GLB_CHUNK_HEADER_SIZE;
+        if (chunk[0] > length - offset) return false;
+
+        if (chunk[1] == GLB_CHUNK_JSON && !has_json) {
+            *json = (const char *) data + offset;
+            *json_size = chunk[0];
+            has_json = true;
+        } else if (chunk[1] == GLB_CHUNK_BIN && *bin == NULL) {
+            *bin = data + offset;
+            *bin_size = chunk[0];
+        }
+
+        /* chunks are padded to 4 bytes */
+        offset += (chunk[0] + 3) & ~(size_t) 3;
+    }
+
+    return has_json;
+}
+
+static bool gltf_load_buffers(struct gltf_loader *loader, const uint8_t *bin, size_t bin_size)
+{
+    const struct json *json = &loader->json;
+    int32_t buffers = json_get(json, loader->root, "buffers");
+    loader->n_buffers = json_len(json, buffers);
+    if (loader->n_buffers == 0) return true;
+
+    loader->buffers = calloc(loader->n_buffers, sizeof(struct gltf_buffer));
+    if (loader->buffers == NULL) {
+        SERROR("Failed to alloc memory for the buffers of '%s'", loader->path);
+        return false;
+    }
+
+    for (size_t i = 0; i < loader->n_buffers; i++) {
+        int32_t buffer = json_at(json, buffers, i);
+        struct gltf_buffer *out = &loader->buffers[i];
+        int64_t byte_length = json_int(json, json_get(json, buffer, "byteLength"), -1);
+
+        char uri[MESH_PATH_MAX_SIZE];
+        int32_t uri_value = json_get(json, buffer, "uri");
+        if (uri_value < 0) {
+            /* the first buffer of a GLB without a uri is its BIN chunk */
+            if (i != 0 || bin == NULL) {
+                SERROR("Buffer %zu of '%s' has no data", i, loader->path);
+                return false;
+            }
+            out->data = bin;
+            out->size = bin_size;
+        } else if (json->values[uri_value].end - json->values[uri_value].start > 5 &&
+                   memcmp(json->text + json->values[uri_value].start, "data:", 5) == 0) {
+            /* data uris can be far longer than a path so they're copied whole */
+            size_t len = json->values[uri_value].end - json->values[uri_value].start;
+            char *data_uri = malloc(len + 1);
+            if (data_uri == NULL) return false;
+            json_string(json, uri_value, data_uri, len + 1);
+            out->decoded = gltf_decode_data_uri(data_uri, &out->size);
+            out->data = out->decoded;
+            free(data_uri);
+
+            if (out->decoded == NULL) {
+                SERROR("Buffer %zu of '%s' has an invalid data uri", i, loader->path);
+                return false;
+            }
+        } else {
+            char path[MESH_PATH_MAX_SIZE];
+            json_string(json, uri_value, uri, sizeof(uri));
+            if (!gltf_resolve_uri(loader->path, uri, path) || !file_map(path, &out->file)) {
+                SERROR("Failed to open buffer '%s' of '%s'", uri, loader->path);
+                return false;
+            }
+            out->data = out->file.data;
+            out->size = out->file.size;
+        }
+
+        if (byte_length >= 0 && (uint64_t) byte_length < out->size)
+            out->size = (size_t) byte_length;
+        if (byte_length >= 0 && (uint64_t) byte_length > out->size) {
+            SERROR("Buffer %zu of '%s' is truncated", i, loader->path);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool gltf_load_views(struct gltf_loader *loader)
+{
+    const struct json *json = &loader->json;
+    int32_t views = json_get(json, loader->root, "bufferViews");
+    loader->n_views = json_len(json, views);
+    if (loader->n_views == 0) return true;
+
+    loader->views = calloc(loader->n_views, sizeof(struct gltf_view));
+    if (loader->views == NULL) {
+        SERROR("Failed to alloc memory for the buffer views of '%s'", loader->path);
+        return false;
+    }
+
+    for (size_t i = 0; i < loader->n_views; i++) {
+        int32_t view = json_at(json, views, i);
+        struct gltf_view *out = &loader->views[i];
+
+        int64_t buffer = json_int(json, json_get(json, view, "buffer"), -1);
+        int64_t offset = json_int(json, json_get(json, view, "byteOffset"), 0);
+        int64_t length = json_int(json, json_get(json, view, "byteLength"), -1);
+        int64_t stride = json_int(json, json_get(json, view, "byteStride"), 0);
+
+        if (buffer < 0 || (size_t) buffer >= loader->n_buffers ||
+            offset < 0 || length < 0 || stride < 0 ||
+            (uint64_t) offset + (uint64_t) length > loader->buffers[buffer].size) {
+            SERROR("Buffer view %zu of '%s' is out of its buffer", i, loader->path);
+            return false;
+        }
+
+        out->buffer = (uint32_t) buffer;
+        out->offset = (size_t) offset;
+        out->length = (size_t) length;
+        out->stride = (size_t) stride;
+        out->blob = -1;
+    }
+
+    return true;
+}
+
+/* Walks the default scene, or every root node if the file has no scenes */
+static void gltf_load_scene(struct gltf_loader *loader)
+{
+    const struct json *json = &loader->json;
+    mat4 identity;
+    mnf_mat4_identity(identity);
+
+    int32_t scenes = json_get(json, loader->root, "scenes");
+    int64_t scene_index = json_int(json, json_get(json, loader->root, "scene"), 0);
+    int32_t scene = json_at(json, scenes, (size_t) scene_index);
+
+    if (scene >= 0) {
+        int32_t nodes = json_get(json, scene, "nodes");
+        for (size_t i = 0; i < json_len(json, nodes); i++)
+            gltf_load_node(loader, (int32_t) json_int(json, json_at(json, nodes, i), -1), identity, 0);
+        return;
+    }
+
+    /* without a scene the roots are the nodes no other node has as a child */
+    int32_t nodes = json_get(json, loader->root, "nodes");
+    size_t n_nodes = json_len(json, nodes);
+    bool *is_child = calloc(n_nodes + 1, sizeof(bool));
+    if (is_child == NULL) return;
+
+    for (size_t i = 0; i < n_nodes; i++) {
+        int32_t children = json_get(json, json_at(json, nodes, i), "children");
+        for (size_t c = 0; c < json_len(json, children); c++) {
+            int64_t child = json_int(json, json_at(json, children, c), -1);
+            if (child >= 0 && (size_t) child < n_nodes) is_child[child] = true;
+        }
+    }
+
+    for (size_t i = 0; i < n_nodes; i++)
+        if (!is_child[i]) gltf_load_node(loader, (int32_t) i, identity, 0);
+
+    free(is_child);
+}
+
+static void gltf_load_node(struct gltf_loader *loader, int32_t node_index, mat4 parent, uint32_t depth)
+{
+    const struct json *json = &loader->json;
+    int32_t node = json_at(json, json_get(json, loader->root, "nodes"), (size_t) node_index);
+    if (node_index < 0 || node < 0) return;
+
+    if (depth >= GLTF_MAX_NODE_DEPTH) {
+        SWARN("Nodes of '%s' are nested too deep, is there a cycle?", loader->path);
+        return;
+    }
+
+    mat4 local, world;
+    gltf_node_matrix(json, node, local);
+    mnf_mat4_mul(parent, local, world);
+
+    int64_t mesh = json_int(json, json_get(json, node, "mesh"), -1);
+    if (mesh >= 0) gltf_load_mesh(loader, (int32_t) mesh, world);
+
+    int32_t children = json_get(json, node, "children");
+    for (size_t i = 0; i < json_len(json, children); i++)
+        gltf_load_node(loader, (int32_t) json_int(json, json_at(json, children, i), -1), world, depth + 1);
+}
+
+/* Either the matrix of the node or its translation * rotation * scale */
+static void gltf_node_matrix(const struct json *json, int32_t node, mat4 out)
+{
+    mnf_mat4_identity(out);
+
+    /* glTF matrices are column major like mat4 */
+    int32_t matrix = json_get(json, node, "matrix");
+    if (json_len(json, matrix) == 16) {
+        for (size_t i = 0; i < 16; i++)
+            out[i / 4][i % 4] = (float) json_number(json, json_at(json, matrix, i), (i % 5 == 0) ? 1.0 : 0.0);
+        return;
+    }
+
+    float t[3] = {0.0f, 0.0f, 0.0f};
+    float r[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+    float s[3] = {1.0f, 1.0f, 1.0f};
+    int32_t translation = json_get(json, node, "translation");
+    int32_t rotation = json_get(json, node, "rotation");
+    int32_t scale = json_get(json, node, "scale");
+    for (size_t i = 0; i < 3; i++) {
+        t[i] = (float) json_number(json, json_at(json, translation, i), t[i]);
+        s[i] = (float) json_number(json, json_at(json, scale, i), s[i]);
+    }
+    for (size_t i = 0; i < 4; i++)
+        r[i] = (float) json_number(json, json_at(json, rotation, i), r[i]);
+
+    /* rotation is a unit quaternion (x, y, z, w) */
+    float x = r[0], y = r[1], z = r[2], w = r[3];
+    out[0][0] = (1.0f - 2.0f * (y * y + z * z)) * s[0];
+    out[0][1] = (2.0f * (x * y + z * w)) * s[0];
+    out[0][2] = (2.0f * (x * z - y * w)) * s[0];
+    out[1][0] = (2.0f * (x * y - z * w)) * s[1];
+    out[1][1] = (1.0f - 2.0f * (x * x + z * z)) * s[1];
+    out[1][2] = (2.0f * (y * z + x * w)) * s[1];
+    out[2][0] = (2.0f * (x * z + y * w)) * s[2];
+    out[2][1] = (2.0f * (y * z - x * w)) * s[2];
+    out[2][2] = (1.0f - 2.0f * (x * x + y * y)) * s[2];
+    out[3][0] = t[0];
+    out[3][1] = t[1];
+    out[3][2] = t[2];
+}
+
+static void gltf_load_mesh(struct gltf_loader *loader, int32_t mesh_index, mat4 transform)
+{
+    const struct json *json = &loader->json;
+    int32_t mesh = json_at(json, json_get(json, loader->root, "meshes"), (size_t) mesh_index);
+    if (mesh < 0) {
+        SWARN("Node of '%s' uses mesh %d which doesn't exist", loader->path, mesh_index);
+        return;
+    }
+
+    char mesh_name[MESH_NAME_MAX_SIZE];
+    if (!json_string(json, json_get(json, mesh, "name"), mesh_name, sizeof(mesh_name)))
+        snprintf(mesh_name, sizeof(mesh_name), "mesh %d", mesh_index);
+
+    int32_t primitives = json_get(json, mesh, "primitives");
+    size_t n_primitives = json_len(json, primitives);
+    for (size_t i = 0; i < n_primitives; i++) {
+        char name[MESH_NAME_MAX_SIZE];
+        if (n_primitives > 1)
+            /* room for " #" & the 10 digits of any uint32_t */
+            snprintf(name, sizeof(name), "%.*s #%u", MESH_NAME_MAX_SIZE - 13, mesh_name, (uint32_t) i);
+        else
+            memcpy(name, mesh_name, sizeof(name));
+
+        if (!gltf_load_primitive(loader, json_at(json, primitives, i), name, transform))
+            loader->n_skipped++;
+    }
+}
+
+static bool gltf_load_primitive(struct gltf_loader *loader,
+                                int32_t primitive,
+                                const char *name,
+                                mat4 transform)
+{
+    const struct json *json = &loader->json;
+
+    if (json_int(json, json_get(json, primitive, "mode"), GLTF_TRIANGLES) != GLTF_TRIANGLES) {
+        SWARN("Primitive '%s' of '%s' isn't made of triangles", name, loader->path);
+        return false;
+    }
+
+    int32_t attributes = json_get(json, primitive, "attributes");
+    int32_t position_index = (int32_t) json_int(json, json_get(json, attributes, "POSITION"), -1);
+    int32_t normal_index = (int32_t) json_int(json, json_get(json, attributes, "NORMAL"), -1);
+    int32_t uv_index = (int32_t) json_int(json, json_get(json, attributes, "TEXCOORD_0"), -1);
+    int32_t indices_index = (int32_t) json_int(json, json_get(json, primitive, "indices"), -1);
+
+    struct mesh_stream_source source;
+    memset(&source, 0, sizeof(source));
+    mnf_mat4_copy(transform, source.transform);
+
+    struct gltf_accessor positions;
+    if (!gltf_accessor(loader, position_index, &positions) ||
+        positions.component_type != GLTF_FLOAT || positions.components != 3) {
+        SWARN("Primitive '%s' of '%s' has no float positions", name, loader->path);
+        return false;
+    }
+    source.vertex_count = (uint32_t) positions.count;
+    if (!gltf_attribute(loader, &positions, &source.attributes[MESH_ATTRIBUTE_POSITION]))
+        return false;
+
+    struct gltf_accessor indices;
+    bool indexed = (indices_index >= 0);
+    if (indexed) {
+        if (!gltf_accessor(loader, indices_index, &indices) ||
+            indices.components != 1 || !gltf_check_indices(loader, &indices, positions.count)) {
+            SWARN("Primitive '%s' of '%s' has invalid indices", name, loader->path);
+            return false;
+        }
+
+        struct mesh_attribute index_range;
+        if (!gltf_attribute(loader, &indices, &index_range)) return false;
+        source.index_blob = index_range.blob;
+        source.index_offset = index_range.offset;
+        source.index_type = indices.component_type;
+        source.index_count = (uint32_t) (indices.count - indices.count % 3);
+    } else {
+        source.vertex_count -= source.vertex_count % 3;
+    }
+
+    struct gltf_accessor normals;
+    if (normal_index >= 0 && gltf_accessor(loader, normal_index, &normals) &&
+        normals.component_type == GLTF_FLOAT && normals.components == 3 &&
+        normals.count >= positions.count) {
+        if (!gltf_attribute(loader, &normals, &source.attributes[MESH_ATTRIBUTE_NORMAL]))
+            return false;
+    } else if (!gltf_generate_normals(loader, position_index, indices_index,
+                                      &positions, indexed ? &indices : NULL,
+                                      &source.attributes[MESH_ATTRIBUTE_NORMAL])) {
+        return false;
+    }
+
+    /* uvs are optional, without any the shader samples the corner of the
+       textures */
+    struct gltf_accessor uvs;
+    if (uv_index >= 0 && gltf_accessor(loader, uv_index, &uvs) &&
+        uvs.components == 2 && uvs.count >= positions.count &&
+        (uvs.component_type == GLTF_FLOAT ||
+         ((uvs.component_type == GLTF_UNSIGNED_BYTE ||
+           uvs.component_type == GLTF_UNSIGNED_SHORT) && uvs.normalized))) {
+        if (!gltf_attribute(loader, &uvs, &source.attributes[MESH_ATTRIBUTE_UV]))
+            return false;
+    }
+
+    struct mesh_submesh submesh;
+    memset(&submesh, 0, sizeof(submesh));
+    memcpy(submesh.name, name, strnlen(name, MESH_NAME_MAX_SIZE - 1));
+
+    int64_t material = json_int(json, json_get(json, primitive, "material"), -1);
+    if (material >= 0)
+        snprintf(submesh.material, sizeof(submesh.material), "#%d", (int) material);
+
+    /* min & max are required on positions but not every exporter writes them */
+    if (positions.has_bounds) {
+        mnf_vec3_copy(positions.min, submesh.bounds.min);
+        mnf_vec3_copy(positions.max, submesh.bounds.max);
+    } else {
+        gltf_accessor_bounds(loader, &positions, &submesh.bounds);
+    }
+
+    darray_push(loader->sources, &source);
+    darray_push(loader->submeshes, &submesh);
+    return true;
+}
+
+/* Reads an accessor & checks every element it has is inside its view */
+static bool gltf_accessor(const struct gltf_loader *loader, int32_t index, struct gltf_accessor *out)
+{
+    const struct json *json = &loader->json;
+    int32_t accessor = json_at(json, json_get(json, loader->root, "accessors"), (size_t) index);
+    if (index < 0 || accessor < 0) return false;
+
+    if (json_get(json, accessor, "sparse") >= 0) {
+        SWARN("Sparse accessors of '%s' aren't supported", loader->path);
+        return false;
+    }
+
+    int64_t view = json_int(json, json_get(json, accessor, "bufferView"), -1);
+    int64_t offset = json_int(json, json_get(json, accessor, "byteOffset"), 0);
+    int64_t count = json_int(json, json_get(json, accessor, "count"), -1);
+    int64_t component_type = json_int(json, json_get(json, accessor, "componentType"), -1);
+
+    out->components = gltf_type_components(json, json_get(json, accessor, "type"));
+    size_t component_size = gltf_component_size((uint32_t) component_type);
+
+    /* accessors without a view are all zeros, nothing worth drawing */
+    if (view < 0 || (size_t) view >= loader->n_views || offset < 0 || count <= 0 ||
+        count > UINT32_MAX || component_size == 0 || out->components == 0)
+        return false;
+
+    const struct gltf_view *buffer_view = &loader->views[view];
+    size_t element_size = component_size * out->components;
+    size_t stride = buffer_view->stride ? buffer_view->stride : element_size;
+    if (stride < element_size || (size_t) offset % component_size != 0) return false;
+
+    uint64_t end = (uint64_t) offset + (uint64_t) stride * (uint64_t) (count - 1) + element_size;
+    if (end > buffer_view->length) return false;
+
+    out->view = (uint32_t) view;
+    out->offset = (size_t) offset;
+    out->component_type = (uint32_t) component_type;
+    out->count = (size_t) count;
+    out->stride = stride;
+    out->normalized = json_bool(json, json_get(json, accessor, "normalized"), false);
+
+    int32_t min = json_get(json, accessor, "min");
+    int32_t max = json_get(json, accessor, "max");
+    out->has_bounds = json_len(json, min) >= 3 && json_len(json, max) >= 3;
+    for (size_t i = 0; i < 3 && out->has_bounds; i++) {
+        out->min[i] = (float) json_number(json, json_at(json, min, i), 0.0);
+        out->max[i] = (float) json_number(json, json_at(json, max, i), 0.0);
+    }
+
+    return true;
+}
+
+/* Points an attribute at the blob of the accessor's view, the view becomes a
+   blob the first time a primitive uses it */
+static bool gltf_attribute(struct gltf_loader *loader,
+                           const struct gltf_accessor *accessor,
+                           struct mesh_attribute *out)
+{
+    struct gltf_view *view = &loader->views[accessor->view];
+    if (view->blob < 0) {
+        struct mesh_blob blob = {
+            .data = loader->buffers[view->buffer].data + view->offset,
+            .size = view->length,
+        };
+        view->blob = (int32_t) darray_push(loader->blobs, &blob);
+    }
+
+    out->blob = (uint32_t) view->blob;
+    out->offset = accessor->offset;
+    out->stride = (uint32_t) accessor->stride;
+    out->size = accessor->components;
+    out->type = accessor->component_type;
+    out->normalized = accessor->normalized;
+
+    return true;
+}
+
+/* Indices have to be unsigned, tightly packed & all reference a vertex, a
+   broken file would otherwise read outside of the vertex buffers */
+static bool gltf_check_indices(const struct gltf_loader *loader,
+                               const struct gltf_accessor *indices,
+                               size_t n_vertices)
+{
+    uint32_t type = indices->component_type;
+    if (type != GLTF_UNSIGNED_BYTE && type != GLTF_UNSIGNED_SHORT && type != GLTF_UNSIGNED_INT)
+        return false;
+    if (indices->stride != gltf_component_size(type)) return false;
+
+    const uint8_t *data = gltf_accessor_data(loader, indices);
+    uint32_t max = 0;
+    for (size_t i = 0; i < indices->count; i++) {
+        uint32_t index = gltf_read_index(data, type, i);
+        if (index > max) max = index;
+    }
+
+    return max < n_vertices;
+}
+
+static const uint8_t *gltf_accessor_data(const struct gltf_loader *loader,
+                                         const struct gltf_accessor *accessor)
+{
+    const struct gltf_view *view = &loader->views[accessor->view];
+    return loader->buffers[view->buffer].data + view->offset + accessor->offset;
+}
+
+static uint32_t gltf_read_index(const uint8_t *data, uint32_t component_type, size_t i)
+{
+    if (component_type == GLTF_UNSIGNED_BYTE) return data[i];
+
+    if (component_type == GLTF_UNSIGNED_SHORT) {
+        uint16_t index;
+        memcpy(&index, data + i * sizeof(uint16_t), sizeof(index));
+        return index;
+    }
+
+    uint32_t index;
+    memcpy(&index, data + i * sizeof(uint32_t), sizeof(index));
+    return index;
+}
+
+static void gltf_accessor_bounds(const struct gltf_loader *loader,
+                                 const struct gltf_accessor *positions,
+                                 struct aabb *out)
+{
+    const uint8_t *data = gltf_accessor_data(loader, positions);
+    for (size_t i = 0; i < positions->count; i++) {
+        vec3 pos;
+        memcpy(pos, data + i * positions->stride, sizeof(vec3));
+        for (size_t axis = 0; axis < 3; axis++) {
+            if (i == 0 || pos[axis] < out->min[axis]) out->min[axis] = pos[axis];
+            if (i == 0 || pos[axis] > out->max[axis]) out->max[axis] = pos[axis];
+        }
+    }
+}
+
+/* Area weighted smooth normals for primitives without any, the one stream
+   the loader has to build itself. Goes into a blob of its own */
+static bool gltf_generate_normals(struct gltf_loader *loader,
+                                  int32_t position_index,
+                                  int32_t indices_index,
+                                  const struct gltf_accessor *positions,
+                                  const struct gltf_accessor *indices,
+                                  struct mesh_attribute *out)
+{
+    out->offset = 0;
+    out->stride = sizeof(float[3]);
+    out->size = 3;
+    out->type = GLTF_FLOAT;
+    out->normalized = false;
+
+    const struct gltf_normals *generated = loader->generated->items;
+    for (size_t i = 0; i < loader->generated->len; i++) {
+        if (generated[i].positions == position_index && generated[i].indices == indices_index) {
+            out->blob = generated[i].blob;
+            return true;
+        }
+    }
+
+    float (*normals)[3] = calloc(positions->count, sizeof(float[3]));
+    if (normals == NULL) {
+        SERROR("Failed to alloc memory for the normals of '%s'", loader->path);
+        return false;
+    }
+
+    const uint8_t *position_data = gltf_accessor_data(loader, positions);
+    const uint8_t *index_data = indices ? gltf_accessor_data(loader, indices) : NULL;
+    size_t n_corners = indices ? indices->count : positions->count;
+
+    for (size_t i = 0; i + 2 < n_corners; i += 3) {
+        uint32_t corners[3];
+        vec3 pos[3];
+        for (size_t j = 0; j < 3; j++) {
+            corners[j] = indices ? gltf_read_index(index_data, indices->component_type, i + j)
+                                 : (uint32_t) (i + j);
+            memcpy(pos[j], position_data + corners[j] * positions->stride, sizeof(vec3));
+        }
+
+        vec3 ab, ac, cross;
+        mnf_vec3_sub(pos[1], pos[0], ab);
+        mnf_vec3_sub(pos[2], pos[0], ac);
+        mnf_vec3_cross(ab, ac, cross);
+        for (size_t j = 0; j < 3; j++)
+            mnf_vec3_add(normals[corners[j]], cross, normals[corners[j]]);
+    }
+
+    for (size_t i = 0; i < positions->count; i++)
+        mnf_vec3_normalize(normals[i], normals[i]);
+
+    struct mesh_blob blob = {
+        .data = normals,
+        .size = positions->count * sizeof(float[3]),
+    };
+    out->blob = (uint32_t) darray_push(loader->blobs, &blob);
+
+    struct gltf_normals entry = {
+        .positions = position_index,
+        .indices = indices_index,
+        .blob = out->blob,
+        .data = normals,
+    };
+    darray_push(loader->generated, &entry);
+
+    return true;
+}
+
+/* The metallic roughness materials are approximated for the phong shader:
+   the base color becomes the diffuse map, smoother surfaces get a brighter &
+   tighter highlight. Metalness & the other maps are ignored */
+static void gltf_load_materials(struct gltf_loader *loader, struct mtl_library *library)
+{
+    const struct json *json = &loader->json;
+    int32_t materials = json_get(json, loader->root, "materials");
+
+    for (size_t i = 0; i < json_len(json, materials); i++) {
+        int32_t pbr = json_get(json, json_at(json, materials, i), "pbrMetallicRoughness");
+
+        float base_color[3] = {1.0f, 1.0f, 1.0f};
+        int32_t factor = json_get(json, pbr, "baseColorFactor");
+        for (size_t c = 0; c < 3; c++)
+            base_color[c] = (float) json_number(json, json_at(json, factor, c), 1.0);
+
+        float roughness = (float) json_number(json, json_get(json, pbr, "roughnessFactor"), 1.0);
+        roughness = fmaxf(0.05f, fminf(1.0f, roughness));
+        float gloss = 1.0f - roughness;
+        float specular[3] = {gloss, gloss, gloss};
+
+        int64_t texture = json_int(json, json_get(json, json_get(json, pbr, "baseColorTexture"), "index"), -1);
+
+        /* phong exponent matching the width of a GGX lobe of that roughness */
+        float alpha = roughness * roughness;
+        float shininess = fmaxf(1.0f, fminf(1024.0f, 2.0f / (alpha * alpha) - 2.0f));
+
+        struct material material = {
+            .diffuse_map = gltf_load_image(loader, library, (int32_t) texture, base_color),
+            .specular_map = mtl_library_color(library, specular),
+            .shininess = shininess,
+        };
+
+        char name[MESH_NAME_MAX_SIZE];
+        snprintf(name, sizeof(name), "#%zu", i);
+        mtl_library_add_material(library, name, material);
+    }
+}
+
+/* Loads the image of a texture once, falls back onto a flat color when there
+   is no texture or its image can't be decoded */
+static struct texture gltf_load_image(struct gltf_loader *loader,
+                                      struct mtl_library *library,
+                                      int32_t texture,
+                                      const float fallback[3])
+{
+    const struct json *json = &loader->json;
+    int32_t texture_value = json_at(json, json_get(json, loader->root, "textures"), (size_t) texture);
+    int64_t image_index = json_int(json, json_get(json, texture_value, "source"), -1);
+    int32_t image = json_at(json, json_get(json, loader->root, "images"), (size_t) image_index);
+    if (texture < 0 || image_index < 0 || image < 0)
+        return mtl_library_color(library, fallback);
+
+    char key[MESH_PATH_MAX_SIZE];
+    snprintf(key, sizeof(key), "%s:image %d", loader->path, (int) image_index);
+    const struct texture *loaded = mtl_library_find_texture(library, key);
+    if (loaded != NULL) return *loaded;
+
+    struct texture created = {0};
+    int64_t view_index = json_int(json, json_get(json, image, "bufferView"), -1);
+    int32_t uri_value = json_get(json, image, "uri");
+
+    if (view_index >= 0 && (size_t) view_index < loader->n_views) {
+        /* embedded in the file, decoded straight out of the mapping */
+        const struct gltf_view *view = &loader->views[view_index];
+        created = texture_create_from_memory(loader->buffers[view->buffer].data + view->offset,
+                                             view->length);
+    } else if (uri_value >= 0) {
+        size_t len = json->values[uri_value].end - json->values[uri_value].start;
+        char *uri = malloc(len + 1);
+        if (uri != NULL) {
+            json_string(json, uri_value, uri, len + 1);
+
+            char path[MESH_PATH_MAX_SIZE];
+            struct mapped_file file;
+            if (strncmp(uri, "data:", 5) == 0) {
+                size_t size = 0;
+                uint8_t *data = gltf_decode_data_uri(uri, &size);
+                if (data != NULL) created = texture_create_from_memory(data, size);
+                free(data);
+            } else if (gltf_resolve_uri(loader->path, uri, path) && file_map(path, &file)) {
+                created = texture_create_from_memory(file.data, file.size);
+                file_unmap(&file);
+            }
+            free(uri);
+        }
+    }
+
+    if (created.id == 0) {
+        SWARN("Image %d of '%s' failed to load, using its base color", (int) image_index, loader->path);
+        return mtl_library_color(library, fallback);
+    }
+
+    mtl_library_add_texture(library, key, created);
+    return created;
+}
+
+static size_t gltf_component_size(uint32_t component_type)
+{
+    switch (component_type) {
+    case GLTF_BYTE:
+    case GLTF_UNSIGNED_BYTE:
+        return 1;
+    case GLTF_SHORT:
+    case GLTF_UNSIGNED_SHORT:
+        return 2;
+    case GLTF_UNSIGNED_INT:
+    case GLTF_FLOAT:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static uint32_t gltf_type_components(const struct json *json, int32_t type)
+{
+    if (json_string_eq(json, type, "SCALAR")) return 1;
+    if (json_string_eq(json, type, "VEC2")) return 2;
+    if (json_string_eq(json, type, "VEC3")) return 3;
+    if (json_string_eq(json, type, "VEC4")) return 4;
+    /* matrices are never vertex attributes we use */
+    return 0;
+}
+
+/* Uris are relative to the file & percent encoded */
+static bool gltf_resolve_uri(const char *base, const char *uri, char out[MESH_PATH_MAX_SIZE])
+{
+    const char *slash = strrchr(base, '/');
+    size_t len = (slash != NULL && uri[0] != '/') ? (size_t) (slash - base + 1) : 0;
+    if (len >= MESH_PATH_MAX_SIZE) return false;
+    memcpy(out, base, len);
+
+    for (const char *c = uri; *c != '\0'; c++) {
+        if (len + 1 >= MESH_PATH_MAX_SIZE) return false;
+
+        unsigned int byte;
+        if (*c == '%' && c[1] != '\0' && c[2] != '\0' && sscanf(c + 1, "%2x", &byte) == 1) {
+            out[len++] = (char) byte;
+            c += 2;
+        } else {
+            out[len++] = *c;
+        }
+    }
+    out[len] = '\0';
+
+    return true;
+}
+
+/* Decodes a "data:<mime>;base64,<data>" uri, returns a malloc'd buffer the
+   caller frees, NULL if it isn't base64 */
+static uint8_t *gltf_decode_data_uri(const char *uri, size_t *size)
+{
+    const char *data = strstr(uri, ";base64,");
+    if (data == NULL) return NULL;
+    data += strlen(";base64,");
+
+    size_t len = strlen(data);
+    uint8_t *out = malloc(len / 4 * 3 + 3);
+    if (out == NULL) return NULL;
+
+    uint32_t bits = 0;
+    uint32_t n_bits = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < len && data[i] != '='; i++) {
+        char c = data[i];
+        uint32_t value;
+        if (c >= 'A' && c <= 'Z') value = (uint32_t) (c - 'A');
+        else if (c >= 'a' && c <= 'z') value = (uint32_t) (c - 'a' + 26);
+        else if (c >= '0' && c <= '9') value = (uint32_t) (c - '0' + 52);
+        else if (c == '+') value = 62;
+        else if (c == '/') value = 63;
+        else {
+            free(out);
+            return NULL;
+        }
+
+        bits = (bits << 6) | value;
+        n_bits += 6;
+        if (n_bits >= 8) {
+            n_bits -= 8;
+            out[n++] = (uint8_t) (bits >> n_bits);
+        }
+    }
+
+    *size = n;
+    return out;
+}
+
+static void gltf_free(struct gltf_loader *loader)
+{
+    for (size_t i = 0; i < loader->n_buffers; i++) {
+        file_unmap(&loader->buffers[i].file);
+        free(loader->buffers[i].decoded);
+    }
+    free(loader->buffers);
+    free(loader->views);
+
+    if (loader->generated != NULL) {
+        struct gltf_normals *generated = loader->generated->items;
+        for (size_t i = 0; i < loader->generated->len; i++)
+            free(generated[i].data);
+        darray_free(loader->generated);
+    }
+    if (loader->blobs) darray_free(loader->blobs);
+    if (loader->sources) darray_free(loader->sources);
+    if (loader->submeshes) darray_free(loader->submeshes);
+
+    json_free(&loader->json);
+}
+
+static double gltf_elapsed_ms(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start.tv_sec) * 1000.0 +
+           (double) (now.tv_nsec - start.tv_nsec) / 1000000.0;
+}
@@ -0,0 +1,35 @@
+#ifndef SAGE_GLTF_LOADER_H
+#define SAGE_GLTF_LOADER_H
+
+#include <stdbool.h>
+
+#include "mesh.h"
+#include "mtl_loader.h"
+
+/*
+ * glTF 2.0 loader (.gltf & .glb)
+ *
+ * The file is memory mapped and only its JSON is parsed, the vertex & index
+ * data is never turned into struct vertex arrays: every bufferView an
+ * accessor of a primitive uses is handed to mesh_create_from_streams() as a
+ * blob that goes straight into a GL buffer, the accessors becoming the
+ * offsets & strides of the VAO. Interleaved & split streams both work.
+ *
+ * Every primitive of every mesh the nodes of the default scene reference
+ * becomes a submesh drawn at the transform of its node. Primitives without
+ * normals get smooth normals generated, which is the only vertex data the
+ * loader builds itself.
+ *
+ * Supported: triangle lists, float positions & normals, float or normalized
+ * integer uvs, 8/16/32-bit indices, GLB with the BIN chunk, external .bin
+ * files & base64 data uris, images embedded in a bufferView or referenced by
+ * uri. Sparse accessors, skins, morph targets & animations are ignored.
+ */
+
+/* Loads the default scene of the file into 'mesh'. The materials go into
+   'library' named "#<material index>", which is what the material of every
+   submesh is set to (empty for primitives without a material). Returns false
+   if the file can't be read or has nothing that can be drawn */
+bool gltf_load(const char *path, struct mesh *mesh, struct mtl_library *library);
+
+#endif /* SAGE_GLTF_LOADER_H */
@@ -0,0 +1,46 @@
+#include <string.h>
+
+#include "hash.h"
+
+/* Constants from Austin Appleby's MurmurHash2, 64-bit version A */
+#define HASH_M 0xc6a4a7935bd1e995ull
+#define HASH_R 47
+
+uint64_t hash_64(const void *data, size_t size, uint64_t seed)
+{
+    const uint8_t *bytes = data;
+    uint64_t h = seed ^ (size * HASH_M);
+
+    /* 8 bytes at a time, memcpy because the data isn't necessarily aligned */
+    size_t n_blocks = size / 8;
+    for (size_t i = 0; i < n_blocks; i++) {
+        uint64_t k;
+        memcpy(&k, bytes + i * 8, sizeof(k));
+
+        k *= HASH_M;
+        k ^= k >> HASH_R;
+        k *= HASH_M;
+
+        h ^= k;
+        h *= HASH_M;
+    }
+
+    /* remaining tail bytes */
+    const uint8_t *tail = bytes + n_blocks * 8;
+    switch (size & 7) {
+    case 7: h ^= (uint64_t) tail[6] << 48; /* fall through */
+    case 6: h ^= (uint64_t) tail[5] << 40; /* fall through */
+    case 5: h ^= (uint64_t) tail[4] << 32; /* fall through */
+    case 4: h ^= (uint64_t) tail[3] << 24; /* fall through */
+    case 3: h ^= (uint64_t) tail[2] << 16; /* fall through */
+    case 2: h ^= (uint64_t) tail[1] << 8;  /* fall through */
+    case 1: h ^= (uint64_t) tail[0];
+            h *= HASH_M;
+    }
+
+    h ^= h >> HASH_R;
+    h *= HASH_M;
+    h ^= h >> HASH_R;
+
+    return h;
+}
@@ -0,0 +1,11 @@
+#ifndef SAGE_HASH_H
+#define SAGE_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Non-cryptographic 64-bit hash of a block of memory (MurmurHash64A), used to
+   tell whether the content of a file has changed */
+uint64_t hash_64(const void *data, size_t size, uint64_t seed);
+
+#endif /* SAGE_HASH_H */
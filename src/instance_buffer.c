@@ -0,0 +1,184 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glad/gl.h>
+
+#include "instance_buffer.h"
+#include "uniform_buffer.h"
+#include "gl_state.h"
+#include "mnf/mnf_vector.h"
+#include "hash.h"
+#include "darray.h"
+#include "logger.h"
+
+/* twice the materials so the probes stay short */
+#define INSTANCE_MATERIAL_SLOTS (INSTANCE_MAX_MATERIALS * 2)
+
+struct instance_buffer {
+    uint32_t handle;
+    size_t capacity;        /* bytes of the GL buffer */
+    darray *instances;      /* struct model_instance */
+
+    struct instance_material_block materials;
+    uint32_t n_materials;
+    uint16_t slots[INSTANCE_MATERIAL_SLOTS];   /* index + 1 into 'materials', 0 if empty */
+    bool warned_full;
+    struct uniform_buffer material_buffer;
+};
+
+static struct instance_buffer instances;
+
+static void instance_normal_matrix(mat4 model, mat3 out);
+
+bool instance_buffer_init(void)
+{
+    memset(&instances, 0, sizeof(instances));
+    instances.instances = darray_alloc(sizeof(struct model_instance), 256);
+    if (instances.instances == NULL) {
+        SERROR("Failed to alloc memory for the instances of models");
+        return false;
+    }
+
+    glGenBuffers(1, &instances.handle);
+    instances.material_buffer = uniform_buffer_create(UNIFORM_BLOCK_MATERIAL,
+                                                      sizeof(struct instance_material_block));
+    return true;
+}
+
+void instance_buffer_begin(void)
+{
+    if (instances.instances) instances.instances->len = 0;
+
+    /* the block is compared to the last upload, what's unused stays zero */
+    memset(&instances.materials, 0, sizeof(instances.materials));
+    memset(instances.slots, 0, sizeof(instances.slots));
+    instances.n_materials = 0;
+}
+
+uint32_t instance_buffer_material(const struct instance_material *material)
+{
+    /* without the padding of the caller, it's hashed & compared */
+    struct instance_material added;
+    memset(&added, 0, sizeof(added));
+    memcpy(added.color, material->color, sizeof(added.color));
+    added.shininess = material->shininess;
+    added.packed = material->packed;
+
+    uint32_t slot = (uint32_t) hash_64(&added, sizeof(added), 0) % INSTANCE_MATERIAL_SLOTS;
+    while (instances.slots[slot] != 0) {
+        uint32_t index = instances.slots[slot] - 1u;
+        if (memcmp(&instances.materials.materials[index], &added, sizeof(added)) == 0)
+            return index;
+        slot = (slot + 1) % INSTANCE_MATERIAL_SLOTS;
+    }
+
+    if (instances.n_materials == INSTANCE_MAX_MATERIALS) {
+        if (!instances.warned_full) {
+            SWARN("More than %d materials in a frame, the rest are drawn with the first",
+                  INSTANCE_MAX_MATERIALS);
+            instances.warned_full = true;
+        }
+        return 0;
+    }
+
+    uint32_t index = instances.n_materials++;
+    instances.materials.materials[index] = added;
+    instances.slots[slot] = (uint16_t) (index + 1);
+    return index;
+}
+
+uint32_t instance_buffer_push(mat4 model, uint32_t material)
+{
+    struct model_instance instance;
+    memcpy(instance.model, model, sizeof(instance.model));
+    instance_normal_matrix(model, instance.normal_matrix);
+    instance.material = material;
+
+    return (uint32_t) darray_push(instances.instances, &instance);
+}
+
+const struct model_instance *instance_buffer_at(uint32_t instance)
+{
+    return darray_at(instances.instances, instance);
+}
+
+void instance_buffer_upload(void)
+{
+    uniform_buffer_update(&instances.material_buffer, &instances.materials);
+
+    size_t size = instances.instances->len * sizeof(struct model_instance);
+    if (size == 0) return;
+
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, instances.handle);
+    if (size > instances.capacity) {
+        size_t capacity = (instances.capacity > 0) ? instances.capacity : 64 * 1024;
+        while (capacity < size) capacity *= 2;
+        instances.capacity = capacity;
+    }
+
+    /* orphaned so the draws of the last frame can still read the old one */
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) instances.capacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) size, instances.instances->items);
+}
+
+void instance_buffer_bind(uint32_t first)
+{
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, instances.handle);
+
+    GLsizei stride = (GLsizei) sizeof(struct model_instance);
+    uintptr_t base = (uintptr_t) first * sizeof(struct model_instance);
+
+    for (uint32_t column = 0; column < 4; column++) {
+        uint32_t location = INSTANCE_ATTRIBUTE_MODEL + column;
+        uintptr_t offset = base + offsetof(struct model_instance, model) + column * sizeof(vec4);
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (void *) offset);
+    }
+
+    for (uint32_t column = 0; column < 3; column++) {
+        uint32_t location = INSTANCE_ATTRIBUTE_NORMAL_MATRIX + column;
+        uintptr_t offset = base + offsetof(struct model_instance, normal_matrix) + column * sizeof(vec3);
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, (void *) offset);
+    }
+
+    uintptr_t offset = base + offsetof(struct model_instance, material);
+    glEnableVertexAttribArray(INSTANCE_ATTRIBUTE_MATERIAL);
+    glVertexAttribDivisor(INSTANCE_ATTRIBUTE_MATERIAL, 1);
+    glVertexAttribIPointer(INSTANCE_ATTRIBUTE_MATERIAL, 1, GL_UNSIGNED_INT, stride, (void *) offset);
+}
+
+void instance_buffer_shutdown(void)
+{
+    if (instances.handle != 0) {
+        gl_state_forget_buffer(instances.handle);
+        glDeleteBuffers(1, &instances.handle);
+    }
+    if (instances.instances) darray_free(instances.instances);
+    uniform_buffer_destroy(&instances.material_buffer);
+    memset(&instances, 0, sizeof(instances));
+}
+
+/* The columns of the upper 3x3 crossed with each other over its determinant
+   are the columns of its inverse transpose */
+static void instance_normal_matrix(mat4 model, mat3 out)
+{
+    vec3 x = { model[0][0], model[0][1], model[0][2] };
+    vec3 y = { model[1][0], model[1][1], model[1][2] };
+    vec3 z = { model[2][0], model[2][1], model[2][2] };
+
+    mnf_vec3_cross(y, z, out[0]);
+    mnf_vec3_cross(z, x, out[1]);
+    mnf_vec3_cross(x, y, out[2]);
+
+    /* singular ones keep the cofactors, the normals are normalized anyway */
+    float det = mnf_vec3_dot(x, out[0]);
+    if (det == 0.0f) return;
+
+    for (uint32_t column = 0; column < 3; column++)
+        mnf_vec3_scale(out[column], 1.0f / det, out[column]);
+}
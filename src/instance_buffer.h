@@ -0,0 +1,67 @@
+#ifndef SAGE_INSTANCE_BUFFER_H
+#define SAGE_INSTANCE_BUFFER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "mnf/mnf_types.h"
+
+/*
+ * Instance buffer
+ *
+ * Models are drawn instanced, what sets one draw of a mesh apart from another
+ * comes from per instance attributes instead of uniforms: the model matrix,
+ * the normal matrix & the index of the material parameters in material_block.
+ * Every draw of a frame pushes its instance, they're uploaded together in one
+ * buffer & a run of draws of the same mesh with the same textures becomes a
+ * single glDrawElementsInstanced from the instance it starts at.
+ *
+ * The textures still differ between draws, the material parameters that are
+ * uniforms otherwise live in material_block so draws with different ones can
+ * share a draw call. Only the render thread uses it.
+ */
+
+/* Locations of the per instance attributes, after the ones of enum
+   mesh_attribute. The matrices take a location per column */
+#define INSTANCE_ATTRIBUTE_MODEL 3          /* mat4, 3 to 6 */
+#define INSTANCE_ATTRIBUTE_NORMAL_MATRIX 7  /* mat3, 7 to 9 */
+#define INSTANCE_ATTRIBUTE_MATERIAL 10      /* uint */
+
+/* Length of the array in material_block, MAX_MATERIALS of the .glsl files */
+#define INSTANCE_MAX_MATERIALS 256
+
+struct model_instance {
+    mat4 model;
+    mat3 normal_matrix;     /* inverse transpose of the upper 3x3 of 'model' */
+    uint32_t material;
+};
+
+/* std140 layout of material_params in phong.glsl & light.glsl */
+struct instance_material {
+    vec3 color;             /* of the light gizmos */
+    float shininess;
+    int32_t packed;
+    int32_t pad[3];
+};
+
+struct instance_material_block {
+    struct instance_material materials[INSTANCE_MAX_MATERIALS];
+};
+
+bool instance_buffer_init(void);
+/* Forgets the instances & materials of the last frame */
+void instance_buffer_begin(void);
+/* Index of 'material' in material_block, added if it isn't yet. The first
+   one is reused once the block is full */
+uint32_t instance_buffer_material(const struct instance_material *material);
+/* Adds an instance placed by 'model', returns its index */
+uint32_t instance_buffer_push(mat4 model, uint32_t material);
+const struct model_instance *instance_buffer_at(uint32_t instance);
+/* Uploads the instances & materials pushed this frame, before any is drawn */
+void instance_buffer_upload(void);
+/* Points the instance attributes of the bound VAO at the instances from
+   'first' on, instance 0 of a draw is 'first' */
+void instance_buffer_bind(uint32_t first);
+void instance_buffer_shutdown(void);
+
+#endif /* SAGE_INSTANCE_BUFFER_H */
@@ -0,0 +1,376 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "json.h"
+#include "logger.h"
+
+/* Deepest nesting of arrays & objects accepted, keeps the recursion bounded */
+#define JSON_MAX_DEPTH 64
+
+/* Longest number token handed to strtod() */
+#define JSON_NUMBER_MAX_LEN 64
+
+struct json_parser {
+    const char *text;
+    size_t len;
+    size_t pos;
+    struct json_value *values;
+    size_t n_values;
+    size_t capacity;
+};
+
+static bool json_parse_value(struct json_parser *parser, uint32_t depth);
+static bool json_parse_string(struct json_parser *parser);
+static bool json_parse_literal(struct json_parser *parser, const char *literal, enum json_type type);
+static bool json_parse_number(struct json_parser *parser);
+static int32_t json_push(struct json_parser *parser, enum json_type type, size_t start);
+static void json_skip_spaces(struct json_parser *parser);
+static bool json_expect(struct json_parser *parser, char c);
+static uint32_t json_hex(const char *p);
+
+bool json_parse(const char *text, size_t len, struct json *out)
+{
+    struct json_parser parser = {
+        .text = text,
+        .len = len,
+        .pos = 0,
+        .values = NULL,
+        .n_values = 0,
+        .capacity = 0,
+    };
+
+    out->text = text;
+    out->values = NULL;
+    out->n_values = 0;
+
+    if (len >= UINT32_MAX) {
+        SERROR("JSON document is too big (%zu bytes)", len);
+        return false;
+    }
+
+    bool valid = json_parse_value(&parser, 0);
+    json_skip_spaces(&parser);
+    if (valid && parser.pos != parser.len) valid = false;
+
+    if (!valid) {
+        SERROR("Invalid JSON near byte %zu", parser.pos);
+        free(parser.values);
+        return false;
+    }
+
+    out->values = parser.values;
+    out->n_values = parser.n_values;
+    return true;
+}
+
+void json_free(struct json *json)
+{
+    free(json->values);
+    json->values = NULL;
+    json->n_values = 0;
+}
+
+int32_t json_get(const struct json *json, int32_t object, const char *key)
+{
+    if (object < 0 || json->values[object].type != JSON_OBJECT) return -1;
+
+    uint32_t child = (uint32_t) object + 1;
+    for (uint32_t i = 0; i < json->values[object].size; i++) {
+        uint32_t value = child + 1;
+        if (json_string_eq(json, (int32_t) child, key)) return (int32_t) value;
+        child = json->values[value].next;
+    }
+
+    return -1;
+}
+
+int32_t json_at(const struct json *json, int32_t array, size_t index)
+{
+    if (array < 0 || json->values[array].type != JSON_ARRAY) return -1;
+    if (index >= json->values[array].size) return -1;
+
+    uint32_t child = (uint32_t) array + 1;
+    for (size_t i = 0; i < index; i++)
+        child = json->values[child].next;
+
+    return (int32_t) child;
+}
+
+size_t json_len(const struct json *json, int32_t value)
+{
+    if (value < 0) return 0;
+    enum json_type type = json->values[value].type;
+    return (type == JSON_ARRAY || type == JSON_OBJECT) ? json->values[value].size : 0;
+}
+
+double json_number(const struct json *json, int32_t value, double fallback)
+{
+    if (value < 0 || json->values[value].type != JSON_NUMBER) return fallback;
+
+    const struct json_value *number = &json->values[value];
+    char token[JSON_NUMBER_MAX_LEN + 1];
+    size_t len = number->end - number->start;
+    if (len > JSON_NUMBER_MAX_LEN) return fallback;
+
+    /* the text isn't null terminated so the token is copied first */
+    memcpy(token, json->text + number->start, len);
+    token[len] = '\0';
+
+    return strtod(token, NULL);
+}
+
+int64_t json_int(const struct json *json, int32_t value, int64_t fallback)
+{
+    double number = json_number(json, value, NAN);
+    if (isnan(number) || number != floor(number) ||
+        number < -9007199254740992.0 || number > 9007199254740992.0)
+        return fallback;
+
+    return (int64_t) number;
+}
+
+bool json_bool(const struct json *json, int32_t value, bool fallback)
+{
+    if (value < 0 || json->values[value].type != JSON_BOOL) return fallback;
+    return json->text[json->values[value].start] == 't';
+}
+
+bool json_string(const struct json *json, int32_t value, char *out, size_t size)
+{
+    if (value < 0 || json->values[value].type != JSON_STRING || size == 0) return false;
+
+    const char *p = json->text + json->values[value].start;
+    const char *end = json->text + json->values[value].end;
+    size_t len = 0;
+
+    while (p < end && len + 1 < size) {
+        char c = *p++;
+        if (c != '\\') {
+            out[len++] = c;
+            continue;
+        }
+
+        c = *p++;
+        switch (c) {
+        case 'b': out[len++] = '\b'; break;
+        case 'f': out[len++] = '\f'; break;
+        case 'n': out[len++] = '\n'; break;
+        case 'r': out[len++] = '\r'; break;
+        case 't': out[len++] = '\t'; break;
+        case 'u': {
+            /* only ascii is kept, anything else becomes a '?' */
+            uint32_t code = json_hex(p);
+            p += 4;
+            out[len++] = (code < 0x80) ? (char) code : '?';
+            break;
+        }
+        default:
+            /* \" \\ \/ */
+            out[len++] = c;
+            break;
+        }
+    }
+    out[len] = '\0';
+
+    return true;
+}
+
+bool json_string_eq(const struct json *json, int32_t value, const char *s)
+{
+    if (value < 0 || json->values[value].type != JSON_STRING) return false;
+
+    size_t len = json->values[value].end - json->values[value].start;
+    return strlen(s) == len && memcmp(json->text + json->values[value].start, s, len) == 0;
+}
+
+static bool json_parse_value(struct json_parser *parser, uint32_t depth)
+{
+    if (depth > JSON_MAX_DEPTH) return false;
+
+    json_skip_spaces(parser);
+    if (parser->pos >= parser->len) return false;
+
+    char c = parser->text[parser->pos];
+    switch (c) {
+    case '{':
+    case '[': {
+        bool object = (c == '{');
+        int32_t index = json_push(parser, object ? JSON_OBJECT : JSON_ARRAY, parser->pos);
+        if (index < 0) return false;
+        parser->pos++;
+
+        json_skip_spaces(parser);
+        uint32_t size = 0;
+        if (parser->pos < parser->len && parser->text[parser->pos] == (object ? '}' : ']')) {
+            parser->pos++;
+        } else {
+            for (;;) {
+                if (object) {
+                    json_skip_spaces(parser);
+                    if (!json_parse_string(parser)) return false;
+                    if (!json_expect(parser, ':')) return false;
+                }
+                if (!json_parse_value(parser, depth + 1)) return false;
+                size++;
+
+                json_skip_spaces(parser);
+                if (parser->pos >= parser->len) return false;
+                char separator = parser->text[parser->pos++];
+                if (separator == ',') continue;
+                if (separator == (object ? '}' : ']')) break;
+                return false;
+            }
+        }
+
+        /* the array may have moved while parsing the children */
+        parser->values[index].size = size;
+        parser->values[index].end = (uint32_t) parser->pos;
+        parser->values[index].next = (uint32_t) parser->n_values;
+        return true;
+    }
+    case '"':
+        return json_parse_string(parser);
+    case 't':
+        return json_parse_literal(parser, "true", JSON_BOOL);
+    case 'f':
+        return json_parse_literal(parser, "false", JSON_BOOL);
+    case 'n':
+        return json_parse_literal(parser, "null", JSON_NULL);
+    default:
+        return json_parse_number(parser);
+    }
+}
+
+static bool json_parse_string(struct json_parser *parser)
+{
+    if (parser->pos >= parser->len || parser->text[parser->pos] != '"') return false;
+    size_t start = ++parser->pos;
+
+    while (parser->pos < parser->len) {
+        char c = parser->text[parser->pos];
+        if (c == '"') break;
+        if ((unsigned char) c < 0x20) return false;
+
+        if (c == '\\') {
+            if (parser->pos + 1 >= parser->len) return false;
+            char escape = parser->text[parser->pos + 1];
+            if (escape == 'u') {
+                if (parser->pos + 6 > parser->len) return false;
+                for (size_t i = 2; i < 6; i++) {
+                    char h = parser->text[parser->pos + i];
+                    bool hex = (h >= '0' && h <= '9') || (h >= 'a' && h <= 'f') || (h >= 'A' && h <= 'F');
+                    if (!hex) return false;
+                }
+                parser->pos += 6;
+                continue;
+            }
+            if (strchr("\"\\/bfnrt", escape) == NULL) return false;
+            parser->pos += 2;
+            continue;
+        }
+        parser->pos++;
+    }
+
+    if (parser->pos >= parser->len) return false;
+
+    int32_t index = json_push(parser, JSON_STRING, start);
+    if (index < 0) return false;
+    parser->values[index].end = (uint32_t) parser->pos;
+    parser->pos++; /* closing quote */
+
+    return true;
+}
+
+static bool json_parse_literal(struct json_parser *parser, const char *literal, enum json_type type)
+{
+    size_t len = strlen(literal);
+    if (parser->pos + len > parser->len ||
+        memcmp(parser->text + parser->pos, literal, len) != 0)
+        return false;
+
+    int32_t index = json_push(parser, type, parser->pos);
+    if (index < 0) return false;
+    parser->pos += len;
+    parser->values[index].end = (uint32_t) parser->pos;
+
+    return true;
+}
+
+/* Only checks the characters are the ones a number is made of, strtod()
+   decides the value when it's asked for */
+static bool json_parse_number(struct json_parser *parser)
+{
+    size_t start = parser->pos;
+    while (parser->pos < parser->len) {
+        char c = parser->text[parser->pos];
+        bool digit = (c >= '0' && c <= '9');
+        if (!digit && c != '+' && c != '-' && c != '.' && c != 'e' && c != 'E') break;
+        parser->pos++;
+    }
+
+    if (parser->pos == start) return false;
+
+    int32_t index = json_push(parser, JSON_NUMBER, start);
+    if (index < 0) return false;
+    parser->values[index].end = (uint32_t) parser->pos;
+
+    return true;
+}
+
+static int32_t json_push(struct json_parser *parser, enum json_type type, size_t start)
+{
+    if (parser->n_values == parser->capacity) {
+        size_t capacity = parser->capacity ? parser->capacity * 2 : 64;
+        if (capacity > INT32_MAX) return -1;
+
+        struct json_value *values = realloc(parser->values, capacity * sizeof(struct json_value));
+        if (values == NULL) {
+            SERROR("Failed to alloc memory for parsing JSON");
+            return -1;
+        }
+        parser->values = values;
+        parser->capacity = capacity;
+    }
+
+    size_t index = parser->n_values++;
+    parser->values[index] = (struct json_value) {
+        .type = type,
+        .start = (uint32_t) start,
+        .end = (uint32_t) start,
+        .size = 0,
+        .next = (uint32_t) parser->n_values,
+    };
+
+    return (int32_t) index;
+}
+
+static void json_skip_spaces(struct json_parser *parser)
+{
+    while (parser->pos < parser->len) {
+        char c = parser->text[parser->pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') break;
+        parser->pos++;
+    }
+}
+
+static bool json_expect(struct json_parser *parser, char c)
+{
+    json_skip_spaces(parser);
+    if (parser->pos >= parser->len || parser->text[parser->pos] != c) return false;
+    parser->pos++;
+    return true;
+}
+
+static uint32_t json_hex(const char *p)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; i++) {
+        char c = p[i];
+        uint32_t digit = (c >= '0' && c <= '9') ? (uint32_t) (c - '0')
+                       : (c >= 'a' && c <= 'f') ? (uint32_t) (c - 'a' + 10)
+                       : (uint32_t) (c - 'A' + 10);
+        value = value * 16 + digit;
+    }
+    return value;
+}
@@ -0,0 +1,65 @@
+#ifndef SAGE_JSON_H
+#define SAGE_JSON_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Minimal JSON reader
+ *
+ * The text is tokenized into a flat array of values in document order, an
+ * array or object is followed by its children (objects alternate between a
+ * key string & its value). Nothing is copied out of the text until a string
+ * or number is asked for, so the text must outlive the document.
+ *
+ * Values are referred to by their index, -1 meaning "missing". Every getter
+ * accepts -1 so lookups can be chained without checking each step.
+ */
+
+enum json_type {
+    JSON_NULL = 1,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT,
+};
+
+struct json_value {
+    enum json_type type;
+    uint32_t start;     /* bytes of the text it spans, strings without quotes */
+    uint32_t end;
+    uint32_t size;      /* elements of an array, members of an object */
+    uint32_t next;      /* index of the value after this one & its children */
+};
+
+struct json {
+    const char *text;
+    struct json_value *values;
+    size_t n_values;
+};
+
+/* Parses 'len' bytes of text, returns false with an error logged if it isn't
+   valid JSON. The root is value 0 */
+bool json_parse(const char *text, size_t len, struct json *out);
+void json_free(struct json *json);
+
+/* Value of 'key' in an object */
+int32_t json_get(const struct json *json, int32_t object, const char *key);
+/* Element 'index' of an array */
+int32_t json_at(const struct json *json, int32_t array, size_t index);
+/* Elements of an array or members of an object, 0 for anything else */
+size_t json_len(const struct json *json, int32_t value);
+
+double json_number(const struct json *json, int32_t value, double fallback);
+/* Same as json_number() but only for integers that fit, otherwise fallback */
+int64_t json_int(const struct json *json, int32_t value, int64_t fallback);
+bool json_bool(const struct json *json, int32_t value, bool fallback);
+/* Copies a string with its escapes resolved, truncated to fit 'size' with the
+   terminator. Returns false if the value isn't a string */
+bool json_string(const struct json *json, int32_t value, char *out, size_t size);
+/* Compares a string without escapes against 's' */
+bool json_string_eq(const struct json *json, int32_t value, const char *s);
+
+#endif /* SAGE_JSON_H */
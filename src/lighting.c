@@ -5,8 +5,6 @@
 #include "logger.h"
 #include "mnf/mnf_vector.h"
 
-#define MAX_UNIFORM_NAME_LEN 64
-
 struct point_light point_light_create(const char name[LIGHT_NAME_MAX_SIZE], float attenuation_range)
 {
     struct point_light light = {
@@ -44,72 +42,44 @@ void point_light_set_specular(struct point_light *light, vec3 specular)
     mnf_vec3_copy(specular, light->specular);
 }
 
-void lighting_apply(struct shader active_shader,
-                    struct directional_light directional_light,
-                    darray *point_lights,
-                    struct lighting_params params)
+void lighting_uniform_block(struct directional_light directional_light,
+                            darray *point_lights,
+                            struct lighting_params params,
+                            struct lighting_block *block)
 {
-    shader_uniform_vec3(active_shader, "u_directional_light.direction", directional_light.direction);
-
-    if (params.enable_ambient)
-        shader_uniform_vec3(active_shader, "u_directional_light.ambient", directional_light.ambient);
-    else
-        shader_uniform_vec3(active_shader, "u_directional_light.ambient", MNF_ZERO_VECTOR);
+    /* the padding is compared to the last upload too, it has to stay zero */
+    memset(block, 0, sizeof(*block));
 
-    if (params.enable_diffuse)
-        shader_uniform_vec3(active_shader, "u_directional_light.diffuse", directional_light.diffuse);
-    else
-        shader_uniform_vec3(active_shader, "u_directional_light.diffuse", MNF_ZERO_VECTOR);
+    struct lighting_block_directional_light *directional = &block->directional_light;
+    mnf_vec3_copy(directional_light.direction, directional->direction);
+    if (params.enable_ambient) mnf_vec3_copy(directional_light.ambient, directional->ambient);
+    if (params.enable_diffuse) mnf_vec3_copy(directional_light.diffuse, directional->diffuse);
+    if (params.enable_specular) mnf_vec3_copy(directional_light.specular, directional->specular);
 
-    if (params.enable_specular)
-        shader_uniform_vec3(active_shader, "u_directional_light.specular", directional_light.specular);
-    else
-        shader_uniform_vec3(active_shader, "u_directional_light.specular", MNF_ZERO_VECTOR);
+    /* the shader only has room for so many */
+    size_t n_point_lights = point_lights->len;
+    if (n_point_lights > LIGHTING_MAX_POINT_LIGHTS) n_point_lights = LIGHTING_MAX_POINT_LIGHTS;
+    block->n_point_lights = (int32_t) n_point_lights;
 
-    shader_uniform_1i(active_shader, "u_num_point_lights", point_lights->len);
-    for (size_t i = 0; i < point_lights->len; i++) {
+    for (size_t i = 0; i < n_point_lights; i++) {
         struct point_light *point_light = darray_at(point_lights, i);
-        char uniform_name[MAX_UNIFORM_NAME_LEN] = {0};
+        struct lighting_block_point_light *light = &block->point_lights[i];
 
-        /* visible */
-        snprintf(uniform_name, MAX_UNIFORM_NAME_LEN, "u_point_lights[%zu].visible", i);
-        shader_uniform_1i(active_shader, uniform_name, point_light->visible);
+        light->visible = point_light->visible;
         if (!point_light->visible) continue;
 
-        /* position */
-        snprintf(uniform_name, MAX_UNIFORM_NAME_LEN, "u_point_lights[%zu].pos", i);
-        shader_uniform_vec3(active_shader, uniform_name, point_light->pos);
-
-        /* diffuse */
-        snprintf(uniform_name, MAX_UNIFORM_NAME_LEN, "u_point_lights[%zu].diffuse", i);
-        if (params.enable_diffuse)
-            shader_uniform_vec3(active_shader, uniform_name, point_light->diffuse);
-        else
-            shader_uniform_vec3(active_shader, uniform_name, MNF_ZERO_VECTOR);
-        /* specular */
-        snprintf(uniform_name, MAX_UNIFORM_NAME_LEN, "u_point_lights[%zu].specular", i);
-        if (params.enable_specular)
-            shader_uniform_vec3(active_shader, uniform_name, point_light->specular);
-        else
-            shader_uniform_vec3(active_shader, uniform_name, MNF_ZERO_VECTOR);
-
-        /* constant */
-        snprintf(uniform_name, MAX_UNIFORM_NAME_LEN, "u_point_lights[%zu].constant", i);
-        shader_uniform_1f(active_shader, uniform_name, point_light->constant);
-        /* linear */
-        snprintf(uniform_name, MAX_UNIFORM_NAME_LEN, "u_point_lights[%zu].linear", i);
-        shader_uniform_1f(active_shader, uniform_name, point_light->linear);
-
-        /* quadratic */
-        snprintf(uniform_name, MAX_UNIFORM_NAME_LEN, "u_point_lights[%zu].quadratic", i);
-        shader_uniform_1f(active_shader, uniform_name, point_light->quadratic);
-
+        mnf_vec3_copy(point_light->pos, light->pos);
+        if (params.enable_diffuse) mnf_vec3_copy(point_light->diffuse, light->diffuse);
+        if (params.enable_specular) mnf_vec3_copy(point_light->specular, light->specular);
+        light->constant = point_light->constant;
+        light->linear = point_light->linear;
+        light->quadratic = point_light->quadratic;
     }
 }
 
-void light_set_name(struct point_light *light, const char name[LIGHT_NAME_MAX_SIZE])
+void light_set_name(struct point_light *light, const char *name)
 {
-    strncpy(light->name, name, LIGHT_NAME_MAX_SIZE);
+    snprintf(light->name, sizeof(light->name), "%s", name);
 }
 
 void point_light_set_attenuation_range(struct point_light *light, float range)
@@ -7,6 +7,8 @@
 #include "model.h"
 
 #define LIGHT_NAME_MAX_SIZE 100
+/* MAX_SCENE_POINT_LIGHT of phong.glsl, the lights past it aren't uploaded */
+#define LIGHTING_MAX_POINT_LIGHTS 8
 
 struct directional_light {
     /* light source to object */
@@ -40,6 +42,37 @@ struct lighting_params {
     bool enable_specular;
 };
 
+/* std140 layout of lighting_block in phong.glsl, every vec3 is padded to 16
+   bytes by the scalar after it */
+struct lighting_block_directional_light {
+    vec3 direction;
+    float pad0;
+    vec3 ambient;
+    float pad1;
+    vec3 diffuse;
+    float pad2;
+    vec3 specular;
+    float pad3;
+};
+
+struct lighting_block_point_light {
+    vec3 pos;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+    int32_t visible;    /* bool is 4 bytes in std140 */
+};
+
+struct lighting_block {
+    struct lighting_block_directional_light directional_light;
+    struct lighting_block_point_light point_lights[LIGHTING_MAX_POINT_LIGHTS];
+    int32_t n_point_lights;
+    int32_t pad[3];
+};
+
 struct point_light point_light_create(const char *name, float attenuation_range);
 void point_light_set_attenuation_range(struct point_light *light, float range);
 
@@ -48,12 +81,14 @@ void point_light_set_color(struct point_light *light, vec3 color);
 void point_light_set_diffuse(struct point_light *light, vec3 diffuse);
 void point_light_set_specular(struct point_light *light, vec3 specular);
 
-void lighting_apply(struct shader active_shader,
-                    struct directional_light directional_light,
-                    darray *point_lights,
-                    struct lighting_params params);
+/* What the lights write into their uniform block, see uniform_buffer.h.
+   Lights switched off by 'params' are written as black */
+void lighting_uniform_block(struct directional_light directional_light,
+                            darray *point_lights,
+                            struct lighting_params params,
+                            struct lighting_block *block);
 
-void light_set_name(struct point_light *light, const char name[LIGHT_NAME_MAX_SIZE]);
+void light_set_name(struct point_light *light, const char *name);
 
 
 #endif /* SAGE_LIGHTING_H */
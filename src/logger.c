@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdarg.h>
 #include <time.h>
@@ -58,14 +59,16 @@ void sage_log_output(enum log_level level, const char *fmt, ...)
 static int32_t timef_get(char time_fmt[LOG_TIME_FMT_BUFFER_SIZE])
 {
     time_t raw_time = (time_t) -1;
-    struct tm *info = NULL;
+    struct tm info;
     time(&raw_time);
 
     if (raw_time == (time_t) -1)
         return 1;
 
-    info = localtime(&raw_time);
-    strftime(time_fmt, LOG_TIME_FMT_BUFFER_SIZE, LOG_TIME_FMT, info);
+    /* the reentrant version since worker threads log too */
+    if (localtime_r(&raw_time, &info) == NULL)
+        return 1;
+    strftime(time_fmt, LOG_TIME_FMT_BUFFER_SIZE, LOG_TIME_FMT, &info);
 
     return 0;
 }
@@ -1,14 +1,19 @@
 #include "material.h"
 #include "texture.h"
+#include "resource_cache.h"
 #include "mnf/mnf_util.h"
 #include "logger.h"
 
+/* every material without a map samples the same white texture */
+static const uint8_t material_white[4] = {255, 255, 255, 255};
+
 struct material material_create_default(void)
 {
     struct material material = {
-        .diffuse_map = texture_create_default(),
-        .specular_map = texture_create_default(),
-        .shininess = 32
+        .diffuse_map = resource_cache_color(material_white),
+        .specular_map = resource_cache_color(material_white),
+        .shininess = 32,
+        .packed = false
     };
 
     return material;
@@ -18,9 +23,8 @@ struct material material_create(const char *diffuse_map_path,
                                 const char *specular_map_path,
                                 float shininess)
 {
-    /* TODO: figure out whether i create an array of textures in the scene
-       so that i don't end up creating more textures & it makes it easier to
-       free memory w/o leaking from forgetting to destroy textures in the GPU */
+    /* textures come from the resource cache, a path already loaded by
+       another material is shared instead of loaded again */
     if (shininess <= 0) {
         SWARN("Shininess should be greater than 0... clamping it to 1");
         shininess = MIN(shininess, 1);
@@ -28,27 +32,61 @@ struct material material_create(const char *diffuse_map_path,
     struct texture diffuse, specular;
 
     if (diffuse_map_path == NULL)
-        diffuse = texture_create_default();
+        diffuse = resource_cache_color(material_white);
     else
-        diffuse = texture_create(diffuse_map_path);
+        diffuse = resource_cache_texture(diffuse_map_path, TEXTURE_ROLE_COLOR);
 
     if (specular_map_path == NULL)
-        specular = texture_create_default();
+        specular = resource_cache_color(material_white);
     else
-        specular = texture_create(specular_map_path);
+        specular = resource_cache_texture(specular_map_path, TEXTURE_ROLE_MASK);
 
     struct material material = {
         .diffuse_map = diffuse,
         .specular_map = specular,
-        .shininess = shininess
+        .shininess = shininess,
+        .packed = false
     };
 
     return material;
 }
 
-void material_apply(struct shader shader, struct material material)
+struct material material_create_packed(const char *diffuse_map_path,
+                                       const char *specular_map_path,
+                                       const char *occlusion_map_path,
+                                       float shininess)
+{
+    if (occlusion_map_path == NULL)
+        return material_create(diffuse_map_path, specular_map_path, shininess);
+
+    struct texture packed = resource_cache_packed(specular_map_path, occlusion_map_path);
+    if (packed.id == 0) {
+        SWARN("Material of '%s' goes without its occlusion map", occlusion_map_path);
+        return material_create(diffuse_map_path, specular_map_path, shininess);
+    }
+
+    /* the diffuse map & clamping the shininess are the same as unpacked */
+    struct material material = material_create(diffuse_map_path, NULL, shininess);
+    resource_cache_release_texture(&material.specular_map);
+    material.specular_map = packed;
+    material.packed = true;
+
+    return material;
+}
+
+void material_destroy(struct material *material)
+{
+    resource_cache_release_texture(&material->diffuse_map);
+    resource_cache_release_texture(&material->specular_map);
+}
+
+void material_apply(struct material material)
 {
-    shader_uniform_1f(shader, "u_material.shininess", material.shininess);
     texture_bind(material.diffuse_map, 0);
     texture_bind(material.specular_map, 1);
 }
+
+uint32_t material_key(struct material material)
+{
+    return ((material.diffuse_map.id & 0xfff) << 12) | (material.specular_map.id & 0xfff);
+}
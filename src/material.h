@@ -7,8 +7,9 @@
 
 struct material {
     struct texture diffuse_map;
-    struct texture specular_map;
+    struct texture specular_map;    /* specular in r & occlusion in g if packed */
     float shininess;
+    bool packed;
 };
 
 struct material material_create_default(void);
@@ -17,6 +18,24 @@ struct material material_create(const char *diffuse_map_path,
                                 const char *specular_map_path,
                                 float shininess);
 
-void material_apply(struct shader shader, struct material material);
+/* Same as material_create() with an ambient occlusion map, packed with the
+   specular map into a single texture so the material binds one unit less.
+   Either map can be NULL, the material goes without occlusion if the maps
+   can't be packed */
+struct material material_create_packed(const char *diffuse_map_path,
+                                       const char *specular_map_path,
+                                       const char *occlusion_map_path,
+                                       float shininess);
+
+/* Releases the textures of the material, see resource_cache.h */
+void material_destroy(struct material *material);
+
+/* Binds the textures, the shininess & packing are per instance, see
+   instance_buffer.h */
+void material_apply(struct material material);
+/* Tells the texture sets of materials apart for ordering draws by them, from
+   the low 12 bits of both texture ids. Materials differing only in their
+   shininess or packing share a key */
+uint32_t material_key(struct material material);
 
 #endif /* SAGE_MATERIAL_H */
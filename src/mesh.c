@@ -1,15 +1,37 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
+#include <math.h>
 #include <glad/gl.h>
 
 #include "assert.h"
 #include "darray.h"
 #include "mnf/mnf_vector.h"
+#include "mnf/mnf_matrix.h"
 #include "logger.h"
 #include "mesh.h"
-
-static struct mesh_gpu mesh_gpu_create(const darray *vertices, const darray *indices)
+#include "mesh_optimize.h"
+#include "mesh_simplify.h"
+#include "meshlet.h"
+#include "config.h"
+#include "gl_state.h"
+
+static void mesh_compute_bounds(const struct vertex *vertices, size_t n_vertices, struct aabb *bounds);
+static void mesh_compute_submesh_bounds(const struct vertex *vertices,
+                                        const darray *indices,
+                                        struct mesh_submesh *submesh);
+static void mesh_transform_bounds(const struct aabb *bounds, mat4 transform, struct aabb *out);
+static void mesh_encode_octahedral(const float *normal, int16_t out[2]);
+static uint16_t mesh_float_to_half(float value);
+static uint16_t mesh_quantize_unorm16(float value, float min, float extent);
+
+static struct mesh_gpu mesh_gpu_create(const void *vertices,
+                                       size_t n_vertices,
+                                       enum vertex_format format,
+                                       const void *indices,
+                                       size_t n_indices,
+                                       size_t index_size)
 {
     struct mesh_gpu buffer;
     
@@ -22,60 +44,96 @@ static struct mesh_gpu mesh_gpu_create(const darray *vertices, const darray *ind
     glGenBuffers(1, &vbo);
 
     /* bind vao */
-    glBindVertexArray(vao);
+    gl_state_bind_vertex_array(vao);
 
     /* bind and copy data over to the buffer */
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, 
-                 vertices->item_size * vertices->len,
-                 vertices->items,
+                 vertex_format_size(format) * n_vertices,
+                 vertices,
                  GL_STATIC_DRAW);
 
     /* configure the vao to interpret attributes */
     /* stride is the offset between consecutive generic vertex attributes */
-    size_t stride = sizeof(struct vertex);
-
-    void *pos_offset = (void *) 0;
-    void *normal_offset = (void *) offsetof(struct vertex, normal);
-    void *uv_offset = (void *) offsetof(struct vertex, uv);
+    size_t stride = vertex_format_size(format);
+
+    switch (format) {
+    case VERTEX_FORMAT_FLOAT:
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride,
+                              (void *) offsetof(struct vertex, pos));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride,
+                              (void *) offsetof(struct vertex, normal));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride,
+                              (void *) offsetof(struct vertex, uv));
+        break;
+
+    /* the octahedral normals are passed as plain integers and divided by
+       32767 in the shader, GL 4.1 maps snorm16 with (2c + 1) / 65535 which
+       can't represent 0 */
+    case VERTEX_FORMAT_PACKED:
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride,
+                              (void *) offsetof(struct vertex_packed, pos));
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, stride,
+                              (void *) offsetof(struct vertex_packed, normal));
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride,
+                              (void *) offsetof(struct vertex_packed, uv));
+        break;
+
+    case VERTEX_FORMAT_QUANTIZED:
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+                              (void *) offsetof(struct vertex_quantized, pos));
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, stride,
+                              (void *) offsetof(struct vertex_quantized, normal));
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride,
+                              (void *) offsetof(struct vertex_quantized, uv));
+        break;
+
+    default:
+        SASSERT_MSG(false, "Unknown vertex format");
+        break;
+    }
 
-    /* position attribute */
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, pos_offset);
+    /* position, normal & uv attributes */
     glEnableVertexAttribArray(0);
-    /* normal attribute */
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, normal_offset);
     glEnableVertexAttribArray(1);
-    /* uv attribute */
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, uv_offset);
     glEnableVertexAttribArray(2);
 
     if (indices) {
+        SASSERT_MSG(index_size == sizeof(uint16_t) || index_size == sizeof(uint32_t),
+                    "Indices must either be uint16_t or uint32_t");
         glGenBuffers(1, &ibo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                     indices->item_size * indices->len,
-                     indices->items,
+                     index_size * n_indices,
+                     indices,
                      GL_STATIC_DRAW);
         buffer.ibo = ibo;
-        buffer.index_count = indices->len;
+        buffer.index_count = n_indices;
+        buffer.index_type = (index_size == sizeof(uint16_t))
+            ? GL_UNSIGNED_SHORT
+            : GL_UNSIGNED_INT;
     } else {
         buffer.ibo = 0;
         buffer.index_count = 0;
+        buffer.index_type = 0;
     }
 
     /* unbinding */
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, 0);
+    gl_state_bind_vertex_array(0);
 
     buffer.vao = vao;
     buffer.vbo = vbo;
-    buffer.vertex_count = vertices->len;
+    buffer.vertex_count = n_vertices;
+    buffer.format = format;
 
     return buffer;
 }
 
 static void mesh_gpu_free(struct mesh_gpu *buffer)
 {
+    gl_state_forget_vertex_array(buffer->vao);
+    gl_state_forget_buffer(buffer->vbo);
     glDeleteVertexArrays(1, &(buffer->vao));
     glDeleteBuffers(1, &(buffer->vbo));
     if (buffer->ibo > 0)
@@ -86,27 +144,318 @@ static void mesh_gpu_free(struct mesh_gpu *buffer)
     buffer->ibo = 0;
     buffer->vertex_count = 0;
     buffer->index_count = 0;
+    buffer->index_type = 0;
+    buffer->format = 0;
+}
+
+struct mesh mesh_create(darray *vertices,
+                        darray *indices,
+                        const struct mesh_submesh *submeshes,
+                        size_t n_submeshes)
+{
+    struct mesh_pending pending = mesh_prepare(vertices, indices, submeshes, n_submeshes);
+    return mesh_upload(&pending);
 }
 
-struct mesh mesh_create(darray *vertices, darray *indices)
+struct mesh_pending mesh_prepare(darray *vertices,
+                                 darray *indices,
+                                 const struct mesh_submesh *submeshes,
+                                 size_t n_submeshes)
 {
     SASSERT_MSG(vertices !=  NULL, "Creating a mesh must atleast have vertices");
 
     struct mesh mesh;
+    mesh.buffer = (struct mesh_gpu) {0};
+    mesh.material_library[0] = '\0';
+    mesh.streams = NULL;
+    mesh.stream_buffers = NULL;
+    mesh.n_stream_buffers = 0;
+    mesh.meshlets = NULL;
+    mesh.n_meshlets = 0;
+    mesh.n_lods = 1;
+
+    /* without any submeshes the whole mesh is one */
+    struct mesh_submesh whole = {0};
+    whole.lods[0] = (struct mesh_lod) { 0, indices ? (uint32_t) indices->len : 0, 0.0f };
+    if (n_submeshes == 0 || indices == NULL) {
+        submeshes = &whole;
+        n_submeshes = 1;
+    }
+
+    mesh.submeshes = malloc(n_submeshes * sizeof(struct mesh_submesh));
+    if (mesh.submeshes == NULL) {
+        SFATAL("Failed to alloc memory for %zu submeshes", n_submeshes);
+        exit(1);
+    }
+    memcpy(mesh.submeshes, submeshes, n_submeshes * sizeof(struct mesh_submesh));
+    mesh.n_submeshes = n_submeshes;
+
+    /* reordering may drop unreferenced vertices so it runs before anything
+       looks at the vertices, the LODs & meshlets of every submesh are then
+       built from the reordered triangles */
+    if (indices != NULL) {
+        mesh_optimize(vertices, indices, mesh.submeshes, mesh.n_submeshes);
+
+        for (uint32_t i = 0; i < mesh.n_submeshes; i++) {
+            struct mesh_submesh *submesh = &mesh.submeshes[i];
+            mesh_compute_submesh_bounds(vertices->items, indices, submesh);
+
+            submesh->n_lods = mesh_generate_lods(vertices, indices,
+                                                 submesh->lods[0].index_offset,
+                                                 submesh->lods[0].index_count,
+                                                 submesh->lods);
+            if (submesh->n_lods > mesh.n_lods) mesh.n_lods = submesh->n_lods;
+
+            size_t n_meshlets = 0;
+            struct meshlet *meshlets = meshlet_build(vertices->items,
+                                                     indices->items,
+                                                     indices->item_size,
+                                                     submesh->lods[0].index_offset,
+                                                     submesh->lods[0].index_count,
+                                                     &n_meshlets);
+            submesh->meshlet_offset = mesh.n_meshlets;
+            submesh->n_meshlets = 0;
+            if (meshlets == NULL) continue;
+
+            struct meshlet *grown = realloc(mesh.meshlets,
+                                            (mesh.n_meshlets + n_meshlets) * sizeof(struct meshlet));
+            if (grown != NULL) {
+                memcpy(grown + mesh.n_meshlets, meshlets, n_meshlets * sizeof(struct meshlet));
+                mesh.meshlets = grown;
+                mesh.n_meshlets += n_meshlets;
+                submesh->n_meshlets = n_meshlets;
+            } else {
+                SERROR("Failed to alloc memory for %zu meshlets, drawing without culling", n_meshlets);
+            }
+            free(meshlets);
+        }
+        SDEBUG("Split %u submeshes into %u meshlets", mesh.n_submeshes, mesh.n_meshlets);
+    }
+
     mesh.vertices = vertices;
+    mesh_compute_bounds(vertices->items, vertices->len, &mesh.bounds);
+    if (indices == NULL) mesh.submeshes[0].bounds = mesh.bounds;
+
+    mesh.indices = indices;
+
+    struct mesh_pending pending = {
+        .mesh = mesh,
+        .format = SAGE_VERTEX_FORMAT,
+        .encoded = mesh_encode_vertices(vertices->items, vertices->len,
+                                        SAGE_VERTEX_FORMAT, &mesh.bounds),
+    };
+    if (pending.encoded == NULL) pending.format = VERTEX_FORMAT_FLOAT;
+
+    return pending;
+}
+
+struct mesh mesh_upload(struct mesh_pending *pending)
+{
+    struct mesh mesh = pending->mesh;
+    darray *vertices = mesh.vertices;
+    darray *indices = mesh.indices;
+    const void *encoded = pending->encoded ? pending->encoded : vertices->items;
 
     if (indices == NULL) {
-        mesh.buffer = mesh_gpu_create(vertices, NULL);
-        mesh.indices = NULL;
-        SINFO("Created a mesh with %u vertices and 0 indices", mesh.vertices->len);
+        mesh.buffer = mesh_gpu_create(encoded, vertices->len, pending->format, NULL, 0, 0);
+        SINFO("Created a mesh with %zu vertices and 0 indices", mesh.vertices->len);
     } else {
-        mesh.buffer = mesh_gpu_create(vertices, indices);
-        mesh.indices = indices;
-        SINFO("Created a mesh with %u vertices and %u indices",
+        mesh.buffer = mesh_gpu_create(encoded,
+                                      vertices->len,
+                                      pending->format,
+                                      indices->items,
+                                      indices->len,
+                                      indices->item_size);
+        SINFO("Created a mesh with %zu vertices (%zu bytes each), %zu indices and %u submeshes",
               mesh.vertices->len,
-              mesh.indices->len);
+              vertex_format_size(pending->format),
+              mesh.indices->len,
+              mesh.n_submeshes);
+    }
+
+    free(pending->encoded);
+    pending->encoded = NULL;
+
+    return mesh;
+}
+
+void mesh_pending_destroy(struct mesh_pending *pending)
+{
+    /* nothing was created on the GPU, so only the CPU side is freed */
+    struct mesh *mesh = &pending->mesh;
+    if (mesh->vertices) darray_free(mesh->vertices);
+    if (mesh->indices) darray_free(mesh->indices);
+    free(mesh->meshlets);
+    free(mesh->submeshes);
+    free(pending->encoded);
+    memset(pending, 0, sizeof(*pending));
+}
+
+struct mesh mesh_create_from_memory(const void *vertices,
+                                    size_t n_vertices,
+                                    enum vertex_format format,
+                                    const void *indices,
+                                    size_t n_indices,
+                                    size_t index_size,
+                                    struct aabb bounds,
+                                    const struct mesh_submesh *submeshes,
+                                    size_t n_submeshes,
+                                    const struct meshlet *meshlets,
+                                    size_t n_meshlets)
+{
+    SASSERT_MSG(vertices != NULL, "Creating a mesh must atleast have vertices");
+
+    struct mesh mesh;
+    mesh.vertices = NULL;
+    mesh.indices = NULL;
+    mesh.bounds = bounds;
+    mesh.material_library[0] = '\0';
+    mesh.streams = NULL;
+    mesh.stream_buffers = NULL;
+    mesh.n_stream_buffers = 0;
+
+    struct mesh_submesh whole = {0};
+    whole.bounds = bounds;
+    whole.lods[0] = (struct mesh_lod) { 0, n_indices, 0.0f };
+    whole.n_lods = 1;
+    if (n_submeshes == 0) {
+        submeshes = &whole;
+        n_submeshes = 1;
+    }
+
+    mesh.submeshes = malloc(n_submeshes * sizeof(struct mesh_submesh));
+    if (mesh.submeshes == NULL) {
+        SFATAL("Failed to alloc memory for %zu submeshes", n_submeshes);
+        exit(1);
+    }
+    memcpy(mesh.submeshes, submeshes, n_submeshes * sizeof(struct mesh_submesh));
+    mesh.n_submeshes = n_submeshes;
+
+    mesh.n_lods = 1;
+    for (uint32_t i = 0; i < mesh.n_submeshes; i++) {
+        SASSERT_MSG(mesh.submeshes[i].n_lods <= MESH_MAX_LODS, "Submesh has more LODs than MESH_MAX_LODS");
+        if (mesh.submeshes[i].n_lods == 0) mesh.submeshes[i].n_lods = 1;
+        if (mesh.submeshes[i].n_lods > mesh.n_lods) mesh.n_lods = mesh.submeshes[i].n_lods;
+    }
+
+    mesh.meshlets = NULL;
+    mesh.n_meshlets = 0;
+    if (n_meshlets > 0) {
+        mesh.meshlets = malloc(n_meshlets * sizeof(struct meshlet));
+        if (mesh.meshlets != NULL) {
+            memcpy(mesh.meshlets, meshlets, n_meshlets * sizeof(struct meshlet));
+            mesh.n_meshlets = n_meshlets;
+        } else {
+            SERROR("Failed to alloc memory for %zu meshlets, drawing without culling", n_meshlets);
+            for (uint32_t i = 0; i < mesh.n_submeshes; i++)
+                mesh.submeshes[i].n_meshlets = 0;
+        }
+    }
+
+    mesh.buffer = mesh_gpu_create(vertices, n_vertices, format, indices, n_indices, index_size);
+
+    SINFO("Created a mesh with %zu vertices, %zu indices and %zu submeshes from memory",
+          n_vertices, n_indices, n_submeshes);
+
+    return mesh;
+}
+
+struct mesh mesh_create_from_streams(const struct mesh_blob *blobs,
+                                     size_t n_blobs,
+                                     const struct mesh_stream_source *sources,
+                                     const struct mesh_submesh *submeshes,
+                                     size_t n_submeshes)
+{
+    SASSERT_MSG(n_submeshes > 0, "Creating a mesh from streams must atleast have a submesh");
+
+    struct mesh mesh = {0};
+    mesh.n_lods = 1;
+    mesh.submeshes = malloc(n_submeshes * sizeof(struct mesh_submesh));
+    mesh.streams = calloc(n_submeshes, sizeof(struct mesh_stream));
+    mesh.stream_buffers = calloc(n_blobs + 1, sizeof(uint32_t));
+    if (mesh.submeshes == NULL || mesh.streams == NULL || mesh.stream_buffers == NULL) {
+        SFATAL("Failed to alloc memory for %zu submeshes", n_submeshes);
+        exit(1);
+    }
+    memcpy(mesh.submeshes, submeshes, n_submeshes * sizeof(struct mesh_submesh));
+    mesh.n_submeshes = n_submeshes;
+
+    /* the blobs go into the buffers untouched, straight out of wherever the
+       caller has them (a mapped file most of the time) */
+    glGenBuffers(n_blobs, mesh.stream_buffers);
+    mesh.n_stream_buffers = n_blobs;
+    for (size_t i = 0; i < n_blobs; i++) {
+        gl_state_bind_buffer(GL_ARRAY_BUFFER, mesh.stream_buffers[i]);
+        glBufferData(GL_ARRAY_BUFFER, blobs[i].size, blobs[i].data, GL_STATIC_DRAW);
+    }
+
+    size_t n_vertices = 0;
+    size_t n_indices = 0;
+    for (uint32_t i = 0; i < mesh.n_submeshes; i++) {
+        const struct mesh_stream_source *source = &sources[i];
+        struct mesh_stream *stream = &mesh.streams[i];
+        struct mesh_submesh *submesh = &mesh.submeshes[i];
+
+        glGenVertexArrays(1, &stream->vao);
+        gl_state_bind_vertex_array(stream->vao);
+
+        for (uint32_t slot = 0; slot < MESH_ATTRIBUTE_COUNT; slot++) {
+            const struct mesh_attribute *attribute = &source->attributes[slot];
+            if (attribute->type == 0 || attribute->blob >= n_blobs) {
+                glDisableVertexAttribArray(slot);
+                continue;
+            }
+
+            gl_state_bind_buffer(GL_ARRAY_BUFFER, mesh.stream_buffers[attribute->blob]);
+            glVertexAttribPointer(slot, attribute->size, attribute->type, attribute->normalized,
+                                  attribute->stride, (void *) (uintptr_t) attribute->offset);
+            glEnableVertexAttribArray(slot);
+        }
+
+        /* the element buffer binding is part of the VAO */
+        if (source->index_type && source->index_blob < n_blobs) {
+            gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, mesh.stream_buffers[source->index_blob]);
+            stream->index_type = source->index_type;
+            stream->index_offset = source->index_offset;
+            stream->count = source->index_count;
+        } else {
+            stream->count = source->vertex_count;
+        }
+        mnf_mat4_copy((float (*)[4]) source->transform, stream->transform);
+
+        submesh->lods[0] = (struct mesh_lod) { 0, stream->index_type ? stream->count : 0, 0.0f };
+        submesh->n_lods = 1;
+        submesh->meshlet_offset = 0;
+        submesh->n_meshlets = 0;
+
+        /* the bounds of the mesh hold every submesh where it's placed */
+        struct aabb placed;
+        mesh_transform_bounds(&submesh->bounds, stream->transform, &placed);
+        if (i == 0) {
+            mesh.bounds = placed;
+        } else {
+            for (size_t axis = 0; axis < 3; axis++) {
+                mesh.bounds.min[axis] = fminf(mesh.bounds.min[axis], placed.min[axis]);
+                mesh.bounds.max[axis] = fmaxf(mesh.bounds.max[axis], placed.max[axis]);
+            }
+        }
+
+        n_vertices += source->vertex_count;
+        n_indices += stream->index_type ? stream->count : 0;
     }
 
+    gl_state_bind_vertex_array(0);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+    /* buffer only describes the mesh, the GL objects are in streams */
+    mesh.buffer.vao = mesh.streams[0].vao;
+    mesh.buffer.vertex_count = n_vertices;
+    mesh.buffer.index_count = n_indices;
+    mesh.buffer.format = VERTEX_FORMAT_FLOAT;
+
+    SINFO("Created a mesh with %zu vertices, %zu indices and %zu submeshes from %zu streams",
+          n_vertices, n_indices, n_submeshes, n_blobs);
+
     return mesh;
 }
 
@@ -176,9 +525,24 @@ struct mesh mesh_geometry_create_cube(void)
         darray_push(vertices, &vertex);
     }
 
-    mesh.buffer = mesh_gpu_create(vertices, NULL);
+    /* the skybox draws the cube with a shader that only takes float positions */
+    mesh.buffer = mesh_gpu_create(vertices->items, vertices->len, VERTEX_FORMAT_FLOAT, NULL, 0, 0);
     mesh.vertices = vertices;
     mesh.indices = NULL;
+    mesh.meshlets = NULL;
+    mesh.n_meshlets = 0;
+    mesh.n_lods = 1;
+    mesh.material_library[0] = '\0';
+    mesh.streams = NULL;
+    mesh.stream_buffers = NULL;
+    mesh.n_stream_buffers = 0;
+    mesh_compute_bounds(vertices->items, vertices->len, &mesh.bounds);
+
+    mesh.submeshes = calloc(1, sizeof(struct mesh_submesh));
+    if (mesh.submeshes == NULL) goto err;
+    mesh.submeshes[0].bounds = mesh.bounds;
+    mesh.submeshes[0].n_lods = 1;
+    mesh.n_submeshes = 1;
 
     return mesh;
 
@@ -190,6 +554,23 @@ err:
 
 void mesh_destroy(struct mesh *mesh)
 {
+    if (mesh->streams != NULL) {
+        for (uint32_t i = 0; i < mesh->n_submeshes; i++) {
+            gl_state_forget_vertex_array(mesh->streams[i].vao);
+            glDeleteVertexArrays(1, &mesh->streams[i].vao);
+        }
+        for (uint32_t i = 0; i < mesh->n_stream_buffers; i++)
+            gl_state_forget_buffer(mesh->stream_buffers[i]);
+        glDeleteBuffers(mesh->n_stream_buffers, mesh->stream_buffers);
+
+        free(mesh->streams);
+        free(mesh->stream_buffers);
+        mesh->streams = NULL;
+        mesh->stream_buffers = NULL;
+        mesh->n_stream_buffers = 0;
+        mesh->buffer = (struct mesh_gpu) {0};
+    }
+
     mesh_gpu_free(&(mesh->buffer));
 
     if (mesh->vertices) {
@@ -201,28 +582,417 @@ void mesh_destroy(struct mesh *mesh)
         darray_free(mesh->indices);
         mesh->indices = NULL;
     }
+
+    free(mesh->meshlets);
+    mesh->meshlets = NULL;
+    mesh->n_meshlets = 0;
+
+    free(mesh->submeshes);
+    mesh->submeshes = NULL;
+    mesh->n_submeshes = 0;
 }
 
 void mesh_bind(struct mesh mesh)
 {
-    glBindVertexArray(mesh.buffer.vao);
-    if (mesh.indices)
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.buffer.ibo);
+    /* the element buffer comes with the VAO */
+    gl_state_bind_vertex_array(mesh.buffer.vao);
 }
 
 void mesh_draw(struct mesh mesh)
 {
-    /* this check is probably expensive but is important for my sake */
-    int32_t bounded_vao = 0;
-    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &bounded_vao);
-    SASSERT_MSG((int32_t) mesh.buffer.vao == bounded_vao, "Attempted to draw a mesh without binding it first");
+    mesh_draw_lod(mesh, 0);
+}
 
-    if (mesh.indices) {
-        glDrawElements(GL_TRIANGLES, 
-                       mesh.buffer.index_count,
-                       GL_UNSIGNED_INT,
-                       0);
-    } else {
+void mesh_draw_lod(struct mesh mesh, uint32_t lod)
+{
+    /* every submesh of a streamed mesh has its own VAO */
+    if (mesh.streams != NULL) {
+        for (uint32_t i = 0; i < mesh.n_submeshes; i++)
+            mesh_draw_submesh(mesh, i, lod);
+        return;
+    }
+
+    SASSERT_MSG(gl_state_vertex_array() == mesh.buffer.vao,
+                "Attempted to draw a mesh without binding it first");
+
+    if (!mesh.buffer.ibo) {
+        glDrawArrays(GL_TRIANGLES, 0, mesh.buffer.vertex_count);
+        return;
+    }
+
+    if (mesh.n_submeshes == 1) {
+        mesh_draw_submesh(mesh, 0, lod);
+        return;
+    }
+
+    /* scratch for the ranges, grown to the most submeshes any mesh has */
+    static int32_t *counts = NULL;
+    static const void **offsets = NULL;
+    static size_t capacity = 0;
+
+    if (mesh.n_submeshes > capacity) {
+        int32_t *new_counts = realloc(counts, mesh.n_submeshes * sizeof(int32_t));
+        if (new_counts != NULL) counts = new_counts;
+        const void **new_offsets = realloc(offsets, mesh.n_submeshes * sizeof(void *));
+        if (new_offsets != NULL) offsets = new_offsets;
+
+        if (new_counts == NULL || new_offsets == NULL) {
+            SERROR("Failed to alloc memory for drawing %u submeshes", mesh.n_submeshes);
+            return;
+        }
+        capacity = mesh.n_submeshes;
+    }
+
+    size_t index_size = (mesh.buffer.index_type == GL_UNSIGNED_SHORT)
+        ? sizeof(uint16_t)
+        : sizeof(uint32_t);
+    for (uint32_t i = 0; i < mesh.n_submeshes; i++) {
+        const struct mesh_submesh *submesh = &mesh.submeshes[i];
+        uint32_t submesh_lod = (lod < submesh->n_lods) ? lod : submesh->n_lods - 1;
+        counts[i] = submesh->lods[submesh_lod].index_count;
+        offsets[i] = (const void *) (submesh->lods[submesh_lod].index_offset * index_size);
+    }
+
+    glMultiDrawElements(GL_TRIANGLES, counts, mesh.buffer.index_type, offsets, mesh.n_submeshes);
+}
+
+void mesh_draw_submesh(struct mesh mesh, uint32_t submesh, uint32_t lod)
+{
+    SASSERT_MSG(submesh < mesh.n_submeshes, "Attempted to draw a submesh the mesh doesn't have");
+
+    if (mesh.streams != NULL) {
+        const struct mesh_stream *stream = &mesh.streams[submesh];
+        gl_state_bind_vertex_array(stream->vao);
+        if (stream->index_type)
+            glDrawElements(GL_TRIANGLES, stream->count, stream->index_type,
+                           (void *) (uintptr_t) stream->index_offset);
+        else
+            glDrawArrays(GL_TRIANGLES, 0, stream->count);
+        return;
+    }
+
+    if (!mesh.buffer.ibo) {
         glDrawArrays(GL_TRIANGLES, 0, mesh.buffer.vertex_count);
+        return;
+    }
+
+    const struct mesh_submesh *part = &mesh.submeshes[submesh];
+    if (lod >= part->n_lods) lod = part->n_lods - 1;
+
+    size_t index_size = (mesh.buffer.index_type == GL_UNSIGNED_SHORT)
+        ? sizeof(uint16_t)
+        : sizeof(uint32_t);
+    glDrawElements(GL_TRIANGLES,
+                   part->lods[lod].index_count,
+                   mesh.buffer.index_type,
+                   (void *) (part->lods[lod].index_offset * index_size));
+}
+
+void mesh_draw_instanced(struct mesh mesh, uint32_t submesh, uint32_t lod, uint32_t n_instances)
+{
+    SASSERT_MSG(submesh < mesh.n_submeshes, "Attempted to draw a submesh the mesh doesn't have");
+
+    if (mesh.streams != NULL) {
+        const struct mesh_stream *stream = &mesh.streams[submesh];
+        SASSERT_MSG(gl_state_vertex_array() == stream->vao,
+                    "Attempted to draw a submesh without binding its VAO first");
+        if (stream->index_type)
+            glDrawElementsInstanced(GL_TRIANGLES, stream->count, stream->index_type,
+                                    (void *) (uintptr_t) stream->index_offset, n_instances);
+        else
+            glDrawArraysInstanced(GL_TRIANGLES, 0, stream->count, n_instances);
+        return;
+    }
+
+    SASSERT_MSG(gl_state_vertex_array() == mesh.buffer.vao,
+                "Attempted to draw a mesh without binding it first");
+
+    if (!mesh.buffer.ibo) {
+        glDrawArraysInstanced(GL_TRIANGLES, 0, mesh.buffer.vertex_count, n_instances);
+        return;
+    }
+
+    const struct mesh_submesh *part = &mesh.submeshes[submesh];
+    if (lod >= part->n_lods) lod = part->n_lods - 1;
+
+    size_t index_size = (mesh.buffer.index_type == GL_UNSIGNED_SHORT)
+        ? sizeof(uint16_t)
+        : sizeof(uint32_t);
+    glDrawElementsInstanced(GL_TRIANGLES,
+                            part->lods[lod].index_count,
+                            mesh.buffer.index_type,
+                            (void *) (part->lods[lod].index_offset * index_size),
+                            n_instances);
+}
+
+void mesh_draw_culled(struct mesh mesh,
+                      uint32_t submesh,
+                      uint32_t lod,
+                      const struct meshlet_view *view,
+                      struct meshlet_stats *stats)
+{
+    const struct mesh_submesh *part = &mesh.submeshes[submesh];
+    if (lod != 0 || part->n_meshlets == 0) {
+        mesh_draw_submesh(mesh, submesh, lod);
+        return;
+    }
+
+    /* scratch for the ranges, grown to the most meshlets any submesh has */
+    static int32_t *counts = NULL;
+    static const void **offsets = NULL;
+    static size_t capacity = 0;
+
+    if (part->n_meshlets > capacity) {
+        int32_t *new_counts = realloc(counts, part->n_meshlets * sizeof(int32_t));
+        if (new_counts != NULL) counts = new_counts;
+        const void **new_offsets = realloc(offsets, part->n_meshlets * sizeof(void *));
+        if (new_offsets != NULL) offsets = new_offsets;
+
+        if (new_counts == NULL || new_offsets == NULL) {
+            SERROR("Failed to alloc memory for culling %u meshlets", part->n_meshlets);
+            mesh_draw_submesh(mesh, submesh, lod);
+            return;
+        }
+        capacity = part->n_meshlets;
+    }
+
+    size_t index_size = (mesh.buffer.index_type == GL_UNSIGNED_SHORT)
+        ? sizeof(uint16_t)
+        : sizeof(uint32_t);
+    size_t n_ranges = meshlet_cull(&mesh.meshlets[part->meshlet_offset], part->n_meshlets,
+                                   view, index_size, counts, offsets, stats);
+    if (n_ranges == 0) return;
+
+    glMultiDrawElements(GL_TRIANGLES, counts, mesh.buffer.index_type, offsets, n_ranges);
+}
+
+float mesh_lod_error(const struct mesh *mesh, uint32_t lod)
+{
+    float error = 0.0f;
+    for (uint32_t i = 0; i < mesh->n_submeshes; i++) {
+        const struct mesh_submesh *submesh = &mesh->submeshes[i];
+        uint32_t submesh_lod = (lod < submesh->n_lods) ? lod : submesh->n_lods - 1;
+        if (submesh->lods[submesh_lod].error > error)
+            error = submesh->lods[submesh_lod].error;
+    }
+
+    return error;
+}
+
+size_t vertex_format_size(enum vertex_format format)
+{
+    switch (format) {
+    case VERTEX_FORMAT_FLOAT: return sizeof(struct vertex);
+    case VERTEX_FORMAT_PACKED: return sizeof(struct vertex_packed);
+    case VERTEX_FORMAT_QUANTIZED: return sizeof(struct vertex_quantized);
+    }
+
+    SASSERT_MSG(false, "Unknown vertex format");
+    return 0;
+}
+
+void *mesh_encode_vertices(const struct vertex *vertices,
+                           size_t n_vertices,
+                           enum vertex_format format,
+                           const struct aabb *bounds)
+{
+    size_t size = vertex_format_size(format);
+    uint8_t *encoded = malloc(size * n_vertices + 1);
+    if (encoded == NULL) {
+        SERROR("Failed to alloc memory for encoding %zu vertices", n_vertices);
+        return NULL;
+    }
+
+    vec3 extent;
+    mnf_vec3_sub((float *) bounds->max, (float *) bounds->min, extent);
+
+    for (size_t i = 0; i < n_vertices; i++) {
+        const struct vertex *vertex = &vertices[i];
+
+        switch (format) {
+        case VERTEX_FORMAT_FLOAT:
+            memcpy(encoded + i * size, vertex, sizeof(struct vertex));
+            break;
+
+        case VERTEX_FORMAT_PACKED: {
+            struct vertex_packed *packed = (struct vertex_packed *) encoded + i;
+            mnf_vec3_copy((float *) vertex->pos, packed->pos);
+            mesh_encode_octahedral(vertex->normal, packed->normal);
+            packed->uv[0] = mesh_float_to_half(vertex->uv[0]);
+            packed->uv[1] = mesh_float_to_half(vertex->uv[1]);
+            break;
+        }
+
+        case VERTEX_FORMAT_QUANTIZED: {
+            struct vertex_quantized *quantized = (struct vertex_quantized *) encoded + i;
+            for (size_t axis = 0; axis < 3; axis++)
+                quantized->pos[axis] = mesh_quantize_unorm16(vertex->pos[axis],
+                                                             bounds->min[axis],
+                                                             extent[axis]);
+            quantized->pos[3] = 0;
+            mesh_encode_octahedral(vertex->normal, quantized->normal);
+            quantized->uv[0] = mesh_float_to_half(vertex->uv[0]);
+            quantized->uv[1] = mesh_float_to_half(vertex->uv[1]);
+            break;
+        }
+        }
+    }
+
+    return encoded;
+}
+
+void mesh_dequantization(const struct mesh *mesh, vec3 scale, vec3 bias)
+{
+    if (mesh->buffer.format == VERTEX_FORMAT_QUANTIZED) {
+        /* unorm16 arrives in the shader as [0, 1] */
+        mnf_vec3_sub((float *) mesh->bounds.max, (float *) mesh->bounds.min, scale);
+        mnf_vec3_copy((float *) mesh->bounds.min, bias);
+    } else {
+        mnf_vec3_copy(MNF_ONE_VECTOR, scale);
+        mnf_vec3_copy(MNF_ZERO_VECTOR, bias);
+    }
+}
+
+/* Octahedral normal encoding (Cigolle et al. 2014): the unit sphere is
+   projected onto an octahedron that's unfolded into a square, the lower half
+   folded over the corners. Decoded by oct_decode() in phong.glsl */
+static void mesh_encode_octahedral(const float *normal, int16_t out[2])
+{
+    float sum = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    if (sum == 0.0f) {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+
+    float x = normal[0] / sum;
+    float y = normal[1] / sum;
+    if (normal[2] < 0.0f) {
+        float folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = folded_x;
+        y = folded_y;
+    }
+
+    out[0] = (int16_t) lroundf(fmaxf(-1.0f, fminf(1.0f, x)) * 32767.0f);
+    out[1] = (int16_t) lroundf(fmaxf(-1.0f, fminf(1.0f, y)) * 32767.0f);
+}
+
+/* Rounds to the nearest half float, overflowing to infinity & flushing values
+   too small for a half's subnormals to zero */
+static uint16_t mesh_float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint16_t sign = (uint16_t) ((bits >> 16) & 0x8000);
+    int32_t exponent = (int32_t) ((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    /* nan & infinity */
+    if (((bits >> 23) & 0xFF) == 0xFF)
+        return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+
+    if (exponent >= 31) return sign | 0x7C00;
+
+    if (exponent <= 0) {
+        if (exponent < -10) return sign;
+        /* subnormal half, the implicit one becomes explicit */
+        mantissa |= 0x800000;
+        uint32_t shift = (uint32_t) (14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1))) half++;
+        return sign | (uint16_t) half;
+    }
+
+    uint32_t half = ((uint32_t) exponent << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1FFF;
+    /* round to nearest even, a carry into the exponent is still correct */
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) half++;
+
+    return sign | (uint16_t) half;
+}
+
+static uint16_t mesh_quantize_unorm16(float value, float min, float extent)
+{
+    if (extent <= 0.0f) return 0;
+
+    float normalized = (value - min) / extent;
+    normalized = fmaxf(0.0f, fminf(1.0f, normalized));
+
+    return (uint16_t) lroundf(normalized * 65535.0f);
+}
+
+static void mesh_compute_bounds(const struct vertex *vertices, size_t n_vertices, struct aabb *bounds)
+{
+    if (n_vertices == 0) {
+        mnf_vec3_copy(MNF_ZERO_VECTOR, bounds->min);
+        mnf_vec3_copy(MNF_ZERO_VECTOR, bounds->max);
+        return;
+    }
+
+    mnf_vec3_copy((float *) vertices[0].pos, bounds->min);
+    mnf_vec3_copy((float *) vertices[0].pos, bounds->max);
+    for (size_t i = 1; i < n_vertices; i++) {
+        for (size_t axis = 0; axis < 3; axis++) {
+            float value = vertices[i].pos[axis];
+            if (value < bounds->min[axis]) bounds->min[axis] = value;
+            if (value > bounds->max[axis]) bounds->max[axis] = value;
+        }
+    }
+}
+
+/* Bounds of the vertices LOD 0 of a submesh uses, coarser LODs only use a
+   subset of them */
+static void mesh_compute_submesh_bounds(const struct vertex *vertices,
+                                        const darray *indices,
+                                        struct mesh_submesh *submesh)
+{
+    const struct mesh_lod *range = &submesh->lods[0];
+    if (range->index_count == 0) {
+        mnf_vec3_copy(MNF_ZERO_VECTOR, submesh->bounds.min);
+        mnf_vec3_copy(MNF_ZERO_VECTOR, submesh->bounds.max);
+        return;
+    }
+
+    for (uint32_t i = 0; i < range->index_count; i++) {
+        size_t at = range->index_offset + i;
+        uint32_t index = (indices->item_size == sizeof(uint16_t))
+            ? ((const uint16_t *) indices->items)[at]
+            : ((const uint32_t *) indices->items)[at];
+        const float *pos = vertices[index].pos;
+
+        if (i == 0) {
+            mnf_vec3_copy((float *) pos, submesh->bounds.min);
+            mnf_vec3_copy((float *) pos, submesh->bounds.max);
+            continue;
+        }
+
+        for (size_t axis = 0; axis < 3; axis++) {
+            if (pos[axis] < submesh->bounds.min[axis]) submesh->bounds.min[axis] = pos[axis];
+            if (pos[axis] > submesh->bounds.max[axis]) submesh->bounds.max[axis] = pos[axis];
+        }
+    }
+}
+
+/* Bounds around the 8 corners of a box after they're transformed */
+static void mesh_transform_bounds(const struct aabb *bounds, mat4 transform, struct aabb *out)
+{
+    for (size_t corner = 0; corner < 8; corner++) {
+        vec4 local = {
+            (corner & 1) ? bounds->max[0] : bounds->min[0],
+            (corner & 2) ? bounds->max[1] : bounds->min[1],
+            (corner & 4) ? bounds->max[2] : bounds->min[2],
+            1.0f
+        };
+        vec4 placed;
+        mnf_mat4_mul_vec4(transform, local, placed);
+
+        for (size_t axis = 0; axis < 3; axis++) {
+            if (corner == 0 || placed[axis] < out->min[axis]) out->min[axis] = placed[axis];
+            if (corner == 0 || placed[axis] > out->max[axis]) out->max[axis] = placed[axis];
+        }
     }
 }
@@ -6,6 +6,7 @@
 
 #include "mnf/mnf_types.h"
 #include "darray.h"
+#include "meshlet.h"
 
 struct vertex {
     vec3 pos;
@@ -13,32 +14,235 @@ struct vertex {
     vec2 uv;
 };
 
+/* Layouts vertices can be stored in on the GPU, the CPU side copy of a mesh
+   is always struct vertex */
+enum vertex_format {
+    VERTEX_FORMAT_FLOAT = 1,    /* struct vertex, 32 bytes */
+    VERTEX_FORMAT_PACKED,       /* struct vertex_packed, 20 bytes */
+    VERTEX_FORMAT_QUANTIZED,    /* struct vertex_quantized, 16 bytes */
+};
+
+/* Float positions, octahedral encoded normals & half float uvs */
+struct vertex_packed {
+    vec3 pos;
+    int16_t normal[2];
+    uint16_t uv[2];
+};
+
+/* Same as vertex_packed but the positions are unorm16 quantized against the
+   bounds of the mesh, decoded with the scale & bias of mesh_dequantization() */
+struct vertex_quantized {
+    uint16_t pos[4];    /* w is padding to keep the normal 4 byte aligned */
+    int16_t normal[2];
+    uint16_t uv[2];
+};
+
+/* Most levels of detail a mesh can have, LOD 0 being the full mesh */
+#define MESH_MAX_LODS 8
+
+/* A level of detail drawn from a range of the shared index buffer */
+struct mesh_lod {
+    uint32_t index_offset;
+    uint32_t index_count;   /* 0 for meshes drawn without indices */
+    float error;            /* how far the surface strays from LOD 0, in model space */
+};
+
+/* Axis aligned bounding box in model space */
+struct aabb {
+    vec3 min;
+    vec3 max;
+};
+
+#define MESH_NAME_MAX_SIZE 64
+#define MESH_PATH_MAX_SIZE 256
+
+/* A part of a mesh drawn with its own material. Every LOD of a submesh is
+   its own range of the shared index buffer, a submesh with fewer LODs than
+   the mesh keeps drawing its coarsest one */
+struct mesh_submesh {
+    char name[MESH_NAME_MAX_SIZE];
+    char material[MESH_NAME_MAX_SIZE];  /* in the material library, empty if none */
+    struct aabb bounds;
+    struct mesh_lod lods[MESH_MAX_LODS];
+    uint32_t n_lods;
+    uint32_t meshlet_offset;            /* meshlets of LOD 0 */
+    uint32_t n_meshlets;
+};
+
 struct mesh_gpu {
     uint32_t vao;
     uint32_t vbo;
     uint32_t ibo;
     uint32_t vertex_count;
     uint32_t index_count;
+    /* GL_UNSIGNED_SHORT or GL_UNSIGNED_INT depending on the size of the
+       indices, unused if there is no ibo */
+    uint32_t index_type;
+    enum vertex_format format;
 };
 
+/* Vertex attributes every VAO is set up with, matching the layout locations
+   of the shaders */
+enum mesh_attribute_slot {
+    MESH_ATTRIBUTE_POSITION = 0,
+    MESH_ATTRIBUTE_NORMAL,
+    MESH_ATTRIBUTE_UV,
+    MESH_ATTRIBUTE_COUNT,
+};
+
+/* A block of memory uploaded as-is into its own GL buffer */
+struct mesh_blob {
+    const void *data;
+    size_t size;
+};
+
+/* An attribute read straight out of a blob, 'type' is a GL component type
+   (GL_FLOAT, GL_UNSIGNED_SHORT, ...) or 0 if the attribute is missing, in
+   which case the shader sees zeros */
+struct mesh_attribute {
+    uint32_t blob;
+    uint64_t offset;    /* bytes into the blob */
+    uint32_t stride;    /* bytes between two vertices */
+    uint32_t size;      /* components */
+    uint32_t type;
+    bool normalized;
+};
+
+/* Where a submesh of a mesh created by mesh_create_from_streams() reads its
+   vertices & indices from before it's placed by 'transform' */
+struct mesh_stream_source {
+    struct mesh_attribute attributes[MESH_ATTRIBUTE_COUNT];
+    uint32_t vertex_count;
+    uint32_t index_blob;
+    uint64_t index_offset;  /* bytes into the blob */
+    uint32_t index_type;    /* GL_UNSIGNED_BYTE, _SHORT or _INT, 0 if not indexed */
+    uint32_t index_count;
+    mat4 transform;
+};
+
+/* The GL state a submesh of a streamed mesh is drawn with */
+struct mesh_stream {
+    uint32_t vao;
+    uint32_t index_type;
+    uint64_t index_offset;
+    uint32_t count;         /* indices, or vertices if it isn't indexed */
+    mat4 transform;
+};
+
+/* vertices & indices are the CPU side copies of what's in the buffers, both
+   are NULL if the mesh was created straight from memory it doesn't own. The
+   LOD 0 ranges of the submeshes follow each other at the start of the index
+   buffer, their coarser LODs come after. LOD 0 is also split into meshlets
+   that are culled before drawing */
 struct mesh {
     struct mesh_gpu buffer;
     darray *vertices;
     darray *indices;
+    struct aabb bounds;
+    struct mesh_submesh *submeshes;     /* atleast one */
+    uint32_t n_submeshes;
+    uint32_t n_lods;                    /* most LODs of any submesh */
+    struct meshlet *meshlets;
+    uint32_t n_meshlets;
+    char material_library[MESH_PATH_MAX_SIZE]; /* .mtl the materials are from, empty if none */
+    /* per submesh VAOs into buffers shared by the submeshes, NULL unless
+       created by mesh_create_from_streams() */
+    struct mesh_stream *streams;
+    uint32_t *stream_buffers;
+    uint32_t n_stream_buffers;
 };
 
+/* A mesh whose CPU side work is done but that has no GL objects yet. Made by
+   mesh_prepare() on any thread & turned into a mesh by mesh_upload() on the
+   one with the GL context */
+struct mesh_pending {
+    struct mesh mesh;
+    void *encoded;              /* vertices in 'format', NULL if they're the float ones */
+    enum vertex_format format;
+};
 
 /* TODO: documentation */
 
 /* ... */
 struct mesh mesh_geometry_create_cube(void);
-/* ... */
-struct mesh mesh_create(darray *vertices, darray *indices);
+/* Uploads the vertices & indices in SAGE_VERTEX_FORMAT. The submeshes only
+   need their name, material & LOD 0 range set, without any the whole mesh is
+   one submesh. Indexed meshes are first reordered in place by mesh_optimize()
+   within each submesh, then every submesh gets its LODs appended by
+   mesh_generate_lods() and its LOD 0 split by meshlet_build() */
+struct mesh mesh_create(darray *vertices,
+                        darray *indices,
+                        const struct mesh_submesh *submeshes,
+                        size_t n_submeshes);
+/* The part of mesh_create() that doesn't touch GL: optimizing, LODs,
+   meshlets, bounds & encoding the vertices. Takes ownership of the darrays */
+struct mesh_pending mesh_prepare(darray *vertices,
+                                 darray *indices,
+                                 const struct mesh_submesh *submeshes,
+                                 size_t n_submeshes);
+/* Creates the buffers of a prepared mesh, the rest of mesh_create() */
+struct mesh mesh_upload(struct mesh_pending *pending);
+/* Frees a prepared mesh that never got uploaded */
+void mesh_pending_destroy(struct mesh_pending *pending);
+/* Uploads vertices already encoded in 'format' & indices (uint16_t or uint32_t
+   depending on index_size, can be NULL) without keeping a copy, used for
+   mapped caches. Without any submeshes the whole index buffer is the LOD 0
+   of a single one, the submeshes & meshlets are copied */
+struct mesh mesh_create_from_memory(const void *vertices,
+                                    size_t n_vertices,
+                                    enum vertex_format format,
+                                    const void *indices,
+                                    size_t n_indices,
+                                    size_t index_size,
+                                    struct aabb bounds,
+                                    const struct mesh_submesh *submeshes,
+                                    size_t n_submeshes,
+                                    const struct meshlet *meshlets,
+                                    size_t n_meshlets);
+/* Uploads every blob into a GL buffer without touching its contents & sets
+   up a VAO per submesh reading from them as its source describes, so files
+   whose buffers are already laid out for the GPU (glTF) skip building struct
+   vertex arrays. Every submesh is drawn at its own transform & only has LOD
+   0, there are no meshlets & no CPU side copies */
+struct mesh mesh_create_from_streams(const struct mesh_blob *blobs,
+                                     size_t n_blobs,
+                                     const struct mesh_stream_source *sources,
+                                     const struct mesh_submesh *submeshes,
+                                     size_t n_submeshes);
+/* Size in bytes of a single vertex in 'format' */
+size_t vertex_format_size(enum vertex_format format);
+/* Encodes vertices into 'format', positions are quantized against 'bounds'.
+   Returns a malloc'd buffer the caller frees, NULL on failure */
+void *mesh_encode_vertices(const struct vertex *vertices,
+                           size_t n_vertices,
+                           enum vertex_format format,
+                           const struct aabb *bounds);
+/* Scale & bias turning the position attribute back into model space, the
+   identity for formats that aren't quantized */
+void mesh_dequantization(const struct mesh *mesh, vec3 scale, vec3 bias);
 /* ... */
 void mesh_destroy(struct mesh *mesh);
 /* ... */
 void mesh_bind(struct mesh mesh);
-/* ... */
+/* Draws LOD 0 */
 void mesh_draw(struct mesh mesh);
+/* Draws a LOD of every submesh with a single draw, each clamped to the LODs
+   the submesh has */
+void mesh_draw_lod(struct mesh mesh, uint32_t lod);
+/* Draws a LOD of a single submesh */
+void mesh_draw_submesh(struct mesh mesh, uint32_t submesh, uint32_t lod);
+/* Draws a LOD of a submesh 'n_instances' times with a single draw, the VAO
+   of the submesh bound with its instance attributes set */
+void mesh_draw_instanced(struct mesh mesh, uint32_t submesh, uint32_t lod, uint32_t n_instances);
+/* Draws a LOD of a submesh, LOD 0 only drawing the meshlets that survive
+   culling against 'view' with a single glMultiDrawElements. The results add
+   up in 'stats' */
+void mesh_draw_culled(struct mesh mesh,
+                      uint32_t submesh,
+                      uint32_t lod,
+                      const struct meshlet_view *view,
+                      struct meshlet_stats *stats);
+/* Largest error of a LOD over every submesh */
+float mesh_lod_error(const struct mesh *mesh, uint32_t lod);
 
 #endif /* SAGE_MESH_H */
@@ -0,0 +1,331 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#include "mesh_cache.h"
+#include "config.h"
+#include "file.h"
+#include "hash.h"
+#include "logger.h"
+#include "mnf/mnf_vector.h"
+
+/* blobs start on this boundary so they can be read in place */
+#define SMESH_ALIGNMENT 16
+
+static bool mesh_cache_is_fresh(const char *path, const struct smesh_header *header);
+static bool mesh_cache_hash_source(const char *path, uint64_t *hash);
+static bool mesh_cache_range_valid(uint64_t offset, uint64_t bytes, size_t size);
+static bool mesh_cache_indices_valid(const struct smesh_header *header, const uint8_t *base);
+static bool mesh_cache_submeshes_valid(const struct smesh_header *header, const uint8_t *base);
+static size_t smesh_align(size_t offset);
+static double mesh_cache_elapsed_ms(struct timespec start);
+
+bool mesh_cache_load(const char *path, struct mesh *mesh)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct mesh_cache_file cache;
+    if (!mesh_cache_open(path, &cache)) return false;
+
+    *mesh = mesh_cache_upload(&cache);
+
+    SINFO("Loaded '%s' from the mesh cache in %.2f ms", path, mesh_cache_elapsed_ms(start));
+    return true;
+}
+
+bool mesh_cache_open(const char *path, struct mesh_cache_file *cache)
+{
+    char cache_path[SMESH_PATH_BUFFER_SIZE];
+    if (!mesh_cache_path(path, cache_path)) return false;
+
+    struct mapped_file *file = &cache->file;
+    if (!file_map(cache_path, file)) return false;
+
+    if (!mesh_cache_validate(file->data, file->size, cache_path)) goto miss;
+
+    const struct smesh_header *header = file->data;
+    if (!mesh_cache_is_fresh(path, header)) {
+        SINFO("Mesh cache '%s' is stale, reparsing '%s'", cache_path, path);
+        goto miss;
+    }
+
+    return true;
+
+miss:
+    file_unmap(file);
+    return false;
+}
+
+struct mesh mesh_cache_upload(struct mesh_cache_file *cache)
+{
+    struct mesh mesh = mesh_cache_create(cache->file.data);
+
+    /* glBufferData has copied the data so the mapping isn't needed anymore */
+    mesh_cache_close(cache);
+
+    return mesh;
+}
+
+void mesh_cache_close(struct mesh_cache_file *cache)
+{
+    file_unmap(&cache->file);
+}
+
+bool mesh_cache_validate(const void *data, size_t size, const char *name)
+{
+    const struct smesh_header *header = data;
+    if (size < sizeof(struct smesh_header) ||
+        header->magic != SMESH_MAGIC ||
+        header->version != SMESH_VERSION ||
+        header->vertex_format != SAGE_VERTEX_FORMAT ||
+        header->vertex_size != vertex_format_size(SAGE_VERTEX_FORMAT)) {
+        SDEBUG("Mesh cache '%s' is from another version or configuration of sage", name);
+        return false;
+    }
+
+    bool indexed = header->index_size == sizeof(uint16_t) || header->index_size == sizeof(uint32_t);
+    if (!indexed && (header->index_size != 0 || header->index_count != 0)) {
+        SWARN("Mesh cache '%s' is corrupt", name);
+        return false;
+    }
+
+    /* the counts are 32-bit so the sizes can't overflow, the offsets can */
+    uint64_t vertex_bytes = (uint64_t) header->vertex_count * header->vertex_size;
+    uint64_t index_bytes = (uint64_t) header->index_count * header->index_size;
+    uint64_t submesh_bytes = (uint64_t) header->n_submeshes * sizeof(struct mesh_submesh);
+    uint64_t meshlet_bytes = (uint64_t) header->n_meshlets * sizeof(struct meshlet);
+    if (!mesh_cache_range_valid(header->vertex_offset, vertex_bytes, size) ||
+        !mesh_cache_range_valid(header->index_offset, index_bytes, size) ||
+        !mesh_cache_range_valid(header->submesh_offset, submesh_bytes, size) ||
+        !mesh_cache_range_valid(header->meshlet_offset, meshlet_bytes, size) ||
+        !mesh_cache_indices_valid(header, data) ||
+        !mesh_cache_submeshes_valid(header, data)) {
+        SWARN("Mesh cache '%s' is truncated or corrupt", name);
+        return false;
+    }
+
+    return true;
+}
+
+struct mesh mesh_cache_create(const void *data)
+{
+    const struct smesh_header *header = data;
+
+    struct aabb bounds;
+    memcpy(bounds.min, header->aabb_min, sizeof(bounds.min));
+    memcpy(bounds.max, header->aabb_max, sizeof(bounds.max));
+
+    const uint8_t *base = data;
+    struct mesh mesh = mesh_create_from_memory(base + header->vertex_offset,
+                                               header->vertex_count,
+                                               header->vertex_format,
+                                               header->index_size ? base + header->index_offset : NULL,
+                                               header->index_count,
+                                               header->index_size,
+                                               bounds,
+                                               (const struct mesh_submesh *) (base + header->submesh_offset),
+                                               header->n_submeshes,
+                                               (const struct meshlet *) (base + header->meshlet_offset),
+                                               header->n_meshlets);
+
+    memcpy(mesh.material_library, header->material_library, MESH_PATH_MAX_SIZE);
+    mesh.material_library[MESH_PATH_MAX_SIZE - 1] = '\0';
+
+    return mesh;
+}
+
+bool mesh_cache_store(const char *path, const struct mesh *mesh)
+{
+    char cache_path[SMESH_PATH_BUFFER_SIZE];
+    if (!mesh_cache_path(path, cache_path)) return false;
+    if (!file_make_dir(SAGE_CACHE_DIR)) return false;
+
+    size_t size;
+    void *data = mesh_cache_serialize(path, mesh, &size);
+    if (data == NULL) return false;
+
+    bool written = file_write_atomic(cache_path, data, size);
+    free(data);
+
+    if (written) SINFO("Wrote mesh cache '%s'", cache_path);
+    return written;
+}
+
+void *mesh_cache_serialize(const char *path, const struct mesh *mesh, size_t *out_size)
+{
+    if (mesh->vertices == NULL) return NULL;
+
+    struct file_info info;
+    uint64_t source_hash;
+    if (!file_stat(path, &info) || !mesh_cache_hash_source(path, &source_hash))
+        return NULL;
+
+    const darray *vertices = mesh->vertices;
+    const darray *indices = mesh->indices;
+
+    struct smesh_header header = {
+        .magic = SMESH_MAGIC,
+        .version = SMESH_VERSION,
+        .source_size = info.size,
+        .source_mtime_sec = info.mtime_sec,
+        .source_mtime_nsec = info.mtime_nsec,
+        .source_hash = source_hash,
+        .vertex_format = SAGE_VERTEX_FORMAT,
+        .vertex_size = vertex_format_size(SAGE_VERTEX_FORMAT),
+        .vertex_count = vertices->len,
+        .index_size = indices ? indices->item_size : 0,
+        .index_count = indices ? indices->len : 0,
+    };
+    memcpy(header.aabb_min, mesh->bounds.min, sizeof(header.aabb_min));
+    memcpy(header.aabb_max, mesh->bounds.max, sizeof(header.aabb_max));
+    header.n_submeshes = mesh->n_submeshes;
+    header.n_meshlets = mesh->n_meshlets;
+    /* the rest of the header is zeroed, the name stays terminated */
+    memcpy(header.material_library, mesh->material_library,
+           strnlen(mesh->material_library, MESH_PATH_MAX_SIZE - 1));
+
+    size_t vertex_bytes = vertices->len * header.vertex_size;
+    size_t index_bytes = indices ? indices->len * indices->item_size : 0;
+    size_t submesh_bytes = mesh->n_submeshes * sizeof(struct mesh_submesh);
+    size_t meshlet_bytes = mesh->n_meshlets * sizeof(struct meshlet);
+    header.vertex_offset = smesh_align(sizeof(header));
+    header.index_offset = smesh_align(header.vertex_offset + vertex_bytes);
+    header.submesh_offset = smesh_align(header.index_offset + index_bytes);
+    header.meshlet_offset = smesh_align(header.submesh_offset + submesh_bytes);
+    size_t size = header.meshlet_offset + meshlet_bytes;
+
+    uint8_t *data = calloc(1, size);
+    void *encoded = mesh_encode_vertices(vertices->items, vertices->len,
+                                         SAGE_VERTEX_FORMAT, &mesh->bounds);
+    if (data == NULL || encoded == NULL) {
+        SERROR("Failed to alloc memory for the mesh cache of '%s'", path);
+        free(data);
+        free(encoded);
+        return NULL;
+    }
+
+    memcpy(data, &header, sizeof(header));
+    memcpy(data + header.vertex_offset, encoded, vertex_bytes);
+    free(encoded);
+    if (indices) memcpy(data + header.index_offset, indices->items, index_bytes);
+    memcpy(data + header.submesh_offset, mesh->submeshes, submesh_bytes);
+    if (mesh->n_meshlets) memcpy(data + header.meshlet_offset, mesh->meshlets, meshlet_bytes);
+
+    *out_size = size;
+    return data;
+}
+
+/* Named by the file & a hash of its whole path, so res/bowl.obj is cached as
+   <cache dir>/bowl.obj.<hash>.smesh & files of the same name in different
+   directories don't share a cache */
+bool mesh_cache_path(const char *path, char out[SMESH_PATH_BUFFER_SIZE])
+{
+    const char *name = path;
+    for (const char *c = path; *c != '\0'; c++)
+        if (*c == '/' || *c == '\\') name = c + 1;
+
+    uint64_t path_hash = hash_64(path, strlen(path), 0);
+    int n = snprintf(out, SMESH_PATH_BUFFER_SIZE, "%s/%s.%016" PRIx64 ".smesh",
+                     SAGE_CACHE_DIR, name, path_hash);
+    return n > 0 && n < SMESH_PATH_BUFFER_SIZE;
+}
+
+/* The size & mtime are checked first since they are free, the content hash
+   only decides when the file was touched without its size changing */
+static bool mesh_cache_is_fresh(const char *path, const struct smesh_header *header)
+{
+    struct file_info info;
+    if (!file_stat(path, &info)) return false;
+    if (info.size != header->source_size) return false;
+
+    if (info.mtime_sec == header->source_mtime_sec &&
+        info.mtime_nsec == header->source_mtime_nsec)
+        return true;
+
+    uint64_t hash;
+    if (!mesh_cache_hash_source(path, &hash)) return false;
+
+    return hash == header->source_hash;
+}
+
+static bool mesh_cache_hash_source(const char *path, uint64_t *hash)
+{
+    struct mapped_file file;
+    if (!file_map(path, &file)) return false;
+
+    *hash = hash_64(file.data, file.size, SMESH_MAGIC);
+    file_unmap(&file);
+
+    return true;
+}
+
+/* Whether 'bytes' from 'offset' on are within the file, without wrapping */
+static bool mesh_cache_range_valid(uint64_t offset, uint64_t bytes, size_t size)
+{
+    return offset <= size && bytes <= size - offset;
+}
+
+/* Every index has to be within the vertices & every meshlet within the
+   indices, otherwise a corrupt cache would make the GPU read past its buffers */
+static bool mesh_cache_indices_valid(const struct smesh_header *header, const uint8_t *base)
+{
+    if (header->index_size != 0 && header->index_offset % header->index_size != 0) return false;
+
+    if (header->index_size == sizeof(uint16_t)) {
+        const uint16_t *indices = (const void *) (base + header->index_offset);
+        for (uint32_t i = 0; i < header->index_count; i++)
+            if (indices[i] >= header->vertex_count) return false;
+    } else if (header->index_size == sizeof(uint32_t)) {
+        const uint32_t *indices = (const void *) (base + header->index_offset);
+        for (uint32_t i = 0; i < header->index_count; i++)
+            if (indices[i] >= header->vertex_count) return false;
+    }
+
+    const struct meshlet *meshlets = (const void *) (base + header->meshlet_offset);
+    for (uint32_t i = 0; i < header->n_meshlets; i++) {
+        if ((uint64_t) meshlets[i].index_offset + meshlets[i].index_count > header->index_count)
+            return false;
+    }
+
+    return true;
+}
+
+/* Every LOD range has to be within the index buffer & every meshlet range
+   within the meshlets, otherwise a corrupt cache would draw out of bounds */
+static bool mesh_cache_submeshes_valid(const struct smesh_header *header, const uint8_t *base)
+{
+    if (header->n_submeshes == 0) return false;
+
+    const struct mesh_submesh *submeshes = (const void *) (base + header->submesh_offset);
+    for (uint32_t i = 0; i < header->n_submeshes; i++) {
+        const struct mesh_submesh *submesh = &submeshes[i];
+        if (submesh->n_lods > MESH_MAX_LODS) return false;
+        if ((uint64_t) submesh->meshlet_offset + submesh->n_meshlets > header->n_meshlets)
+            return false;
+
+        for (uint32_t lod = 0; lod < submesh->n_lods; lod++) {
+            const struct mesh_lod *range = &submesh->lods[lod];
+            if ((uint64_t) range->index_offset + range->index_count > header->index_count)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static size_t smesh_align(size_t offset)
+{
+    return (offset + SMESH_ALIGNMENT - 1) & ~((size_t) SMESH_ALIGNMENT - 1);
+}
+
+static double mesh_cache_elapsed_ms(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start.tv_sec) * 1000.0 +
+           (double) (now.tv_nsec - start.tv_nsec) / 1000000.0;
+}
@@ -0,0 +1,98 @@
+#ifndef SAGE_MESH_CACHE_H
+#define SAGE_MESH_CACHE_H
+
+#include <stdbool.h>
+
+#include "mesh.h"
+#include "file.h"
+
+/*
+ * Binary mesh cache (.smesh)
+ *
+ * Parsed meshes are written into SAGE_CACHE_DIR as a header followed by the
+ * raw vertex & index data, exactly how they are laid out in the GPU buffers
+ * (vertices encoded in SAGE_VERTEX_FORMAT), then the submeshes & the meshlets
+ * of their LOD 0.
+ * The header records the size, modification time & content hash of the source
+ * file so editing the source invalidates its cache on the next load.
+ */
+
+#define SMESH_MAGIC   0x48534D53 /* "SMSH" */
+/* Bumped whenever the format or what the loaders output changes */
+#define SMESH_VERSION 7
+
+#define SMESH_PATH_BUFFER_SIZE 1024
+
+struct smesh_header {
+    uint32_t magic;
+    uint32_t version;
+
+    /* source file the cache was built from */
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t source_hash;
+
+    uint32_t vertex_format; /* enum vertex_format */
+    uint32_t vertex_size;
+    uint32_t vertex_count;
+    uint32_t index_size;    /* 0 if the mesh has no indices */
+    uint32_t index_count;
+    uint32_t reserved;
+
+    float aabb_min[3];
+    float aabb_max[3];
+
+    uint32_t n_submeshes;
+    uint32_t n_meshlets;
+
+    /* .mtl the submesh materials are from, empty if none */
+    char material_library[MESH_PATH_MAX_SIZE];
+
+    /* byte offsets from the start of the file */
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t submesh_offset;
+    uint64_t meshlet_offset;
+};
+
+/* A cache file mapped & checked by mesh_cache_open(), which can run on any
+   thread, waiting for mesh_cache_upload() on the one with the GL context */
+struct mesh_cache_file {
+    struct mapped_file file;
+};
+
+/*
+ * Creates a mesh from the cache of the source file at 'path'. The cache is
+ * memory mapped & its vertex & index data handed straight to the buffers, so
+ * the mesh has no CPU side darrays. Returns false when there is no cache or
+ * it's stale, in which case 'mesh' is untouched.
+ */
+bool mesh_cache_load(const char *path, struct mesh *mesh);
+
+/* The two halves of mesh_cache_load(). mesh_cache_open() returns false on a
+   miss, mesh_cache_upload() creates the mesh & closes the cache. A cache that
+   won't be uploaded anymore is closed with mesh_cache_close() */
+bool mesh_cache_open(const char *path, struct mesh_cache_file *cache);
+struct mesh mesh_cache_upload(struct mesh_cache_file *cache);
+void mesh_cache_close(struct mesh_cache_file *cache);
+
+/* Path of the cache file of the source file at 'path', false if it's too
+   long */
+bool mesh_cache_path(const char *path, char out[SMESH_PATH_BUFFER_SIZE]);
+
+/* Writes the CPU side data of a mesh loaded from the source file at 'path'
+   into the cache, returns false if the cache couldn't be written */
+bool mesh_cache_store(const char *path, const struct mesh *mesh);
+
+/* The .smesh that mesh_cache_store() writes, malloc'd, NULL on failure */
+void *mesh_cache_serialize(const char *path, const struct mesh *mesh, size_t *size);
+
+/* For .smesh data that doesn't come from the cache directory, like cooked
+   archives. mesh_cache_validate() checks it's complete & from this version &
+   configuration of sage ('name' is for the logs), the source file isn't looked
+   at. mesh_cache_create() creates the mesh of validated data */
+bool mesh_cache_validate(const void *data, size_t size, const char *name);
+struct mesh mesh_cache_create(const void *data);
+
+#endif /* SAGE_MESH_CACHE_H */
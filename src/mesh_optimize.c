@@ -0,0 +1,498 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "mesh_optimize.h"
+#include "mesh.h"
+#include "logger.h"
+#include "assert.h"
+#include "mnf/mnf_vector.h"
+
+/* Triangles that share vertices with a cluster this small aren't worth
+   sorting on their own, they are merged into the cluster before them */
+#define MESH_OPTIMIZE_MIN_CLUSTER 32
+
+/* Vertex → triangles adjacency in compressed rows: the triangles using vertex
+   v are triangles[offsets[v]] up to triangles[offsets[v + 1]] */
+struct mesh_adjacency {
+    uint32_t *offsets;
+    uint32_t *triangles;
+};
+
+/* A range of triangles that gets sorted as a whole to reduce overdraw */
+struct mesh_cluster {
+    vec3 centroid;
+    vec3 normal;
+    float sort_key;
+    uint32_t begin;
+    uint32_t end;
+};
+
+static uint32_t *mesh_read_indices(const darray *indices);
+static void mesh_write_indices(darray *indices, const uint32_t *source);
+static bool mesh_build_adjacency(const uint32_t *indices, size_t n_indices,
+                                 size_t n_vertices, struct mesh_adjacency *adjacency);
+static size_t mesh_optimize_vertex_cache(const uint32_t *indices, size_t n_indices,
+                                         size_t n_vertices, uint32_t *out,
+                                         uint32_t *cluster_starts);
+static bool mesh_optimize_overdraw(uint32_t *indices, size_t n_indices,
+                                   const struct vertex *vertices,
+                                   const uint32_t *cluster_starts, size_t n_clusters);
+static size_t mesh_optimize_vertex_fetch(darray *vertices, uint32_t *indices, size_t n_indices);
+static struct mesh_cache_stats mesh_simulate_cache(const uint32_t *indices, size_t n_indices,
+                                                   size_t n_vertices);
+static int mesh_cluster_compare(const void *a, const void *b);
+
+void mesh_optimize(darray *vertices,
+                   darray *indices,
+                   const struct mesh_submesh *submeshes,
+                   size_t n_submeshes)
+{
+    SASSERT_MSG(vertices->item_size == sizeof(struct vertex), "Vertices must be struct vertex");
+
+    size_t n_indices = indices->len - indices->len % 3;
+    size_t n_vertices = vertices->len;
+    size_t n_triangles = n_indices / 3;
+    if (n_triangles == 0) return;
+
+    uint32_t *source = mesh_read_indices(indices);
+    uint32_t *optimized = malloc(n_indices * sizeof(uint32_t));
+    uint32_t *cluster_starts = malloc((n_triangles + 1) * sizeof(uint32_t));
+    if (source == NULL || optimized == NULL || cluster_starts == NULL) {
+        SERROR("Failed to alloc memory for optimizing a mesh, leaving it as is");
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < n_indices; i++) {
+        if (source[i] >= n_vertices) {
+            SWARN("Not optimizing a mesh with out of range indices");
+            goto cleanup;
+        }
+    }
+
+    for (size_t i = 0; i < n_submeshes; i++) {
+        const struct mesh_lod *range = &submeshes[i].lods[0];
+        if (range->index_offset % 3 != 0 || range->index_count % 3 != 0 ||
+            range->index_offset + range->index_count > n_indices) {
+            SWARN("Not optimizing a mesh with submeshes that aren't whole triangles");
+            goto cleanup;
+        }
+    }
+
+    struct mesh_cache_stats before = mesh_simulate_cache(source, n_indices, n_vertices);
+
+    /* triangles never leave their submesh, without any the whole mesh is one */
+    memcpy(optimized, source, n_indices * sizeof(uint32_t));
+    struct mesh_lod whole = { 0, (uint32_t) n_indices, 0.0f };
+    size_t n_ranges = (n_submeshes > 0) ? n_submeshes : 1;
+    size_t n_clusters = 0;
+
+    for (size_t i = 0; i < n_ranges; i++) {
+        const struct mesh_lod *range = (n_submeshes > 0) ? &submeshes[i].lods[0] : &whole;
+        if (range->index_count == 0) continue;
+
+        size_t n_range_clusters = mesh_optimize_vertex_cache(source + range->index_offset,
+                                                             range->index_count,
+                                                             n_vertices,
+                                                             optimized + range->index_offset,
+                                                             cluster_starts);
+        if (n_range_clusters == 0) goto cleanup;
+
+        mesh_optimize_overdraw(optimized + range->index_offset, range->index_count,
+                               vertices->items, cluster_starts, n_range_clusters);
+        n_clusters += n_range_clusters;
+    }
+
+    n_vertices = mesh_optimize_vertex_fetch(vertices, optimized, n_indices);
+
+    struct mesh_cache_stats after = mesh_simulate_cache(optimized, n_indices, n_vertices);
+    mesh_write_indices(indices, optimized);
+
+    SINFO("Optimized a mesh with %zu triangles in %zu clusters: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+          n_triangles, n_clusters, before.acmr, after.acmr, before.atvr, after.atvr);
+
+cleanup:
+    free(source);
+    free(optimized);
+    free(cluster_starts);
+}
+
+void mesh_optimize_triangles(uint32_t *indices, size_t n_indices, size_t n_vertices)
+{
+    size_t n_triangles = n_indices / 3;
+    if (n_triangles == 0) return;
+
+    uint32_t *optimized = malloc(n_triangles * 3 * sizeof(uint32_t));
+    uint32_t *cluster_starts = malloc((n_triangles + 1) * sizeof(uint32_t));
+
+    if (optimized != NULL && cluster_starts != NULL &&
+        mesh_optimize_vertex_cache(indices, n_triangles * 3, n_vertices,
+                                   optimized, cluster_starts) > 0)
+        memcpy(indices, optimized, n_triangles * 3 * sizeof(uint32_t));
+
+    free(optimized);
+    free(cluster_starts);
+}
+
+struct mesh_cache_stats mesh_analyze_vertex_cache(const darray *indices, size_t n_vertices)
+{
+    struct mesh_cache_stats stats = {0};
+
+    uint32_t *source = mesh_read_indices(indices);
+    if (source == NULL) return stats;
+
+    stats = mesh_simulate_cache(source, indices->len - indices->len % 3, n_vertices);
+    free(source);
+
+    return stats;
+}
+
+/* Widens uint16_t indices so every pass only deals with uint32_t */
+static uint32_t *mesh_read_indices(const darray *indices)
+{
+    SASSERT_MSG(indices->item_size == sizeof(uint16_t) || indices->item_size == sizeof(uint32_t),
+                "Indices must either be uint16_t or uint32_t");
+
+    uint32_t *out = malloc((indices->len + 1) * sizeof(uint32_t));
+    if (out == NULL) return NULL;
+
+    if (indices->item_size == sizeof(uint32_t)) {
+        memcpy(out, indices->items, indices->len * sizeof(uint32_t));
+    } else {
+        const uint16_t *narrow = indices->items;
+        for (size_t i = 0; i < indices->len; i++)
+            out[i] = narrow[i];
+    }
+
+    return out;
+}
+
+/* Writes indices back in the size of the darray, a trailing partial triangle
+   is left untouched */
+static void mesh_write_indices(darray *indices, const uint32_t *source)
+{
+    size_t n = indices->len - indices->len % 3;
+
+    if (indices->item_size == sizeof(uint32_t)) {
+        memcpy(indices->items, source, n * sizeof(uint32_t));
+    } else {
+        uint16_t *narrow = indices->items;
+        for (size_t i = 0; i < n; i++)
+            narrow[i] = (uint16_t) source[i];
+    }
+}
+
+static bool mesh_build_adjacency(const uint32_t *indices, size_t n_indices,
+                                 size_t n_vertices, struct mesh_adjacency *adjacency)
+{
+    adjacency->offsets = calloc(n_vertices + 1, sizeof(uint32_t));
+    adjacency->triangles = malloc(n_indices * sizeof(uint32_t));
+    if (adjacency->offsets == NULL || adjacency->triangles == NULL) return false;
+
+    /* counting sort: count the uses of each vertex, prefix sum into offsets,
+       then fill using offsets as cursors which shifts them by one row */
+    for (size_t i = 0; i < n_indices; i++)
+        adjacency->offsets[indices[i] + 1]++;
+    for (size_t v = 0; v < n_vertices; v++)
+        adjacency->offsets[v + 1] += adjacency->offsets[v];
+
+    for (size_t i = 0; i < n_indices; i++)
+        adjacency->triangles[adjacency->offsets[indices[i]]++] = (uint32_t) (i / 3);
+
+    for (size_t v = n_vertices; v > 0; v--)
+        adjacency->offsets[v] = adjacency->offsets[v - 1];
+    adjacency->offsets[0] = 0;
+
+    return true;
+}
+
+/*
+ * Tipsify (Sander, Nehab & Barczak 2007). Fans around a vertex emitting every
+ * triangle still using it, then moves on to the neighbour that will still be
+ * in the cache after its remaining triangles are emitted. When no neighbour
+ * has triangles left it's a dead end: the most recently used vertex that
+ * does is picked, or the next one in input order. Every dead end starts a new
+ * cluster, which the overdraw pass sorts.
+ *
+ * Returns the amount of clusters, 0 on failure.
+ */
+static size_t mesh_optimize_vertex_cache(const uint32_t *indices, size_t n_indices,
+                                         size_t n_vertices, uint32_t *out,
+                                         uint32_t *cluster_starts)
+{
+    const int64_t cache_size = MESH_OPTIMIZE_CACHE_SIZE;
+    size_t n_triangles = n_indices / 3;
+    size_t n_clusters = 0;
+
+    struct mesh_adjacency adjacency;
+    uint32_t *live = malloc(n_vertices * sizeof(uint32_t));
+    int64_t *timestamps = calloc(n_vertices, sizeof(int64_t));
+    uint32_t *dead_ends = malloc(n_indices * sizeof(uint32_t));
+    bool *emitted = calloc(n_triangles, sizeof(bool));
+    bool adjacent = mesh_build_adjacency(indices, n_indices, n_vertices, &adjacency);
+
+    /* vertices of the triangles emitted around the current fan */
+    uint32_t max_valence = 0;
+    if (adjacent) {
+        for (size_t v = 0; v < n_vertices; v++) {
+            uint32_t valence = adjacency.offsets[v + 1] - adjacency.offsets[v];
+            if (valence > max_valence) max_valence = valence;
+        }
+    }
+    uint32_t *candidates = malloc((max_valence * 3 + 1) * sizeof(uint32_t));
+
+    if (!adjacent || live == NULL || timestamps == NULL || dead_ends == NULL ||
+        emitted == NULL || candidates == NULL) {
+        SERROR("Failed to alloc memory for optimizing the vertex cache of a mesh");
+        goto cleanup;
+    }
+
+    for (size_t v = 0; v < n_vertices; v++)
+        live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+
+    size_t n_dead_ends = 0;
+    size_t n_out = 0;
+    size_t cursor = 0;
+    int64_t time = cache_size + 1;
+
+    /* the first vertex used starts the first cluster */
+    int64_t fan = indices[0];
+    cluster_starts[0] = 0;
+    size_t n_found = 1;
+
+    while (fan >= 0) {
+        size_t n_candidates = 0;
+
+        for (uint32_t i = adjacency.offsets[fan]; i < adjacency.offsets[fan + 1]; i++) {
+            uint32_t triangle = adjacency.triangles[i];
+            if (emitted[triangle]) continue;
+
+            for (size_t j = 0; j < 3; j++) {
+                uint32_t v = indices[triangle * 3 + j];
+                out[n_out++] = v;
+                dead_ends[n_dead_ends++] = v;
+                candidates[n_candidates++] = v;
+                live[v]--;
+
+                if (time - timestamps[v] > cache_size)
+                    timestamps[v] = time++;
+            }
+            emitted[triangle] = true;
+        }
+
+        /* the neighbour with the highest position in the cache that will
+           still be cached after emitting its remaining triangles */
+        int64_t next = -1;
+        int64_t best_priority = -1;
+        for (size_t i = 0; i < n_candidates; i++) {
+            uint32_t v = candidates[i];
+            if (live[v] == 0) continue;
+
+            int64_t priority = 0;
+            if (time - timestamps[v] + 2 * (int64_t) live[v] <= cache_size)
+                priority = time - timestamps[v];
+            if (priority > best_priority) {
+                best_priority = priority;
+                next = v;
+            }
+        }
+
+        if (next >= 0) {
+            fan = next;
+            continue;
+        }
+
+        /* dead end */
+        while (n_dead_ends > 0 && next < 0) {
+            uint32_t v = dead_ends[--n_dead_ends];
+            if (live[v] > 0) next = v;
+        }
+        while (cursor < n_vertices && next < 0) {
+            if (live[cursor] > 0) next = (int64_t) cursor;
+            cursor++;
+        }
+
+        if (next >= 0 && n_out / 3 < n_triangles) {
+            /* tiny clusters are folded into the previous one */
+            uint32_t start = (uint32_t) (n_out / 3);
+            if (start - cluster_starts[n_found - 1] >= MESH_OPTIMIZE_MIN_CLUSTER)
+                cluster_starts[n_found++] = start;
+        }
+        fan = next;
+    }
+
+    SASSERT_MSG(n_out == n_indices, "Tipsify didn't emit every triangle");
+    cluster_starts[n_found] = (uint32_t) n_triangles;
+    n_clusters = n_found;
+
+cleanup:
+    free(adjacency.offsets);
+    free(adjacency.triangles);
+    free(live);
+    free(timestamps);
+    free(dead_ends);
+    free(emitted);
+    free(candidates);
+
+    return n_clusters;
+}
+
+/*
+ * Sorts the clusters by how much they face away from the center of the mesh
+ * (Nehab, Barczak & Sander 2006). Clusters on the outside facing the camera
+ * are then drawn before the ones they hide, no matter where the camera is.
+ * The order within a cluster is kept so the vertex cache efficiency barely
+ * changes.
+ */
+static bool mesh_optimize_overdraw(uint32_t *indices, size_t n_indices,
+                                   const struct vertex *vertices,
+                                   const uint32_t *cluster_starts, size_t n_clusters)
+{
+    if (n_clusters < 2) return true;
+
+    struct mesh_cluster *clusters = malloc(n_clusters * sizeof(struct mesh_cluster));
+    uint32_t *sorted = malloc(n_indices * sizeof(uint32_t));
+    if (clusters == NULL || sorted == NULL) {
+        free(clusters);
+        free(sorted);
+        return false;
+    }
+
+    /* area weighted centroid of the whole mesh */
+    vec3 mesh_centroid = {0.0f, 0.0f, 0.0f};
+    float mesh_area = 0.0f;
+
+    for (size_t i = 0; i < n_clusters; i++) {
+        vec3 centroid = {0.0f, 0.0f, 0.0f};
+        vec3 normal = {0.0f, 0.0f, 0.0f};
+        float area = 0.0f;
+
+        for (uint32_t t = cluster_starts[i]; t < cluster_starts[i + 1]; t++) {
+            const float *a = vertices[indices[t * 3 + 0]].pos;
+            const float *b = vertices[indices[t * 3 + 1]].pos;
+            const float *c = vertices[indices[t * 3 + 2]].pos;
+
+            vec3 ab, ac, cross;
+            mnf_vec3_sub((float *) b, (float *) a, ab);
+            mnf_vec3_sub((float *) c, (float *) a, ac);
+            mnf_vec3_cross(ab, ac, cross);
+
+            /* the length of the cross product is twice the area */
+            float triangle_area = mnf_vec3_norm(cross) * 0.5f;
+            for (size_t k = 0; k < 3; k++)
+                centroid[k] += (a[k] + b[k] + c[k]) / 3.0f * triangle_area;
+            mnf_vec3_add(normal, cross, normal);
+            area += triangle_area;
+        }
+
+        for (size_t k = 0; k < 3; k++)
+            mesh_centroid[k] += centroid[k];
+        mesh_area += area;
+
+        if (area > 0.0f)
+            mnf_vec3_scale(centroid, 1.0f / area, centroid);
+        mnf_vec3_normalize(normal, normal);
+
+        mnf_vec3_copy(centroid, clusters[i].centroid);
+        mnf_vec3_copy(normal, clusters[i].normal);
+        clusters[i].begin = cluster_starts[i];
+        clusters[i].end = cluster_starts[i + 1];
+    }
+
+    if (mesh_area > 0.0f)
+        mnf_vec3_scale(mesh_centroid, 1.0f / mesh_area, mesh_centroid);
+
+    for (size_t i = 0; i < n_clusters; i++) {
+        vec3 offset;
+        mnf_vec3_sub(clusters[i].centroid, mesh_centroid, offset);
+        clusters[i].sort_key = mnf_vec3_dot(offset, clusters[i].normal);
+    }
+
+    qsort(clusters, n_clusters, sizeof(struct mesh_cluster), mesh_cluster_compare);
+
+    size_t n_sorted = 0;
+    for (size_t i = 0; i < n_clusters; i++) {
+        size_t n = (clusters[i].end - clusters[i].begin) * 3;
+        memcpy(&sorted[n_sorted], &indices[clusters[i].begin * 3], n * sizeof(uint32_t));
+        n_sorted += n;
+    }
+    memcpy(indices, sorted, n_indices * sizeof(uint32_t));
+
+    free(clusters);
+    free(sorted);
+    return true;
+}
+
+/* Renumbers the vertices in the order the indices first reference them and
+   moves them accordingly, returns the new amount of vertices */
+static size_t mesh_optimize_vertex_fetch(darray *vertices, uint32_t *indices, size_t n_indices)
+{
+    size_t n_vertices = vertices->len;
+    uint32_t *remap = malloc(n_vertices * sizeof(uint32_t));
+    struct vertex *reordered = malloc(n_vertices * sizeof(struct vertex));
+    if (remap == NULL || reordered == NULL) {
+        free(remap);
+        free(reordered);
+        return n_vertices;
+    }
+
+    memset(remap, 0xFF, n_vertices * sizeof(uint32_t));
+
+    const struct vertex *source = vertices->items;
+    uint32_t n_used = 0;
+    for (size_t i = 0; i < n_indices; i++) {
+        uint32_t v = indices[i];
+        if (remap[v] == UINT32_MAX) {
+            reordered[n_used] = source[v];
+            remap[v] = n_used++;
+        }
+        indices[i] = remap[v];
+    }
+
+    memcpy(vertices->items, reordered, n_used * sizeof(struct vertex));
+    vertices->len = n_used;
+
+    free(remap);
+    free(reordered);
+    return n_used;
+}
+
+/* FIFO cache, a vertex is cached if less than cache size misses happened
+   since it was last loaded */
+static struct mesh_cache_stats mesh_simulate_cache(const uint32_t *indices, size_t n_indices,
+                                                   size_t n_vertices)
+{
+    struct mesh_cache_stats stats = {0};
+    if (n_indices == 0 || n_vertices == 0) return stats;
+
+    int64_t *loaded_at = malloc(n_vertices * sizeof(int64_t));
+    if (loaded_at == NULL) return stats;
+    for (size_t v = 0; v < n_vertices; v++)
+        loaded_at[v] = -MESH_OPTIMIZE_CACHE_SIZE - 1;
+
+    int64_t n_misses = 0;
+    for (size_t i = 0; i < n_indices; i++) {
+        uint32_t v = indices[i];
+        if (n_misses - loaded_at[v] > MESH_OPTIMIZE_CACHE_SIZE) {
+            loaded_at[v] = n_misses;
+            n_misses++;
+        }
+    }
+    free(loaded_at);
+
+    stats.acmr = (float) n_misses / (float) (n_indices / 3);
+    stats.atvr = (float) n_misses / (float) n_vertices;
+    return stats;
+}
+
+/* Descending sort key, ties keep the Tipsify order */
+static int mesh_cluster_compare(const void *a, const void *b)
+{
+    const struct mesh_cluster *left = a;
+    const struct mesh_cluster *right = b;
+
+    if (left->sort_key > right->sort_key) return -1;
+    if (left->sort_key < right->sort_key) return 1;
+    return (left->begin > right->begin) - (left->begin < right->begin);
+}
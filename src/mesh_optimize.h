@@ -0,0 +1,43 @@
+#ifndef SAGE_MESH_OPTIMIZE_H
+#define SAGE_MESH_OPTIMIZE_H
+
+#include "darray.h"
+#include "mesh.h"
+
+/* Size of the post transform vertex cache that is optimized for & simulated
+   when reporting the ACMR/ATVR, modern GPUs are roughly this big or bigger */
+#define MESH_OPTIMIZE_CACHE_SIZE 16
+
+/* Statistics of a simulated FIFO vertex cache running over the indices */
+struct mesh_cache_stats {
+    float acmr; /* average cache miss ratio: transformed vertices per triangle */
+    float atvr; /* average transformed vertex ratio: transformed per vertex */
+};
+
+/*
+ * Reorders an indexed triangle list (struct vertex, uint16_t or uint32_t
+ * indices) in place for rendering efficiency:
+ *
+ *  1. triangles are reordered for the post transform vertex cache (Tipsify)
+ *  2. the clusters that pass leaves behind are sorted so that the ones facing
+ *     outwards are drawn first, reducing overdraw from any direction
+ *  3. vertices are reordered in the order the indices first use them so the
+ *     vertex fetch walks memory linearly, unreferenced vertices are dropped
+ *
+ * Triangles are only reordered within the LOD 0 range of their submesh, with
+ * no submeshes the whole mesh is treated as one. The ACMR & ATVR before and
+ * after are logged.
+ */
+void mesh_optimize(darray *vertices,
+                   darray *indices,
+                   const struct mesh_submesh *submeshes,
+                   size_t n_submeshes);
+
+/* Only reorders the triangles for the vertex cache, for index ranges that
+   share their vertices with others like LODs */
+void mesh_optimize_triangles(uint32_t *indices, size_t n_indices, size_t n_vertices);
+
+/* Simulates a MESH_OPTIMIZE_CACHE_SIZE entry FIFO cache over the indices */
+struct mesh_cache_stats mesh_analyze_vertex_cache(const darray *indices, size_t n_vertices);
+
+#endif /* SAGE_MESH_OPTIMIZE_H */
@@ -0,0 +1,646 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <float.h>
+
+#include "mesh_simplify.h"
+#include "mesh_optimize.h"
+#include "darray.h"
+#include "logger.h"
+#include "mnf/mnf_vector.h"
+
+/* Border edges are held in place by planes perpendicular to their triangle,
+   weighted this much more than the surface so silhouettes of open meshes
+   survive */
+#define MESH_SIMPLIFY_BORDER_WEIGHT 10.0
+
+/* Marks an unused slot in the edge set & an unpicked wedge */
+#define MESH_SIMPLIFY_EMPTY_EDGE UINT64_MAX
+#define MESH_SIMPLIFY_EMPTY UINT32_MAX
+
+/* Symmetric 4x4 matrix summing the squared distances to a set of planes, the
+   summed weight turns the error back into a distance */
+struct quadric {
+    double a2, ab, ac, ad;
+    double b2, bc, bd;
+    double c2, cd;
+    double d2;
+    double weight;
+};
+
+/* An edge that can be collapsed, 'from' is snapped onto 'to' */
+struct collapse {
+    uint32_t from;
+    uint32_t to;
+    double cost;
+};
+
+/* Directed edges between position classes, used to find borders */
+struct edge_set {
+    uint64_t *keys;
+    size_t mask;
+};
+
+static void simplify_build_classes(const struct vertex *vertices, size_t n_vertices,
+                                   uint32_t *class_of, uint32_t *wedge_next);
+static uint32_t simplify_find(uint32_t *remap, uint32_t c);
+static bool simplify_flips(const struct vertex *vertices, const uint32_t *triangles,
+                           const uint32_t *class_of,
+                           const uint32_t *adjacency_offsets, const uint32_t *adjacency,
+                           uint32_t from, uint32_t to);
+static uint32_t simplify_pick_wedge(const struct vertex *vertices, const uint32_t *wedge_next,
+                                    uint32_t v, uint32_t c);
+static void quadric_add_plane(struct quadric *q, const double *n, double d, double weight);
+static void quadric_add(struct quadric *dst, const struct quadric *src);
+static double quadric_error(const struct quadric *a, const struct quadric *b, const float *p);
+static bool edge_set_init(struct edge_set *set, size_t n);
+static void edge_set_clear(struct edge_set *set);
+static void edge_set_insert(struct edge_set *set, uint32_t a, uint32_t b);
+static bool edge_set_contains(const struct edge_set *set, uint32_t a, uint32_t b);
+static void edge_set_free(struct edge_set *set);
+static int collapse_compare(const void *a, const void *b);
+static bool simplify_append_indices(darray *indices, const uint32_t *source, size_t n);
+
+size_t mesh_simplify(const struct vertex *vertices,
+                     size_t n_vertices,
+                     const uint32_t *indices,
+                     size_t n_indices,
+                     size_t target_n_indices,
+                     float max_error,
+                     uint32_t *out,
+                     float *error)
+{
+    *error = 0.0f;
+
+    size_t n_triangles = n_indices / 3;
+    size_t target_triangles = target_n_indices / 3;
+    size_t n_written = 0;
+    double max_cost = (double) max_error * (double) max_error;
+    double applied_cost = 0.0;
+
+    uint32_t *class_of = malloc((n_vertices + 1) * sizeof(uint32_t));
+    uint32_t *wedge_next = malloc((n_vertices + 1) * sizeof(uint32_t));
+    uint32_t *remap = malloc((n_vertices + 1) * sizeof(uint32_t));
+    uint32_t *wedge_choice = malloc((n_vertices + 1) * sizeof(uint32_t));
+    struct quadric *quadrics = calloc(n_vertices + 1, sizeof(struct quadric));
+    bool *border = calloc(n_vertices + 1, sizeof(bool));
+    bool *locked = calloc(n_vertices + 1, sizeof(bool));
+    uint32_t *adjacency_offsets = malloc((n_vertices + 2) * sizeof(uint32_t));
+    uint32_t *adjacency = malloc((n_indices + 1) * sizeof(uint32_t));
+    uint32_t *triangles = malloc((n_indices + 1) * sizeof(uint32_t));
+    struct collapse *collapses = malloc((n_indices + 1) * sizeof(struct collapse));
+    struct edge_set edges = {0};
+
+    if (class_of == NULL || wedge_next == NULL || remap == NULL ||
+        wedge_choice == NULL || quadrics == NULL || border == NULL ||
+        locked == NULL || adjacency_offsets == NULL || adjacency == NULL ||
+        triangles == NULL || collapses == NULL || !edge_set_init(&edges, n_indices)) {
+        SERROR("Failed to alloc memory for simplifying a mesh");
+        goto cleanup;
+    }
+
+    simplify_build_classes(vertices, n_vertices, class_of, wedge_next);
+    for (size_t c = 0; c < n_vertices; c++)
+        remap[c] = (uint32_t) c;
+
+    /* triangles already degenerate in position are dropped up front */
+    size_t n_current = 0;
+    for (size_t t = 0; t < n_triangles; t++) {
+        const uint32_t *corners = &indices[t * 3];
+        uint32_t c0 = class_of[corners[0]];
+        uint32_t c1 = class_of[corners[1]];
+        uint32_t c2 = class_of[corners[2]];
+        if (c0 == c1 || c1 == c2 || c0 == c2) continue;
+
+        memcpy(&triangles[n_current * 3], corners, 3 * sizeof(uint32_t));
+        n_current++;
+    }
+
+    /* every triangle adds its plane onto the quadrics of its corners,
+       weighted by its area */
+    for (size_t t = 0; t < n_current; t++) {
+        const float *p0 = vertices[triangles[t * 3 + 0]].pos;
+        const float *p1 = vertices[triangles[t * 3 + 1]].pos;
+        const float *p2 = vertices[triangles[t * 3 + 2]].pos;
+
+        double e1[3], e2[3], n[3];
+        for (size_t k = 0; k < 3; k++) {
+            e1[k] = (double) p1[k] - p0[k];
+            e2[k] = (double) p2[k] - p0[k];
+        }
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+        double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0) continue;
+        for (size_t k = 0; k < 3; k++) n[k] /= length;
+
+        double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+        for (size_t k = 0; k < 3; k++)
+            quadric_add_plane(&quadrics[class_of[triangles[t * 3 + k]]], n, d, length * 0.5);
+
+        for (size_t k = 0; k < 3; k++)
+            edge_set_insert(&edges, class_of[triangles[t * 3 + k]],
+                            class_of[triangles[t * 3 + (k + 1) % 3]]);
+    }
+
+    /* edges only one triangle uses are borders, pinned by a plane through
+       the edge that's perpendicular to the triangle */
+    for (size_t t = 0; t < n_current; t++) {
+        for (size_t k = 0; k < 3; k++) {
+            uint32_t a = class_of[triangles[t * 3 + k]];
+            uint32_t b = class_of[triangles[t * 3 + (k + 1) % 3]];
+            if (edge_set_contains(&edges, b, a)) continue;
+
+            const float *pa = vertices[triangles[t * 3 + k]].pos;
+            const float *pb = vertices[triangles[t * 3 + (k + 1) % 3]].pos;
+            const float *pc = vertices[triangles[t * 3 + (k + 2) % 3]].pos;
+
+            vec3 edge, other, face, perpendicular;
+            mnf_vec3_sub((float *) pb, (float *) pa, edge);
+            mnf_vec3_sub((float *) pc, (float *) pa, other);
+            mnf_vec3_cross(edge, other, face);
+            mnf_vec3_cross(edge, face, perpendicular);
+            mnf_vec3_normalize(perpendicular, perpendicular);
+
+            double n[3] = { perpendicular[0], perpendicular[1], perpendicular[2] };
+            double d = -(n[0] * pa[0] + n[1] * pa[1] + n[2] * pa[2]);
+            double weight = mnf_vec3_dot(edge, edge) * MESH_SIMPLIFY_BORDER_WEIGHT;
+            quadric_add_plane(&quadrics[a], n, d, weight);
+            quadric_add_plane(&quadrics[b], n, d, weight);
+        }
+    }
+
+    /* every pass collapses a set of cheapest edges that don't touch each
+       other's triangles, then rebuilds the triangles */
+    while (n_current > target_triangles) {
+        /* class → triangles adjacency */
+        memset(adjacency_offsets, 0, (n_vertices + 2) * sizeof(uint32_t));
+        for (size_t i = 0; i < n_current * 3; i++)
+            adjacency_offsets[class_of[triangles[i]] + 1]++;
+        for (size_t c = 0; c < n_vertices; c++)
+            adjacency_offsets[c + 1] += adjacency_offsets[c];
+        for (size_t i = 0; i < n_current * 3; i++)
+            adjacency[adjacency_offsets[class_of[triangles[i]]]++] = (uint32_t) (i / 3);
+        for (size_t c = n_vertices; c > 0; c--)
+            adjacency_offsets[c] = adjacency_offsets[c - 1];
+        adjacency_offsets[0] = 0;
+
+        /* borders of what's left */
+        edge_set_clear(&edges);
+        memset(border, 0, n_vertices * sizeof(bool));
+        for (size_t t = 0; t < n_current; t++)
+            for (size_t k = 0; k < 3; k++)
+                edge_set_insert(&edges, class_of[triangles[t * 3 + k]],
+                                class_of[triangles[t * 3 + (k + 1) % 3]]);
+        for (size_t t = 0; t < n_current; t++) {
+            for (size_t k = 0; k < 3; k++) {
+                uint32_t a = class_of[triangles[t * 3 + k]];
+                uint32_t b = class_of[triangles[t * 3 + (k + 1) % 3]];
+                if (!edge_set_contains(&edges, b, a)) border[a] = border[b] = true;
+            }
+        }
+
+        /* candidates, each edge in the direction with the least error.
+           Border vertices may only slide along their border */
+        size_t n_collapses = 0;
+        for (size_t t = 0; t < n_current; t++) {
+            for (size_t k = 0; k < 3; k++) {
+                uint32_t a = class_of[triangles[t * 3 + k]];
+                uint32_t b = class_of[triangles[t * 3 + (k + 1) % 3]];
+
+                /* interior edges are seen from both triangles, only one adds them */
+                bool border_edge = !edge_set_contains(&edges, b, a);
+                if (!border_edge && a > b) continue;
+
+                double cost_ab = quadric_error(&quadrics[a], &quadrics[b], vertices[b].pos);
+                double cost_ba = quadric_error(&quadrics[b], &quadrics[a], vertices[a].pos);
+                if (border[a] && !border_edge) cost_ab = INFINITY;
+                if (border[b] && !border_edge) cost_ba = INFINITY;
+
+                struct collapse collapse = (cost_ab <= cost_ba)
+                    ? (struct collapse) { a, b, cost_ab }
+                    : (struct collapse) { b, a, cost_ba };
+                if (collapse.cost > max_cost) continue;
+
+                collapses[n_collapses++] = collapse;
+            }
+        }
+
+        if (n_collapses == 0) break;
+        qsort(collapses, n_collapses, sizeof(struct collapse), collapse_compare);
+
+        memset(locked, 0, n_vertices * sizeof(bool));
+        size_t n_removed = 0;
+        size_t n_applied = 0;
+
+        for (size_t i = 0; i < n_collapses && n_current - n_removed > target_triangles; i++) {
+            uint32_t from = collapses[i].from;
+            uint32_t to = collapses[i].to;
+            if (locked[from] || locked[to]) continue;
+
+            if (simplify_flips(vertices, triangles, class_of,
+                               adjacency_offsets, adjacency, from, to))
+                continue;
+
+            /* nothing around 'from' can change again this pass since the
+               flip test above only saw the triangles as they were */
+            for (uint32_t j = adjacency_offsets[from]; j < adjacency_offsets[from + 1]; j++) {
+                const uint32_t *corners = &triangles[adjacency[j] * 3];
+                bool has_to = false;
+                for (size_t k = 0; k < 3; k++) {
+                    uint32_t c = class_of[corners[k]];
+                    locked[c] = true;
+                    if (c == to) has_to = true;
+                }
+                if (has_to) n_removed++;
+            }
+
+            remap[from] = to;
+            quadric_add(&quadrics[to], &quadrics[from]);
+            if (collapses[i].cost > applied_cost) applied_cost = collapses[i].cost;
+            n_applied++;
+        }
+
+        if (n_applied == 0) break;
+
+        /* rebuilding the triangles with every class moved onto where it
+           collapsed, the ones that lost an edge are dropped */
+        for (size_t v = 0; v < n_vertices; v++)
+            class_of[v] = simplify_find(remap, class_of[v]);
+
+        size_t n_kept = 0;
+        for (size_t t = 0; t < n_current; t++) {
+            const uint32_t *corners = &triangles[t * 3];
+            uint32_t c0 = class_of[corners[0]];
+            uint32_t c1 = class_of[corners[1]];
+            uint32_t c2 = class_of[corners[2]];
+            if (c0 == c1 || c1 == c2 || c0 == c2) continue;
+
+            memmove(&triangles[n_kept * 3], corners, 3 * sizeof(uint32_t));
+            n_kept++;
+        }
+        n_current = n_kept;
+    }
+
+    /* corners whose class collapsed pick the vertex at the new position that
+       looks most like them */
+    memset(wedge_choice, 0xFF, n_vertices * sizeof(uint32_t));
+    for (size_t i = 0; i < n_current * 3; i++) {
+        uint32_t v = triangles[i];
+        uint32_t c = class_of[v];
+
+        if (vertices[c].pos[0] == vertices[v].pos[0] &&
+            vertices[c].pos[1] == vertices[v].pos[1] &&
+            vertices[c].pos[2] == vertices[v].pos[2]) {
+            out[i] = v;
+            continue;
+        }
+
+        if (wedge_choice[v] == MESH_SIMPLIFY_EMPTY)
+            wedge_choice[v] = simplify_pick_wedge(vertices, wedge_next, v, c);
+        out[i] = wedge_choice[v];
+    }
+
+    n_written = n_current * 3;
+    *error = (float) sqrt(applied_cost);
+
+cleanup:
+    free(class_of);
+    free(wedge_next);
+    free(remap);
+    free(wedge_choice);
+    free(quadrics);
+    free(border);
+    free(locked);
+    free(adjacency_offsets);
+    free(adjacency);
+    free(triangles);
+    free(collapses);
+    edge_set_free(&edges);
+
+    return n_written;
+}
+
+size_t mesh_generate_lods(const darray *vertices,
+                          darray *indices,
+                          uint32_t index_offset,
+                          uint32_t index_count,
+                          struct mesh_lod lods[MESH_MAX_LODS])
+{
+    size_t n_base = index_count - index_count % 3;
+    lods[0] = (struct mesh_lod) { index_offset, (uint32_t) n_base, 0.0f };
+    if (n_base / 3 <= MESH_LOD_TARGET_TRIANGLES) return 1;
+
+    uint32_t *source = malloc(n_base * sizeof(uint32_t));
+    uint32_t *simplified = malloc(n_base * sizeof(uint32_t));
+    if (source == NULL || simplified == NULL) {
+        SERROR("Failed to alloc memory for generating LODs");
+        free(source);
+        free(simplified);
+        return 1;
+    }
+
+    for (size_t i = 0; i < n_base; i++) {
+        source[i] = (indices->item_size == sizeof(uint16_t))
+            ? ((const uint16_t *) indices->items)[index_offset + i]
+            : ((const uint32_t *) indices->items)[index_offset + i];
+    }
+
+    /* every LOD is simplified from the one before it, the error of each step
+       adds up to an upper bound on how far it strays from LOD 0 */
+    size_t n_lods = 1;
+    size_t n_source = n_base;
+    float error = 0.0f;
+
+    while (n_lods < MESH_MAX_LODS && n_source / 3 > MESH_LOD_TARGET_TRIANGLES) {
+        float step_error = 0.0f;
+        size_t n = mesh_simplify(vertices->items, vertices->len,
+                                 source, n_source, n_source / 2,
+                                 FLT_MAX, simplified, &step_error);
+
+        /* not worth a LOD if it barely got simpler */
+        if (n == 0 || n > n_source * 9 / 10) break;
+
+        mesh_optimize_triangles(simplified, n, vertices->len);
+
+        size_t offset = indices->len;
+        if (!simplify_append_indices(indices, simplified, n)) break;
+
+        error += step_error;
+        lods[n_lods++] = (struct mesh_lod) { (uint32_t) offset, (uint32_t) n, error };
+
+        uint32_t *swap = source;
+        source = simplified;
+        simplified = swap;
+        n_source = n;
+    }
+
+    SINFO("Generated %zu LODs from %zu down to %u triangles",
+          n_lods, n_base / 3, lods[n_lods - 1].index_count / 3);
+
+    free(source);
+    free(simplified);
+    return n_lods;
+}
+
+/* Vertices at the same position form a class named after the first of them,
+   wedge_next links every vertex of a class into a ring */
+static void simplify_build_classes(const struct vertex *vertices, size_t n_vertices,
+                                   uint32_t *class_of, uint32_t *wedge_next)
+{
+    size_t capacity = 16;
+    while (capacity < n_vertices * 2) capacity <<= 1;
+
+    uint32_t *table = malloc(capacity * sizeof(uint32_t));
+    if (table == NULL) {
+        /* every vertex in its own class still simplifies, only worse at seams */
+        for (size_t v = 0; v < n_vertices; v++) {
+            class_of[v] = (uint32_t) v;
+            wedge_next[v] = (uint32_t) v;
+        }
+        return;
+    }
+    memset(table, 0xFF, capacity * sizeof(uint32_t));
+
+    for (size_t v = 0; v < n_vertices; v++) {
+        const float *pos = vertices[v].pos;
+        uint32_t bits[3];
+        memcpy(bits, pos, sizeof(bits));
+
+        uint64_t hash = bits[0] * 0x9E3779B97F4A7C15ull ^
+                        bits[1] * 0xC2B2AE3D27D4EB4Full ^
+                        bits[2] * 0x165667B19E3779F9ull;
+        size_t slot = (hash ^ (hash >> 32)) & (capacity - 1);
+
+        for (;;) {
+            uint32_t other = table[slot];
+            if (other == MESH_SIMPLIFY_EMPTY) {
+                table[slot] = (uint32_t) v;
+                class_of[v] = (uint32_t) v;
+                wedge_next[v] = (uint32_t) v;
+                break;
+            }
+
+            if (memcmp(vertices[other].pos, pos, sizeof(vec3)) == 0) {
+                class_of[v] = other;
+                wedge_next[v] = wedge_next[other];
+                wedge_next[other] = (uint32_t) v;
+                break;
+            }
+
+            slot = (slot + 1) & (capacity - 1);
+        }
+    }
+
+    free(table);
+}
+
+static uint32_t simplify_find(uint32_t *remap, uint32_t c)
+{
+    uint32_t root = c;
+    while (remap[root] != root) root = remap[root];
+
+    /* path compression */
+    while (remap[c] != root) {
+        uint32_t next = remap[c];
+        remap[c] = root;
+        c = next;
+    }
+
+    return root;
+}
+
+/* Whether moving 'from' onto 'to' turns any of the triangles around 'from'
+   that survive the collapse upside down */
+static bool simplify_flips(const struct vertex *vertices, const uint32_t *triangles,
+                           const uint32_t *class_of,
+                           const uint32_t *adjacency_offsets, const uint32_t *adjacency,
+                           uint32_t from, uint32_t to)
+{
+    for (uint32_t j = adjacency_offsets[from]; j < adjacency_offsets[from + 1]; j++) {
+        const uint32_t *corners = &triangles[adjacency[j] * 3];
+
+        const float *p[3];
+        const float *moved[3];
+        bool degenerate = false;
+        for (size_t k = 0; k < 3; k++) {
+            uint32_t c = class_of[corners[k]];
+            if (c == to) degenerate = true;
+            p[k] = vertices[corners[k]].pos;
+            moved[k] = (c == from) ? vertices[to].pos : p[k];
+        }
+        if (degenerate) continue;
+
+        vec3 e1, e2, before, after;
+        mnf_vec3_sub((float *) p[1], (float *) p[0], e1);
+        mnf_vec3_sub((float *) p[2], (float *) p[0], e2);
+        mnf_vec3_cross(e1, e2, before);
+        mnf_vec3_sub((float *) moved[1], (float *) moved[0], e1);
+        mnf_vec3_sub((float *) moved[2], (float *) moved[0], e2);
+        mnf_vec3_cross(e1, e2, after);
+
+        if (mnf_vec3_dot(before, after) <= 0.0f) return true;
+    }
+
+    return false;
+}
+
+/* The vertex in class 'c' with the closest normal & uv to 'v' */
+static uint32_t simplify_pick_wedge(const struct vertex *vertices, const uint32_t *wedge_next,
+                                    uint32_t v, uint32_t c)
+{
+    const struct vertex *target = &vertices[v];
+    uint32_t best = c;
+    float best_score = -INFINITY;
+
+    uint32_t u = c;
+    do {
+        const struct vertex *candidate = &vertices[u];
+        float du = candidate->uv[0] - target->uv[0];
+        float dv = candidate->uv[1] - target->uv[1];
+        float score = mnf_vec3_dot((float *) candidate->normal, (float *) target->normal) -
+                      sqrtf(du * du + dv * dv);
+        if (score > best_score) {
+            best_score = score;
+            best = u;
+        }
+        u = wedge_next[u];
+    } while (u != c);
+
+    return best;
+}
+
+static void quadric_add_plane(struct quadric *q, const double *n, double d, double weight)
+{
+    q->a2 += weight * n[0] * n[0];
+    q->ab += weight * n[0] * n[1];
+    q->ac += weight * n[0] * n[2];
+    q->ad += weight * n[0] * d;
+    q->b2 += weight * n[1] * n[1];
+    q->bc += weight * n[1] * n[2];
+    q->bd += weight * n[1] * d;
+    q->c2 += weight * n[2] * n[2];
+    q->cd += weight * n[2] * d;
+    q->d2 += weight * d * d;
+    q->weight += weight;
+}
+
+static void quadric_add(struct quadric *dst, const struct quadric *src)
+{
+    dst->a2 += src->a2;
+    dst->ab += src->ab;
+    dst->ac += src->ac;
+    dst->ad += src->ad;
+    dst->b2 += src->b2;
+    dst->bc += src->bc;
+    dst->bd += src->bd;
+    dst->c2 += src->c2;
+    dst->cd += src->cd;
+    dst->d2 += src->d2;
+    dst->weight += src->weight;
+}
+
+/* Squared distance of p to the planes of a + b, averaged by their weight */
+static double quadric_error(const struct quadric *a, const struct quadric *b, const float *p)
+{
+    double x = p[0], y = p[1], z = p[2];
+    double error = 0.0;
+    double weight = 0.0;
+
+    const struct quadric *qs[2] = { a, b };
+    for (size_t i = 0; i < 2; i++) {
+        const struct quadric *q = qs[i];
+        error += q->a2 * x * x + 2.0 * q->ab * x * y + 2.0 * q->ac * x * z + 2.0 * q->ad * x +
+                 q->b2 * y * y + 2.0 * q->bc * y * z + 2.0 * q->bd * y +
+                 q->c2 * z * z + 2.0 * q->cd * z +
+                 q->d2;
+        weight += q->weight;
+    }
+
+    if (weight <= 0.0) return 0.0;
+    return fabs(error) / weight;
+}
+
+static bool edge_set_init(struct edge_set *set, size_t n)
+{
+    size_t capacity = 16;
+    while (capacity < n * 2) capacity <<= 1;
+
+    set->keys = malloc(capacity * sizeof(uint64_t));
+    set->mask = capacity - 1;
+    if (set->keys == NULL) return false;
+
+    edge_set_clear(set);
+    return true;
+}
+
+static void edge_set_clear(struct edge_set *set)
+{
+    memset(set->keys, 0xFF, (set->mask + 1) * sizeof(uint64_t));
+}
+
+static void edge_set_insert(struct edge_set *set, uint32_t a, uint32_t b)
+{
+    uint64_t key = (uint64_t) a << 32 | b;
+    uint64_t hash = key * 0x9E3779B97F4A7C15ull;
+    size_t slot = (hash ^ (hash >> 32)) & set->mask;
+
+    while (set->keys[slot] != MESH_SIMPLIFY_EMPTY_EDGE) {
+        if (set->keys[slot] == key) return;
+        slot = (slot + 1) & set->mask;
+    }
+    set->keys[slot] = key;
+}
+
+static bool edge_set_contains(const struct edge_set *set, uint32_t a, uint32_t b)
+{
+    uint64_t key = (uint64_t) a << 32 | b;
+    uint64_t hash = key * 0x9E3779B97F4A7C15ull;
+    size_t slot = (hash ^ (hash >> 32)) & set->mask;
+
+    while (set->keys[slot] != MESH_SIMPLIFY_EMPTY_EDGE) {
+        if (set->keys[slot] == key) return true;
+        slot = (slot + 1) & set->mask;
+    }
+    return false;
+}
+
+static void edge_set_free(struct edge_set *set)
+{
+    free(set->keys);
+    set->keys = NULL;
+    set->mask = 0;
+}
+
+/* Cheapest first, ties broken by the vertices so the order is deterministic */
+static int collapse_compare(const void *a, const void *b)
+{
+    const struct collapse *left = a;
+    const struct collapse *right = b;
+
+    if (left->cost < right->cost) return -1;
+    if (left->cost > right->cost) return 1;
+    if (left->from != right->from) return (left->from > right->from) - (left->from < right->from);
+    return (left->to > right->to) - (left->to < right->to);
+}
+
+/* Appends indices in the size of the darray */
+static bool simplify_append_indices(darray *indices, const uint32_t *source, size_t n)
+{
+    if (!darray_reserve(indices, indices->len + n)) return false;
+
+    if (indices->item_size == sizeof(uint16_t)) {
+        uint16_t *narrow = (uint16_t *) indices->items + indices->len;
+        for (size_t i = 0; i < n; i++)
+            narrow[i] = (uint16_t) source[i];
+    } else {
+        memcpy((uint32_t *) indices->items + indices->len, source, n * sizeof(uint32_t));
+    }
+    indices->len += n;
+
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef SAGE_MESH_SIMPLIFY_H
+#define SAGE_MESH_SIMPLIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mesh.h"
+
+/*
+ * Simplifies a triangle list towards 'target_n_indices' indices by collapsing
+ * the edges with the least quadric error (Garland & Heckbert 1997), stopping
+ * early once a collapse would move the surface by more than 'max_error'.
+ *
+ * Collapses snap onto existing vertices so the result indexes into the same
+ * vertices as the input, which is what lets every LOD share one vertex buffer.
+ * Vertices split along uv or normal seams are collapsed together and the
+ * closest matching vertex is picked on the other side.
+ *
+ * 'out' must have room for n_indices indices. Returns the amount written and
+ * stores the largest error, as a distance in model space, in 'error'.
+ */
+size_t mesh_simplify(const struct vertex *vertices,
+                     size_t n_vertices,
+                     const uint32_t *indices,
+                     size_t n_indices,
+                     size_t target_n_indices,
+                     float max_error,
+                     uint32_t *out,
+                     float *error);
+
+/* The coarsest LOD generated has atmost this many triangles */
+#define MESH_LOD_TARGET_TRIANGLES 256
+
+/* Appends a chain of LODs of the index range starting at index_offset onto
+   the indices, each with half the triangles of the one before, until
+   MESH_LOD_TARGET_TRIANGLES or MESH_MAX_LODS is hit. Writes every LOD into
+   'lods' and returns how many there are, LOD 0 being the range as it was */
+size_t mesh_generate_lods(const darray *vertices,
+                          darray *indices,
+                          uint32_t index_offset,
+                          uint32_t index_count,
+                          struct mesh_lod lods[MESH_MAX_LODS]);
+
+#endif /* SAGE_MESH_SIMPLIFY_H */
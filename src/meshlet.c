@@ -0,0 +1,475 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "meshlet.h"
+#include "mesh.h"
+#include "mesh_optimize.h"
+#include "logger.h"
+#include "mnf/mnf_vector.h"
+#include "mnf/mnf_matrix.h"
+
+/* Cones wider than this (the cosine between the axis & the normal furthest
+   from it) can barely ever be culled, so they are not tested at all */
+#define MESHLET_CONE_MIN_SPREAD 0.1f
+
+/* How much a triangle facing away from the meshlet counts against adding it
+   compared to each vertex it adds, higher values give narrower cones at the
+   cost of more meshlets */
+#define MESHLET_CONE_WEIGHT 2.0f
+
+/* Cutoff of a meshlet that is never back face culled */
+#define MESHLET_CONE_DISABLED 2.0f
+
+static void meshlet_triangle_normal(const struct vertex *vertices,
+                                    const uint32_t *corners,
+                                    vec3 normal,
+                                    vec3 centroid);
+static void meshlet_compute_bounds(const struct vertex *vertices,
+                                   const uint32_t *triangles,
+                                   const uint32_t *order,
+                                   size_t n_triangles,
+                                   struct meshlet *meshlet);
+static void meshlet_position_classes(const struct vertex *vertices, size_t n_vertices,
+                                     uint32_t *class_of);
+static uint32_t meshlet_index(const void *indices, size_t index_size, size_t i);
+
+struct meshlet *meshlet_build(const struct vertex *vertices,
+                              void *indices,
+                              size_t index_size,
+                              size_t index_offset,
+                              size_t n_indices,
+                              size_t *n_meshlets)
+{
+    *n_meshlets = 0;
+
+    size_t n_triangles = n_indices / 3;
+    if (n_triangles == 0) return NULL;
+
+    uint32_t max_vertex = 0;
+    for (size_t i = 0; i < n_triangles * 3; i++) {
+        uint32_t v = meshlet_index(indices, index_size, index_offset + i);
+        if (v > max_vertex) max_vertex = v;
+    }
+    size_t n_vertices = (size_t) max_vertex + 1;
+
+    /* every meshlet has atleast MESHLET_MAX_VERTICES / 3 triangles unless it
+       runs out of neighbours, the worst case is one per triangle */
+    struct meshlet *meshlets = malloc(n_triangles * sizeof(struct meshlet));
+    uint32_t *triangles = malloc(n_triangles * 3 * sizeof(uint32_t));
+    uint32_t *order = malloc(n_triangles * sizeof(uint32_t));
+    vec3 *normals = malloc(n_triangles * sizeof(vec3));
+    vec3 *centroids = malloc(n_triangles * sizeof(vec3));
+    bool *emitted = calloc(n_triangles, sizeof(bool));
+    uint32_t *adjacency_offsets = calloc(n_vertices + 1, sizeof(uint32_t));
+    uint32_t *adjacency = malloc(n_triangles * 3 * sizeof(uint32_t));
+    uint32_t *last_used = malloc(n_vertices * sizeof(uint32_t));
+    uint32_t *class_of = malloc(n_vertices * sizeof(uint32_t));
+    if (meshlets == NULL || triangles == NULL || order == NULL || normals == NULL ||
+        centroids == NULL || emitted == NULL || adjacency_offsets == NULL ||
+        adjacency == NULL || last_used == NULL || class_of == NULL) {
+        SERROR("Failed to alloc memory for building meshlets");
+        free(meshlets);
+        meshlets = NULL;
+        goto cleanup;
+    }
+
+    /* neighbours are found through positions rather than vertices, flat
+       shaded meshes share no vertices between faces */
+    meshlet_position_classes(vertices, n_vertices, class_of);
+
+    for (size_t t = 0; t < n_triangles; t++) {
+        for (size_t k = 0; k < 3; k++) {
+            triangles[t * 3 + k] = meshlet_index(indices, index_size, index_offset + t * 3 + k);
+            adjacency_offsets[class_of[triangles[t * 3 + k]] + 1]++;
+        }
+        meshlet_triangle_normal(vertices, &triangles[t * 3], normals[t], centroids[t]);
+    }
+
+    /* triangles around each position */
+    for (size_t v = 0; v < n_vertices; v++)
+        adjacency_offsets[v + 1] += adjacency_offsets[v];
+    memcpy(last_used, adjacency_offsets, n_vertices * sizeof(uint32_t));
+    for (size_t t = 0; t < n_triangles; t++)
+        for (size_t k = 0; k < 3; k++)
+            adjacency[last_used[class_of[triangles[t * 3 + k]]]++] = (uint32_t) t;
+
+    memset(last_used, 0xFF, n_vertices * sizeof(uint32_t));
+
+    /* Grows each meshlet greedily out of triangles sharing its vertices,
+       preferring the ones adding the fewest vertices & facing the same way
+       as the meshlet so far, which keeps the normal cones narrow (similar to
+       meshopt_buildMeshlets of Zeux's meshoptimizer) */
+    size_t n_ordered = 0;
+    size_t n_built = 0;
+    size_t seed_cursor = 0;
+    vec3 last_center = {0.0f, 0.0f, 0.0f};
+
+    while (n_ordered < n_triangles) {
+        uint32_t meshlet_id = (uint32_t) n_built;
+        size_t begin = n_ordered;
+        size_t n_meshlet_vertices = 0;
+        uint32_t meshlet_vertices[MESHLET_MAX_VERTICES];
+        vec3 normal_sum = {0.0f, 0.0f, 0.0f};
+
+        /* seeds with the unused triangle closest to where the last meshlet
+           ended so neighbouring meshlets stay next to each other */
+        while (emitted[seed_cursor]) seed_cursor++;
+        uint32_t candidate = (uint32_t) seed_cursor;
+        if (n_built > 0) {
+            float best_distance = INFINITY;
+            for (size_t t = seed_cursor; t < n_triangles; t++) {
+                if (emitted[t]) continue;
+                vec3 offset;
+                mnf_vec3_sub(centroids[t], last_center, offset);
+                float distance = mnf_vec3_dot(offset, offset);
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    candidate = (uint32_t) t;
+                }
+            }
+        }
+
+        while (candidate != UINT32_MAX) {
+            const uint32_t *corners = &triangles[candidate * 3];
+            for (size_t k = 0; k < 3; k++) {
+                if (last_used[corners[k]] == meshlet_id) continue;
+                last_used[corners[k]] = meshlet_id;
+                meshlet_vertices[n_meshlet_vertices++] = corners[k];
+            }
+            emitted[candidate] = true;
+            order[n_ordered++] = candidate;
+            mnf_vec3_add(normal_sum, normals[candidate], normal_sum);
+
+            if (n_ordered - begin == MESHLET_MAX_TRIANGLES) break;
+
+            vec3 axis;
+            mnf_vec3_normalize(normal_sum, axis);
+
+            candidate = UINT32_MAX;
+            float best_score = INFINITY;
+            for (size_t i = 0; i < n_meshlet_vertices; i++) {
+                uint32_t v = class_of[meshlet_vertices[i]];
+                for (uint32_t a = adjacency_offsets[v]; a < adjacency_offsets[v + 1]; a++) {
+                    uint32_t t = adjacency[a];
+                    if (emitted[t]) continue;
+
+                    size_t n_new = 0;
+                    for (size_t k = 0; k < 3; k++)
+                        if (last_used[triangles[t * 3 + k]] != meshlet_id) n_new++;
+                    if (n_meshlet_vertices + n_new > MESHLET_MAX_VERTICES) continue;
+
+                    float spread = 1.0f - mnf_vec3_dot(axis, normals[t]);
+                    float score = (float) n_new + spread * MESHLET_CONE_WEIGHT;
+                    if (score < best_score) {
+                        best_score = score;
+                        candidate = t;
+                    }
+                }
+            }
+        }
+
+        struct meshlet *meshlet = &meshlets[n_built++];
+        meshlet->index_offset = (uint32_t) begin;
+        meshlet->index_count = (uint32_t) ((n_ordered - begin) * 3);
+        meshlet_compute_bounds(vertices, triangles, &order[begin], n_ordered - begin, meshlet);
+        mnf_vec3_copy(meshlet->center, last_center);
+    }
+
+    /* writes the triangles back in meshlet order, reordered once more for
+       the vertex cache inside each meshlet on their local vertices */
+    for (size_t i = 0; i < n_built; i++) {
+        struct meshlet *meshlet = &meshlets[i];
+        size_t begin = meshlet->index_offset;
+        size_t n_local_indices = meshlet->index_count;
+
+        uint32_t local[MESHLET_MAX_TRIANGLES * 3];
+        uint32_t local_vertices[MESHLET_MAX_VERTICES];
+        size_t n_local_vertices = 0;
+        for (size_t j = 0; j < n_local_indices; j++) {
+            uint32_t v = triangles[order[begin + j / 3] * 3 + j % 3];
+            size_t id = 0;
+            while (id < n_local_vertices && local_vertices[id] != v) id++;
+            if (id == n_local_vertices) local_vertices[n_local_vertices++] = v;
+            local[j] = (uint32_t) id;
+        }
+        mesh_optimize_triangles(local, n_local_indices, n_local_vertices);
+
+        meshlet->index_offset = (uint32_t) (index_offset + begin * 3);
+        for (size_t j = 0; j < n_local_indices; j++) {
+            uint32_t v = local_vertices[local[j]];
+            size_t at = meshlet->index_offset + j;
+            if (index_size == sizeof(uint16_t)) ((uint16_t *) indices)[at] = (uint16_t) v;
+            else ((uint32_t *) indices)[at] = v;
+        }
+    }
+
+    *n_meshlets = n_built;
+    struct meshlet *shrunk = realloc(meshlets, n_built * sizeof(struct meshlet));
+    if (shrunk != NULL) meshlets = shrunk;
+
+cleanup:
+    free(triangles);
+    free(order);
+    free(normals);
+    free(centroids);
+    free(emitted);
+    free(adjacency_offsets);
+    free(adjacency);
+    free(last_used);
+    free(class_of);
+    return meshlets;
+}
+
+void meshlet_view_create(mat4 projection, mat4 view, mat4 model, vec3 eye,
+                         struct meshlet_view *out)
+{
+    /* Gribb & Hartmann: the planes of the frustum are sums & differences of
+       the rows of the clip matrix, here in model space since the model
+       matrix is part of it. The matrices are column major */
+    mat4 view_model, clip;
+    mnf_mat4_mul(view, model, view_model);
+    mnf_mat4_mul(projection, view_model, clip);
+
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t j = 0; j < 2; j++) {
+            float sign = (j == 0) ? 1.0f : -1.0f;
+            float *plane = out->planes[i * 2 + j];
+            for (size_t k = 0; k < 4; k++)
+                plane[k] = clip[k][3] + sign * clip[k][i];
+
+            float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            if (length > 0.0f)
+                for (size_t k = 0; k < 4; k++) plane[k] /= length;
+        }
+    }
+
+    /* the camera in model space */
+    mat4 inverse;
+    mnf_mat4_inv(model, inverse);
+    vec4 world_eye = { eye[0], eye[1], eye[2], 1.0f };
+    vec4 model_eye;
+    mnf_mat4_mul_vec4(inverse, world_eye, model_eye);
+    mnf_vec3_copy(model_eye, out->eye);
+
+    /* a mirroring transform turns the winding & so the facing around */
+    out->cull_backfaces = mnf_mat4_det(model) > 0.0f;
+}
+
+bool meshlet_view_test_aabb(const struct meshlet_view *view, const vec3 min, const vec3 max)
+{
+    /* only the corner furthest along the normal of a plane has to be checked */
+    for (size_t p = 0; p < 6; p++) {
+        const float *plane = view->planes[p];
+        float distance = plane[0] * (plane[0] >= 0.0f ? max[0] : min[0]) +
+                         plane[1] * (plane[1] >= 0.0f ? max[1] : min[1]) +
+                         plane[2] * (plane[2] >= 0.0f ? max[2] : min[2]) + plane[3];
+        if (distance < 0.0f) return false;
+    }
+
+    return true;
+}
+
+size_t meshlet_cull(const struct meshlet *meshlets,
+                    size_t n_meshlets,
+                    const struct meshlet_view *view,
+                    size_t index_size,
+                    int32_t *counts,
+                    const void **offsets,
+                    struct meshlet_stats *stats)
+{
+    size_t n_ranges = 0;
+    uint32_t range_end = UINT32_MAX;
+
+    for (size_t i = 0; i < n_meshlets; i++) {
+        const struct meshlet *meshlet = &meshlets[i];
+        stats->meshlets++;
+        stats->triangles += meshlet->index_count / 3;
+
+        bool outside = false;
+        for (size_t p = 0; p < 6 && !outside; p++) {
+            const float *plane = view->planes[p];
+            float distance = plane[0] * meshlet->center[0] +
+                             plane[1] * meshlet->center[1] +
+                             plane[2] * meshlet->center[2] + plane[3];
+            outside = distance < -meshlet->radius;
+        }
+        if (outside) {
+            stats->culled_frustum++;
+            continue;
+        }
+
+        if (view->cull_backfaces && meshlet->cone_cutoff <= 1.0f) {
+            vec3 direction;
+            mnf_vec3_sub((float *) meshlet->cone_apex, (float *) view->eye, direction);
+            float length = mnf_vec3_norm(direction);
+            if (length > 0.0f &&
+                mnf_vec3_dot(direction, (float *) meshlet->cone_axis) >= meshlet->cone_cutoff * length) {
+                stats->culled_backface++;
+                continue;
+            }
+        }
+
+        stats->triangles_drawn += meshlet->index_count / 3;
+
+        /* meshlets next to each other in the index buffer become one range */
+        if (n_ranges > 0 && range_end == meshlet->index_offset) {
+            counts[n_ranges - 1] += meshlet->index_count;
+        } else {
+            counts[n_ranges] = meshlet->index_count;
+            offsets[n_ranges] = (const void *) ((size_t) meshlet->index_offset * index_size);
+            n_ranges++;
+        }
+        range_end = meshlet->index_offset + meshlet->index_count;
+    }
+
+    stats->draw_ranges += n_ranges;
+    return n_ranges;
+}
+
+/* Unit normal & centroid of a triangle, the normal is zero if it's degenerate */
+static void meshlet_triangle_normal(const struct vertex *vertices,
+                                    const uint32_t *corners,
+                                    vec3 normal,
+                                    vec3 centroid)
+{
+    const float *p0 = vertices[corners[0]].pos;
+    const float *p1 = vertices[corners[1]].pos;
+    const float *p2 = vertices[corners[2]].pos;
+
+    vec3 e1, e2;
+    mnf_vec3_sub((float *) p1, (float *) p0, e1);
+    mnf_vec3_sub((float *) p2, (float *) p0, e2);
+    mnf_vec3_cross(e1, e2, normal);
+    mnf_vec3_normalize(normal, normal);
+
+    for (size_t axis = 0; axis < 3; axis++)
+        centroid[axis] = (p0[axis] + p1[axis] + p2[axis]) / 3.0f;
+}
+
+/* Bounding sphere around the box of the vertices, and the cone around the
+   triangle normals (Zeux's meshoptimizer, meshopt_computeClusterBounds) */
+static void meshlet_compute_bounds(const struct vertex *vertices,
+                                   const uint32_t *triangles,
+                                   const uint32_t *order,
+                                   size_t n_triangles,
+                                   struct meshlet *meshlet)
+{
+    vec3 min, max;
+    mnf_vec3_copy((float *) vertices[triangles[order[0] * 3]].pos, min);
+    mnf_vec3_copy(min, max);
+    for (size_t t = 0; t < n_triangles; t++) {
+        for (size_t k = 0; k < 3; k++) {
+            const float *pos = vertices[triangles[order[t] * 3 + k]].pos;
+            for (size_t axis = 0; axis < 3; axis++) {
+                if (pos[axis] < min[axis]) min[axis] = pos[axis];
+                if (pos[axis] > max[axis]) max[axis] = pos[axis];
+            }
+        }
+    }
+
+    vec3 center;
+    mnf_vec3_add(min, max, center);
+    mnf_vec3_scale(center, 0.5f, center);
+
+    float radius = 0.0f;
+    for (size_t t = 0; t < n_triangles; t++) {
+        for (size_t k = 0; k < 3; k++) {
+            vec3 offset;
+            mnf_vec3_sub((float *) vertices[triangles[order[t] * 3 + k]].pos, center, offset);
+            float distance = mnf_vec3_norm(offset);
+            if (distance > radius) radius = distance;
+        }
+    }
+
+    mnf_vec3_copy(center, meshlet->center);
+    meshlet->radius = radius;
+    meshlet->reserved = 0;
+
+    /* the axis is the average of the triangle normals */
+    vec3 normals[MESHLET_MAX_TRIANGLES];
+    vec3 axis = {0.0f, 0.0f, 0.0f};
+    for (size_t t = 0; t < n_triangles; t++) {
+        vec3 centroid;
+        meshlet_triangle_normal(vertices, &triangles[order[t] * 3], normals[t], centroid);
+        mnf_vec3_add(axis, normals[t], axis);
+    }
+    mnf_vec3_normalize(axis, axis);
+
+    float min_dot = 1.0f;
+    for (size_t t = 0; t < n_triangles; t++) {
+        if (mnf_vec3_norm(normals[t]) == 0.0f) continue;
+        float dot = mnf_vec3_dot(axis, normals[t]);
+        if (dot < min_dot) min_dot = dot;
+    }
+
+    if (mnf_vec3_norm(axis) == 0.0f || min_dot <= MESHLET_CONE_MIN_SPREAD) {
+        mnf_vec3_copy(center, meshlet->cone_apex);
+        mnf_vec3_copy(MNF_ZERO_VECTOR, meshlet->cone_axis);
+        meshlet->cone_cutoff = MESHLET_CONE_DISABLED;
+        return;
+    }
+
+    /* the apex is pulled back along the axis until every triangle plane is
+       in front of it, so testing the direction from the apex is conservative
+       for every point of the cluster */
+    float max_t = 0.0f;
+    for (size_t t = 0; t < n_triangles; t++) {
+        if (mnf_vec3_norm(normals[t]) == 0.0f) continue;
+
+        vec3 offset;
+        mnf_vec3_sub(center, (float *) vertices[triangles[order[t] * 3]].pos, offset);
+        float distance = mnf_vec3_dot(offset, normals[t]);
+        float along = mnf_vec3_dot(axis, normals[t]);
+        float t_plane = distance / along;
+        if (t_plane > max_t) max_t = t_plane;
+    }
+
+    vec3 pull;
+    mnf_vec3_scale(axis, max_t, pull);
+    mnf_vec3_sub(center, pull, meshlet->cone_apex);
+    mnf_vec3_copy(axis, meshlet->cone_axis);
+    meshlet->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+/* Maps every vertex onto the first vertex with the exact same position */
+static void meshlet_position_classes(const struct vertex *vertices, size_t n_vertices,
+                                     uint32_t *class_of)
+{
+    size_t capacity = 16;
+    while (capacity < n_vertices * 2) capacity <<= 1;
+
+    uint32_t *table = malloc(capacity * sizeof(uint32_t));
+    if (table == NULL) {
+        /* meshlets still build, only without crossing seams */
+        for (size_t v = 0; v < n_vertices; v++) class_of[v] = (uint32_t) v;
+        return;
+    }
+    memset(table, 0xFF, capacity * sizeof(uint32_t));
+
+    for (size_t v = 0; v < n_vertices; v++) {
+        uint32_t bits[3];
+        memcpy(bits, vertices[v].pos, sizeof(bits));
+
+        uint64_t hash = bits[0] * 0x9E3779B97F4A7C15ull ^
+                        bits[1] * 0xC2B2AE3D27D4EB4Full ^
+                        bits[2] * 0x165667B19E3779F9ull;
+        size_t slot = (hash ^ (hash >> 32)) & (capacity - 1);
+
+        while (table[slot] != UINT32_MAX &&
+               memcmp(vertices[table[slot]].pos, vertices[v].pos, sizeof(vec3)) != 0)
+            slot = (slot + 1) & (capacity - 1);
+
+        if (table[slot] == UINT32_MAX) table[slot] = (uint32_t) v;
+        class_of[v] = table[slot];
+    }
+
+    free(table);
+}
+
+static uint32_t meshlet_index(const void *indices, size_t index_size, size_t i)
+{
+    return (index_size == sizeof(uint16_t)) ? ((const uint16_t *) indices)[i]
+                                            : ((const uint32_t *) indices)[i];
+}
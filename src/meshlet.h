@@ -0,0 +1,86 @@
+#ifndef SAGE_MESHLET_H
+#define SAGE_MESHLET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "mnf/mnf_types.h"
+
+/* Limits of a single meshlet, the same ones mesh shading hardware prefers so
+   the clusters stay small enough to cull precisely */
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+struct vertex;
+
+/*
+ * A cluster of triangles drawn from a range of the index buffer of LOD 0,
+ * with the bounds needed to cull it as a whole in model space.
+ *
+ * The normal cone holds the normals of every triangle: the cluster faces away
+ * from a camera at 'eye' when
+ *      dot(normalize(cone_apex - eye), cone_axis) >= cone_cutoff
+ * A cutoff above 1 means the triangles face too many ways to ever be culled.
+ */
+struct meshlet {
+    uint32_t index_offset;
+    uint32_t index_count;
+    vec3 center;
+    float radius;
+    vec3 cone_apex;
+    float cone_cutoff;
+    vec3 cone_axis;
+    uint32_t reserved;
+};
+
+/* What the meshlets of a model are culled against, in the model's space */
+struct meshlet_view {
+    vec4 planes[6];     /* frustum planes as (normal, distance), normals point inwards */
+    vec3 eye;
+    bool cull_backfaces; /* false for mirrored transforms */
+};
+
+/* Culling results of a frame, accumulated over every model drawn */
+struct meshlet_stats {
+    uint32_t meshlets;
+    uint32_t culled_backface;
+    uint32_t culled_frustum;
+    uint32_t triangles;
+    uint32_t triangles_drawn;
+    uint32_t draw_ranges;
+    uint32_t submeshes;
+    uint32_t culled_submeshes; /* outside the frustum, their meshlets aren't counted */
+};
+
+/* Splits the indices (uint16_t or uint32_t depending on index_size) from
+   index_offset up to index_offset + n_indices into meshlets, reordering the
+   triangles of the range in place so each meshlet is one range. Returns a
+   malloc'd array or NULL if there are no triangles */
+struct meshlet *meshlet_build(const struct vertex *vertices,
+                              void *indices,
+                              size_t index_size,
+                              size_t index_offset,
+                              size_t n_indices,
+                              size_t *n_meshlets);
+
+/* Moves the view frustum & the camera into the space of a model */
+void meshlet_view_create(mat4 projection, mat4 view, mat4 model, vec3 eye,
+                         struct meshlet_view *out);
+
+/* Returns false if the box (in the same space as the meshlets) is entirely
+   outside of one of the frustum planes */
+bool meshlet_view_test_aabb(const struct meshlet_view *view, const vec3 min, const vec3 max);
+
+/* Culls the meshlets & writes the index ranges that are left into counts &
+   offsets (room for n_meshlets each), merging ranges that follow each other.
+   Returns the amount of ranges */
+size_t meshlet_cull(const struct meshlet *meshlets,
+                    size_t n_meshlets,
+                    const struct meshlet_view *view,
+                    size_t index_size,
+                    int32_t *counts,
+                    const void **offsets,
+                    struct meshlet_stats *stats);
+
+#endif /* SAGE_MESHLET_H */
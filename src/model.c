@@ -1,4 +1,8 @@
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <stdbool.h>
 
 #include "material.h"
 #include "mesh.h"
@@ -7,26 +11,66 @@
 #include "model.h"
 #include "shader.h"
 #include "mnf/mnf_vector.h"
-#include "obj_loader.h"
+#include "mtl_loader.h"
+#include "gltf_loader.h"
+#include "resource_cache.h"
+#include "texture_residency.h"
 #include "darray.h"
 #include "texture.h"
+#include "instance_buffer.h"
+#include "gl_state.h"
 #include "logger.h"
+#include "config.h"
+
+/* Ids of the uniforms models set, resolved on the first draw */
+struct model_uniforms {
+    shader_uniform position_scale;
+    shader_uniform position_bias;
+    shader_uniform octahedral_normals;
+};
+
+static struct model_uniforms uniforms;
 
 static void transform_model_matrix(struct transform transform, mat4 out);
+static void model_bind(const struct model *model, struct shader shader);
+static void model_load_materials(struct model *model);
+static void model_resolve_materials(struct model *model);
+static bool model_is_gltf(const char *path);
+static float model_screen_size(const struct model *model, const struct camera *cam);
+static void model_submesh_matrix(const struct model *model, uint32_t submesh,
+                                 mat4 model_matrix, mat4 out);
+static struct material model_submesh_material(const struct model *model, uint32_t submesh);
+static float model_view_depth(const struct aabb *bounds, mat4 matrix, const struct camera *cam);
 
 struct model model_load_from_file(const char *path)
 {
     struct model model;
-    struct mesh mesh;
+    model.mesh_job = 0;
+    model.mesh_resource = 0;
+    model.owns_mesh = false;
 
-    darray *vertices = NULL;
-    darray *indices = NULL;
-    obj_load_mesh(path, &vertices, &indices);
-    mesh = mesh_create(vertices, indices);
+    if (model_is_gltf(path)) {
+        /* glTF goes straight from the file into GL buffers, it has nothing the
+           cache or the asset loader would save */
+        if (!gltf_load(path, &model.mesh, &model.library)) {
+            SFATAL("Failed to load model '%s'", path);
+            exit(1);
+        }
+        model.owns_mesh = true;
+    } else {
+        /* every model of the same .obj draws the same mesh, unless the cache
+           is full & it's the model's own once it's loaded */
+        model.mesh_resource = resource_cache_mesh(path, &model.mesh, &model.mesh_job);
+        model.owns_mesh = model.mesh_resource == 0 && model.mesh_job == 0;
+    }
 
-    model.mesh = mesh;
     model.visible = true;
+    model.lod = 0;
     model.material = material_create_default();
+    if (model_is_gltf(path))
+        model_resolve_materials(&model);
+    else
+        model_load_materials(&model);
     
     mnf_vec3_copy(MNF_ONE_VECTOR, model.transform.scale);
     mnf_vec3_copy(MNF_ZERO_VECTOR, model.transform.rotation);
@@ -37,16 +81,32 @@ struct model model_load_from_file(const char *path)
     return model;
 }
 
-struct model model_create_cube(void)
+bool model_stream(struct model *model)
 {
-    struct model model;
     struct mesh mesh;
+    if (model->mesh_job == 0 || !asset_loader_mesh(model->mesh_job, &mesh)) return false;
+
+    /* the placeholder belongs to the asset loader, it's only replaced */
+    model->mesh = mesh;
+    model->mesh_job = 0;
+    model->owns_mesh = model->mesh_resource == 0;
+    model->lod = 0;
+    model_load_materials(model);
 
-    mesh = mesh_geometry_create_cube();
-    model.mesh = mesh;
+    return true;
+}
+
+struct model model_create_cube(void)
+{
+    struct model model;
+    model.mesh_resource = resource_cache_cube(&model.mesh);
+    model.mesh_job = 0;
+    model.owns_mesh = model.mesh_resource == 0;
     model.visible = true;
+    model.lod = 0;
 
     model.material = material_create_default();
+    model_load_materials(&model);
     
     mnf_vec3_copy(MNF_ONE_VECTOR, model.transform.scale);
     mnf_vec3_copy(MNF_ZERO_VECTOR, model.transform.rotation);
@@ -55,30 +115,156 @@ struct model model_create_cube(void)
     return model;
 }
 
-void model_set_name(struct model *model, char name[MODEL_NAME_MAX_SIZE])
+void model_set_name(struct model *model, const char *name)
 {
-    strncpy(model->name, name, MODEL_NAME_MAX_SIZE);
+    snprintf(model->name, sizeof(model->name), "%s", name);
 }
 
-void model_draw(struct model model, struct shader shader)
+void model_queue(const struct model *model,
+                 uint32_t id,
+                 struct shader shader,
+                 const struct camera *cam,
+                 struct render_queue *queue,
+                 struct meshlet_stats *stats)
 {
-    struct material material = model.material;
-    texture_bind(material.diffuse_map, 0);
-    texture_bind(material.specular_map, 1);
-
     mat4 model_matrix;
-    transform_model_matrix(model.transform, model_matrix);
+    transform_model_matrix(model->transform, model_matrix);
+
+    struct meshlet_view view;
+    meshlet_view_create((float (*)[4]) cam->projection,
+                        (float (*)[4]) cam->view,
+                        model_matrix,
+                        (float *) cam->pos,
+                        &view);
+
+    /* how much of their textures is seen decides which mips stay resident */
+    float screen_size = model_screen_size(model, cam);
+
+    for (uint32_t i = 0; i < model->mesh.n_submeshes; i++) {
+        const struct mesh_submesh *submesh = &model->mesh.submeshes[i];
+
+        /* submeshes with a transform of their own are culled in their space */
+        mat4 submesh_matrix;
+        model_submesh_matrix(model, i, model_matrix, submesh_matrix);
+        if (model->mesh.streams != NULL)
+            meshlet_view_create((float (*)[4]) cam->projection,
+                                (float (*)[4]) cam->view,
+                                submesh_matrix,
+                                (float *) cam->pos,
+                                &view);
+
+        stats->submeshes++;
+        if (!meshlet_view_test_aabb(&view, submesh->bounds.min, submesh->bounds.max)) {
+            stats->culled_submeshes++;
+            continue;
+        }
+
+        struct material material = model_submesh_material(model, i);
+        texture_residency_use(material.diffuse_map, screen_size);
+        texture_residency_use(material.specular_map, screen_size);
+
+        uint32_t vao = model->mesh.streams ? model->mesh.streams[i].vao : model->mesh.buffer.vao;
+        render_queue_push(queue, RENDER_PASS_OPAQUE, shader.handle, material_key(material), vao,
+                          model_view_depth(&submesh->bounds, submesh_matrix, cam), id, i);
+    }
+}
+
+uint32_t model_push_instance(const struct model *model, uint32_t submesh, vec3 color)
+{
+    mat4 model_matrix, submesh_matrix;
+    transform_model_matrix(model->transform, model_matrix);
+    model_submesh_matrix(model, submesh, model_matrix, submesh_matrix);
+
+    struct material material = model_submesh_material(model, submesh);
+    struct instance_material params;
+    memset(&params, 0, sizeof(params));
+    mnf_vec3_copy(color, params.color);
+    params.shininess = material.shininess;
+    params.packed = material.packed;
+
+    return instance_buffer_push(submesh_matrix, instance_buffer_material(&params));
+}
+
+bool model_batches_with(const struct model *model, const struct model *other, uint32_t submesh)
+{
+    if (model->mesh.buffer.vao != other->mesh.buffer.vao || model->mesh.streams != other->mesh.streams ||
+        model->lod != other->lod)
+        return false;
 
-    mesh_bind(model.mesh);
-    shader_uniform_mat4(shader, "u_model", model_matrix);
-    mesh_draw(model.mesh);
+    struct material material = model_submesh_material(model, submesh);
+    struct material other_material = model_submesh_material(other, submesh);
+    return material.diffuse_map.id == other_material.diffuse_map.id &&
+           material.specular_map.id == other_material.specular_map.id;
+}
+
+void model_draw_instances(const struct model *model,
+                          uint32_t submesh,
+                          uint32_t first,
+                          uint32_t n_instances,
+                          struct shader shader,
+                          const struct camera *cam,
+                          bool cone_culling,
+                          struct model_draw_state *state,
+                          struct meshlet_stats *stats)
+{
+    if (state->model != model) {
+        model_bind(model, shader);
+        state->model = model;
+    }
+
+    /* the instance attributes are state of the VAO the submesh is drawn from */
+    uint32_t vao = model->mesh.streams ? model->mesh.streams[submesh].vao : model->mesh.buffer.vao;
+    gl_state_bind_vertex_array(vao);
+    instance_buffer_bind(first);
+
+    struct material material = model_submesh_material(model, submesh);
+    if (!state->applied || material.diffuse_map.id != state->material.diffuse_map.id ||
+        material.specular_map.id != state->material.specular_map.id) {
+        material_apply(material);
+        state->material = material;
+        state->applied = true;
+    }
+
+    if (n_instances > 1) {
+        mesh_draw_instanced(model->mesh, submesh, model->lod, n_instances);
+        return;
+    }
+
+    /* a lone instance keeps its meshlets culled in its own space */
+    mat4 instance_matrix;
+    mnf_mat4_copy((float (*)[4]) instance_buffer_at(first)->model, instance_matrix);
+
+    struct meshlet_view view;
+    meshlet_view_create((float (*)[4]) cam->projection,
+                        (float (*)[4]) cam->view,
+                        instance_matrix,
+                        (float *) cam->pos,
+                        &view);
+    view.cull_backfaces = view.cull_backfaces && cone_culling;
+    mesh_draw_culled(model->mesh, submesh, model->lod, &view, stats);
+}
+
+void model_set_material(struct model *model, struct material material)
+{
+    material_destroy(&model->material);
+    model->material = material;
 }
 
 void model_destroy(struct model *model)
 {
-    texture_destroy(&model->material.diffuse_map);
-    texture_destroy(&model->material.specular_map);
-    mesh_destroy(&model->mesh);
+    material_destroy(&model->material);
+    mtl_destroy(&model->library);
+    free(model->submesh_materials);
+    model->submesh_materials = NULL;
+
+    /* shared meshes are the cache's to destroy & placeholders the asset
+       loader's */
+    if (model->mesh_resource != 0)
+        resource_cache_release_mesh(model->mesh_resource);
+    else if (model->owns_mesh)
+        mesh_destroy(&model->mesh);
+    model->mesh_resource = 0;
+    model->owns_mesh = false;
 }
 
 void model_reset_transform(struct model *model) 
@@ -103,6 +289,162 @@ void model_translate(struct model *model, vec3 position)
     mnf_vec3_copy(position, model->transform.position);
 }
 
+uint32_t model_select_lod(const struct model *model, const struct camera *cam)
+{
+    const struct mesh *mesh = &model->mesh;
+    if (mesh->n_lods <= 1) return 0;
+
+    float sphere_size = model_screen_size(model, cam);
+    if (sphere_size <= 0.0f || isinf(sphere_size)) return 0;
+
+    /* the errors are in the space of the mesh, as is the radius they're
+       compared against */
+    vec3 extent;
+    mnf_vec3_sub((float *) mesh->bounds.max, (float *) mesh->bounds.min, extent);
+    float radius = mnf_vec3_norm(extent) * 0.5f;
+
+    for (uint32_t lod = mesh->n_lods - 1; lod > 0; lod--) {
+        float screen_error = mesh_lod_error(mesh, lod) / radius * sphere_size * 0.5f;
+        if (screen_error < SAGE_LOD_MAX_SCREEN_ERROR) return lod;
+    }
+
+    return 0;
+}
+
+/* Height of the bounding sphere of the model on screen as a fraction of the
+   screen's height, infinite with the camera inside of it */
+static float model_screen_size(const struct model *model, const struct camera *cam)
+{
+    const struct mesh *mesh = &model->mesh;
+
+    /* bounding sphere around the bounds, moved into world space */
+    vec3 center, extent;
+    mnf_vec3_add((float *) mesh->bounds.min, (float *) mesh->bounds.max, center);
+    mnf_vec3_scale(center, 0.5f, center);
+    mnf_vec3_sub((float *) mesh->bounds.max, (float *) mesh->bounds.min, extent);
+
+    mat4 model_matrix;
+    transform_model_matrix(model->transform, model_matrix);
+    vec4 local_center = { center[0], center[1], center[2], 1.0f };
+    vec4 world_center;
+    mnf_mat4_mul_vec4(model_matrix, local_center, world_center);
+
+    float scale = fmaxf(fabsf(model->transform.scale[0]),
+                  fmaxf(fabsf(model->transform.scale[1]), fabsf(model->transform.scale[2])));
+    float radius = mnf_vec3_norm(extent) * 0.5f * scale;
+
+    if (radius <= 0.0f) return 0.0f;
+
+    vec3 to_camera;
+    mnf_vec3_sub(world_center, (float *) cam->pos, to_camera);
+    float distance = mnf_vec3_norm(to_camera) - radius;
+    if (distance <= cam->near) return INFINITY;
+
+    /* projection[1][1] is cot(fov / 2), it turns a length at 'distance' into
+       a fraction of half the screen height, which for the radius is the
+       fraction of the whole height the sphere covers. The bigger the sphere
+       is on screen the less error each of its LODs is allowed */
+    return radius * cam->projection[1][1] / distance;
+}
+
+/* Loads the material library of the mesh & resolves the material of every
+   submesh in it, submeshes whose material can't be found use model.material */
+static void model_load_materials(struct model *model)
+{
+    const struct mesh *mesh = &model->mesh;
+    model->library.materials = NULL;
+    model->library.textures = NULL;
+    model->submesh_materials = NULL;
+
+    if (mesh->material_library[0] == '\0') return;
+    if (!mtl_load(mesh->material_library, &model->library)) {
+        SWARN("Drawing '%s' with the material of the model instead", mesh->material_library);
+        return;
+    }
+
+    model_resolve_materials(model);
+}
+
+/* Looks the material of every submesh up in model.library */
+static void model_resolve_materials(struct model *model)
+{
+    const struct mesh *mesh = &model->mesh;
+    model->submesh_materials = NULL;
+    if (model->library.materials == NULL) return;
+
+    model->submesh_materials = malloc(mesh->n_submeshes * sizeof(int32_t));
+    if (model->submesh_materials == NULL) {
+        SERROR("Failed to alloc memory for the materials of %u submeshes", mesh->n_submeshes);
+        return;
+    }
+
+    for (uint32_t i = 0; i < mesh->n_submeshes; i++) {
+        const char *name = mesh->submeshes[i].material;
+        model->submesh_materials[i] = mtl_find(&model->library, name);
+        if (model->submesh_materials[i] < 0 && name[0] != '\0')
+            SWARN("Material '%s' isn't in '%s'", name, mesh->material_library);
+    }
+}
+
+static struct material model_submesh_material(const struct model *model, uint32_t submesh)
+{
+    int32_t index = model->submesh_materials ? model->submesh_materials[submesh] : -1;
+    return (index >= 0) ? mtl_material_at(&model->library, index) : model->material;
+}
+
+/* Distance along the view direction to the center of 'bounds' placed by 'matrix' */
+static float model_view_depth(const struct aabb *bounds, mat4 matrix, const struct camera *cam)
+{
+    vec4 center = {
+        (bounds->min[0] + bounds->max[0]) * 0.5f,
+        (bounds->min[1] + bounds->max[1]) * 0.5f,
+        (bounds->min[2] + bounds->max[2]) * 0.5f,
+        1.0f,
+    };
+    vec4 world_center;
+    mnf_mat4_mul_vec4(matrix, center, world_center);
+
+    vec3 to_center;
+    mnf_vec3_sub(world_center, (float *) cam->pos, to_center);
+    return mnf_vec3_dot(to_center, (float *) cam->forward);
+}
+
+static bool model_is_gltf(const char *path)
+{
+    const char *extension = strrchr(path, '.');
+    return extension != NULL && (strcmp(extension, ".gltf") == 0 || strcmp(extension, ".glb") == 0);
+}
+
+/* Model matrix of a submesh, streamed meshes have a transform per submesh */
+static void model_submesh_matrix(const struct model *model, uint32_t submesh,
+                                 mat4 model_matrix, mat4 out)
+{
+    if (model->mesh.streams == NULL) {
+        mnf_mat4_copy(model_matrix, out);
+        return;
+    }
+    mnf_mat4_mul(model_matrix, model->mesh.streams[submesh].transform, out);
+}
+
+static void model_bind(const struct model *model, struct shader shader)
+{
+    if (uniforms.position_scale == 0) {
+        uniforms.position_scale = shader_uniform_id("u_position_scale");
+        uniforms.position_bias = shader_uniform_id("u_position_bias");
+        uniforms.octahedral_normals = shader_uniform_id("u_octahedral_normals");
+    }
+
+    /* compact vertex formats are decoded in the vertex shader */
+    vec3 position_scale, position_bias;
+    mesh_dequantization(&model->mesh, position_scale, position_bias);
+    bool octahedral_normals = model->mesh.buffer.format != VERTEX_FORMAT_FLOAT;
+
+    mesh_bind(model->mesh);
+    shader_set_vec3(shader, uniforms.position_scale, position_scale);
+    shader_set_vec3(shader, uniforms.position_bias, position_bias);
+    shader_set_1i(shader, uniforms.octahedral_normals, octahedral_normals);
+}
+
 static void transform_model_matrix(struct transform transform, mat4 out)
 {
     mnf_mat4_identity(out);
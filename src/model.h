@@ -6,6 +6,11 @@
 #include "material.h"
 #include "shader.h"
 #include "mesh.h"
+#include "camera.h"
+#include "mtl_loader.h"
+#include "asset_loader.h"
+#include "resource_cache.h"
+#include "render_queue.h"
 
 #define MODEL_NAME_MAX_SIZE 64
 
@@ -18,15 +23,67 @@ struct transform {
 struct model {
     char name[MODEL_NAME_MAX_SIZE];
     struct mesh mesh;
-    struct material material;
+    struct material material;   /* for submeshes without one of their own */
+    struct mtl_library library; /* materials of the submeshes */
+    int32_t *submesh_materials; /* per submesh index into 'library', -1 for 'material' */
     struct transform transform;
     bool visible;
+    uint32_t lod;   /* the LOD of the mesh that's drawn */
+    asset_job mesh_job; /* while the mesh is streamed in 'mesh' is a placeholder, 0 once loaded */
+    resource_mesh mesh_resource; /* the shared mesh of resource_cache.h, 0 if it's the model's */
+    bool owns_mesh; /* destroyed with the model, never while 'mesh' is a placeholder */
 };
 
+/* Loads a .obj, .gltf or .glb. With the asset loader running .obj files are
+   streamed in, the model starts out with a placeholder mesh */
 struct model model_load_from_file(const char *path);
-void model_set_name(struct model *model, char name[MODEL_NAME_MAX_SIZE]);
+/* Swaps the streamed mesh in once the asset loader has uploaded it, returns
+   true on the call that swaps it in */
+bool model_stream(struct model *model);
+void model_set_name(struct model *model, const char *name);
+/* Unit cube, every cube shares the same mesh */
 struct model model_create_cube(void);
-void model_draw(struct model model, struct shader shader);
+/* Replaces the material of the model, releasing the textures of the old one */
+void model_set_material(struct model *model, struct material material);
+
+/* What the last model_draw_instances() left set, so the next one only sets
+   what differs. Zeroed before the first draw & whenever something else
+   changed the shader or the textures */
+struct model_draw_state {
+    const struct model *model;
+    struct material material;
+    bool applied;
+};
+
+/* Pushes a draw into 'queue' for every submesh in the view of 'cam' with its
+   own material, tagged with 'id'. The culled submeshes are counted in 'stats' */
+void model_queue(const struct model *model,
+                 uint32_t id,
+                 struct shader shader,
+                 const struct camera *cam,
+                 struct render_queue *queue,
+                 struct meshlet_stats *stats);
+/* Adds an instance of a submesh to the instance buffer placed by the model's
+   transform, 'color' is only read by the light gizmos. Returns its index */
+uint32_t model_push_instance(const struct model *model, uint32_t submesh, vec3 color);
+/* True if a submesh of both models can be drawn by the same instanced draw,
+   they share the mesh, its LOD & the textures of the submesh */
+bool model_batches_with(const struct model *model, const struct model *other, uint32_t submesh);
+/* Draws 'n_instances' of a submesh queued by model_queue() from the instance
+   'first' on with a single draw. A lone instance has its meshlets culled
+   against the view of 'cam', back facing ones only if 'cone_culling' is set
+   since faces aren't culled for meshes that aren't closed */
+void model_draw_instances(const struct model *model,
+                          uint32_t submesh,
+                          uint32_t first,
+                          uint32_t n_instances,
+                          struct shader shader,
+                          const struct camera *cam,
+                          bool cone_culling,
+                          struct model_draw_state *state,
+                          struct meshlet_stats *stats);
+/* Picks the LOD of the mesh from how big its bounding sphere is on screen */
+uint32_t model_select_lod(const struct model *model, const struct camera *cam);
 void model_destroy(struct model *model);
 
 void model_reset_transform(struct model *model);
@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mtl_loader.h"
+#include "darray.h"
+#include "file.h"
+#include "logger.h"
+#include "resource_cache.h"
+
+/* Longest statement of a .mtl file that is looked at */
+#define MTL_LINE_MAX_SIZE 512
+
+/* A material while its statements are being read */
+struct mtl_pending {
+    char name[MESH_NAME_MAX_SIZE];
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+    char diffuse_map[MESH_PATH_MAX_SIZE];
+    char specular_map[MESH_PATH_MAX_SIZE];
+};
+
+static void mtl_pending_reset(struct mtl_pending *pending, const char *name);
+static void mtl_finish(struct mtl_library *library, const struct mtl_pending *pending);
+static struct texture mtl_texture(struct mtl_library *library,
+                                  const char *map,
+                                  const float color[3],
+                                  enum texture_role role);
+static void mtl_parse_color(const char *p, float out[3]);
+static void mtl_parse_map(const char *mtl_path, const char *p, char out[MESH_PATH_MAX_SIZE]);
+static const char *mtl_statement(const char *line, const char *tag);
+
+bool mtl_load(const char *path, struct mtl_library *library)
+{
+    library->materials = NULL;
+    library->textures = NULL;
+
+    struct mapped_file file;
+    if (!file_map(path, &file)) {
+        SWARN("Failed to open material library '%s'", path);
+        return false;
+    }
+
+    if (!mtl_library_init(library)) {
+        SERROR("Failed to alloc memory for material library '%s'", path);
+        file_unmap(&file);
+        return false;
+    }
+
+    struct mtl_pending pending;
+    bool has_pending = false;
+
+    const char *p = file.data;
+    const char *end = p + file.size;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (eol == NULL) eol = end;
+
+        /* the mapping isn't null terminated, statements are short enough to
+           be copied out */
+        char line[MTL_LINE_MAX_SIZE];
+        size_t len = (size_t) (eol - p);
+        if (len >= MTL_LINE_MAX_SIZE) len = MTL_LINE_MAX_SIZE - 1;
+        memcpy(line, p, len);
+        line[len] = '\0';
+        while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' ' || line[len - 1] == '\t'))
+            line[--len] = '\0';
+        p = eol + 1;
+
+        const char *statement = line + strspn(line, " \t");
+        const char *args;
+
+        if ((args = mtl_statement(statement, "newmtl")) != NULL) {
+            if (has_pending) mtl_finish(library, &pending);
+            mtl_pending_reset(&pending, args);
+            has_pending = true;
+        } else if (!has_pending) {
+            continue;
+        } else if ((args = mtl_statement(statement, "Kd")) != NULL) {
+            mtl_parse_color(args, pending.diffuse);
+        } else if ((args = mtl_statement(statement, "Ks")) != NULL) {
+            mtl_parse_color(args, pending.specular);
+        } else if ((args = mtl_statement(statement, "Ns")) != NULL) {
+            pending.shininess = strtof(args, NULL);
+        } else if ((args = mtl_statement(statement, "map_Kd")) != NULL) {
+            mtl_parse_map(path, args, pending.diffuse_map);
+        } else if ((args = mtl_statement(statement, "map_Ks")) != NULL) {
+            mtl_parse_map(path, args, pending.specular_map);
+        }
+    }
+
+    if (has_pending) mtl_finish(library, &pending);
+    file_unmap(&file);
+
+    SINFO("Loaded %zu materials using %zu textures from '%s'",
+          library->materials->len, library->textures->len, path);
+
+    return true;
+}
+
+int32_t mtl_find(const struct mtl_library *library, const char *name)
+{
+    if (library->materials == NULL) return -1;
+
+    const struct mtl_material *materials = library->materials->items;
+    for (size_t i = 0; i < library->materials->len; i++)
+        if (strcmp(materials[i].name, name) == 0) return (int32_t) i;
+
+    return -1;
+}
+
+struct material mtl_material_at(const struct mtl_library *library, int32_t index)
+{
+    const struct mtl_material *materials = library->materials->items;
+    return materials[index].material;
+}
+
+bool mtl_library_init(struct mtl_library *library)
+{
+    library->materials = darray_alloc(sizeof(struct mtl_material), 4);
+    library->textures = darray_alloc(sizeof(struct mtl_texture), 4);
+    if (library->materials == NULL || library->textures == NULL) {
+        mtl_destroy(library);
+        return false;
+    }
+
+    return true;
+}
+
+void mtl_library_add_material(struct mtl_library *library,
+                              const char *name,
+                              struct material material)
+{
+    struct mtl_material entry;
+    memset(entry.name, 0, sizeof(entry.name));
+    snprintf(entry.name, sizeof(entry.name), "%s", name);
+    entry.material = material;
+
+    darray_push(library->materials, &entry);
+}
+
+const struct texture *mtl_library_find_texture(const struct mtl_library *library,
+                                               const char *key)
+{
+    const struct mtl_texture *textures = library->textures->items;
+    for (size_t i = 0; i < library->textures->len; i++)
+        if (strcmp(textures[i].key, key) == 0) return &textures[i].texture;
+
+    return NULL;
+}
+
+void mtl_library_add_texture(struct mtl_library *library,
+                             const char *key,
+                             struct texture texture)
+{
+    struct mtl_texture entry;
+    memset(entry.key, 0, sizeof(entry.key));
+    strncpy(entry.key, key, MESH_PATH_MAX_SIZE - 1);
+    entry.texture = texture;
+
+    darray_push(library->textures, &entry);
+}
+
+struct texture mtl_library_color(struct mtl_library *library, const float color[3])
+{
+    uint8_t rgba[4] = {255, 255, 255, 255};
+    for (size_t i = 0; i < 3; i++) {
+        float value = fmaxf(0.0f, fminf(1.0f, color[i]));
+        rgba[i] = (uint8_t) lroundf(value * 255.0f);
+    }
+
+    /* paths never start with a '#' once resolved against their file */
+    char key[16];
+    snprintf(key, sizeof(key), "#%02x%02x%02x", rgba[0], rgba[1], rgba[2]);
+
+    const struct texture *created = mtl_library_find_texture(library, key);
+    if (created != NULL) return *created;
+
+    struct texture texture = resource_cache_color(rgba);
+    mtl_library_add_texture(library, key, texture);
+    return texture;
+}
+
+void mtl_destroy(struct mtl_library *library)
+{
+    if (library->textures != NULL) {
+        struct mtl_texture *textures = library->textures->items;
+        for (size_t i = 0; i < library->textures->len; i++)
+            resource_cache_release_texture(&textures[i].texture);
+        darray_free(library->textures);
+    }
+
+    if (library->materials != NULL) darray_free(library->materials);
+
+    library->materials = NULL;
+    library->textures = NULL;
+}
+
+/* The defaults match material_create_default(), white & a shininess of 32 */
+static void mtl_pending_reset(struct mtl_pending *pending, const char *name)
+{
+    memset(pending, 0, sizeof(*pending));
+    strncpy(pending->name, name, MESH_NAME_MAX_SIZE - 1);
+    pending->diffuse[0] = pending->diffuse[1] = pending->diffuse[2] = 1.0f;
+    pending->specular[0] = pending->specular[1] = pending->specular[2] = 1.0f;
+    pending->shininess = 32.0f;
+}
+
+static void mtl_finish(struct mtl_library *library, const struct mtl_pending *pending)
+{
+    struct material material;
+    material.diffuse_map = mtl_texture(library, pending->diffuse_map, pending->diffuse,
+                                       TEXTURE_ROLE_COLOR);
+    material.specular_map = mtl_texture(library, pending->specular_map, pending->specular,
+                                        TEXTURE_ROLE_MASK);
+
+    /* exporters write Ns 0 for matte materials, pow() in the shader wants it
+       to be atleast 1 */
+    material.shininess = (pending->shininess >= 1.0f) ? pending->shininess : 1.0f;
+    material.packed = false;
+
+    mtl_library_add_material(library, pending->name, material);
+}
+
+/* Returns the texture of the map, or of the color if there is none, loading
+   it only if no material of the library has used it yet */
+static struct texture mtl_texture(struct mtl_library *library,
+                                  const char *map,
+                                  const float color[3],
+                                  enum texture_role role)
+{
+    if (map[0] == '\0') return mtl_library_color(library, color);
+
+    const struct texture *loaded = mtl_library_find_texture(library, map);
+    if (loaded != NULL) return *loaded;
+
+    struct texture texture = resource_cache_texture(map, role);
+
+    /* images that fail to load fall back onto the color */
+    if (texture.id == 0) {
+        SWARN("Using the color of the material instead of '%s'", map);
+        return mtl_library_color(library, color);
+    }
+
+    mtl_library_add_texture(library, map, texture);
+    return texture;
+}
+
+static void mtl_parse_color(const char *p, float out[3])
+{
+    char *next = NULL;
+    for (size_t i = 0; i < 3; i++) {
+        float value = strtof(p, &next);
+        if (next == p) {
+            /* a single value is a grey */
+            if (i == 1) out[1] = out[2] = out[0];
+            return;
+        }
+        out[i] = value;
+        p = next;
+    }
+}
+
+/* Maps are relative to the directory of the .mtl */
+static void mtl_parse_map(const char *mtl_path, const char *p, char out[MESH_PATH_MAX_SIZE])
+{
+    const char *file = strrchr(p, ' ');
+    const char *tab = strrchr(p, '\t');
+    if (tab != NULL && (file == NULL || tab > file)) file = tab;
+    file = (file != NULL) ? file + 1 : p;
+
+    const char *slash = strrchr(mtl_path, '/');
+    size_t dir_len = (slash != NULL && file[0] != '/') ? (size_t) (slash - mtl_path + 1) : 0;
+
+    int n = snprintf(out, MESH_PATH_MAX_SIZE, "%.*s%s", (int) dir_len, mtl_path, file);
+    if (n < 0 || n >= MESH_PATH_MAX_SIZE) {
+        SWARN("Texture path '%s' is too long, ignoring it", file);
+        out[0] = '\0';
+    }
+}
+
+/* Returns the arguments after 'tag' if the line is that statement */
+static const char *mtl_statement(const char *line, const char *tag)
+{
+    size_t len = strlen(tag);
+    if (strncmp(line, tag, len) != 0) return NULL;
+    if (line[len] != ' ' && line[len] != '\t') return NULL;
+
+    return line + len + strspn(line + len, " \t");
+}
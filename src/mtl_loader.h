@@ -0,0 +1,69 @@
+#ifndef SAGE_MTL_LOADER_H
+#define SAGE_MTL_LOADER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "material.h"
+#include "mesh.h"
+
+/* A named material of a .mtl file */
+struct mtl_material {
+    char name[MESH_NAME_MAX_SIZE];
+    struct material material;
+};
+
+/* A texture the materials of a library use, keyed by the path of its image
+   or by its color for flat colored ones */
+struct mtl_texture {
+    char key[MESH_PATH_MAX_SIZE];
+    struct texture texture;
+};
+
+/* Every material of a .mtl file. Materials share their textures, an image
+   referenced by several materials or libraries is only loaded once, see
+   resource_cache.h */
+struct mtl_library {
+    darray *materials;  /* struct mtl_material */
+    darray *textures;   /* struct mtl_texture */
+};
+
+/* Loads the materials of a .mtl file, understands newmtl, Kd, Ks, Ns, map_Kd
+   & map_Ks. Colors without a map become 1x1 textures so every material is
+   applied the same way. Maps are relative to the .mtl and only the last token
+   of the statement is used as the path, options before it are ignored.
+   Returns false if the file can't be read, leaving 'library' empty */
+bool mtl_load(const char *path, struct mtl_library *library);
+
+/* Index of the material with 'name', -1 if the library doesn't have it */
+int32_t mtl_find(const struct mtl_library *library, const char *name);
+
+/* Returns the material at 'index' of mtl_find() */
+struct material mtl_material_at(const struct mtl_library *library, int32_t index);
+
+/* Starts an empty library for loaders of other formats to fill, returns
+   false if it couldn't be allocated */
+bool mtl_library_init(struct mtl_library *library);
+
+/* Adds a material, its textures should be ones the library owns */
+void mtl_library_add_material(struct mtl_library *library,
+                              const char *name,
+                              struct material material);
+
+/* Texture the library owns under 'key', NULL if there is none yet */
+const struct texture *mtl_library_find_texture(const struct mtl_library *library,
+                                               const char *key);
+
+/* Hands a reference to a texture over to the library, released along with it.
+   Textures outside the resource cache are destroyed then */
+void mtl_library_add_texture(struct mtl_library *library,
+                             const char *key,
+                             struct texture texture);
+
+/* 1x1 texture of a color, shared through the resource cache */
+struct texture mtl_library_color(struct mtl_library *library, const float color[3]);
+
+/* Releases every texture of the library */
+void mtl_destroy(struct mtl_library *library);
+
+#endif /* SAGE_MTL_LOADER_H */
@@ -1,115 +1,1264 @@
 #define _POSIX_C_SOURCE 200809L
-#include <stdio.h> 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <float.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "obj_loader.h"
 #include "darray.h"
+#include "file.h"
 #include "logger.h"
+#include "assert.h"
 #include "mnf/mnf_vector.h"
 
-#define LINE_INITIAL_SIZE 512
+/* Longest number token that gets handed to strtod() when the fast path can't
+   represent it exactly, anything longer is considered garbage */
+#define OBJ_NUMBER_MAX_LEN 64
+
+/* Mantissas with more digits than this no longer fit in a uint64_t */
+#define OBJ_MANTISSA_MAX_DIGITS 19
+
+/* Powers of ten that are exactly representable as a double, multiplying or
+   dividing a mantissa of atmost 2^53 by these keeps the result correctly
+   rounded (Clinger's fast path) */
+#define OBJ_POW10_MAX 22
+#define OBJ_DOUBLE_MANTISSA_MAX (UINT64_C(1) << 53)
+
+/* The same for floats, 10^10 is the last power of ten a float holds exactly */
+#define OBJ_FLOAT_POW10_MAX 10
+#define OBJ_FLOAT_MANTISSA_MAX (UINT64_C(1) << 24)
+
+static const double pow10_table[OBJ_POW10_MAX + 1] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Files are only split across threads in pieces atleast this big */
+#define OBJ_LOADER_CHUNK_MIN_SIZE (256 * 1024)
+
+/* Marks an unused slot in the vertex table */
+#define OBJ_VERTEX_SLOT_EMPTY UINT32_MAX
+
+/* Index of a uv or normal a face corner doesn't reference */
+#define OBJ_ATTRIBUTE_MISSING (-1)
+
+/* Number of records of each kind, gathered before parsing so that every
+   darray is sized exactly once */
+struct obj_counts {
+    size_t positions;
+    size_t normals;
+    size_t uvs;
+    size_t triangles;
+};
+
+/* One corner of a face as 0-based indices into the attribute arrays, the uv
+   & normal are OBJ_ATTRIBUTE_MISSING when the face leaves them out */
+struct obj_corner {
+    int32_t v;
+    int32_t t;
+    int32_t n;
+};
+
+/* Every record in the file, shared between the threads that each fill their
+   own slice of it */
+struct obj_records {
+    vec3 *positions;
+    vec3 *normals;
+    vec2 *uvs;
+    struct obj_corner *corners; /* 3 per triangle */
+    float (*smooth_normals)[4]; /* per position, only if normals are missing */
+};
+
+/* What an o, g or usemtl statement switches to */
+enum obj_group_kind {
+    OBJ_GROUP_OBJECT,   /* o, also resets the group */
+    OBJ_GROUP_GROUP,    /* g */
+    OBJ_GROUP_MATERIAL, /* usemtl */
+};
+
+/* A statement that changes the submesh every triangle after it goes in */
+struct obj_group_event {
+    size_t triangle;    /* triangles before it, within its chunk until globalized */
+    enum obj_group_kind kind;
+    char name[MESH_NAME_MAX_SIZE];
+};
+
+/* Consecutive triangles of the file that all go in the same submesh */
+struct obj_run {
+    size_t begin;
+    size_t end;
+    uint32_t submesh;
+};
+
+/* A newline aligned piece of the file handled by a single thread */
+struct obj_chunk {
+    const char *begin;
+    const char *end;
+    struct obj_counts counts;   /* records inside this chunk */
+    struct obj_counts offsets;  /* records inside every chunk before this one */
+    size_t n_skipped_faces;
+    size_t n_missing_normals;   /* corners of valid faces without a normal */
+    struct obj_records *records;
+    darray *groups;             /* struct obj_group_event, NULL if there are none */
+    char material_library[MESH_PATH_MAX_SIZE]; /* first mtllib, empty if none */
+};
+
+/* A range of unique corners turned into vertices by a single thread */
+struct obj_gather {
+    const struct obj_records *records;
+    struct vertex *vertices;
+    size_t begin;
+    size_t end;
+};
+
+/* Face corners referencing the same (position, uv, normal) triplet become the
+   same vertex, the table maps a triplet onto the index of that vertex */
+struct obj_vertex_slot {
+    int32_t v;
+    int32_t t;
+    int32_t n;
+    uint32_t index;
+};
+
+struct obj_vertex_table {
+    struct obj_vertex_slot *slots;
+    size_t mask;
+};
+
+static void obj_load(const char *path,
+                     darray **vertices,
+                     darray **indices,
+                     uint32_t n_threads,
+                     darray **submeshes,
+                     char material_library[MESH_PATH_MAX_SIZE]);
+static darray *obj_group_runs(struct obj_chunk *chunks, size_t n_chunks,
+                              size_t n_triangles, darray *submeshes);
+static uint32_t obj_find_submesh(darray *submeshes, const char *name, const char *material);
+static void obj_record_group(struct obj_chunk *chunk, const char *p, const char *eol);
+static void obj_copy_name(const char *p, const char *end, char *out, size_t size);
+static void obj_resolve_path(const char *base, const char *path, char out[MESH_PATH_MAX_SIZE]);
+static bool obj_vertex_table_init(struct obj_vertex_table *table, size_t n_corners);
+static uint32_t obj_vertex_table_insert(struct obj_vertex_table *table,
+                                        int32_t v, int32_t t, int32_t n,
+                                        uint32_t next_index);
+static void obj_vertex_table_free(struct obj_vertex_table *table);
+static darray *obj_narrow_indices(darray *indices, size_t n_vertices);
+static size_t obj_thread_count(size_t file_size, uint32_t n_threads);
+static void obj_split_chunks(const struct mapped_file *file,
+                             struct obj_chunk *chunks,
+                             size_t n_chunks);
+static void obj_run_parallel(void *(*fn)(void *), void *args, size_t arg_size, size_t n);
+static void *obj_count_chunk(void *arg);
+static void *obj_parse_chunk(void *arg);
+static void *obj_gather_vertices(void *arg);
+static void obj_accumulate_normals(const struct obj_records *records, size_t n_triangles,
+                                   float (*normals)[4]);
+static void obj_normalize_normals(float (*normals)[4], size_t n);
+static size_t obj_count_face_corners(const char *p, const char *end);
+static const char *obj_parse_corner(const char *p, const char *end,
+                                    const struct obj_counts *declared,
+                                    struct obj_corner *corner);
+static bool obj_resolve_index(int32_t index, size_t n_declared, int32_t *out);
+static const char *obj_find_newline(const char *p, const char *end);
+static const char *obj_skip_spaces(const char *p, const char *end);
+static const char *obj_parse_float(const char *p, const char *end, float *out);
+static bool obj_float_rounds_once(double value);
+static const char *obj_parse_int(const char *p, const char *end, int32_t *out);
+static const char *obj_parse_vec(const char *p, const char *end, float *out, size_t n);
+static double obj_elapsed_ms(struct timespec start);
 
 void obj_load_mesh(const char *path, darray **vertices, darray **indices)
 {
-    FILE *file = fopen(path, "r");
+    obj_load_mesh_threaded(path, vertices, indices, 0);
+}
+
+void obj_load_mesh_threaded(const char *path,
+                            darray **vertices,
+                            darray **indices,
+                            uint32_t n_threads)
+{
+    obj_load(path, vertices, indices, n_threads, NULL, NULL);
+}
+
+void obj_load_model(const char *path,
+                    darray **vertices,
+                    darray **indices,
+                    darray **submeshes,
+                    char material_library[MESH_PATH_MAX_SIZE])
+{
+    SASSERT_MSG(submeshes != NULL && *submeshes == NULL, "Submeshes must be a NULL darray");
+    obj_load(path, vertices, indices, 0, submeshes, material_library);
+}
 
-    if (file == NULL) {
+/* Loads the file, also splitting it into submeshes when 'submeshes' is set */
+static void obj_load(const char *path,
+                     darray **vertices,
+                     darray **indices,
+                     uint32_t n_threads,
+                     darray **submeshes,
+                     char material_library[MESH_PATH_MAX_SIZE])
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct mapped_file file;
+    if (!file_map(path, &file)) {
         SFATAL("Failed to open .obj file '%s'", path);
         exit(1);
     }
 
-    size_t size = LINE_INITIAL_SIZE;
-    char *line = malloc(size);
-    if (line == NULL) {
+    /* splitting the file along newlines, every chunk is parsed by one thread */
+    size_t n_chunks = obj_thread_count(file.size, n_threads);
+    struct obj_chunk chunks[OBJ_LOADER_MAX_THREADS];
+    obj_split_chunks(&file, chunks, n_chunks);
+
+    /* counting pass: only looks at the first bytes of each line, except for
+       faces whose corners are counted to know how many triangles they fan
+       out into */
+    obj_run_parallel(obj_count_chunk, chunks, sizeof(struct obj_chunk), n_chunks);
+
+    /* prefix sum over the chunk counts gives every chunk the offset to write
+       its records at, and the amount of records declared before it which is
+       what face indices are checked against */
+    struct obj_counts counts = {0};
+    for (size_t i = 0; i < n_chunks; i++) {
+        chunks[i].offsets = counts;
+        counts.positions += chunks[i].counts.positions;
+        counts.normals += chunks[i].counts.normals;
+        counts.uvs += chunks[i].counts.uvs;
+        counts.triangles += chunks[i].counts.triangles;
+    }
+
+    size_t n_corners = counts.triangles * 3;
+
+    /* +1 because darray_alloc fails on a zero sized calloc */
+    if (*vertices == NULL)
+        *vertices = darray_alloc(sizeof(struct vertex), n_corners + 1);
+
+    /* the indices are gathered as uint32_t and only narrowed at the end once
+       the amount of unique vertices is known */
+    bool narrow_indices = false;
+    if (*indices == NULL) {
+        *indices = darray_alloc(sizeof(uint32_t), n_corners + 1);
+        narrow_indices = true;
+    }
+
+    struct obj_records records = {
+        .positions = malloc((counts.positions + 1) * sizeof(vec3)),
+        .normals = malloc((counts.normals + 1) * sizeof(vec3)),
+        .uvs = malloc((counts.uvs + 1) * sizeof(vec2)),
+        .corners = malloc((n_corners + 1) * sizeof(struct obj_corner)),
+        .smooth_normals = NULL,
+    };
+
+    struct obj_vertex_table table;
+    if (*vertices == NULL || *indices == NULL ||
+        records.positions == NULL || records.normals == NULL ||
+        records.uvs == NULL || records.corners == NULL ||
+        !darray_reserve(*vertices, (*vertices)->len + n_corners) ||
+        !darray_reserve(*indices, (*indices)->len + n_corners) ||
+        !obj_vertex_table_init(&table, n_corners)) {
         SFATAL("Failed to alloc memory for reading .obj file '%s'", path);
-        fclose(file);
         exit(1);
     }
 
-    if (*vertices == NULL)
-        *vertices = darray_alloc(sizeof(struct vertex), 1028);
-
-    /* TODO: Figure out how to load indices */
-    /*
-    if (*indices == NULL)
-        *indices = darray_alloc(sizeof(uint32_t), 1028);
-    */
-    *indices = NULL;
-
-    darray *positions = darray_alloc(sizeof(vec3), 1028);
-    darray *normals = darray_alloc(sizeof(vec3), 1028);
-    darray *uvs = darray_alloc(sizeof(vec2), 1028);
-
-    ssize_t nread;
-    while ((nread = getline(&line, &size, file)) != -1) {
-
-        if ('#' == line[0]) continue;
-
-        /* position */
-        if (strncmp("v ", line, 2) == 0) {
-            vec3 position;
-            sscanf(line,
-                   "v %f %f %f",
-                   &position[0],
-                   &position[1],
-                   &position[2]);
-            darray_push(positions, position);
-        }
-
-        /* normal */
-        if (strncmp("vn ", line, 3) == 0) {
-            vec3 normal;
-            sscanf(line,
-                   "vn %f %f %f",
-                   &normal[0],
-                   &normal[1],
-                   &normal[2]);
-            mnf_vec3_normalize(normal, normal);
-            darray_push(normals, normal);
-        }
-
-        /* uv */
-        if (strncmp("vt ", line, 3) == 0) {
-            vec2 uv;
-            sscanf(line,
-                   "vt %f %f",
-                   &uv[0],
-                   &uv[1]);
-            darray_push(uvs, uv);
-        }
-
-        if (strncmp("f ", line, 2) == 0) {
-            int32_t v_i[3];
-            int32_t t_i[3];
-            int32_t n_i[3];
-            sscanf(line,
-                   "f %d/%d/%d %d/%d/%d %d/%d/%d",
-                   &v_i[0], &t_i[0], &n_i[0],
-                   &v_i[1], &t_i[1], &n_i[1],
-                   &v_i[2], &t_i[2], &n_i[2]);
-
-            for (size_t i = 0; i < 3; i++) {
-                /* offset by one because obj files start indexing at 1 */
-                vec3 *position = darray_at(positions, v_i[i] - 1);
-                vec3 *normal = darray_at(normals, n_i[i] - 1);
-                vec2 *uv = darray_at(uvs, t_i[i] - 1);
-
-                struct vertex vertex;
-                mnf_vec3_copy(*position, vertex.pos);
-                mnf_vec3_copy(*normal, vertex.normal);
-                mnf_vec2_copy(*uv, vertex.uv);
-
-                darray_push(*vertices, &vertex);
+    /* parsing pass: each chunk writes its records at the offsets it was given
+       so no two threads ever touch the same memory */
+    for (size_t i = 0; i < n_chunks; i++)
+        chunks[i].records = &records;
+    obj_run_parallel(obj_parse_chunk, chunks, sizeof(struct obj_chunk), n_chunks);
+
+    size_t n_skipped_faces = 0;
+    size_t n_missing_normals = 0;
+    for (size_t i = 0; i < n_chunks; i++) {
+        n_skipped_faces += chunks[i].n_skipped_faces;
+        n_missing_normals += chunks[i].n_missing_normals;
+    }
+
+    /* smooth normals for corners that don't reference one, every triangle
+       adds its unnormalized face normal onto its positions so bigger faces
+       weigh more. Runs before dedup since that overwrites the triangles */
+    if (n_missing_normals > 0) {
+        records.smooth_normals = calloc(counts.positions + 1, sizeof(float[4]));
+        if (records.smooth_normals == NULL) {
+            SFATAL("Failed to alloc memory for the normals of .obj file '%s'", path);
+            exit(1);
+        }
+        obj_accumulate_normals(&records, counts.triangles, records.smooth_normals);
+        obj_normalize_normals(records.smooth_normals, counts.positions);
+    }
+
+    /* vertices appended onto an existing darray are indexed after it */
+    size_t base_vertex = (*vertices)->len;
+    size_t index_size = (*indices)->item_size;
+    SASSERT_MSG(index_size == sizeof(uint32_t) || index_size == sizeof(uint16_t),
+                "Indices must either be uint16_t or uint32_t");
+
+    /* dedup pass: the hash table is shared so this runs on a single thread,
+       walking the corners in file order means the vertex & index order is the
+       same no matter how many threads parsed the file. Corners seen for the
+       first time are compacted to the front of the corner array */
+    uint8_t *index_items = (*indices)->items;
+    size_t n_indices = (*indices)->len;
+    size_t n_unique = 0;
+
+    /* with submeshes the triangles are walked one submesh at a time so each
+       ends up as a single range of the indices, otherwise it's the whole file
+       in one run */
+    darray *groups = NULL;
+    darray *runs = NULL;
+    if (submeshes != NULL) {
+        groups = darray_alloc(sizeof(struct mesh_submesh), 4);
+        runs = groups ? obj_group_runs(chunks, n_chunks, counts.triangles, groups) : NULL;
+        if (runs == NULL) {
+            SFATAL("Failed to alloc memory for the groups of .obj file '%s'", path);
+            exit(1);
+        }
+    }
+
+    struct obj_run whole = { 0, counts.triangles, 0 };
+    struct obj_run *run_items = runs ? runs->items : &whole;
+    size_t n_runs = runs ? runs->len : 1;
+    size_t n_groups = groups ? groups->len : 1;
+
+    /* unique corners are compacted in place while the walk is in file order
+       since the write never passes the read, submeshes split across the file
+       break that so they get their own array */
+    bool in_file_order = true;
+    for (size_t i = 1; i < n_runs; i++)
+        if (run_items[i].submesh < run_items[i - 1].submesh) in_file_order = false;
+
+    struct obj_corner *unique = records.corners;
+    if (!in_file_order) {
+        unique = malloc((n_corners + 1) * sizeof(struct obj_corner));
+        if (unique == NULL) {
+            SFATAL("Failed to alloc memory for reading .obj file '%s'", path);
+            exit(1);
+        }
+    }
+
+    for (size_t group = 0; group < n_groups; group++) {
+        size_t group_offset = n_indices;
+
+        for (size_t r = 0; r < n_runs; r++) {
+            if (run_items[r].submesh != group) continue;
+
+            for (size_t i = run_items[r].begin * 3; i < run_items[r].end * 3; i++) {
+                struct obj_corner corner = records.corners[i];
+                if (corner.v < 0) continue; /* skipped face */
+
+                uint32_t index = obj_vertex_table_insert(&table,
+                                                         corner.v, corner.t, corner.n,
+                                                         n_unique);
+                if (index == n_unique)
+                    unique[n_unique++] = corner;
+
+                index += base_vertex;
+                if (index_size == sizeof(uint32_t)) {
+                    ((uint32_t *) index_items)[n_indices++] = index;
+                } else {
+                    SASSERT_MSG(index <= UINT16_MAX, "Mesh has too many vertices for uint16_t indices");
+                    ((uint16_t *) index_items)[n_indices++] = (uint16_t) index;
+                }
             }
         }
+
+        if (groups != NULL) {
+            struct mesh_submesh *submesh = darray_at(groups, group);
+            submesh->lods[0].index_offset = group_offset;
+            submesh->lods[0].index_count = n_indices - group_offset;
+            submesh->n_lods = 1;
+        }
+    }
+
+    if (unique != records.corners) {
+        free(records.corners);
+        records.corners = unique;
+    }
+
+    /* gather pass: every unique corner becomes a vertex, split evenly across
+       the threads */
+    struct obj_gather gathers[OBJ_LOADER_MAX_THREADS];
+    struct vertex *vertex_items = (struct vertex *) (*vertices)->items + base_vertex;
+    for (size_t i = 0; i < n_chunks; i++) {
+        gathers[i].records = &records;
+        gathers[i].vertices = vertex_items;
+        gathers[i].begin = n_unique * i / n_chunks;
+        gathers[i].end = n_unique * (i + 1) / n_chunks;
     }
+    obj_run_parallel(obj_gather_vertices, gathers, sizeof(struct obj_gather), n_chunks);
+
+    size_t n_vertices = base_vertex + n_unique;
+    (*vertices)->len = n_vertices;
+    (*indices)->len = n_indices;
+
+    /* dedup usually leaves most of the reserved vertices unused */
+    darray_shrink(*vertices);
+    if (narrow_indices)
+        *indices = obj_narrow_indices(*indices, n_vertices);
 
-    free(line);
-    darray_free(positions);
-    darray_free(uvs);
-    darray_free(normals);
-    fclose(file);
+    /* submeshes made only of malformed faces are dropped */
+    if (groups != NULL) {
+        struct mesh_submesh *items = groups->items;
+        size_t n_kept = 0;
+        for (size_t i = 0; i < groups->len; i++)
+            if (items[i].lods[0].index_count > 0) items[n_kept++] = items[i];
+        groups->len = n_kept;
+
+        *submeshes = groups;
+        darray_free(runs);
+        SINFO("Split '%s' into %zu submeshes", path, n_kept);
+    }
+
+    if (material_library != NULL) {
+        material_library[0] = '\0';
+        for (size_t i = 0; i < n_chunks; i++) {
+            if (chunks[i].material_library[0] == '\0') continue;
+            obj_resolve_path(path, chunks[i].material_library, material_library);
+            break;
+        }
+    }
+
+    if (n_skipped_faces > 0)
+        SWARN("Skipped %zu malformed faces in '%s'", n_skipped_faces, path);
+    if (n_missing_normals > 0)
+        SINFO("Generated smooth normals for %zu face corners in '%s'",
+              n_missing_normals, path);
+
+    double ms = obj_elapsed_ms(start);
+    double mb = (double) file.size / (1024.0 * 1024.0);
+    SINFO("Parsed '%s' (%.2f MB) with %zu threads in %.2f ms: %.1f MB/s",
+          path, mb, n_chunks, ms, (ms > 0.0) ? mb / (ms / 1000.0) : 0.0);
+    SINFO("Deduplicated %zu face corners into %zu vertices (%zu-bit indices)",
+          n_indices, n_vertices, (*indices)->item_size * 8);
+
+    obj_vertex_table_free(&table);
+    free(records.positions);
+    free(records.normals);
+    free(records.uvs);
+    free(records.corners);
+    free(records.smooth_normals);
+    for (size_t i = 0; i < n_chunks; i++)
+        if (chunks[i].groups) darray_free(chunks[i].groups);
+    file_unmap(&file);
 }
 
+/* Turns the o, g & usemtl statements of every chunk into runs of triangles,
+   creating a submesh for every (group, material) pair that has triangles.
+   'o' starts a new object so it also replaces the group. Returns NULL if the
+   runs couldn't be allocated */
+static darray *obj_group_runs(struct obj_chunk *chunks, size_t n_chunks,
+                              size_t n_triangles, darray *submeshes)
+{
+    darray *runs = darray_alloc(sizeof(struct obj_run), 4);
+    if (runs == NULL) return NULL;
+
+    char name[MESH_NAME_MAX_SIZE] = "default";
+    char material[MESH_NAME_MAX_SIZE] = "";
+    size_t run_begin = 0;
+
+    for (size_t c = 0; c <= n_chunks; c++) {
+        size_t n_events = (c < n_chunks && chunks[c].groups) ? chunks[c].groups->len : 0;
+
+        /* one past the last chunk closes the final run */
+        for (size_t e = 0; e <= n_events; e++) {
+            const struct obj_group_event *event = NULL;
+            size_t triangle = n_triangles;
+            if (e < n_events) {
+                event = darray_at(chunks[c].groups, e);
+                triangle = chunks[c].offsets.triangles + event->triangle;
+            } else if (c < n_chunks) {
+                continue;
+            }
+
+            if (triangle > run_begin) {
+                struct obj_run run = {
+                    .begin = run_begin,
+                    .end = triangle,
+                    .submesh = obj_find_submesh(submeshes, name, material),
+                };
+                if (run.submesh == UINT32_MAX) {
+                    darray_free(runs);
+                    return NULL;
+                }
+                darray_push(runs, &run);
+                run_begin = triangle;
+            }
+
+            if (event == NULL) continue;
+            if (event->kind == OBJ_GROUP_MATERIAL)
+                memcpy(material, event->name, MESH_NAME_MAX_SIZE);
+            else
+                memcpy(name, event->name, MESH_NAME_MAX_SIZE);
+        }
+    }
+
+    return runs;
+}
+
+/* Index of the submesh with the name & material, appending it if there is
+   none yet. Returns UINT32_MAX if it couldn't be appended */
+static uint32_t obj_find_submesh(darray *submeshes, const char *name, const char *material)
+{
+    struct mesh_submesh *items = submeshes->items;
+    for (size_t i = 0; i < submeshes->len; i++)
+        if (strcmp(items[i].name, name) == 0 && strcmp(items[i].material, material) == 0)
+            return (uint32_t) i;
+
+    struct mesh_submesh submesh;
+    memset(&submesh, 0, sizeof(submesh));
+    /* only up to the terminator, what's left of the buffers would end up in
+       the mesh cache & cooked archives */
+    memcpy(submesh.name, name, strnlen(name, MESH_NAME_MAX_SIZE - 1));
+    memcpy(submesh.material, material, strnlen(material, MESH_NAME_MAX_SIZE - 1));
+
+    size_t len = submeshes->len;
+    darray_push(submeshes, &submesh);
+    return (submeshes->len > len) ? (uint32_t) len : UINT32_MAX;
+}
+
+/* Records an o, g, usemtl or mtllib statement of the counting pass, the
+   triangles counted so far are the ones before it */
+static void obj_record_group(struct obj_chunk *chunk, const char *p, const char *eol)
+{
+    struct obj_group_event event;
+    const char *name;
+
+    if ((p[0] == 'o' || p[0] == 'g') && (p[1] == ' ' || p[1] == '\t')) {
+        event.kind = (p[0] == 'o') ? OBJ_GROUP_OBJECT : OBJ_GROUP_GROUP;
+        name = p + 2;
+    } else if (eol - p > 7 && strncmp(p, "usemtl", 6) == 0 && (p[6] == ' ' || p[6] == '\t')) {
+        event.kind = OBJ_GROUP_MATERIAL;
+        name = p + 7;
+    } else if (eol - p > 7 && strncmp(p, "mtllib", 6) == 0 && (p[6] == ' ' || p[6] == '\t')) {
+        if (chunk->material_library[0] == '\0')
+            obj_copy_name(p + 7, eol, chunk->material_library, MESH_PATH_MAX_SIZE);
+        return;
+    } else {
+        return;
+    }
+
+    event.triangle = chunk->counts.triangles;
+    obj_copy_name(name, eol, event.name, MESH_NAME_MAX_SIZE);
+    if (event.kind != OBJ_GROUP_MATERIAL && event.name[0] == '\0')
+        strcpy(event.name, "default");
+
+    if (chunk->groups == NULL)
+        chunk->groups = darray_alloc(sizeof(struct obj_group_event), 8);
+    if (chunk->groups != NULL)
+        darray_push(chunk->groups, &event);
+}
+
+/* Copies the rest of a line without the surrounding whitespace, truncated to
+   fit 'size' with the terminator */
+static void obj_copy_name(const char *p, const char *end, char *out, size_t size)
+{
+    p = obj_skip_spaces(p, end);
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+
+    size_t len = (size_t) (end - p);
+    if (len >= size) len = size - 1;
+    memcpy(out, p, len);
+    out[len] = '\0';
+}
+
+/* Paths inside an .obj are relative to the directory of the .obj */
+static void obj_resolve_path(const char *base, const char *path, char out[MESH_PATH_MAX_SIZE])
+{
+    const char *slash = strrchr(base, '/');
+    size_t dir_len = (slash != NULL && path[0] != '/') ? (size_t) (slash - base + 1) : 0;
+
+    int n = snprintf(out, MESH_PATH_MAX_SIZE, "%.*s%s", (int) dir_len, base, path);
+    if (n < 0 || n >= MESH_PATH_MAX_SIZE) {
+        SWARN("Material library path '%s' is too long, ignoring it", path);
+        out[0] = '\0';
+    }
+}
+
+/* Picks how many threads parse a file, 0 lets the loader decide based on the
+   amount of cores & the size of the file */
+static size_t obj_thread_count(size_t file_size, uint32_t n_threads)
+{
+    if (n_threads == 0) {
+        long n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = (n_cores > 0) ? (uint32_t) n_cores : 1;
+
+        /* small files aren't worth the cost of spawning threads */
+        size_t n_useful = file_size / OBJ_LOADER_CHUNK_MIN_SIZE;
+        if (n_useful < n_threads) n_threads = (uint32_t) n_useful;
+    }
+
+    if (n_threads < 1) n_threads = 1;
+    if (n_threads > OBJ_LOADER_MAX_THREADS) n_threads = OBJ_LOADER_MAX_THREADS;
+
+    return n_threads;
+}
+
+/* Splits the file into roughly equal chunks that each start at the beginning
+   of a line, a chunk can end up empty if a single line spans several chunks */
+static void obj_split_chunks(const struct mapped_file *file,
+                             struct obj_chunk *chunks,
+                             size_t n_chunks)
+{
+    const char *begin = file->data;
+    const char *end = begin + file->size;
+    const char *chunk_begin = begin;
+
+    for (size_t i = 0; i < n_chunks; i++) {
+        const char *chunk_end = end;
+        if (i + 1 < n_chunks) {
+            chunk_end = begin + file->size * (i + 1) / n_chunks;
+            if (chunk_end < chunk_begin) chunk_end = chunk_begin;
+            /* the chunk owns the line its split point lands on */
+            chunk_end = obj_find_newline(chunk_end, end);
+            if (chunk_end < end) chunk_end++;
+        }
+
+        memset(&chunks[i], 0, sizeof(struct obj_chunk));
+        chunks[i].begin = chunk_begin;
+        chunks[i].end = chunk_end;
+        chunk_begin = chunk_end;
+    }
+}
+
+/* Runs fn over every item in args, the first item runs on the calling thread.
+   Falls back onto running everything on the calling thread if a thread can't
+   be spawned */
+static void obj_run_parallel(void *(*fn)(void *), void *args, size_t arg_size, size_t n)
+{
+    pthread_t threads[OBJ_LOADER_MAX_THREADS];
+    bool spawned[OBJ_LOADER_MAX_THREADS] = {0};
+
+    for (size_t i = 1; i < n; i++)
+        spawned[i] = pthread_create(&threads[i], NULL, fn, (uint8_t *) args + i * arg_size) == 0;
+
+    fn(args);
+
+    for (size_t i = 1; i < n; i++) {
+        if (spawned[i])
+            pthread_join(threads[i], NULL);
+        else
+            fn((uint8_t *) args + i * arg_size);
+    }
+}
+
+static void *obj_count_chunk(void *arg)
+{
+    struct obj_chunk *chunk = arg;
+    const char *p = chunk->begin;
+    const char *end = chunk->end;
+    struct obj_counts *counts = &chunk->counts;
+
+    while (p < end) {
+        const char *eol = obj_find_newline(p, end);
+
+        if (eol - p >= 2) {
+            if (p[0] == 'v') {
+                if (p[1] == ' ') counts->positions++;
+                else if (p[1] == 'n') counts->normals++;
+                else if (p[1] == 't') counts->uvs++;
+            } else if (p[0] == 'f' && p[1] == ' ') {
+                /* polygons are fanned into n - 2 triangles */
+                size_t n_face_corners = obj_count_face_corners(p + 2, eol);
+                if (n_face_corners >= 3) counts->triangles += n_face_corners - 2;
+            } else if (p[0] == 'o' || p[0] == 'g' || p[0] == 'u' || p[0] == 'm') {
+                obj_record_group(chunk, p, eol);
+            }
+        }
+
+        p = eol + 1;
+    }
+
+    return NULL;
+}
+
+static void *obj_parse_chunk(void *arg)
+{
+    struct obj_chunk *chunk = arg;
+    const struct obj_counts *offsets = &chunk->offsets;
+    const struct obj_counts *counts = &chunk->counts;
+
+    /* this chunk's slice of the records */
+    vec3 *position_items = chunk->records->positions + offsets->positions;
+    vec3 *normal_items = chunk->records->normals + offsets->normals;
+    vec2 *uv_items = chunk->records->uvs + offsets->uvs;
+    struct obj_corner *corner_items = chunk->records->corners + offsets->triangles * 3;
+
+    size_t n_positions = 0;
+    size_t n_normals = 0;
+    size_t n_uvs = 0;
+    size_t n_triangles = 0;
+
+    const char *p = chunk->begin;
+    const char *end = chunk->end;
+    while (p < end) {
+        const char *eol = obj_find_newline(p, end);
+
+        /* every record we care about is atleast two bytes: a tag & a space */
+        if (eol - p < 2) {
+            p = eol + 1;
+            continue;
+        }
+
+        switch (p[0]) {
+        case 'v':
+            if (p[1] == ' ' && n_positions < counts->positions) {
+                /* position, a malformed one is zeroed to keep the numbering */
+                float *position = position_items[n_positions++];
+                if (!obj_parse_vec(p + 2, eol, position, 3))
+                    mnf_vec3_copy(MNF_ZERO_VECTOR, position);
+            } else if (p[1] == 'n' && n_normals < counts->normals) {
+                /* normal */
+                float *normal = normal_items[n_normals++];
+                if (obj_parse_vec(p + 2, eol, normal, 3))
+                    mnf_vec3_normalize(normal, normal);
+                else
+                    mnf_vec3_copy(MNF_ZERO_VECTOR, normal);
+            } else if (p[1] == 't' && n_uvs < counts->uvs) {
+                /* uv */
+                float *uv = uv_items[n_uvs++];
+                if (!obj_parse_vec(p + 2, eol, uv, 2))
+                    uv[0] = uv[1] = 0.0f;
+            }
+            break;
+
+        case 'f': {
+            if (p[1] != ' ') break;
+
+            /* must agree with the counting pass on the amount of triangles */
+            size_t n_face_corners = obj_count_face_corners(p + 2, eol);
+            if (n_face_corners < 3) {
+                chunk->n_skipped_faces++;
+                break;
+            }
+
+            size_t n_face_triangles = n_face_corners - 2;
+            if (n_triangles + n_face_triangles > counts->triangles) break;
+
+            struct obj_corner *triangles = &corner_items[n_triangles * 3];
+            n_triangles += n_face_triangles;
+
+            /* attributes must've been declared before the face uses them,
+               meaning everything in the previous chunks & what this chunk
+               has parsed so far. Negative indices count back from there */
+            struct obj_counts declared = {
+                .positions = offsets->positions + n_positions,
+                .normals = offsets->normals + n_normals,
+                .uvs = offsets->uvs + n_uvs,
+            };
+
+            /* the polygon is fanned around its first corner:
+               (0 1 2) (0 2 3) (0 3 4) ... */
+            const char *cursor = p + 2;
+            struct obj_corner first = {0};
+            struct obj_corner previous = {0};
+            size_t n_missing_normals = 0;
+            bool valid = true;
+
+            for (size_t i = 0; i < n_face_corners; i++) {
+                struct obj_corner corner;
+                cursor = obj_parse_corner(cursor, eol, &declared, &corner);
+                if (cursor == NULL) {
+                    valid = false;
+                    break;
+                }
+
+                if (i == 0) {
+                    first = corner;
+                } else if (i >= 2) {
+                    struct obj_corner *triangle = &triangles[(i - 2) * 3];
+                    triangle[0] = first;
+                    triangle[1] = previous;
+                    triangle[2] = corner;
+                }
+                previous = corner;
+
+                if (corner.n == OBJ_ATTRIBUTE_MISSING) n_missing_normals++;
+            }
+
+            if (valid) {
+                chunk->n_missing_normals += n_missing_normals;
+            } else {
+                /* the dedup pass skips any corner with a negative position */
+                for (size_t i = 0; i < n_face_triangles * 3; i++)
+                    triangles[i].v = -1;
+                chunk->n_skipped_faces++;
+            }
+            break;
+        }
+
+        default:
+            /* comments, smoothing groups, etc. are ignored, groups &
+               materials were already recorded by the counting pass */
+            break;
+        }
+
+        p = eol + 1;
+    }
+
+    return NULL;
+}
+
+static void *obj_gather_vertices(void *arg)
+{
+    struct obj_gather *gather = arg;
+    const struct obj_records *records = gather->records;
+
+    for (size_t i = gather->begin; i < gather->end; i++) {
+        struct obj_corner corner = records->corners[i];
+        struct vertex *vertex = &gather->vertices[i];
+        mnf_vec3_copy(records->positions[corner.v], vertex->pos);
+
+        if (corner.n != OBJ_ATTRIBUTE_MISSING)
+            mnf_vec3_copy(records->normals[corner.n], vertex->normal);
+        else
+            mnf_vec3_copy(records->smooth_normals[corner.v], vertex->normal);
+
+        if (corner.t != OBJ_ATTRIBUTE_MISSING)
+            mnf_vec2_copy(records->uvs[corner.t], vertex->uv);
+        else
+            vertex->uv[0] = vertex->uv[1] = 0.0f;
+    }
+
+    return NULL;
+}
+
+/* Adds the cross product of every triangle that has a corner without a
+   normal onto the normals of its positions, its length being twice the area
+   of the triangle makes the sum area weighted */
+static void obj_accumulate_normals(const struct obj_records *records, size_t n_triangles,
+                                   float (*normals)[4])
+{
+    for (size_t i = 0; i < n_triangles; i++) {
+        const struct obj_corner *corners = &records->corners[i * 3];
+        if (corners[0].v < 0) continue; /* skipped face */
+        if (corners[0].n != OBJ_ATTRIBUTE_MISSING &&
+            corners[1].n != OBJ_ATTRIBUTE_MISSING &&
+            corners[2].n != OBJ_ATTRIBUTE_MISSING)
+            continue;
+
+        const float *a = records->positions[corners[0].v];
+        const float *b = records->positions[corners[1].v];
+        const float *c = records->positions[corners[2].v];
+
+#ifdef __SSE2__
+        __m128 pa = _mm_setr_ps(a[0], a[1], a[2], 0.0f);
+        __m128 ab = _mm_sub_ps(_mm_setr_ps(b[0], b[1], b[2], 0.0f), pa);
+        __m128 ac = _mm_sub_ps(_mm_setr_ps(c[0], c[1], c[2], 0.0f), pa);
+
+        /* ab x ac = (ab * ac.yzx - ab.yzx * ac).yzx */
+        __m128 ab_yzx = _mm_shuffle_ps(ab, ab, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 ac_yzx = _mm_shuffle_ps(ac, ac, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 cross = _mm_sub_ps(_mm_mul_ps(ab, ac_yzx), _mm_mul_ps(ab_yzx, ac));
+        cross = _mm_shuffle_ps(cross, cross, _MM_SHUFFLE(3, 0, 2, 1));
+
+        for (size_t j = 0; j < 3; j++) {
+            float *normal = normals[corners[j].v];
+            _mm_storeu_ps(normal, _mm_add_ps(_mm_loadu_ps(normal), cross));
+        }
+#else
+        vec3 ab, ac, cross;
+        mnf_vec3_sub((float *) b, (float *) a, ab);
+        mnf_vec3_sub((float *) c, (float *) a, ac);
+        mnf_vec3_cross(ab, ac, cross);
+
+        for (size_t j = 0; j < 3; j++) {
+            float *normal = normals[corners[j].v];
+            mnf_vec3_add(normal, cross, normal);
+        }
+#endif
+    }
+}
+
+/* Normalizes the accumulated normals, ones that are still zero (positions no
+   triangle without normals uses, or degenerate ones) are left at zero */
+static void obj_normalize_normals(float (*normals)[4], size_t n)
+{
+#ifdef __SSE2__
+    const __m128 zero = _mm_setzero_ps();
+    for (size_t i = 0; i < n; i++) {
+        __m128 normal = _mm_loadu_ps(normals[i]);
+
+        /* the w lane is always zero so a horizontal sum of the squares is the
+           squared length */
+        __m128 squared = _mm_mul_ps(normal, normal);
+        __m128 sum = _mm_add_ps(squared, _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(2, 3, 0, 1)));
+        sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+
+        __m128 length = _mm_sqrt_ps(sum);
+        __m128 nonzero = _mm_cmpgt_ps(length, zero);
+        normal = _mm_and_ps(_mm_div_ps(normal, _mm_max_ps(length, _mm_set1_ps(1e-30f))), nonzero);
+
+        _mm_storeu_ps(normals[i], normal);
+    }
+#else
+    for (size_t i = 0; i < n; i++)
+        mnf_vec3_normalize(normals[i], normals[i]);
+#endif
+}
+
+static bool obj_vertex_table_init(struct obj_vertex_table *table, size_t n_corners)
+{
+    /* power of two atleast twice the amount of corners keeps the load factor
+       under 0.5 even if every corner is unique */
+    size_t capacity = 16;
+    while (capacity < n_corners * 2) capacity <<= 1;
+
+    table->slots = malloc(capacity * sizeof(struct obj_vertex_slot));
+    table->mask = capacity - 1;
+    if (table->slots == NULL) return false;
+
+    for (size_t i = 0; i < capacity; i++)
+        table->slots[i].index = OBJ_VERTEX_SLOT_EMPTY;
+
+    return true;
+}
+
+/* Returns the index of the vertex the triplet maps onto, inserting it as
+   'next_index' if it hasn't been seen before */
+static uint32_t obj_vertex_table_insert(struct obj_vertex_table *table,
+                                        int32_t v, int32_t t, int32_t n,
+                                        uint32_t next_index)
+{
+    uint64_t hash = (uint64_t) (uint32_t) v * 0x9E3779B97F4A7C15ull ^
+                    (uint64_t) (uint32_t) t * 0xC2B2AE3D27D4EB4Full ^
+                    (uint64_t) (uint32_t) n * 0x165667B19E3779F9ull;
+    hash ^= hash >> 32;
+
+    /* linear probing */
+    size_t slot = hash & table->mask;
+    for (;;) {
+        struct obj_vertex_slot *entry = &table->slots[slot];
+
+        if (entry->index == OBJ_VERTEX_SLOT_EMPTY) {
+            entry->v = v;
+            entry->t = t;
+            entry->n = n;
+            entry->index = next_index;
+            return next_index;
+        }
+
+        if (entry->v == v && entry->t == t && entry->n == n)
+            return entry->index;
+
+        slot = (slot + 1) & table->mask;
+    }
+}
+
+static void obj_vertex_table_free(struct obj_vertex_table *table)
+{
+    free(table->slots);
+    table->slots = NULL;
+    table->mask = 0;
+}
+
+/* Swaps uint32_t indices for uint16_t ones when every vertex fits */
+static darray *obj_narrow_indices(darray *indices, size_t n_vertices)
+{
+    if (n_vertices > (size_t) UINT16_MAX + 1) {
+        darray_shrink(indices);
+        return indices;
+    }
+
+    darray *narrowed = darray_alloc(sizeof(uint16_t), indices->len + 1);
+    if (narrowed == NULL) return indices;
+
+    uint32_t *wide = indices->items;
+    uint16_t *narrow = narrowed->items;
+    for (size_t i = 0; i < indices->len; i++)
+        narrow[i] = (uint16_t) wide[i];
+    narrowed->len = indices->len;
+
+    darray_free(indices);
+    return narrowed;
+}
+
+/* Returns the position of the next '\n' or 'end' if there is none. Checks 16
+   bytes at a time when SSE2 is available */
+static const char *obj_find_newline(const char *p, const char *end)
+{
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *) p);
+        int32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+        if (mask != 0) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    const char *newline_pos = memchr(p, '\n', end - p);
+    return (newline_pos != NULL) ? newline_pos : end;
+}
+
+static const char *obj_skip_spaces(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p;
+}
+
+/* Counts the whitespace separated corners of a face */
+static size_t obj_count_face_corners(const char *p, const char *end)
+{
+    size_t n = 0;
+    bool in_corner = false;
+
+    for (; p < end; p++) {
+        bool space = (*p == ' ' || *p == '\t' || *p == '\r');
+        if (!space && !in_corner) n++;
+        in_corner = !space;
+    }
+
+    return n;
+}
+
+/* Parses a "v", "v/t", "v//n" or "v/t/n" corner into 0-based indices, returns
+   NULL if it's malformed or references an attribute that isn't declared */
+static const char *obj_parse_corner(const char *p, const char *end,
+                                    const struct obj_counts *declared,
+                                    struct obj_corner *corner)
+{
+    int32_t v = 0;
+    int32_t t = 0;
+    int32_t n = 0;
+    bool has_t = false;
+    bool has_n = false;
+
+    p = obj_skip_spaces(p, end);
+    p = obj_parse_int(p, end, &v);
+    if (p == NULL) return NULL;
+
+    if (p < end && *p == '/') {
+        p++;
+        if (p < end && *p != '/') {
+            p = obj_parse_int(p, end, &t);
+            if (p == NULL) return NULL;
+            has_t = true;
+        }
+        if (p < end && *p == '/') {
+            p = obj_parse_int(p + 1, end, &n);
+            if (p == NULL) return NULL;
+            has_n = true;
+        }
+    }
+
+    /* anything glued onto the corner makes it garbage */
+    if (p < end && *p != ' ' && *p != '\t' && *p != '\r') return NULL;
+
+    if (!obj_resolve_index(v, declared->positions, &corner->v)) return NULL;
+
+    corner->t = OBJ_ATTRIBUTE_MISSING;
+    if (has_t && !obj_resolve_index(t, declared->uvs, &corner->t)) return NULL;
+
+    corner->n = OBJ_ATTRIBUTE_MISSING;
+    if (has_n && !obj_resolve_index(n, declared->normals, &corner->n)) return NULL;
+
+    return p;
+}
+
+/* Turns a 1-based, or negative relative to the last declared, obj index into
+   a 0-based one */
+static bool obj_resolve_index(int32_t index, size_t n_declared, int32_t *out)
+{
+    int64_t resolved = (index > 0) ? (int64_t) index - 1
+                                   : (int64_t) n_declared + index;
+
+    if (index == 0 || resolved < 0 || (size_t) resolved >= n_declared)
+        return false;
+
+    *out = (int32_t) resolved;
+    return true;
+}
+
+/* Parses n floats separated by whitespace, returns NULL if any are missing */
+static const char *obj_parse_vec(const char *p, const char *end, float *out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        p = obj_skip_spaces(p, end);
+        p = obj_parse_float(p, end, &out[i]);
+        if (p == NULL) return NULL;
+    }
+    return p;
+}
+
+static const char *obj_parse_int(const char *p, const char *end, int32_t *out)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    if (p == end || (uint8_t) (*p - '0') > 9) return NULL;
+
+    int64_t value = 0;
+    while (p < end && (uint8_t) (*p - '0') <= 9) {
+        if (value < INT32_MAX) value = value * 10 + (*p - '0');
+        p++;
+    }
+    if (value > INT32_MAX) value = INT32_MAX;
+
+    *out = (int32_t) (negative ? -value : value);
+    return p;
+}
+
+/*
+ * Parses a decimal float of the form [+-]digits[.digits][(e|E)[+-]digits].
+ *
+ * The digits are accumulated into an integer mantissa and a base 10 exponent,
+ * and when both fit in a float exactly the result is a single multiply or
+ * divide by an exact power of ten. When they only fit in a double the same is
+ * done in double, as long as rounding that to a float can't round twice.
+ * Anything else (long mantissas, large exponents, nan, inf) falls back onto
+ * strtof().
+ */
+static const char *obj_parse_float(const char *p, const char *end, float *out)
+{
+    const char *start = p;
+    bool negative = false;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int32_t exponent = 0;
+    int32_t n_digits = 0;
+    bool has_digits = false;
+    bool exact = true;
+
+    /* integer part */
+    while (p < end && (uint8_t) (*p - '0') <= 9) {
+        has_digits = true;
+        if (n_digits < OBJ_MANTISSA_MAX_DIGITS) {
+            mantissa = mantissa * 10 + (*p - '0');
+            /* leading zeros don't use up the precision of the mantissa */
+            if (mantissa > 0) n_digits++;
+        } else {
+            exponent++;
+            exact = false;
+        }
+        p++;
+    }
+
+    /* fractional part */
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && (uint8_t) (*p - '0') <= 9) {
+            has_digits = true;
+            if (n_digits < OBJ_MANTISSA_MAX_DIGITS) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+                if (mantissa > 0) n_digits++;
+            } else {
+                exact = false;
+            }
+            p++;
+        }
+    }
+
+    if (!has_digits) goto slow;
+
+    /* exponent part */
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *exponent_start = p;
+        p++;
+
+        bool exponent_negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exponent_negative = (*p == '-');
+            p++;
+        }
+
+        if (p == end || (uint8_t) (*p - '0') > 9) {
+            /* a lone 'e' isn't part of the number */
+            p = exponent_start;
+        } else {
+            int32_t e = 0;
+            while (p < end && (uint8_t) (*p - '0') <= 9) {
+                if (e < 10000) e = e * 10 + (*p - '0');
+                p++;
+            }
+            exponent += exponent_negative ? -e : e;
+        }
+    }
+
+    if (!exact) goto slow;
+
+    if (mantissa <= OBJ_FLOAT_MANTISSA_MAX &&
+        exponent >= -OBJ_FLOAT_POW10_MAX && exponent <= OBJ_FLOAT_POW10_MAX) {
+        float value = (float) mantissa;
+        if (exponent < 0)
+            value /= (float) pow10_table[-exponent];
+        else
+            value *= (float) pow10_table[exponent];
+
+        *out = negative ? -value : value;
+        return p;
+    }
+
+    if (mantissa > OBJ_DOUBLE_MANTISSA_MAX || exponent < -OBJ_POW10_MAX || exponent > OBJ_POW10_MAX)
+        goto slow;
+
+    double value = (double) mantissa;
+    if (exponent < 0)
+        value /= pow10_table[-exponent];
+    else
+        value *= pow10_table[exponent];
+    if (!obj_float_rounds_once(value)) goto slow;
+
+    *out = (float) (negative ? -value : value);
+    return p;
+
+slow: {
+        /* the mapping isn't null terminated so the token is copied first */
+        char token[OBJ_NUMBER_MAX_LEN + 1];
+        size_t len = 0;
+        const char *q = start;
+        while (q < end && len < OBJ_NUMBER_MAX_LEN &&
+               *q != ' ' && *q != '\t' && *q != '\r' && *q != '\n' && *q != '/')
+            token[len++] = *q++;
+        token[len] = '\0';
+
+        char *token_end = NULL;
+        float value = strtof(token, &token_end);
+        if (token_end == token) return NULL;
+
+        *out = value;
+        return start + (token_end - token);
+    }
+}
+
+/* Whether a correctly rounded double rounds to the same float as the decimal
+   it came from. The decimal is nearer to it than to any other double, so the
+   two only round apart if it lies exactly on the midpoint of two floats, or
+   if it's outside of the normal floats */
+static bool obj_float_rounds_once(double value)
+{
+    if (value == 0.0) return true;
+    if (value < FLT_MIN || value >= FLT_MAX) return false;
+
+    /* a double has 29 bits of mantissa more than a float, a midpoint has only
+       the highest of them set */
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & ((UINT64_C(1) << 29) - 1)) != (UINT64_C(1) << 28);
+}
+
+static double obj_elapsed_ms(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start.tv_sec) * 1000.0 +
+           (double) (now.tv_nsec - start.tv_nsec) / 1000000.0;
+}
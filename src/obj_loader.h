@@ -1,11 +1,53 @@
 #ifndef SAGE_OBJ_LOADER_H
 #define SAGE_OBJ_LOADER_H
 
+#include <stdint.h>
+
 #include "mesh.h"
 
+/* Upper bound on the threads a single .obj file is parsed with */
+#define OBJ_LOADER_MAX_THREADS 16
+
 /* Loads a mesh from an .obj file and pushes the data onto the parameters set.
    But if vertices or indices are declared but have not been allocated, the
-   function allocates memory to it, however they MUST be defined as NULL */
+   function allocates memory to it, however they MUST be defined as NULL.
+
+   Faces can be any polygon, which are fanned into triangles, with corners
+   written as v, v/t, v//n or v/t/n and indices that are either 1-based or
+   negative (relative to the last declared attribute). Corners without a uv
+   get (0, 0), corners without a normal get an area weighted smooth normal
+   computed from the faces around their position.
+
+   Face corners sharing the same position, uv & normal are merged into a single
+   vertex. Indices allocated by the loader are uint16_t when every vertex fits,
+   otherwise uint32_t. Indices passed in keep their size and are offset by the
+   vertices already in the darray.
+
+   The file is memory mapped and scanned twice: once to count the records so
+   every array is sized up front, then once more to parse them. The parse time
+   and throughput are logged, `make bench` reports them for all of res/ */
 void obj_load_mesh(const char *path, darray **vertices, darray **indices);
 
+/* Same as obj_load_mesh() but parses the file with n_threads threads, 0 picks
+   the amount based on the cores available & the size of the file. The file is
+   split along lines into one chunk per thread, the results are identical no
+   matter the amount of threads used */
+void obj_load_mesh_threaded(const char *path,
+                            darray **vertices,
+                            darray **indices,
+                            uint32_t n_threads);
+
+/* Same as obj_load_mesh() but also splits the triangles into submeshes, one
+   for every (group, material) pair set by the o, g & usemtl statements before
+   them. 'submeshes' MUST be NULL and gets allocated as a darray of struct
+   mesh_submesh with their name, material & LOD 0 range of the indices set,
+   each a single range even if its triangles are spread across the file.
+   'material_library' gets the first mtllib relative to the .obj, or an empty
+   string if there is none */
+void obj_load_model(const char *path,
+                    darray **vertices,
+                    darray **indices,
+                    darray **submeshes,
+                    char material_library[MESH_PATH_MAX_SIZE]);
+
 #endif /* SAGE_OBJ_LOADER_H */
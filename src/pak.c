@@ -0,0 +1,227 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <glad/gl.h>
+
+#include "pak.h"
+#include "mesh_cache.h"
+#include "texture_cache.h"
+#include "texture_residency.h"
+#include "hash.h"
+#include "logger.h"
+
+struct pak {
+    bool mounted;
+    struct mapped_file file;
+    const struct pak_entry *entries;
+    uint32_t n_entries;
+    bool *valid;            /* per entry, whether it matched its hash */
+};
+
+/* only changed by pak_mount() & pak_unmount(), before & after the threads
+   that load assets run, so lookups don't lock */
+static struct pak pak;
+
+static const struct pak_entry *pak_find(const char *name, enum pak_entry_type type);
+static int pak_compare_name(const void *name, const void *entry);
+static const struct stex_header *pak_find_texture(const char *name, uint32_t flags,
+                                                 size_t *size);
+static double pak_elapsed_ms(struct timespec start);
+
+bool pak_mount(const char *path)
+{
+    if (pak.mounted) pak_unmount();
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (!file_map(path, &pak.file)) {
+        SDEBUG("No cooked archive at '%s', loading the assets from their files", path);
+        return false;
+    }
+
+    /* every entry is hashed right away, so the whole archive is read once
+       from the front */
+    if (pak.file.size > 0)
+        posix_madvise((void *) pak.file.data, pak.file.size, POSIX_MADV_WILLNEED);
+
+    const struct pak_header *header = pak.file.data;
+    if (pak.file.size < sizeof(struct pak_header) ||
+        header->magic != PAK_MAGIC ||
+        header->version != PAK_VERSION) {
+        SWARN("'%s' isn't a .sagepak of this version of sage, run `make cook`", path);
+        goto err;
+    }
+
+    if (header->toc_offset > pak.file.size ||
+        (pak.file.size - header->toc_offset) / sizeof(struct pak_entry) < header->n_entries) {
+        SWARN("Cooked archive '%s' is truncated", path);
+        goto err;
+    }
+
+    pak.entries = (const struct pak_entry *) ((const uint8_t *) pak.file.data + header->toc_offset);
+    pak.n_entries = header->n_entries;
+
+    /* lookups binary search the names */
+    for (uint32_t i = 0; i < pak.n_entries; i++) {
+        const struct pak_entry *entry = &pak.entries[i];
+        if (memchr(entry->name, '\0', PAK_NAME_MAX_SIZE) == NULL ||
+            (i > 0 && strcmp(pak.entries[i - 1].name, entry->name) >= 0)) {
+            SWARN("The table of contents of '%s' is corrupt", path);
+            goto err;
+        }
+    }
+
+    pak.valid = calloc(pak.n_entries ? pak.n_entries : 1, sizeof(bool));
+    if (pak.valid == NULL) {
+        SERROR("Failed to alloc memory for mounting '%s'", path);
+        goto err;
+    }
+
+    const uint8_t *base = pak.file.data;
+    uint32_t n_valid = 0;
+    for (uint32_t i = 0; i < pak.n_entries; i++) {
+        const struct pak_entry *entry = &pak.entries[i];
+        bool valid = entry->offset <= header->toc_offset &&
+                     entry->size <= header->toc_offset - entry->offset &&
+                     hash_64(base + entry->offset, entry->size, PAK_MAGIC) == entry->hash;
+
+        if (valid && entry->type == PAK_ENTRY_MESH)
+            valid = mesh_cache_validate(base + entry->offset, entry->size, entry->name);
+        else if (valid && entry->type == PAK_ENTRY_TEXTURE)
+            valid = texture_cache_validate(base + entry->offset, entry->size, entry->name);
+
+        /* a bad entry is loaded from its file instead */
+        if (!valid) SWARN("Cooked '%s' is corrupt, loading it from its file", entry->name);
+        pak.valid[i] = valid;
+        n_valid += valid;
+    }
+
+    pak.mounted = true;
+    SINFO("Mounted '%s' (%.2f MB, %u assets) in %.2f ms", path,
+          (double) pak.file.size / (1024.0 * 1024.0), n_valid, pak_elapsed_ms(start));
+
+    return true;
+
+err:
+    file_unmap(&pak.file);
+    return false;
+}
+
+void pak_unmount(void)
+{
+    if (!pak.mounted) return;
+
+    free(pak.valid);
+    file_unmap(&pak.file);
+    memset(&pak, 0, sizeof(pak));
+}
+
+bool pak_contains(const char *name)
+{
+    return pak_find(name, PAK_ENTRY_FILE) != NULL;
+}
+
+bool pak_map(const char *name, struct mapped_file *file)
+{
+    const struct pak_entry *entry = pak_find(name, PAK_ENTRY_FILE);
+    if (entry == NULL) return false;
+
+    file->data = entry->size ? (const uint8_t *) pak.file.data + entry->offset : NULL;
+    file->size = entry->size;
+    file->copied = false;
+    file->borrowed = true;
+
+    return true;
+}
+
+bool pak_mesh(const char *name, struct mesh *mesh)
+{
+    const struct pak_entry *entry = pak_find(name, PAK_ENTRY_MESH);
+    if (entry == NULL) return false;
+
+    *mesh = mesh_cache_create((const uint8_t *) pak.file.data + entry->offset);
+    return true;
+}
+
+bool pak_texture(const char *name, uint32_t flags, struct texture *texture)
+{
+    size_t size;
+    const struct stex_header *header = pak_find_texture(name, flags, &size);
+    if (header == NULL) return false;
+
+    struct texture_image levels[STEX_MAX_LEVELS];
+    uint32_t n_levels = texture_cache_levels(header, levels);
+
+    memset(texture, 0, sizeof(*texture));
+    texture->width = levels[0].width;
+    texture->height = levels[0].height;
+
+    glGenTextures(1, &texture->id);
+
+    /* the residency manager streams the rest of the mips out of the archive */
+    struct texture_cache_file cache = {
+        .file = { .data = header, .size = size, .borrowed = true }
+    };
+    if (!texture_residency_manage(&cache, texture->id))
+        texture_upload_levels(texture->id, levels, n_levels);
+
+    return true;
+}
+
+bool pak_cubemap_face(const char *name, uint32_t flags, uint32_t id, uint32_t face)
+{
+    size_t size;
+    const struct stex_header *header = pak_find_texture(name, flags, &size);
+    if (header == NULL) return false;
+
+    struct texture_image levels[STEX_MAX_LEVELS];
+    texture_cache_levels(header, levels);
+    cubemap_texture_upload_face(id, face, &levels[0]);
+
+    return true;
+}
+
+static const struct pak_entry *pak_find(const char *name, enum pak_entry_type type)
+{
+    if (!pak.mounted) return NULL;
+
+    const struct pak_entry *entry = bsearch(name, pak.entries, pak.n_entries,
+                                            sizeof(struct pak_entry), pak_compare_name);
+    if (entry == NULL || entry->type != (uint32_t) type || !pak.valid[entry - pak.entries])
+        return NULL;
+
+    return entry;
+}
+
+static int pak_compare_name(const void *name, const void *entry)
+{
+    return strcmp(name, ((const struct pak_entry *) entry)->name);
+}
+
+/* Images are cooked with one set of flags, any other loads from its file */
+static const struct stex_header *pak_find_texture(const char *name, uint32_t flags,
+                                                 size_t *size)
+{
+    const struct pak_entry *entry = pak_find(name, PAK_ENTRY_TEXTURE);
+    if (entry == NULL) return NULL;
+
+    const struct stex_header *header = (const void *) ((const uint8_t *) pak.file.data + entry->offset);
+    if (header->flags != flags) {
+        SDEBUG("'%s' was cooked differently, loading it from its file", name);
+        return NULL;
+    }
+
+    *size = entry->size;
+    return header;
+}
+
+static double pak_elapsed_ms(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start.tv_sec) * 1000.0 +
+           (double) (now.tv_nsec - start.tv_nsec) / 1000000.0;
+}
@@ -0,0 +1,77 @@
+#ifndef SAGE_PAK_H
+#define SAGE_PAK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "file.h"
+#include "mesh.h"
+#include "texture.h"
+
+/*
+ * Cooked scene archive (.sagepak)
+ *
+ * `make cook` runs tools/cook.c over the assets of the scene & writes all of
+ * them into one file, laid out the way GL takes them:
+ *     meshes as a .smesh (see mesh_cache.h) in the vertex format of the build
+ *     images as a .stex (see texture_cache.h), compressed as colors with
+ *     every mip level, cubemap faces without
+ *     everything else, like shaders & .mtl files, as is
+ * followed by a table of contents sorted by the path each asset is loaded with,
+ * holding its offset, size & content hash.
+ *
+ * pak_mount() maps the archive once & checks every entry against its hash.
+ * The loaders look into the archive before the file system: meshes & textures
+ * are created straight from the mapping & file_map() hands out the other
+ * files in place. Anything that isn't in the archive loads like before.
+ */
+
+#define PAK_MAGIC   0x4B415053 /* "SPAK" */
+/* Bumped whenever the layout of the archive or of its entries changes */
+#define PAK_VERSION 4
+
+#define PAK_NAME_MAX_SIZE 256
+/* entries start on this boundary so they can be read in place */
+#define PAK_ALIGNMENT 16
+
+enum pak_entry_type {
+    PAK_ENTRY_FILE = 1,
+    PAK_ENTRY_MESH,
+    PAK_ENTRY_TEXTURE,
+};
+
+struct pak_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t n_entries;
+    uint32_t reserved;
+    uint64_t toc_offset;    /* struct pak_entry[n_entries] */
+};
+
+struct pak_entry {
+    char name[PAK_NAME_MAX_SIZE];
+    uint32_t type;          /* enum pak_entry_type */
+    uint32_t reserved;
+    uint64_t offset;        /* from the start of the archive */
+    uint64_t size;
+    uint64_t hash;          /* hash_64() of the data, seeded with PAK_MAGIC */
+};
+
+/* Maps the archive, returns false if it doesn't exist or is unusable */
+bool pak_mount(const char *path);
+void pak_unmount(void);
+/* Whether the mounted archive has the file 'name' */
+bool pak_contains(const char *name);
+
+/* A file stored as is, 'file' points into the archive & unmapping it is a
+   no-op. The engine adds it as a source of file_map() */
+bool pak_map(const char *name, struct mapped_file *file);
+/* Creates the mesh of a cooked .obj */
+bool pak_mesh(const char *name, struct mesh *mesh);
+/* Creates a texture from a cooked image, false if it's not in the archive or
+   wasn't cooked with the same STEX_* 'flags' of texture_cache.h */
+bool pak_texture(const char *name, uint32_t flags, struct texture *texture);
+/* Same for an image uploaded into a face of a cubemap */
+bool pak_cubemap_face(const char *name, uint32_t flags, uint32_t id, uint32_t face);
+
+#endif /* SAGE_PAK_H */
@@ -7,6 +7,8 @@
 #include "platform.h"
 #include "config.h"
 #include "logger.h"
+#include "texture.h"
+#include "gl_state.h"
 
 #define GET_KPD(action) (action) == GLFW_PRESS || (action) == GLFW_REPEAT
 
@@ -51,6 +53,7 @@ bool platform_window_init(struct platform *platform,
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, SAGE_OPENGL_MINOR_VERSION);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_SAMPLES, SAGE_MULTISAMPLE_ANTIALIASING);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, SAGE_GL_DEBUG ? GLFW_TRUE : GLFW_FALSE);
     GLFWwindow *context = glfwCreateWindow(window_width,
                                            window_height,
                                            SAGE_WINDOW_TITLE,
@@ -80,6 +83,7 @@ bool platform_window_init(struct platform *platform,
     SINFO("Loaded OpenGL %d.%d", 
           GLAD_VERSION_MAJOR(version),
           GLAD_VERSION_MINOR(version));
+    gl_state_init();
 
     /* fetching GPU specs */
     int n_vertex_attributes;
@@ -101,6 +105,9 @@ bool platform_window_init(struct platform *platform,
     SINFO("\tMax combined shader texture units: %d", max_combined_texture_units);
     SINFO("\tMax vertex shader attributes: %d", n_vertex_attributes);
 
+    /* before any texture is loaded, it decides how they're stored */
+    texture_detect_compression();
+
     /* Set OpenGL state */
     glViewport(0, 0, viewport_width, viewport_height);
     gl_set_state();
@@ -161,6 +168,10 @@ void platform_swap_buffer(struct platform *platform)
 void platform_window_shutdown(struct platform *platform)
 {
     SINFO("Closing window and cleaning up");
+    struct gl_state_stats stats = gl_state_stats();
+    SINFO("GL state tracking avoided %llu of %llu calls",
+          (unsigned long long) stats.n_avoided,
+          (unsigned long long) (stats.n_avoided + stats.n_issued));
     glfwTerminate();
     platform->context = NULL;
     platform->running = false;
@@ -169,7 +180,7 @@ void platform_window_shutdown(struct platform *platform)
 }
 
 void gl_polygon_mode(enum polygon_mode mode) {
-    GLenum gl_mode;
+    GLenum gl_mode = GL_FILL;
 
     switch (mode) {
         case (POLYGON_FILL): 
@@ -185,11 +196,14 @@ void gl_polygon_mode(enum polygon_mode mode) {
 
 static void gl_set_state(void)
 {
+    /* whatever was bound before is unknown, the calls below are all issued */
+    gl_state_invalidate();
     glFrontFace(GL_CCW);
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl_state_enable(GL_DEPTH_TEST, true);
+    gl_state_depth_func(GL_LESS);
+    gl_state_depth_mask(true);
+    gl_state_enable(GL_BLEND, true);
+    gl_state_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 }
 
 static void error_callback(int32_t error, const char *description)
@@ -0,0 +1,137 @@
+#include <string.h>
+#include <math.h>
+
+#include "render_queue.h"
+#include "logger.h"
+
+#define RENDER_KEY_DEPTH_BITS 16
+#define RENDER_KEY_FINE_DEPTH_BITS 12
+
+static uint64_t render_queue_key(const struct render_queue *queue, enum render_pass pass,
+                                 uint32_t shader, uint32_t material, uint32_t mesh,
+                                 uint32_t submesh, float depth);
+static uint32_t render_queue_switches(const darray *items);
+
+bool render_queue_init(struct render_queue *queue)
+{
+    memset(queue, 0, sizeof(*queue));
+    queue->items = darray_alloc(sizeof(struct render_item), 256);
+    queue->scratch = darray_alloc(sizeof(struct render_item), 256);
+    if (queue->items == NULL || queue->scratch == NULL) {
+        SERROR("Failed to alloc memory for the render queue");
+        render_queue_destroy(queue);
+        return false;
+    }
+
+    return true;
+}
+
+void render_queue_begin(struct render_queue *queue, float near, float far)
+{
+    if (queue->items) queue->items->len = 0;
+    queue->near = near;
+    queue->far = far;
+}
+
+void render_queue_push(struct render_queue *queue, enum render_pass pass,
+                       uint32_t shader, uint32_t material, uint32_t mesh, float depth,
+                       uint32_t object, uint32_t submesh)
+{
+    if (queue->items == NULL) return;
+
+    struct render_item item;
+    item.key = render_queue_key(queue, pass, shader, material, mesh, submesh, depth);
+    item.shader = shader;
+    item.material = material;
+    item.mesh = mesh;
+    item.object = object;
+    item.submesh = submesh;
+    darray_push(queue->items, &item);
+}
+
+void render_queue_sort(struct render_queue *queue)
+{
+    if (queue->items == NULL) return;
+
+    size_t n_items = queue->items->len;
+    queue->stats.n_items = (uint32_t) n_items;
+    queue->stats.unsorted_switches = render_queue_switches(queue->items);
+
+    if (n_items > 1 && !darray_reserve(queue->scratch, n_items)) {
+        SERROR("Failed to alloc memory for sorting %zu draws, drawing them unsorted", n_items);
+        queue->stats.sorted_switches = queue->stats.unsorted_switches;
+        return;
+    }
+
+    /* least significant byte first, each pass is stable so the ones before
+       stay in order within its buckets. Bytes every key shares are skipped */
+    for (uint32_t shift = 0; shift < 64 && n_items > 1; shift += 8) {
+        struct render_item *from = queue->items->items;
+        struct render_item *to = queue->scratch->items;
+
+        size_t offsets[256] = {0};
+        for (size_t i = 0; i < n_items; i++) offsets[(from[i].key >> shift) & 0xff]++;
+        if (offsets[(from[0].key >> shift) & 0xff] == n_items) continue;
+
+        size_t offset = 0;
+        for (size_t i = 0; i < 256; i++) {
+            size_t count = offsets[i];
+            offsets[i] = offset;
+            offset += count;
+        }
+        for (size_t i = 0; i < n_items; i++) to[offsets[(from[i].key >> shift) & 0xff]++] = from[i];
+
+        /* the sorted half becomes the items */
+        darray *sorted = queue->scratch;
+        queue->scratch = queue->items;
+        queue->items = sorted;
+        queue->items->len = n_items;
+        queue->scratch->len = 0;
+    }
+
+    queue->stats.sorted_switches = render_queue_switches(queue->items);
+}
+
+void render_queue_destroy(struct render_queue *queue)
+{
+    if (queue->items) darray_free(queue->items);
+    if (queue->scratch) darray_free(queue->scratch);
+    memset(queue, 0, sizeof(*queue));
+}
+
+static uint64_t render_queue_key(const struct render_queue *queue, enum render_pass pass,
+                                 uint32_t shader, uint32_t material, uint32_t mesh,
+                                 uint32_t submesh, float depth)
+{
+    /* logarithmic so the slices near the camera, where most of the overdraw
+       is, are as thin as the ones far away are wide in the depth buffer */
+    float near = (queue->near > 0.0f) ? queue->near : 0.1f;
+    float far = (queue->far > near) ? queue->far : near * 2.0f;
+    float t = logf(fmaxf(depth, near) / near) / logf(far / near);
+    t = fminf(fmaxf(t, 0.0f), 1.0f);
+    uint64_t quantized = (uint64_t) (t * (float) ((1u << RENDER_KEY_DEPTH_BITS) - 1));
+
+    uint64_t coarse = quantized >> RENDER_KEY_FINE_DEPTH_BITS;
+    uint64_t fine = quantized & ((1u << RENDER_KEY_FINE_DEPTH_BITS) - 1);
+
+    return ((uint64_t) (pass & 0x3) << 62) |
+           ((uint64_t) (shader & 0x3f) << 56) |
+           (coarse << 52) |
+           ((uint64_t) (material & 0xffffff) << 28) |
+           ((uint64_t) (mesh & 0x3ff) << 18) |
+           ((uint64_t) (submesh & 0x3f) << 12) |
+           fine;
+}
+
+static uint32_t render_queue_switches(const darray *items)
+{
+    const struct render_item *item = items->items;
+    uint32_t n_switches = 0;
+    for (size_t i = 1; i < items->len; i++) {
+        n_switches += (item[i].shader != item[i - 1].shader);
+        n_switches += (item[i].material != item[i - 1].material);
+        n_switches += (item[i].mesh != item[i - 1].mesh);
+    }
+
+    return n_switches;
+}
@@ -0,0 +1,68 @@
+#ifndef SAGE_RENDER_QUEUE_H
+#define SAGE_RENDER_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "darray.h"
+
+/*
+ * Render queue
+ *
+ * The draws of a frame are collected first & drawn in the order of a 64-bit
+ * key instead of the order of the scene, from the most significant bits:
+ *
+ *   pass (2) | shader (6) | coarse depth (4) | material (24) | mesh (10) | submesh (6) | fine depth (12)
+ *
+ * So the draws of a shader are together, within it nearer draws go first in
+ * 16 slices of depth for early-z to reject what's behind them, & within a
+ * slice draws sharing a material, mesh & submesh follow each other. The depth is of
+ * the view space & spaced logarithmically between the near & far plane.
+ *
+ * The fields of the key only hold the low bits of the ids, draws whose ids
+ * collide are sorted as if they were the same but are drawn correctly. What
+ * the draws are is up to the caller, the queue only orders them.
+ */
+
+/* Opaque draws go front to back, a pass of transparent ones would go after
+   back to front */
+enum render_pass {
+    RENDER_PASS_OPAQUE,
+};
+
+struct render_item {
+    uint64_t key;
+    uint32_t shader;        /* program */
+    uint32_t material;      /* see material_key() */
+    uint32_t mesh;          /* VAO */
+    uint32_t object;        /* of the caller, like the index of a model */
+    uint32_t submesh;
+};
+
+/* Changes of the shader, material or mesh between consecutive draws */
+struct render_queue_stats {
+    uint32_t n_items;
+    uint32_t unsorted_switches;     /* in the order the draws were pushed */
+    uint32_t sorted_switches;
+};
+
+struct render_queue {
+    darray *items;          /* struct render_item */
+    darray *scratch;        /* the other half of the radix sort */
+    float near;
+    float far;
+    struct render_queue_stats stats;
+};
+
+bool render_queue_init(struct render_queue *queue);
+/* Empties the queue for a frame seen between the 'near' & 'far' planes */
+void render_queue_begin(struct render_queue *queue, float near, float far);
+/* 'depth' is the distance along the view direction */
+void render_queue_push(struct render_queue *queue, enum render_pass pass,
+                       uint32_t shader, uint32_t material, uint32_t mesh, float depth,
+                       uint32_t object, uint32_t submesh);
+/* Orders the items by their keys & counts the state switches before & after */
+void render_queue_sort(struct render_queue *queue);
+void render_queue_destroy(struct render_queue *queue);
+
+#endif /* SAGE_RENDER_QUEUE_H */
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "resource_cache.h"
+#include "mesh_cache.h"
+#include "obj_loader.h"
+#include "pak.h"
+#include "hash.h"
+#include "darray.h"
+#include "logger.h"
+
+enum resource_type {
+    RESOURCE_TEXTURE = 1,
+    RESOURCE_MESH,
+};
+
+struct resource_entry {
+    enum resource_type type;
+    char key[MESH_PATH_MAX_SIZE];
+    uint32_t params;        /* the role of textures */
+    uint64_t hash;          /* of the key, type & params */
+    uint32_t refs;          /* 0 once released, the slot is reused */
+
+    struct texture texture;
+    struct mesh mesh;
+    asset_job job;          /* while the mesh is streamed, 'mesh' is the placeholder */
+};
+
+struct resource_cache {
+    darray *entries;        /* struct resource_entry, handles are their index + 1 */
+    uint32_t n_shared;      /* loads a reference saved */
+};
+
+static struct resource_cache cache;
+
+static struct resource_entry *resource_cache_find(enum resource_type type, const char *key,
+                                                  uint32_t params, size_t *index);
+static struct resource_entry *resource_cache_add(enum resource_type type, const char *key,
+                                                 uint32_t params, size_t *index);
+static void resource_cache_destroy(struct resource_entry *entry);
+static void resource_cache_update_mesh(struct resource_entry *entry);
+static void resource_cache_load_mesh(const char *path, struct mesh *mesh, asset_job *job);
+static void resource_cache_canonical_path(const char *path, char out[MESH_PATH_MAX_SIZE]);
+
+struct texture resource_cache_texture(const char *path, enum texture_role role)
+{
+    char key[MESH_PATH_MAX_SIZE];
+    resource_cache_canonical_path(path, key);
+
+    struct resource_entry *entry = resource_cache_find(RESOURCE_TEXTURE, key, role, NULL);
+    if (entry != NULL) return entry->texture;
+
+    struct texture texture = texture_create(path, role);
+    if (texture.id == 0) return texture;
+
+    entry = resource_cache_add(RESOURCE_TEXTURE, key, role, NULL);
+    if (entry != NULL) entry->texture = texture;
+
+    return texture;
+}
+
+struct texture resource_cache_packed(const char *red_path, const char *green_path)
+{
+    /* keyed by both paths, an empty side is the mask of white */
+    char red[MESH_PATH_MAX_SIZE] = "";
+    char green[MESH_PATH_MAX_SIZE] = "";
+    if (red_path) resource_cache_canonical_path(red_path, red);
+    if (green_path) resource_cache_canonical_path(green_path, green);
+
+    char key[MESH_PATH_MAX_SIZE];
+    int n = snprintf(key, sizeof(key), "%s+%s", red, green);
+    if (n < 0 || n >= (int) sizeof(key)) return texture_create_packed(red_path, green_path);
+
+    struct resource_entry *entry = resource_cache_find(RESOURCE_TEXTURE, key,
+                                                       TEXTURE_ROLE_PACKED, NULL);
+    if (entry != NULL) return entry->texture;
+
+    struct texture texture = texture_create_packed(red_path, green_path);
+    if (texture.id == 0) return texture;
+
+    entry = resource_cache_add(RESOURCE_TEXTURE, key, TEXTURE_ROLE_PACKED, NULL);
+    if (entry != NULL) entry->texture = texture;
+
+    return texture;
+}
+
+struct texture resource_cache_color(const uint8_t rgba[4])
+{
+    /* paths never start with a '#' */
+    char key[16];
+    snprintf(key, sizeof(key), "#%02x%02x%02x%02x", rgba[0], rgba[1], rgba[2], rgba[3]);
+
+    struct resource_entry *entry = resource_cache_find(RESOURCE_TEXTURE, key, 0, NULL);
+    if (entry != NULL) return entry->texture;
+
+    struct texture texture = texture_create_color(rgba);
+
+    entry = resource_cache_add(RESOURCE_TEXTURE, key, 0, NULL);
+    if (entry != NULL) entry->texture = texture;
+
+    return texture;
+}
+
+void resource_cache_release_texture(struct texture *texture)
+{
+    if (texture->id == 0) return;
+
+    struct resource_entry *entries = cache.entries ? cache.entries->items : NULL;
+    size_t n_entries = cache.entries ? cache.entries->len : 0;
+    for (size_t i = 0; i < n_entries; i++) {
+        if (entries[i].refs == 0 || entries[i].type != RESOURCE_TEXTURE ||
+            entries[i].texture.id != texture->id)
+            continue;
+
+        if (--entries[i].refs == 0) resource_cache_destroy(&entries[i]);
+        texture->id = 0;
+        return;
+    }
+
+    texture_destroy(texture);
+}
+
+resource_mesh resource_cache_mesh(const char *path, struct mesh *mesh, asset_job *job)
+{
+    char key[MESH_PATH_MAX_SIZE];
+    resource_cache_canonical_path(path, key);
+
+    size_t index;
+    struct resource_entry *entry = resource_cache_find(RESOURCE_MESH, key, 0, &index);
+    if (entry == NULL) {
+        struct mesh loaded;
+        asset_job loading;
+        resource_cache_load_mesh(path, &loaded, &loading);
+
+        entry = resource_cache_add(RESOURCE_MESH, key, 0, &index);
+        if (entry == NULL) {
+            *mesh = loaded;
+            *job = loading;
+            return 0;
+        }
+        entry->mesh = loaded;
+        entry->job = loading;
+    }
+
+    resource_cache_update_mesh(entry);
+    *mesh = entry->mesh;
+    *job = entry->job;
+
+    return (resource_mesh) index + 1;
+}
+
+resource_mesh resource_cache_cube(struct mesh *mesh)
+{
+    size_t index;
+    struct resource_entry *entry = resource_cache_find(RESOURCE_MESH, "#cube", 0, &index);
+    if (entry == NULL) {
+        struct mesh cube = mesh_geometry_create_cube();
+
+        entry = resource_cache_add(RESOURCE_MESH, "#cube", 0, &index);
+        if (entry == NULL) {
+            *mesh = cube;
+            return 0;
+        }
+        entry->mesh = cube;
+    }
+
+    *mesh = entry->mesh;
+    return (resource_mesh) index + 1;
+}
+
+void resource_cache_release_mesh(resource_mesh handle)
+{
+    if (handle == 0 || cache.entries == NULL || handle > cache.entries->len) return;
+
+    struct resource_entry *entry = darray_at(cache.entries, handle - 1);
+    if (entry->refs == 0) {
+        SWARN("Mesh %u of the resource cache was released more often than it was used", handle);
+        return;
+    }
+
+    if (--entry->refs == 0) resource_cache_destroy(entry);
+}
+
+void resource_cache_shutdown(void)
+{
+    if (cache.entries == NULL) return;
+
+    uint32_t n_referenced = 0;
+    struct resource_entry *entries = cache.entries->items;
+    for (size_t i = 0; i < cache.entries->len; i++) {
+        if (entries[i].refs == 0) continue;
+        n_referenced++;
+        resource_cache_destroy(&entries[i]);
+    }
+
+    SINFO("Resource cache shared %u loads, destroyed %u resources still referenced",
+          cache.n_shared, n_referenced);
+
+    darray_free(cache.entries);
+    cache.entries = NULL;
+    cache.n_shared = 0;
+}
+
+/* Adds a reference to the resource if it's in the cache */
+static struct resource_entry *resource_cache_find(enum resource_type type, const char *key,
+                                                  uint32_t params, size_t *index)
+{
+    if (cache.entries == NULL) return NULL;
+
+    uint64_t hash = hash_64(key, strlen(key), ((uint64_t) type << 32) | params);
+    struct resource_entry *entries = cache.entries->items;
+    for (size_t i = 0; i < cache.entries->len; i++) {
+        struct resource_entry *entry = &entries[i];
+        if (entry->refs == 0 || entry->hash != hash || entry->type != type ||
+            entry->params != params || strcmp(entry->key, key) != 0)
+            continue;
+
+        entry->refs++;
+        cache.n_shared++;
+        SDEBUG("Sharing '%s' with %u users", key, entry->refs);
+
+        if (index) *index = i;
+        return entry;
+    }
+
+    return NULL;
+}
+
+/* Takes a released slot or pushes a new one, with a single reference. NULL if
+   there is no memory for it, the resource isn't shared then */
+static struct resource_entry *resource_cache_add(enum resource_type type, const char *key,
+                                                 uint32_t params, size_t *index)
+{
+    if (cache.entries == NULL) {
+        cache.entries = darray_alloc(sizeof(struct resource_entry), 64);
+        if (cache.entries == NULL) {
+            SERROR("Failed to alloc memory for the resource cache");
+            return NULL;
+        }
+    }
+
+    struct resource_entry added;
+    memset(&added, 0, sizeof(added));
+    added.type = type;
+    strncpy(added.key, key, MESH_PATH_MAX_SIZE - 1);
+    added.params = params;
+    added.hash = hash_64(key, strlen(key), ((uint64_t) type << 32) | params);
+    added.refs = 1;
+
+    size_t slot = cache.entries->len;
+    struct resource_entry *entries = cache.entries->items;
+    for (size_t i = 0; i < cache.entries->len; i++) {
+        if (entries[i].refs == 0) {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot == cache.entries->len)
+        darray_push(cache.entries, &added);
+    else
+        entries[slot] = added;
+
+    if (index) *index = slot;
+    return darray_at(cache.entries, slot);
+}
+
+static void resource_cache_destroy(struct resource_entry *entry)
+{
+    entry->refs = 0;
+    if (entry->type == RESOURCE_TEXTURE) {
+        texture_destroy(&entry->texture);
+        return;
+    }
+
+    /* a mesh nobody picked up yet is the asset loader's to free */
+    resource_cache_update_mesh(entry);
+    if (entry->job == 0) mesh_destroy(&entry->mesh);
+}
+
+/* Swaps the streamed mesh in once the asset loader has uploaded it */
+static void resource_cache_update_mesh(struct resource_entry *entry)
+{
+    struct mesh mesh;
+    if (entry->job == 0 || !asset_loader_mesh(entry->job, &mesh)) return;
+
+    entry->mesh = mesh;
+    entry->job = 0;
+}
+
+static void resource_cache_load_mesh(const char *path, struct mesh *mesh, asset_job *job)
+{
+    *job = 0;
+
+    /* cooked, created straight from the mapped archive */
+    if (pak_mesh(path, mesh)) return;
+
+    if (asset_loader_active() && (*job = asset_loader_queue_mesh(path)) != 0) {
+        *mesh = asset_loader_placeholder_mesh();
+        return;
+    }
+
+    if (mesh_cache_load(path, mesh)) return;
+
+    darray *vertices = NULL;
+    darray *indices = NULL;
+    darray *submeshes = NULL;
+    char material_library[MESH_PATH_MAX_SIZE];
+    obj_load_model(path, &vertices, &indices, &submeshes, material_library);
+
+    *mesh = mesh_create(vertices, indices, submeshes->items, submeshes->len);
+    memcpy(mesh->material_library, material_library, MESH_PATH_MAX_SIZE);
+    darray_free(submeshes);
+
+    mesh_cache_store(path, mesh);
+}
+
+/* Drops empty & "." components & resolves ".." against the one before it,
+   without touching the file system since cooked files don't have to exist */
+static void resource_cache_canonical_path(const char *path, char out[MESH_PATH_MAX_SIZE])
+{
+    size_t len = 0;
+    size_t n_components = 0;    /* that can be taken back by a ".." */
+    if (path[0] == '/') out[len++] = '/';
+
+    const char *p = path;
+    while (*p != '\0') {
+        size_t n = strcspn(p, "/");
+        const char *component = p;
+        p += n;
+        if (*p == '/') p++;
+
+        if (n == 0 || (n == 1 && component[0] == '.')) continue;
+
+        if (n == 2 && component[0] == '.' && component[1] == '.' && n_components > 0) {
+            /* back to after the slash ending the component before */
+            len--;
+            while (len > 0 && out[len - 1] != '/') len--;
+            n_components--;
+            continue;
+        }
+
+        if (len + n + 1 >= MESH_PATH_MAX_SIZE) break;
+        memcpy(out + len, component, n);
+        len += n;
+        out[len++] = '/';
+
+        /* leading ".." can't be resolved, they're kept */
+        if (!(n == 2 && component[0] == '.' && component[1] == '.')) n_components++;
+    }
+
+    /* without the trailing slash */
+    if (len > 1 && out[len - 1] == '/') len--;
+    out[len] = '\0';
+}
@@ -0,0 +1,46 @@
+#ifndef SAGE_RESOURCE_CACHE_H
+#define SAGE_RESOURCE_CACHE_H
+
+#include <stdint.h>
+
+#include "texture.h"
+#include "mesh.h"
+#include "asset_loader.h"
+
+/*
+ * Shared meshes & textures
+ *
+ * Every texture & .obj mesh is loaded once no matter how many models or
+ * materials ask for it, they're handed the same GL objects & keep a reference
+ * count. Resources are keyed by their path, with "." & ".." resolved so two
+ * spellings of a file are the same resource, plus whatever they're loaded
+ * with (the role of a texture). Flat colors & the cube are keyed by what they
+ * are. The GL objects are destroyed once the last reference is released.
+ *
+ * Only the render thread uses the cache.
+ */
+
+/* Handle of a mesh in the cache, 0 is one the cache doesn't own */
+typedef uint32_t resource_mesh;
+
+/* texture_create() of 'path', the id is 0 if it failed to load */
+struct texture resource_cache_texture(const char *path, enum texture_role role);
+/* texture_create_packed() of the two masks, either can be NULL */
+struct texture resource_cache_packed(const char *red_path, const char *green_path);
+/* texture_create_color() */
+struct texture resource_cache_color(const uint8_t rgba[4]);
+/* Drops a reference to a texture of the cache, textures it doesn't own (like
+   the ones decoded out of a glTF) are destroyed outright */
+void resource_cache_release_texture(struct texture *texture);
+
+/* Mesh of the .obj at 'path'. While the asset loader streams it 'mesh' is its
+   placeholder & 'job' the job to wait on, 0 otherwise */
+resource_mesh resource_cache_mesh(const char *path, struct mesh *mesh, asset_job *job);
+/* mesh_geometry_create_cube() */
+resource_mesh resource_cache_cube(struct mesh *mesh);
+void resource_cache_release_mesh(resource_mesh handle);
+
+/* Destroys whatever is still referenced, before the asset loader shuts down */
+void resource_cache_shutdown(void);
+
+#endif /* SAGE_RESOURCE_CACHE_H */
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include <glad/gl.h>
 
 #include "mnf/mnf_vector.h"
@@ -8,15 +9,34 @@
 #include "darray.h"
 #include "logger.h"
 #include "material.h"
+#include "resource_cache.h"
+#include "texture_residency.h"
 #include "model.h"
 #include "shader.h"
 #include "lighting.h"
+#include "uniform_buffer.h"
+#include "instance_buffer.h"
+#include "asset_loader.h"
+#include "file_batch.h"
+#include "pak.h"
+#include "config.h"
 
 static void scene_clear_color(struct scene *scene);
+static void scene_stream_models(struct scene *scene);
+static void scene_queue(struct scene *scene);
+static void scene_push_instances(struct scene *scene);
+static const struct model *scene_item_model(const struct scene *scene, const struct render_item *item);
 
 struct shader phong_shader;
 struct shader light_shader;
 
+/* the camera & the lights every shader of a frame reads */
+static struct uniform_buffer camera_buffer;
+static struct uniform_buffer lighting_buffer;
+
+/* the draws of a frame, ordered by what they bind */
+static struct render_queue queue;
+
 void scene_init(struct scene *scene, float viewport_width, float viewport_height)
 {
     /* Allocating memory for models, materials, lighting, & shaders */
@@ -31,11 +51,12 @@ void scene_init(struct scene *scene, float viewport_width, float viewport_height
     }
 
     scene->draw_skybox = true;
+    scene->cone_culling = true;
+    memset(&scene->meshlet_stats, 0, sizeof(scene->meshlet_stats));
+    memset(&scene->render_stats, 0, sizeof(scene->render_stats));
+    scene->n_batches = 0;
     mnf_vec3_copy((vec3){0.0f, 0.0f, 0.0f}, scene->clear_color);
-
-    /* preparing shaders */
-    phong_shader = shader_create("glsl/phong.glsl");
-    light_shader = shader_create("glsl/light.glsl");
+    scene->viewport_height = viewport_height;
 
     struct camera *cam = &(scene->cam);
     float aspect = viewport_width / viewport_height;
@@ -49,51 +70,100 @@ void scene_init(struct scene *scene, float viewport_width, float viewport_height
     scene->lighting_params.enable_ambient = true;
     scene->lighting_params.enable_diffuse = true;
     scene->lighting_params.enable_specular = true;
+
+    /* before the asset loader starts since its threads look into it */
+    pak_mount(SAGE_PAK_PATH);
+
+    /* file_map() hands out what's in the .sagepak first, then the batch */
+    file_add_source(pak_map);
+    file_add_source(file_batch_take);
+
+#if SAGE_ASYNC_LOADING
+    asset_loader_init(SAGE_ASSET_LOADER_THREADS);
+#endif
+
+    /* every file the scene needs is read in one batch, the asset loader adds
+       the ones of the models & textures as they're queued */
+    file_batch_begin();
+    file_batch_add("glsl/phong.glsl");
+    file_batch_add("glsl/light.glsl");
+
     scene_init_lighting(scene);
     scene_init_models(scene);
     scene_init_skybox(scene);
 
+    file_batch_submit();
+
+    /* preparing shaders */
+    phong_shader = shader_create("glsl/phong.glsl");
+    light_shader = shader_create("glsl/light.glsl");
+    camera_buffer = uniform_buffer_create(UNIFORM_BLOCK_CAMERA, sizeof(struct camera_block));
+    lighting_buffer = uniform_buffer_create(UNIFORM_BLOCK_LIGHTING, sizeof(struct lighting_block));
+    if (!render_queue_init(&queue) || !instance_buffer_init()) exit(1);
+
     SINFO("Finished Initializing Scene!");
 }
 
 void scene_render(struct scene *scene)
 {
     scene_clear_color(scene);
+    memset(&scene->meshlet_stats, 0, sizeof(scene->meshlet_stats));
+    scene_stream_models(scene);
+    texture_residency_update(scene->viewport_height);
 
     struct camera *cam = &(scene->cam);
     camera_update(cam);
 
     if (scene->draw_skybox) skybox_draw(scene->skybox, cam->view, cam->projection);
 
-    shader_use(light_shader);
-    shader_uniform_mat4(light_shader, "u_view", cam->view);
-    shader_uniform_mat4(light_shader, "u_projection", cam->projection);
-    for (uint32_t i = 0; i < scene->point_lights->len; i++) {
-        struct point_light *light = darray_at(scene->point_lights, i);
-        if (!light->visible) continue;
+    /* written once for every shader, & only if the camera or lights moved */
+    struct camera_block camera_block;
+    camera_uniform_block(cam, &camera_block);
+    uniform_buffer_update(&camera_buffer, &camera_block);
 
-        struct model light_model = light->geometric_model;
-        model_translate(&light_model, light->pos);
-        shader_uniform_vec3(light_shader, "u_color", light->color);
-        model_draw(light_model, light_shader);
-    }
+    struct lighting_block lighting_block;
+    lighting_uniform_block(scene->environment_light, scene->point_lights,
+                           scene->lighting_params, &lighting_block);
+    uniform_buffer_update(&lighting_buffer, &lighting_block);
 
-    shader_use(phong_shader);
-    shader_uniform_mat4(phong_shader, "u_view", cam->view);
-    shader_uniform_vec3(phong_shader, "u_view_pos", cam->pos);
-    shader_uniform_mat4(phong_shader, "u_projection", cam->projection);
-    for (uint32_t i = 0; i < scene->models->len; i++) {
-        struct model *model = darray_at(scene->models, i);
-        if (!model->visible) continue;
+    scene_queue(scene);
+    scene_push_instances(scene);
 
-        lighting_apply(phong_shader,
-                       scene->environment_light,
-                       scene->point_lights,
-                       scene->lighting_params);
+    /* a run of draws of the same submesh with the same textures is a single
+       instanced draw, the state it leaves bound is only known while the
+       shader stays */
+    struct model_draw_state state;
+    uint32_t program = 0;
+    const struct render_item *items = queue.items ? queue.items->items : NULL;
+    size_t n_items = queue.items ? queue.items->len : 0;
+    scene->n_batches = 0;
+    for (size_t i = 0; i < n_items;) {
+        const struct render_item *item = &items[i];
+        const struct model *model = scene_item_model(scene, item);
 
-        material_apply(phong_shader, model->material);
-        model_draw(*model, phong_shader);
+        size_t n_instances = 1;
+        while (i + n_instances < n_items) {
+            const struct render_item *next = &items[i + n_instances];
+            if (next->shader != item->shader || next->mesh != item->mesh ||
+                next->submesh != item->submesh ||
+                !model_batches_with(model, scene_item_model(scene, next), item->submesh))
+                break;
+            n_instances++;
+        }
+
+        struct shader shader = (item->shader == light_shader.handle) ? light_shader : phong_shader;
+        if (item->shader != program) {
+            shader_use(shader);
+            memset(&state, 0, sizeof(state));
+            program = item->shader;
+        }
+
+        model_draw_instances(model, item->submesh, (uint32_t) i, (uint32_t) n_instances, shader, cam,
+                             scene->cone_culling, &state, &scene->meshlet_stats);
+        scene->n_batches++;
+        i += n_instances;
     }
+    scene->render_stats = queue.stats;
 }
 
 void scene_destroy(struct scene *scene)
@@ -105,10 +175,114 @@ void scene_destroy(struct scene *scene)
         model_destroy(model);
     }
 
+    /* the meshes & textures the lights still share, before the asset loader
+       frees what nobody picked up */
+    resource_cache_shutdown();
+    texture_residency_shutdown();
+
     darray_free(scene->point_lights);
     darray_free(scene->models);
     shader_destroy(&phong_shader);
     shader_destroy(&light_shader);
+    uniform_buffer_destroy(&camera_buffer);
+    uniform_buffer_destroy(&lighting_buffer);
+    render_queue_destroy(&queue);
+    instance_buffer_shutdown();
+    asset_loader_shutdown();
+    file_batch_end();
+    pak_unmount();
+}
+
+/* Uploads what the asset loader has finished within the frame's budget &
+   swaps the meshes into the models waiting on them */
+static void scene_stream_models(struct scene *scene)
+{
+    if (asset_loader_pending() == 0) {
+        /* whatever the batch read is consumed by now */
+        file_batch_end();
+        return;
+    }
+
+    asset_loader_update(SAGE_ASSET_UPLOAD_BUDGET_MS);
+
+    for (uint32_t i = 0; i < scene->models->len; i++) {
+        struct model *model = darray_at(scene->models, i);
+        model_stream(model);
+    }
+
+    for (uint32_t i = 0; i < scene->point_lights->len; i++) {
+        struct point_light *light = darray_at(scene->point_lights, i);
+        model_stream(&light->geometric_model);
+    }
+}
+
+/* Collects the draws of the visible lights & models, sorted by their keys */
+static void scene_queue(struct scene *scene)
+{
+    struct camera *cam = &(scene->cam);
+    render_queue_begin(&queue, cam->near, cam->far);
+
+    for (uint32_t i = 0; i < scene->point_lights->len; i++) {
+        struct point_light *light = darray_at(scene->point_lights, i);
+        if (!light->visible) continue;
+
+        /* the gizmos sample no textures, they all share a material. The
+           body is drawn where the light is */
+        struct model *body = &light->geometric_model;
+        model_translate(body, light->pos);
+        body->lod = model_select_lod(body, cam);
+
+        vec3 to_light;
+        mnf_vec3_sub(light->pos, cam->pos, to_light);
+        for (uint32_t j = 0; j < body->mesh.n_submeshes; j++) {
+            uint32_t vao = body->mesh.streams ? body->mesh.streams[j].vao : body->mesh.buffer.vao;
+            render_queue_push(&queue, RENDER_PASS_OPAQUE, light_shader.handle, 0, vao,
+                              mnf_vec3_dot(to_light, cam->forward), i, j);
+        }
+    }
+
+    for (uint32_t i = 0; i < scene->models->len; i++) {
+        struct model *model = darray_at(scene->models, i);
+        if (!model->visible) continue;
+
+        model->lod = model_select_lod(model, cam);
+        model_queue(model, i, phong_shader, cam, &queue, &scene->meshlet_stats);
+    }
+
+    render_queue_sort(&queue);
+}
+
+/* The instances of the sorted draws, instance i is drawn by item i so a run
+   of items is a run of instances */
+static void scene_push_instances(struct scene *scene)
+{
+    instance_buffer_begin();
+
+    const struct render_item *items = queue.items ? queue.items->items : NULL;
+    size_t n_items = queue.items ? queue.items->len : 0;
+    for (size_t i = 0; i < n_items; i++) {
+        const struct render_item *item = &items[i];
+        if (item->shader == light_shader.handle) {
+            const struct point_light *light = darray_at(scene->point_lights, item->object);
+            model_push_instance(&light->geometric_model, item->submesh, (float *) light->color);
+            continue;
+        }
+
+        const struct model *model = darray_at(scene->models, item->object);
+        model_push_instance(model, item->submesh, MNF_ONE_VECTOR);
+    }
+
+    instance_buffer_upload();
+}
+
+static const struct model *scene_item_model(const struct scene *scene, const struct render_item *item)
+{
+    if (item->shader == light_shader.handle) {
+        const struct point_light *light = darray_at(scene->point_lights, item->object);
+        return &light->geometric_model;
+    }
+
+    return darray_at(scene->models, item->object);
 }
 
 static void scene_clear_color(struct scene *scene)
@@ -5,6 +5,8 @@
 #include "lighting.h"
 #include "darray.h"
 #include "skybox.h"
+#include "meshlet.h"
+#include "render_queue.h"
 
 struct scene {
     struct camera cam; 
@@ -13,9 +15,14 @@ struct scene {
     darray *models;
     darray *point_lights;
     vec3 clear_color;
+    float viewport_height;  /* pixels, for how much of a texture is seen */
 
     bool draw_skybox;
+    bool cone_culling;
     struct lighting_params lighting_params;
+    struct meshlet_stats meshlet_stats; /* of the last frame */
+    struct render_queue_stats render_stats; /* of the last frame */
+    uint32_t n_batches;     /* instanced draws the queued ones became, last frame */
 };
 
 void scene_init(struct scene *scene, float viewport_width, float viewport_height);
@@ -10,7 +10,7 @@ void scene_init_models(struct scene *scene)
 {
     
     struct model jake = model_load_from_file("res/jake-the-dog.obj");
-    jake.material = material_create("res/jake/textures/jake.png", NULL, 80);
+    model_set_material(&jake, material_create("res/jake/textures/jake.png", NULL, 80));
     model_translate(&jake, (vec3){0, 0, 0.5});
     model_rotation(&jake, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&jake, (vec3){5, 5, 5});
@@ -19,7 +19,7 @@ void scene_init_models(struct scene *scene)
 
     /*
     struct model floor = model_create_cube();
-    floor.material = material_create("res/textures/base.png", NULL, 1);
+    model_set_material(&floor, material_create("res/textures/base.png", NULL, 1));
     model_scale(&floor, (vec3){30, 0.1, 30});
     model_translate(&floor, (vec3){0, -2, 0});
     model_set_name(&floor, "Floor");
@@ -30,7 +30,7 @@ void scene_init_models(struct scene *scene)
 void scene_init_lighting(struct scene *scene)
 {
     struct model light_body = model_load_from_file("res/sphere.obj");
-    light_body.material = material_create(NULL, NULL, 1);
+    model_set_material(&light_body, material_create(NULL, NULL, 1));
     model_scale(&light_body, (vec3){0.1, 0.1, 0.1});
 
     struct directional_light environment_light = {
@@ -107,8 +107,8 @@ void scene_init_skybox(struct scene *scene)
 void scene_init_models(struct scene *scene)
 {
     struct model avocado = model_load_from_file("res/avocado.obj");
-    avocado.material = material_create("res/avocado/textures/avocado_albedo.jpeg", 
-                                       "res/avocado/textures/avocado_specular.jpeg", 1);
+    model_set_material(&avocado, material_create("res/avocado/textures/avocado_albedo.jpeg", 
+                                                 "res/avocado/textures/avocado_specular.jpeg", 1));
     model_scale(&avocado, (vec3){6, 6, 6});
     model_rotation(&avocado, (vec3){MNF_RAD(-46), MNF_RAD(6), MNF_RAD(-133)});
     model_translate(&avocado, (vec3){0.10, 4.78, 1.20});
@@ -116,8 +116,9 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &avocado);
         
     struct model croissant = model_load_from_file("res/croissant.obj");
-    croissant.material = material_create("res/croissant/textures/croissant_albedo.jpeg", 
-                                         "res/croissant/textures/croissant_albedo.jpeg", 1);
+    model_set_material(&croissant, material_create_packed("res/croissant/textures/croissant_albedo.jpeg", 
+                                                          "res/croissant/textures/croissant_albedo.jpeg",
+                                                          "res/croissant/textures/croissant_ao.jpeg", 1));
     model_scale(&croissant, (vec3){6, 6, 6});
     model_rotation(&croissant, (vec3){MNF_RAD(0), MNF_RAD(-105), MNF_RAD(0)});
     model_translate(&croissant, (vec3){0.05, 4.34, -1.09});
@@ -125,8 +126,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &croissant);
             
     struct model lemon = model_load_from_file("res/lemon.obj");
-    lemon.material = material_create("res/lemon/textures/lemon_albedo.jpeg", 
-                                     "res/lemon/textures/lemon_specular.jpeg", 1);
+    model_set_material(&lemon, material_create("res/lemon/textures/lemon_albedo.jpeg", 
+                                               "res/lemon/textures/lemon_specular.jpeg", 1));
     model_scale(&lemon, (vec3){8, 8, 8});
     model_rotation(&lemon, (vec3){MNF_RAD(67), MNF_RAD(38), MNF_RAD(96)});
     model_translate(&lemon, (vec3){-0.10, 4.82, 1.28});
@@ -134,8 +135,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &lemon);
         
     struct model lime = model_load_from_file("res/lime.obj");
-    lime.material = material_create("res/lime/textures/lime_albedo.jpeg", 
-                                    "res/lime/textures/lime_specular.jpeg", 1);
+    model_set_material(&lime, material_create("res/lime/textures/lime_albedo.jpeg", 
+                                              "res/lime/textures/lime_specular.jpeg", 1));
     model_scale(&lime, (vec3){5, 5, 5});
     model_rotation(&lime, (vec3){MNF_RAD(67), MNF_RAD(80), MNF_RAD(-25)});
     model_translate(&lime, (vec3){-0.43, 4.67, 1.25});
@@ -143,8 +144,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &lime);
         
     struct model orange = model_load_from_file("res/orange.obj");
-    orange.material = material_create("res/orange/textures/orange_albedo.jpeg", 
-                                      "res/orange/textures/orange_specular.jpeg", 1);
+    model_set_material(&orange, material_create("res/orange/textures/orange_albedo.jpeg", 
+                                                "res/orange/textures/orange_specular.jpeg", 1));
     model_scale(&orange, (vec3){5, 5, 5});
     model_rotation(&orange, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_translate(&orange, (vec3){-0.30, 4.44, 1.03});
@@ -152,8 +153,9 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &orange);
 
     struct model bowl = model_load_from_file("res/bowl.obj");
-    bowl.material = material_create("res/bowl/textures/bowl.jpeg", 
-                                    "res/bowl/textures/bowl_occlusion.jpeg", 1);
+    model_set_material(&bowl, material_create_packed("res/bowl/textures/bowl.jpeg", 
+                                                     "res/bowl/textures/bowl_occlusion.jpeg",
+                                                     "res/bowl/textures/bowl_occlusion.jpeg", 1));
     model_scale(&bowl, (vec3){5.1, 5.1, 5.1});
     model_rotation(&bowl, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_translate(&bowl, (vec3){0.36, 4.30, 0.60});
@@ -161,8 +163,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &bowl);
         
     struct model cucumber = model_load_from_file("res/cucumber.obj");
-    cucumber.material = material_create("res/cucumber/textures/cucumber.jpeg", 
-                                        NULL, 1);
+    model_set_material(&cucumber, material_create("res/cucumber/textures/cucumber.jpeg", 
+                                                  NULL, 1));
     model_scale(&cucumber, (vec3){6, 6, 6});
     model_rotation(&cucumber, (vec3){MNF_RAD(239), MNF_RAD(42), MNF_RAD(85)});
     model_translate(&cucumber, (vec3){0, 4.84, 1.74});
@@ -170,8 +172,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &cucumber);
     
     struct model peach = model_load_from_file("res/peach.obj");
-    peach.material = material_create("res/peach/textures/peach.jpg", 
-                                     NULL, 1);
+    model_set_material(&peach, material_create("res/peach/textures/peach.jpg", 
+                                               NULL, 1));
     model_translate(&peach, (vec3){-0.04, 4.64, 0.89});
     model_rotation(&peach, (vec3){MNF_RAD(58), MNF_RAD(154.01), MNF_RAD(-19)});
     model_scale(&peach, (vec3){4, 4, 4});
@@ -179,8 +181,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &peach);
     
     struct model cake = model_load_from_file("res/cake.obj");
-    cake.material = material_create("res/cake/textures/cake.jpeg", 
-                                    NULL, 1);
+    model_set_material(&cake, material_create("res/cake/textures/cake.jpeg", 
+                                              NULL, 1));
     model_translate(&cake, (vec3){1.29, 4.34, -0.44});
     model_rotation(&cake, (vec3){MNF_RAD(0), MNF_RAD(-4), MNF_RAD(0)});
     model_scale(&cake, (vec3){6, 6, 6});
@@ -188,8 +190,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &cake);
     
     struct model pudding = model_load_from_file("res/pudding.obj");
-    pudding.material = material_create("res/pudding/textures/pudding.jpeg", 
-                                    NULL, 1);
+    model_set_material(&pudding, material_create("res/pudding/textures/pudding.jpeg", 
+                                                 NULL, 1));
     model_translate(&pudding, (vec3){-0.84, 4.35, 0.60});
     model_rotation(&pudding, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&pudding, (vec3){6, 6, 6});
@@ -197,8 +199,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &pudding);
 
     struct model homemade = model_load_from_file("res/homemade-bread.obj");
-    homemade.material = material_create("res/homemade/textures/homemade.jpeg", 
-                                    NULL, 1);
+    model_set_material(&homemade, material_create("res/homemade/textures/homemade.jpeg", 
+                                                  NULL, 1));
     model_translate(&homemade, (vec3){0.28, 4.30, -1.43});
     model_rotation(&homemade, (vec3){MNF_RAD(0), MNF_RAD(89), MNF_RAD(-0.99)});
     model_scale(&homemade, (vec3){4, 4, 4});
@@ -206,8 +208,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &homemade);
     
     struct model melon_bread = model_load_from_file("res/melon-bread.obj");
-    melon_bread.material = material_create("res/melon_bread/textures/melon-bread.jpeg", 
-                                    NULL, 1);
+    model_set_material(&melon_bread, material_create("res/melon_bread/textures/melon-bread.jpeg", 
+                                                     NULL, 1));
     model_translate(&melon_bread, (vec3){-0.44, 4.34, -1.04});
     model_rotation(&melon_bread, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&melon_bread, (vec3){4, 4, 4});
@@ -215,8 +217,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &melon_bread);
 
     struct model wooden_tray = model_load_from_file("res/wooden-tray.obj");
-    wooden_tray.material = material_create("res/wooden_tray/textures/tray.jpg", 
-                                            "res/wooden_tray/textures/tray_ROUGHNESS.jpg", 1);
+    model_set_material(&wooden_tray, material_create("res/wooden_tray/textures/tray.jpg", 
+                                                     "res/wooden_tray/textures/tray_ROUGHNESS.jpg", 1));
     model_translate(&wooden_tray, (vec3){-0.39, 4.13, -2.08});
     model_rotation(&wooden_tray, (vec3){MNF_RAD(0), MNF_RAD(-86), MNF_RAD(0)});
     model_scale(&wooden_tray, (vec3){6, 6, 6});
@@ -224,8 +226,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &wooden_tray);
     
     struct model cake_plate = model_load_from_file("res/dinner-plate.obj");
-    cake_plate.material = material_create("res/dinner_plate/textures/dinner_plate.jpeg", 
-                                            NULL, 1);
+    model_set_material(&cake_plate, material_create("res/dinner_plate/textures/dinner_plate.jpeg", 
+                                                    NULL, 1));
     model_translate(&cake_plate, (vec3){0.95, 4.19, 0.24});
     model_rotation(&cake_plate, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&cake_plate, (vec3){7, 7, 7});
@@ -233,8 +235,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &cake_plate);
     
     struct model pudding_plate = model_load_from_file("res/dinner-plate.obj");
-    pudding_plate.material = material_create("res/dinner_plate/textures/dinner_plate.jpeg", 
-                                            NULL, 1);
+    model_set_material(&pudding_plate, material_create("res/dinner_plate/textures/dinner_plate.jpeg", 
+                                                       NULL, 1));
     model_translate(&pudding_plate, (vec3){-0.29, 4.19, 0.05});
     model_rotation(&pudding_plate, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&pudding_plate, (vec3){6, 6, 6});
@@ -242,8 +244,9 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &pudding_plate);
     
     struct model v_coffee = model_load_from_file("res/vienna.obj");
-    v_coffee.material = material_create("res/vienna-coffee/textures/vienna.jpeg", 
-                                        "res/vienna-coffee/textures/vienna_ao.jpeg", 1);
+    model_set_material(&v_coffee, material_create_packed("res/vienna-coffee/textures/vienna.jpeg", 
+                                                         "res/vienna-coffee/textures/vienna_ao.jpeg",
+                                                         "res/vienna-coffee/textures/vienna_ao.jpeg", 1));
     model_translate(&v_coffee, (vec3){-0.20, 4.34, -1.66});
     model_rotation(&v_coffee, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&v_coffee, (vec3){5, 5, 5});
@@ -251,8 +254,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &v_coffee);
     
     struct model coffee = model_load_from_file("res/coffee.obj");
-    coffee.material = material_create("res/coffee/textures/coffee_alb.jpg", 
-                                        "res/coffee/textures/coffee_sp.jpg", 1);
+    model_set_material(&coffee, material_create("res/coffee/textures/coffee_alb.jpg", 
+                                                "res/coffee/textures/coffee_sp.jpg", 1));
     model_translate(&coffee, (vec3){-0.76, 4.34, -1.66});
     model_rotation(&coffee, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&coffee, (vec3){22, 22, 22});
@@ -260,8 +263,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &coffee);
     
     struct model pot = model_load_from_file("res/teapot.obj");
-    pot.material = material_create("res/coffee-pot/textures/teapot_alb.png", 
-                                        "res/coffee-pot/textures/teapot_roughness.png", 1);
+    model_set_material(&pot, material_create("res/coffee-pot/textures/teapot_alb.png", 
+                                             "res/coffee-pot/textures/teapot_roughness.png", 1));
     model_translate(&pot, (vec3){-0.07, 4.33, -1.96});
     model_rotation(&pot, (vec3){MNF_RAD(0), MNF_RAD(124), MNF_RAD(0)});
     model_scale(&pot, (vec3){25, 25, 25});
@@ -269,7 +272,7 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &pot);
 
     struct model slv = model_load_from_file("res/silverware.obj");
-    slv.material = material_create(NULL, NULL , 2048);
+    model_set_material(&slv, material_create(NULL, NULL , 2048));
     model_translate(&slv, (vec3){-0.93, 4.05, -1.04});
     model_rotation(&slv, (vec3){MNF_RAD(5.6), MNF_RAD(47), MNF_RAD(-7.90)});
     model_scale(&slv, (vec3){30, 30, 30});
@@ -278,8 +281,8 @@ void scene_init_models(struct scene *scene)
     
     struct model tissue = model_load_from_file("res/tissue.obj");
 
-    tissue.material = material_create("res/tissue/textures/tissue_alb.png", 
-                                    NULL, 1);
+    model_set_material(&tissue, material_create("res/tissue/textures/tissue_alb.png", 
+                                                NULL, 1));
     model_translate(&tissue, (vec3){0.52, 4.26, -1.91});
     model_rotation(&tissue, (vec3){MNF_RAD(93), MNF_RAD(185), MNF_RAD(2.20)});
     model_scale(&tissue, (vec3){25, 45, 10});
@@ -288,8 +291,8 @@ void scene_init_models(struct scene *scene)
     
     struct model tissue2 = model_load_from_file("res/tissue.obj");
 
-    tissue2.material = material_create("res/tissue/textures/tissue_alb.png", 
-                                    NULL, 1);
+    model_set_material(&tissue2, material_create("res/tissue/textures/tissue_alb.png", 
+                                                 NULL, 1));
     model_translate(&tissue2, (vec3){0.59, 4.22, -1.90});
     model_rotation(&tissue2, (vec3){MNF_RAD(90), MNF_RAD(182.6), MNF_RAD(0)});
     model_scale(&tissue2, (vec3){25, 45, 10});
@@ -299,8 +302,8 @@ void scene_init_models(struct scene *scene)
     
     struct model socrates = model_load_from_file("res/socrates.obj");
 
-    socrates.material = material_create("res/socrates/textures/soc_alb.png", 
-                                        "res/socrates/textures/soc_rough.png", 1);
+    model_set_material(&socrates, material_create("res/socrates/textures/soc_alb.png", 
+                                                  "res/socrates/textures/soc_rough.png", 1));
     model_translate(&socrates, (vec3){1.19, 4.3, 1.66});
     model_rotation(&socrates, (vec3){MNF_RAD(0), MNF_RAD(25.9), MNF_RAD(0)});
     model_scale(&socrates, (vec3){4, 4, 4});
@@ -308,8 +311,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &socrates);  
 
     struct model wooden_table = model_load_from_file("res/wooden-table.obj");
-    wooden_table.material = material_create("res/wooden_table/textures/table.png", 
-                                            NULL, 1);
+    model_set_material(&wooden_table, material_create("res/wooden_table/textures/table.png", 
+                                                      NULL, 1));
     model_scale(&wooden_table, (vec3){7, 7, 7});
     model_rotation(&wooden_table, (vec3){MNF_RAD(0), MNF_RAD(90), MNF_RAD(0)});
     model_translate(&wooden_table, (vec3){0, -0.2, 0});
@@ -317,8 +320,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &wooden_table);
     
     struct model wooden_chair = model_load_from_file("res/wooden-chair.obj");
-    wooden_chair.material = material_create("res/wooden_chair/textures/chair.png", 
-                                            NULL, 1);
+    model_set_material(&wooden_chair, material_create("res/wooden_chair/textures/chair.png", 
+                                                      NULL, 1));
     model_scale(&wooden_chair, (vec3){6, 6, 6});
     model_rotation(&wooden_chair, (vec3){MNF_RAD(0), MNF_RAD(90), MNF_RAD(0)});
     model_translate(&wooden_chair, (vec3){1.7, -0.2, -1.45});
@@ -326,8 +329,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &wooden_chair);
     
     struct model carpet = model_load_from_file("res/carpet.obj");
-    carpet.material = material_create("res/carpet/textures/carpet_alb.png", 
-                                    "res/carpet/textures/carpet_mtl.png", 1);
+    model_set_material(&carpet, material_create("res/carpet/textures/carpet_alb.png", 
+                                                "res/carpet/textures/carpet_mtl.png", 1));
     model_translate(&carpet, (vec3){0, -0.22, 0});
     model_rotation(&carpet, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&carpet, (vec3){3, 3, 3});
@@ -335,8 +338,8 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &carpet);
     
     struct model hw_floor = model_create_cube();
-    hw_floor.material = material_create("res/hardwood/textures/hw_diff.jpeg", 
-                                        "res/hardwood/textures/hw_spec.png", 1);
+    model_set_material(&hw_floor, material_create("res/hardwood/textures/hw_diff.jpeg", 
+                                                  "res/hardwood/textures/hw_spec.png", 1));
     model_translate(&hw_floor, (vec3){0, -0.24, 0});
     model_rotation(&hw_floor, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&hw_floor, (vec3){40, 0.1, 40});
@@ -347,7 +350,7 @@ void scene_init_models(struct scene *scene)
 void scene_init_lighting(struct scene *scene)
 {
     struct model light_body = model_load_from_file("res/sphere.obj");
-    light_body.material = material_create(NULL, NULL, 1);
+    model_set_material(&light_body, material_create(NULL, NULL, 1));
     model_scale(&light_body, (vec3){0.1, 0.1, 0.1});
 
     struct directional_light environment_light = {
@@ -389,8 +392,8 @@ void scene_init_models(struct scene *scene)
 {
     struct model socrates = model_load_from_file("res/socrates.obj");
 
-    socrates.material = material_create("res/socrates/textures/soc_alb.png", 
-                                    "res/socrates/textures/soc_rough.png", 1);
+    model_set_material(&socrates, material_create("res/socrates/textures/soc_alb.png", 
+                                                  "res/socrates/textures/soc_rough.png", 1));
     model_translate(&socrates, (vec3){0, 0, 0});
     model_rotation(&socrates, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&socrates, (vec3){6, 6, 6});
@@ -401,7 +404,7 @@ void scene_init_models(struct scene *scene)
 void scene_init_lighting(struct scene *scene)
 {
     struct model light_body = model_load_from_file("res/sphere.obj");
-    light_body.material = material_create(NULL, NULL, 1);
+    model_set_material(&light_body, material_create(NULL, NULL, 1));
     model_scale(&light_body, (vec3){0.1, 0.1, 0.1});
 
     struct directional_light environment_light = {
@@ -441,7 +444,7 @@ void scene_init_skybox(struct scene *scene)
 void scene_init_models(struct scene *scene)
 {
     struct model mc_castle = model_load_from_file("res/castle.obj");
-    mc_castle.material = material_create("res/minecraft-castle/textures/castle.jpg", NULL, 80);
+    model_set_material(&mc_castle, material_create("res/minecraft-castle/textures/castle.jpg", NULL, 80));
     model_translate(&mc_castle, (vec3){0, 0, 0});
     model_rotation(&mc_castle, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&mc_castle, (vec3){16, 16, 16});
@@ -452,7 +455,7 @@ void scene_init_models(struct scene *scene)
 void scene_init_lighting(struct scene *scene)
 {
     struct model light_body = model_load_from_file("res/sphere.obj");
-    light_body.material = material_create(NULL, NULL, 1);
+    model_set_material(&light_body, material_create(NULL, NULL, 1));
     model_scale(&light_body, (vec3){0.1, 0.1, 0.1});
 
     struct directional_light environment_light = {
@@ -492,7 +495,7 @@ void scene_init_skybox(struct scene *scene)
 void scene_init_models(struct scene *scene)
 {
     struct model teapot = model_load_from_file("res/teapot/source/teapot.obj");
-    teapot.material = material_create("res/textures/lavender.png", NULL, 120);
+    model_set_material(&teapot, material_create("res/textures/lavender.png", NULL, 120));
     model_translate(&teapot, (vec3){0.32, 1.64, 0});
     model_rotation(&teapot, (vec3){MNF_RAD(0), MNF_RAD(73.0), MNF_RAD(0)});
     model_scale(&teapot, (vec3){0.1, 0.1, 0.1});
@@ -500,7 +503,7 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &teapot);
 
     struct model sphere = model_load_from_file("res/sphere.obj");
-    sphere.material = material_create("res/textures/uv-grid.jpg", NULL, 120);
+    model_set_material(&sphere, material_create("res/textures/uv-grid.jpg", NULL, 120));
     model_translate(&sphere, (vec3){-2.91, 1.87, -2.34});
     model_rotation(&sphere, (vec3){MNF_RAD(15.40), MNF_RAD(144.30), MNF_RAD(42.60)});
     model_scale(&sphere, (vec3){1.0, 1.0, 1.0});
@@ -508,7 +511,7 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &sphere);
 
     struct model cube = model_create_cube();
-    cube.material = material_create("res/textures/base.png", NULL, 120);
+    model_set_material(&cube, material_create("res/textures/base.png", NULL, 120));
     model_translate(&cube, (vec3){-1.79, 1.37, 1.74});
     model_rotation(&cube, (vec3){MNF_RAD(0), MNF_RAD(111.90), MNF_RAD(0)});
     model_scale(&cube, (vec3){2.0, 2.0, 2.0});
@@ -516,25 +519,18 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &cube);
 
     struct model cub = model_create_cube();
-    cub.material = material_create("res/textures/base.png", NULL, 120);
+    model_set_material(&cub, material_create("res/textures/base.png", NULL, 120));
     model_translate(&cub, (vec3){0.21, 1, 0});
     model_rotation(&cub, (vec3){MNF_RAD(0), MNF_RAD(50), MNF_RAD(0)});
     model_scale(&cub, (vec3){2.4, 1.3, 1.3});
     model_set_name(&cub, "Cube 2");
     darray_push(scene->models, &cub);
 
-    /* problem with model_create_cube is that it continously initiates a new
-       vertex array with the same vertices and VAO attributes, so we are
-       generating the multiple meshes for the same model, THAT is not good!
-
-       We only need to have one mesh and then we can make multiple models out
-       of that mesh. Currently there is no resource management which is why
-       this problem is put off for now but it is very problematic!
-
-       Same thing for the textures */
+    /* every cube shares one mesh & the textures of the walls are loaded once
+       no matter how many models use them, see resource_cache.h */
     struct model floor = model_create_cube();
     //floor.material = material_create("res/textures/base.png", NULL, 12);
-    floor.material = material_create(NULL, NULL, 12);
+    model_set_material(&floor, material_create(NULL, NULL, 12));
     model_translate(&floor, (vec3){0, 0, 0});
     model_rotation(&floor, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&floor, (vec3){10.0, 1.0, 10.0});
@@ -543,7 +539,7 @@ void scene_init_models(struct scene *scene)
 
 
     struct model left_wall = model_create_cube();
-    left_wall.material = material_create("res/textures/red.png", NULL, 1);
+    model_set_material(&left_wall, material_create("res/textures/red.png", NULL, 1));
     model_translate(&left_wall, (vec3){0, 5, 5});
     model_rotation(&left_wall, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&left_wall, (vec3){10.0, 10.0, 1.0});
@@ -551,7 +547,7 @@ void scene_init_models(struct scene *scene)
     darray_push(scene->models, &left_wall);
 
     struct model right_wall = model_create_cube();
-    right_wall.material = material_create("res/textures/green.png", NULL, 1);
+    model_set_material(&right_wall, material_create("res/textures/green.png", NULL, 1));
     model_translate(&right_wall, (vec3){0, 5, -5});
     model_rotation(&right_wall, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&right_wall, (vec3){10.0, 10.0, 1.0});
@@ -560,7 +556,7 @@ void scene_init_models(struct scene *scene)
 
 
     struct model back_wall = model_create_cube();
-    back_wall.material = material_create(NULL, NULL, 1);
+    model_set_material(&back_wall, material_create(NULL, NULL, 1));
     model_translate(&back_wall, (vec3){-5, 5, 0});
     model_rotation(&back_wall, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&back_wall, (vec3){1.0, 10.0, 10.0});
@@ -569,7 +565,7 @@ void scene_init_models(struct scene *scene)
 
 
     struct model roof = model_create_cube();
-    roof.material = material_create(NULL, NULL, 1);
+    model_set_material(&roof, material_create(NULL, NULL, 1));
     model_translate(&roof, (vec3){0, 10, 0});
     model_rotation(&roof, (vec3){MNF_RAD(0), MNF_RAD(0), MNF_RAD(0)});
     model_scale(&roof, (vec3){10.0, 1.0, 10.0});
@@ -580,7 +576,7 @@ void scene_init_models(struct scene *scene)
 void scene_init_lighting(struct scene *scene)
 {
     struct model light_body = model_load_from_file("res/sphere.obj");
-    light_body.material = material_create(NULL, NULL, 1);
+    model_set_material(&light_body, material_create(NULL, NULL, 1));
     model_scale(&light_body, (vec3){0.1, 0.1, 0.1});
 
     struct directional_light environment_light = {
@@ -1,11 +1,16 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <glad/gl.h>
 
 #include "shader.h"
 #include "logger.h"
+#include "file.h"
+#include "hash.h"
+#include "uniform_buffer.h"
+#include "gl_state.h"
 
 #define DEFINE_VERSION      "#version 410 core\n"
 #define DEFINE_VS           "#define COMPILE_VS\n"
@@ -14,8 +19,42 @@
 #define INJECT_DEFINE_FS    DEFINE_VERSION DEFINE_FS
 /* defines the number of strings passed to glShaderSource */
 #define SHADER_SRC_N_STR 2
+/* slots of the open addressing table of uniform ids, kept atmost half full */
+#define SHADER_UNIFORM_SLOTS (SHADER_MAX_UNIFORMS * 2)
+/* a location not looked up in the table yet */
+#define SHADER_UNRESOLVED INT32_MIN
+
+/* An active uniform of a program, a slot of the table is empty if the name is */
+struct shader_active_uniform {
+    uint64_t hash;
+    char name[SHADER_UNIFORM_NAME_MAX_SIZE];
+    int32_t location;
+};
+
+struct shader_uniforms {
+    struct shader_active_uniform *table;    /* open addressing by name */
+    uint32_t table_size;                    /* power of two */
+    int32_t locations[SHADER_MAX_UNIFORMS]; /* by id, filled from the table on first use */
+};
+
+/* Every uniform name given an id, ids start at 1 */
+struct shader_uniform_registry {
+    char names[SHADER_MAX_UNIFORMS][SHADER_UNIFORM_NAME_MAX_SIZE];
+    uint64_t hashes[SHADER_MAX_UNIFORMS];
+    shader_uniform slots[SHADER_UNIFORM_SLOTS];
+    uint32_t n_names;
+};
+
+static struct shader_uniform_registry registry;
 
 static char *shader_load_from_source(const char *path);
+static struct shader_uniforms *shader_introspect(uint32_t program, const char *path);
+static void shader_bind_blocks(uint32_t program);
+static void shader_table_insert(struct shader_uniforms *uniforms, const char *name, int32_t location);
+static int32_t shader_table_find(const struct shader_uniforms *uniforms, const char *name,
+                                 uint64_t hash);
+static int32_t shader_location(struct shader shader, shader_uniform uniform);
+static void shader_destroy_uniforms(struct shader_uniforms *uniforms);
 
 struct shader shader_create(const char *path)
 {
@@ -80,6 +119,10 @@ struct shader shader_create(const char *path)
     glDeleteShader(vs_id);
 
     shader.handle = id;
+    if (id != 0) {
+        shader_bind_blocks(id);
+        shader.uniforms = shader_introspect(id, path);
+    }
 
     int i = 0;
     for (i = 0; i < SHADER_PATH_BUFFER_SIZE  - 1 && path[i] != '\0'; i++)
@@ -94,105 +137,278 @@ void shader_hot_reload(struct shader *shader)
     struct shader reloaded_shader = shader_create(shader->path);
     if (!reloaded_shader.handle) {
         SWARN("Shader '%s' hot-reload failed", shader->path);
-    } else {
-        SDEBUG("Hot-reloading shader '%s'", shader->path);
-        glDeleteProgram(shader->handle);
-        shader->handle = reloaded_shader.handle;
+        return;
     }
+
+    SDEBUG("Hot-reloading shader '%s'", shader->path);
+    gl_state_forget_program(shader->handle);
+    glDeleteProgram(shader->handle);
+    shader->handle = reloaded_shader.handle;
+
+    /* the ids stay the same, their locations are looked up again in the new
+       table. Swapped in place since copies of the struct point at it too */
+    if (shader->uniforms == NULL || reloaded_shader.uniforms == NULL) {
+        shader_destroy_uniforms(shader->uniforms);
+        shader->uniforms = reloaded_shader.uniforms;
+        return;
+    }
+    free(shader->uniforms->table);
+    *shader->uniforms = *reloaded_shader.uniforms;
+    free(reloaded_shader.uniforms);
 }
 
 void shader_use(struct shader shader)
 {
-    glUseProgram(shader.handle);
+    gl_state_use_program(shader.handle);
 }
 
 void shader_destroy(struct shader *shader)
 {
+    gl_state_forget_program(shader->handle);
     glDeleteProgram(shader->handle);
     shader->handle = 0;
+    shader_destroy_uniforms(shader->uniforms);
+    shader->uniforms = NULL;
 }
 
-void shader_uniform_vec4(struct shader shader, const char *uniform, vec4 v)
+shader_uniform shader_uniform_id(const char *name)
 {
-    int32_t location = glGetUniformLocation(shader.handle, uniform);
-    if (location < 0) {
-        SDEBUG("Uniform '%s' doesn't exist in '%s'", uniform, shader.path);
-    } else {
-        glUniform4f(location, v[0], v[1], v[2], v[3]);
+    size_t len = strlen(name);
+    if (len >= SHADER_UNIFORM_NAME_MAX_SIZE) {
+        SWARN("Uniform name '%s' is too long to be resolved", name);
+        return 0;
+    }
+
+    uint64_t hash = hash_64(name, len, 0);
+    uint32_t slot = (uint32_t) hash & (SHADER_UNIFORM_SLOTS - 1);
+    while (registry.slots[slot] != 0) {
+        shader_uniform id = registry.slots[slot];
+        if (registry.hashes[id] == hash && strcmp(registry.names[id], name) == 0) return id;
+        slot = (slot + 1) & (SHADER_UNIFORM_SLOTS - 1);
+    }
+
+    if (registry.n_names + 1 >= SHADER_MAX_UNIFORMS) {
+        SWARN("Can't resolve uniform '%s', only %d uniform names fit", name, SHADER_MAX_UNIFORMS - 1);
+        return 0;
     }
+
+    shader_uniform id = (shader_uniform) ++registry.n_names;
+    memcpy(registry.names[id], name, len + 1);
+    registry.hashes[id] = hash;
+    registry.slots[slot] = id;
+
+    return id;
 }
 
-void shader_uniform_mat4(struct shader shader, const char *uniform, mat4 m)
+void shader_set_vec4(struct shader shader, shader_uniform uniform, vec4 v)
 {
-    int32_t location = glGetUniformLocation(shader.handle, uniform);
-    if (location < 0) {
-        SDEBUG("Uniform '%s' doesn't exist in '%s'", uniform, shader.path);
-    } else {
-        glUniformMatrix4fv(location, 1, GL_FALSE, (const GLfloat *)m);
-    }
+    int32_t location = shader_location(shader, uniform);
+    if (location >= 0) glUniform4f(location, v[0], v[1], v[2], v[3]);
+}
+
+void shader_set_mat4(struct shader shader, shader_uniform uniform, mat4 m)
+{
+    int32_t location = shader_location(shader, uniform);
+    if (location >= 0) glUniformMatrix4fv(location, 1, GL_FALSE, (const GLfloat *)m);
+}
+
+void shader_set_1i(struct shader shader, shader_uniform uniform, int32_t n)
+{
+    int32_t location = shader_location(shader, uniform);
+    if (location >= 0) glUniform1i(location, n);
+}
+
+void shader_set_1f(struct shader shader, shader_uniform uniform, float f)
+{
+    int32_t location = shader_location(shader, uniform);
+    if (location >= 0) glUniform1f(location, f);
+}
+
+void shader_set_vec3(struct shader shader, shader_uniform uniform, vec3 v)
+{
+    int32_t location = shader_location(shader, uniform);
+    if (location >= 0) glUniform3f(location, v[0], v[1], v[2]);
+}
+
+void shader_uniform_vec4(struct shader shader, const char *uniform, vec4 v)
+{
+    shader_set_vec4(shader, shader_uniform_id(uniform), v);
+}
 
+void shader_uniform_mat4(struct shader shader, const char *uniform, mat4 m)
+{
+    shader_set_mat4(shader, shader_uniform_id(uniform), m);
 }
 
 void shader_uniform_1i(struct shader shader, const char *uniform, int32_t n)
 {
-    int32_t location = glGetUniformLocation(shader.handle, uniform);
-    if (location < 0) {
-        SDEBUG("Uniform '%s' doesn't exist in '%s'", uniform, shader.path);
-    } else {
-        glUniform1i(location, n);
-    }
+    shader_set_1i(shader, shader_uniform_id(uniform), n);
 }
 
 void shader_uniform_1f(struct shader shader, const char *uniform, float f)
 {
-    int32_t location = glGetUniformLocation(shader.handle, uniform);
-    if (location < 0) {
-        SDEBUG("Uniform '%s' doesn't exist in '%s'", uniform, shader.path);
-    } else {
-        glUniform1f(location, f);
-    }
+    shader_set_1f(shader, shader_uniform_id(uniform), f);
 }
 
 void shader_uniform_vec3(struct shader shader, const char *uniform, vec3 v)
 {
-    int32_t location = glGetUniformLocation(shader.handle, uniform);
-    if (location < 0) {
-        SDEBUG("Uniform '%s' doesn't exist in '%s'", uniform, shader.path);
-    } else {
-        glUniform3f(location, v[0], v[1], v[2]);
-    }
-
+    shader_set_vec3(shader, shader_uniform_id(uniform), v);
 }
 
 static char *shader_load_from_source(const char *path)
 {
-    FILE *file = NULL;
+    struct mapped_file file;
     char *source = NULL;
-    long length = 0;
-    size_t bytes_read = 0;
 
-    file = fopen(path, "rb");
-    if (file == NULL) goto err;
+    /* mapped rather than read with stdio so the file batch of the scene can
+       hand it over */
+    if (!file_map(path, &file)) goto err;
 
-    if (fseek(file, 0, SEEK_END) == -1) goto err;
-    length = ftell(file);
-    if (length == -1) goto err;
-    if (fseek(file, 0, SEEK_SET) == -1) goto err;
-
-    source = malloc(length + 1);
+    source = malloc(file.size + 1);
     if (source == NULL) goto err;
 
-    bytes_read = fread(source, sizeof(char), length, file);
-    if (bytes_read != (size_t) length) goto err;
-
-    source[length] = '\0';
-    fclose(file);
+    if (file.size > 0) memcpy(source, file.data, file.size);
+    source[file.size] = '\0';
+    file_unmap(&file);
     return source;
 
 err:
     SERROR("Failed to load shader '%s' onto memory", path);
-    if (file) fclose(file);
-    free(source);
+    file_unmap(&file);
     return NULL;
 }
 
+
+/* Puts every active uniform of a linked program in a table by name, arrays of
+   basic types under their name, "name[0]" & each element. Uniforms of blocks
+   have no location & are left out. NULL if there is no memory for it */
+static struct shader_uniforms *shader_introspect(uint32_t program, const char *path)
+{
+    int32_t n_active = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &n_active);
+
+    char name[SHADER_UNIFORM_NAME_MAX_SIZE];
+    int32_t size;
+    GLenum type;
+
+    /* an array takes a slot per element & one for its name */
+    uint32_t n_names = 0;
+    for (int32_t i = 0; i < n_active; i++) {
+        glGetActiveUniform(program, (GLuint) i, sizeof(name), NULL, &size, &type, name);
+        n_names += (size > 1) ? (uint32_t) size + 1 : 1;
+    }
+
+    struct shader_uniforms *uniforms = malloc(sizeof(struct shader_uniforms));
+    uint32_t table_size = 16;
+    while (table_size < n_names * 2) table_size *= 2;
+    struct shader_active_uniform *table = calloc(table_size, sizeof(struct shader_active_uniform));
+    if (uniforms == NULL || table == NULL) {
+        SERROR("Failed to alloc memory for the uniforms of '%s', they're looked up by name", path);
+        free(uniforms);
+        free(table);
+        return NULL;
+    }
+
+    uniforms->table = table;
+    uniforms->table_size = table_size;
+    for (uint32_t i = 0; i < SHADER_MAX_UNIFORMS; i++) uniforms->locations[i] = SHADER_UNRESOLVED;
+
+    for (int32_t i = 0; i < n_active; i++) {
+        int32_t length = 0;
+        glGetActiveUniform(program, (GLuint) i, sizeof(name), &length, &size, &type, name);
+        if (length >= (int32_t) sizeof(name) - 1) {
+            SWARN("Uniform '%s...' of '%s' has too long a name, it can't be set", name, path);
+            continue;
+        }
+
+        int32_t location = glGetUniformLocation(program, name);
+        if (location < 0) continue;
+        shader_table_insert(uniforms, name, location);
+
+        /* the elements past the first aren't listed, they're looked up here
+           once instead of on every frame */
+        char *subscript = strstr(name, "[0]");
+        if (size <= 1 || subscript == NULL || subscript[3] != '\0') continue;
+
+        *subscript = '\0';
+        shader_table_insert(uniforms, name, location);
+
+        char element[SHADER_UNIFORM_NAME_MAX_SIZE];
+        for (int32_t e = 1; e < size; e++) {
+            int n = snprintf(element, sizeof(element), "%s[%d]", name, (int) e);
+            if (n < 0 || n >= (int) sizeof(element)) break;
+            shader_table_insert(uniforms, element, glGetUniformLocation(program, element));
+        }
+    }
+
+    SDEBUG("Shader '%s' has %d active uniforms", path, (int) n_active);
+    return uniforms;
+}
+
+/* Points the uniform blocks of the program at the buffers of the same name,
+   see uniform_buffer.h */
+static void shader_bind_blocks(uint32_t program)
+{
+    for (uint32_t block = 0; block < UNIFORM_BLOCK_COUNT; block++) {
+        GLuint index = glGetUniformBlockIndex(program, uniform_block_name(block));
+        if (index != GL_INVALID_INDEX) glUniformBlockBinding(program, index, block);
+    }
+}
+
+static void shader_table_insert(struct shader_uniforms *uniforms, const char *name, int32_t location)
+{
+    uint64_t hash = hash_64(name, strlen(name), 0);
+    uint32_t mask = uniforms->table_size - 1;
+    uint32_t slot = (uint32_t) hash & mask;
+    while (uniforms->table[slot].name[0] != '\0') {
+        if (uniforms->table[slot].hash == hash && strcmp(uniforms->table[slot].name, name) == 0)
+            return;
+        slot = (slot + 1) & mask;
+    }
+
+    struct shader_active_uniform *entry = &uniforms->table[slot];
+    entry->hash = hash;
+    strncpy(entry->name, name, SHADER_UNIFORM_NAME_MAX_SIZE - 1);
+    entry->location = location;
+}
+
+/* -1 if the program has no such uniform */
+static int32_t shader_table_find(const struct shader_uniforms *uniforms, const char *name,
+                                 uint64_t hash)
+{
+    uint32_t mask = uniforms->table_size - 1;
+    uint32_t slot = (uint32_t) hash & mask;
+    while (uniforms->table[slot].name[0] != '\0') {
+        const struct shader_active_uniform *entry = &uniforms->table[slot];
+        if (entry->hash == hash && strcmp(entry->name, name) == 0) return entry->location;
+        slot = (slot + 1) & mask;
+    }
+
+    return -1;
+}
+
+/* The location of a uniform id, from the table the first time it's set on
+   this program & from the locations by id after that */
+static int32_t shader_location(struct shader shader, shader_uniform uniform)
+{
+    if (uniform == 0) return -1;
+
+    /* without a table the driver is asked like before */
+    if (shader.uniforms == NULL) return glGetUniformLocation(shader.handle, registry.names[uniform]);
+
+    int32_t location = shader.uniforms->locations[uniform];
+    if (location != SHADER_UNRESOLVED) return location;
+
+    location = shader_table_find(shader.uniforms, registry.names[uniform], registry.hashes[uniform]);
+    if (location < 0) SDEBUG("Uniform '%s' doesn't exist in '%s'", registry.names[uniform], shader.path);
+    shader.uniforms->locations[uniform] = location;
+
+    return location;
+}
+
+static void shader_destroy_uniforms(struct shader_uniforms *uniforms)
+{
+    if (uniforms == NULL) return;
+    free(uniforms->table);
+    free(uniforms);
+}
@@ -6,6 +6,9 @@
 #include "mnf/mnf_types.h"
 
 #define SHADER_PATH_BUFFER_SIZE 1024
+#define SHADER_UNIFORM_NAME_MAX_SIZE 64
+/* Uniform names that can be resolved, across every shader */
+#define SHADER_MAX_UNIFORMS 256
 
 enum shader_type {
     SHADER_BASIC,
@@ -15,13 +18,24 @@ enum shader_type {
     SHADER_PHONG,
 };
 
+/* A uniform name resolved ahead of time with shader_uniform_id(), the same id
+   in every shader. 0 is a name that couldn't be resolved, setting it does
+   nothing */
+typedef uint16_t shader_uniform;
+
+/* Locations of the active uniforms of a program, see shader.c */
+struct shader_uniforms;
+
 /* Represents an OpenGL shader program containing:
  * handle   - id of the program object
  * path     - .glsl file path
+ * uniforms - active uniforms introspected after linking, shared by every
+ *            copy of the struct & re-resolved by shader_hot_reload()
  */
 struct shader {
     uint32_t handle;
     char path[SHADER_PATH_BUFFER_SIZE];
+    struct shader_uniforms *uniforms;
 };
 
 /*
@@ -35,7 +49,7 @@ struct shader shader_create(const char *path);
 /* Wrapper around glUseProgram */
 void shader_use(struct shader shader);
 
-/* Wrapper around glDeleteProgram */
+/* Wrapper around glDeleteProgram, frees the uniform table */
 void shader_destroy(struct shader *shader);
 
 /*
@@ -45,7 +59,20 @@ void shader_destroy(struct shader *shader);
  */
 void shader_hot_reload(struct shader *shader);
 
-/* for setting uniform states */
+/* Id of the uniform 'name', like "u_model" or "u_point_lights[2].pos". Hashes
+   the name, so it's meant to be called once & the id kept for every frame */
+shader_uniform shader_uniform_id(const char *name);
+
+/* for setting uniform states by id, an index into the locations the shader
+   resolved without asking the driver */
+void shader_set_1i(struct shader shader, shader_uniform uniform, int32_t n);
+void shader_set_1f(struct shader shader, shader_uniform uniform, float f);
+void shader_set_vec3(struct shader shader, shader_uniform uniform, vec3 v);
+void shader_set_vec4(struct shader shader, shader_uniform uniform, vec4 v);
+void shader_set_mat4(struct shader shader, shader_uniform uniform, mat4 m);
+
+/* for setting uniform states by name, which is resolved to its id on every
+   call. Fine outside of the render loop */
 void shader_uniform_1i(struct shader shader, const char *uniform, int32_t n);
 void shader_uniform_1f(struct shader shader, const char *uniform, float f);
 void shader_uniform_vec3(struct shader shader, const char* uniform, vec3 v);
@@ -5,14 +5,20 @@
 #include "texture.h"
 #include "mnf/mnf_matrix.h"
 #include "logger.h"
+#include "gl_state.h"
 
 struct shader skybox_shader;
+static shader_uniform u_view;
+static shader_uniform u_projection;
 
 void skybox_init(struct skybox *skybox, const char *cubemap_paths[6])
 {
     SINFO("Initializing skybox");
-    if (skybox_shader.handle == 0)
+    if (skybox_shader.handle == 0) {
         skybox_shader = shader_create("glsl/skybox.glsl");
+        u_view = shader_uniform_id("u_view");
+        u_projection = shader_uniform_id("u_projection");
+    }
 
     skybox->mesh = mesh_geometry_create_cube();
     skybox->cubemap = cubemap_texture_create(cubemap_paths);
@@ -33,11 +39,11 @@ void skybox_draw(struct skybox skybox, mat4 view, mat4 projection)
     view_no_translation[3][2] = 0;
     view_no_translation[3][3] = 1;
 
-    shader_uniform_mat4(skybox_shader, "u_view", view_no_translation);
-    shader_uniform_mat4(skybox_shader, "u_projection", projection);
-    glDepthMask(GL_FALSE);
+    shader_set_mat4(skybox_shader, u_view, view_no_translation);
+    shader_set_mat4(skybox_shader, u_projection, projection);
+    gl_state_depth_mask(false);
     mesh_draw(skybox.mesh);
-    glDepthMask(GL_TRUE);
+    gl_state_depth_mask(true);
 }
 
 void skybox_destroy(struct skybox *skybox)
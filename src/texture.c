@@ -9,38 +9,111 @@
 #include "logger.h"
 #include "assert.h"
 #include "texture.h"
+#include "texture_cache.h"
+#include "texture_residency.h"
+#include "asset_loader.h"
+#include "pak.h"
+#include "gl_state.h"
 
-struct texture texture_create(const char *path)
+static GLenum texture_gl_format(enum texture_format format);
+static GLenum texture_gl_pixel_format(enum texture_format format);
+
+/* S3TC is an extension, though every desktop GPU has it */
+static bool texture_s3tc = true;
+
+struct texture texture_create(const char *path, enum texture_role role)
 {
 	SINFO("Creating texture of %s", path);
 	struct texture texture = {0};
-	int32_t width, height, channels;
 
 	/* OpenGL expects the uv 0.0 coordinate on the y-axis to be on the bottom
        side of the image */
-	stbi_set_flip_vertically_on_load(true);
-	unsigned char *data = stbi_load(path, &width, &height, &channels, STBI_rgb_alpha);
+    uint32_t flags = texture_cache_flags(true, true, role);
+    if (pak_texture(path, flags, &texture)) return texture;
+
+    /* streamed into a white placeholder when loading asynchronously */
+    if (asset_loader_active()) {
+        texture = texture_create_default();
+        asset_loader_queue_texture(path, texture.id, flags);
+        return texture;
+    }
 
-	if (data == NULL) {
+    struct texture_cache_file cache;
+	if (!texture_cache_load(path, flags, &cache)) {
 		SERROR("Texture '%s' failed to load", path);
         return texture;
 	}
 
-    /* TODO: */
-    GLenum format;
-    switch (channels) {
-        case 3: format = GL_RGB;
-                break;
-        case 4: format = GL_RGBA;
-                break;
-        default: format = GL_RED;
-                 break;
-    }
-    texture.width = width;
-    texture.height = height;
+    const struct stex_header *header = cache.file.data;
+    texture.width = (int32_t) header->width;
+    texture.height = (int32_t) header->height;
 
 	glGenTextures(1, &texture.id);
-	glBindTexture(GL_TEXTURE_2D, texture.id);
+    if (!texture_residency_manage(&cache, texture.id))
+        texture_cache_upload(&cache, texture.id);
+
+    return texture;
+}
+
+struct texture texture_create_packed(const char *red_path, const char *green_path)
+{
+	SINFO("Creating texture packing %s & %s", red_path ? red_path : "white",
+          green_path ? green_path : "white");
+	struct texture texture = {0};
+
+    /* packed masks aren't cooked or streamed, the .stex makes loading them
+       again cheap enough */
+    uint32_t flags = texture_cache_flags(true, true, TEXTURE_ROLE_PACKED);
+    struct texture_cache_file cache;
+	if (!texture_cache_load_packed(red_path, green_path, flags, &cache)) {
+		SERROR("Textures '%s' & '%s' failed to pack", red_path ? red_path : "white",
+               green_path ? green_path : "white");
+        return texture;
+	}
+
+    const struct stex_header *header = cache.file.data;
+    texture.width = (int32_t) header->width;
+    texture.height = (int32_t) header->height;
+
+	glGenTextures(1, &texture.id);
+    if (!texture_residency_manage(&cache, texture.id))
+        texture_cache_upload(&cache, texture.id);
+
+    return texture;
+}
+
+/* stb's flip flag is global, so it's never set & the rows are flipped here
+   instead, which lets images be decoded on several threads at once */
+bool texture_decode(const uint8_t *data, size_t size, bool flip, struct texture_image *image)
+{
+    if (size > INT32_MAX) return false;
+
+	image->pixels = stbi_load_from_memory(data, (int) size, &image->width,
+                                          &image->height, &image->channels, STBI_rgb_alpha);
+	if (image->pixels == NULL) return false;
+
+    image->format = TEXTURE_FORMAT_RGBA8;
+    image->size = (size_t) image->width * image->height * 4;
+
+    if (flip) {
+        size_t row_size = (size_t) image->width * 4;
+        uint8_t *top = image->pixels;
+        uint8_t *bottom = image->pixels + (size_t) (image->height - 1) * row_size;
+        for (; top < bottom; top += row_size, bottom -= row_size) {
+            for (size_t i = 0; i < row_size; i++) {
+                uint8_t byte = top[i];
+                top[i] = bottom[i];
+                bottom[i] = byte;
+            }
+        }
+    }
+
+    return true;
+}
+
+void texture_upload_levels(uint32_t id, const struct texture_image *levels, uint32_t n_levels)
+{
+	gl_state_bind_texture(GL_TEXTURE_2D, id);
 
     /* set texture parameters */
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -48,20 +121,85 @@ struct texture texture_create(const char *path)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-	glTexImage2D(GL_TEXTURE_2D, /* target           */
-              0,                /* level (lod)      */
-              format,           /* color components */
-              width,            /* width            */
-              height,           /* height           */
-              0,                /* border           */
-              GL_RGBA,          /* pixel format     */
-              GL_UNSIGNED_BYTE, /* data type        */
-              data);            /* data in memory   */
+    /* a BC4 or R8 mask only has red, it's read back as gray like the image
+       was. Packed masks are read by channel & keep g */
+    bool gray = levels[0].format == TEXTURE_FORMAT_BC4 || levels[0].format == TEXTURE_FORMAT_R8;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, gray ? GL_RED : GL_GREEN);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, gray ? GL_RED : GL_BLUE);
+
+    /* the levels can be replaced by fewer ones when the residency manager
+       evicts mips, the ones past them are left out of sampling */
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint) n_levels - 1);
+
+    /* rows of R8 & RG8 levels aren't padded to 4 bytes */
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (uint32_t level = 0; level < n_levels; level++) {
+        enum texture_format format = levels[level].format;
+        if (format != TEXTURE_FORMAT_RGBA8 && format != TEXTURE_FORMAT_R8 &&
+            format != TEXTURE_FORMAT_RG8) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, texture_gl_format(format),
+                                   levels[level].width, levels[level].height, 0,
+                                   (GLsizei) levels[level].size, levels[level].pixels);
+            continue;
+        }
+
+        glTexImage2D(GL_TEXTURE_2D,                     /* target           */
+                     level,                             /* level (lod)      */
+                     texture_gl_format(format),         /* color components */
+                     levels[level].width,               /* width            */
+                     levels[level].height,              /* height           */
+                     0,                                 /* border           */
+                     texture_gl_pixel_format(format),   /* pixel format     */
+                     GL_UNSIGNED_BYTE,                  /* data type        */
+                     levels[level].pixels);             /* data in memory   */
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	gl_state_bind_texture(GL_TEXTURE_2D, 0);
+}
+
+void texture_image_free(struct texture_image *image)
+{
+	stbi_image_free(image->pixels);
+    image->pixels = NULL;
+}
+
+struct texture texture_create_from_memory(const uint8_t *data, size_t size)
+{
+	struct texture texture = {0};
+	int32_t width, height, channels;
+
+    if (size > INT32_MAX) {
+		SERROR("Image of %zu bytes is too big to decode", size);
+        return texture;
+    }
+
+	unsigned char *pixels = stbi_load_from_memory(data, (int) size, &width, &height,
+                                                  &channels, STBI_rgb_alpha);
+	if (pixels == NULL) {
+		SERROR("Image failed to decode: %s", stbi_failure_reason());
+        return texture;
+	}
+
+    texture.width = width;
+    texture.height = height;
+
+	glGenTextures(1, &texture.id);
+	gl_state_bind_texture(GL_TEXTURE_2D, texture.id);
 
+    /* uvs outside of [0, 1] tile the image */
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 	glGenerateMipmap(GL_TEXTURE_2D);
 
-	glBindTexture(GL_TEXTURE_2D, 0);
-	stbi_image_free(data);
+	gl_state_bind_texture(GL_TEXTURE_2D, 0);
+	stbi_image_free(pixels);
 
 	return texture;
 }
@@ -70,51 +208,22 @@ uint32_t texture_create_id(const char *path, bool flip)
 {
 	SINFO("Creating texture id from %s", path);
     uint32_t id;
-	int32_t width, height, channels;
 
 	/* OpenGL expects the uv 0.0 coordinate on the y-axis to be on the bottom
        side of the image */
-	stbi_set_flip_vertically_on_load(flip);
-	unsigned char *data = stbi_load(path, &width, &height, &channels, STBI_rgb_alpha);
+    uint32_t flags = texture_cache_flags(flip, true, TEXTURE_ROLE_COLOR);
 
-	if (data == NULL) {
+    struct texture cooked;
+    if (pak_texture(path, flags, &cooked)) return cooked.id;
+
+    struct texture_cache_file cache;
+	if (!texture_cache_load(path, flags, &cache)) {
 		SERROR("Texture '%s' failed to load", path);
         return 0;
 	}
 
-    GLenum format;
-    switch (channels) {
-        case 3: format = GL_RGB;
-                break;
-        case 4: format = GL_RGBA;
-                break;
-        default: format = GL_RED;
-                 break;
-    }
-
 	glGenTextures(1, &id);
-	glBindTexture(GL_TEXTURE_2D, id);
-
-    /* set texture parameters */
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	glTexImage2D(GL_TEXTURE_2D, /* target           */
-              0,                /* level (lod)      */
-              format,           /* color components */
-              width,            /* width            */
-              height,           /* height           */
-              0,                /* border           */
-              GL_RGBA,          /* pixel format     */
-              GL_UNSIGNED_BYTE, /* data type        */
-              data);            /* data in memory   */
-
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	glBindTexture(GL_TEXTURE_2D, 0);
-	stbi_image_free(data);
+    texture_cache_upload(&cache, id);
 
 	return id;
 }
@@ -123,15 +232,20 @@ uint32_t texture_create_id(const char *path, bool flip)
 struct texture texture_create_default(void)
 {
 	SINFO("Creating a default 1x1 pixel texture");
-	struct texture texture = {0};
 
     /* single pixel of (255, 255, 255, 255) */
-    const unsigned char white[4] = {255, 255, 255, 255};
+    const uint8_t white[4] = {255, 255, 255, 255};
+    return texture_create_color(white);
+}
+
+struct texture texture_create_color(const uint8_t rgba[4])
+{
+	struct texture texture = {0};
     texture.width = 1;
     texture.height = 1;
 
 	glGenTextures(1, &texture.id);
-	glBindTexture(GL_TEXTURE_2D, texture.id);
+	gl_state_bind_texture(GL_TEXTURE_2D, texture.id);
 
     /* set texture parameters */
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -147,11 +261,11 @@ struct texture texture_create_default(void)
               0,                /* border           */
               GL_RGBA,          /* pixel format     */
               GL_UNSIGNED_BYTE, /* data type        */
-              white);           /* data in memory   */
+              rgba);            /* data in memory   */
 
 	glGenerateMipmap(GL_TEXTURE_2D);
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_state_bind_texture(GL_TEXTURE_2D, 0);
 
 	return texture;
 }
@@ -175,10 +289,7 @@ struct texture cubemap_texture_create(const char *cubemap_faces[6])
 
     /* single pixel of (255, 255, 255, 255) */
 	glGenTextures(1, &texture.id);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, texture.id);
-
-    int32_t width, height, channels;
-	width = height = channels = 0;
+	gl_state_bind_texture(GL_TEXTURE_CUBE_MAP, texture.id);
 
     /* set texture parameters */
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -187,51 +298,112 @@ struct texture cubemap_texture_create(const char *cubemap_faces[6])
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-    for (size_t i = 0; i < 6; i++) {
-        stbi_set_flip_vertically_on_load(false);
-        unsigned char *data = stbi_load(
-            cubemap_faces[i], &width, &height, &channels, 0
-        );
-        
-        GLenum format;
-        switch (channels) {
-            case 3: format = GL_RGB;
-                    break;
-            case 4: format = GL_RGBA;
-                    break;
-            default: format = GL_RED;
-                    break;
-        }
+    /* cubemaps are sampled without mips */
+    uint32_t flags = texture_cache_flags(false, false, TEXTURE_ROLE_COLOR);
 
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                     0,                /* level (lod)      */
-                     format,           /* color components */
-                     width,            /* width            */
-                     height,           /* height           */
-                     0,                /* border           */
-                     format,           /* pixel format     */
-                     GL_UNSIGNED_BYTE, /* data type        */
-                     data);            /* data in memory   */
+    /* black faces until the asset loader has decoded the images */
+    if (asset_loader_active()) {
+        const uint8_t black[4] = {0, 0, 0, 255};
+        for (uint32_t i = 0; i < 6; i++) {
+            if (pak_cubemap_face(cubemap_faces[i], flags, texture.id, i)) continue;
+
+            gl_state_bind_texture(GL_TEXTURE_CUBE_MAP, texture.id);
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, 1, 1, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, black);
+            asset_loader_queue_cubemap_face(cubemap_faces[i], texture.id, i, flags);
+        }
+        gl_state_bind_texture(GL_TEXTURE_CUBE_MAP, 0);
+        return texture;
     }
 
+	gl_state_bind_texture(GL_TEXTURE_CUBE_MAP, 0);
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    for (uint32_t i = 0; i < 6; i++) {
+        if (pak_cubemap_face(cubemap_faces[i], flags, texture.id, i)) continue;
+
+        struct texture_cache_file cache;
+        if (!texture_cache_load(cubemap_faces[i], flags, &cache)) {
+            SERROR("Cubemap face '%s' failed to load", cubemap_faces[i]);
+            continue;
+        }
+        texture_cache_upload_face(&cache, texture.id, i);
+    }
 
 	return texture;
 }
 
+void cubemap_texture_upload_face(uint32_t id, uint32_t face, const struct texture_image *image)
+{
+	gl_state_bind_texture(GL_TEXTURE_CUBE_MAP, id);
+    if (image->format != TEXTURE_FORMAT_RGBA8) {
+        glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0,
+                               texture_gl_format(image->format), image->width, image->height,
+                               0, (GLsizei) image->size, image->pixels);
+    } else {
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA, image->width, image->height,
+                     0, GL_RGBA, GL_UNSIGNED_BYTE, image->pixels);
+    }
+	gl_state_bind_texture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+void texture_detect_compression(void)
+{
+    GLint n_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &n_extensions);
+
+    texture_s3tc = false;
+    for (GLint i = 0; i < n_extensions; i++) {
+        const char *extension = (const char *) glGetStringi(GL_EXTENSIONS, (GLuint) i);
+        if (extension && strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+            texture_s3tc = true;
+    }
+
+    if (!texture_s3tc) SWARN("GPU has no S3TC support, textures are stored uncompressed");
+}
+
+bool texture_compression_supported(void)
+{
+    return texture_s3tc;
+}
+
+static GLenum texture_gl_format(enum texture_format format)
+{
+    switch (format) {
+    case TEXTURE_FORMAT_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case TEXTURE_FORMAT_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case TEXTURE_FORMAT_BC4: return GL_COMPRESSED_RED_RGTC1;
+    case TEXTURE_FORMAT_BC5: return GL_COMPRESSED_RG_RGTC2;
+    case TEXTURE_FORMAT_R8: return GL_R8;
+    case TEXTURE_FORMAT_RG8: return GL_RG8;
+    case TEXTURE_FORMAT_RGBA8: break;
+    }
+
+    return GL_RGBA8;
+}
+
+/* What the pixels of an uncompressed level are laid out as */
+static GLenum texture_gl_pixel_format(enum texture_format format)
+{
+    if (format == TEXTURE_FORMAT_R8) return GL_RED;
+    if (format == TEXTURE_FORMAT_RG8) return GL_RG;
+
+    return GL_RGBA;
+}
+
 void cubemap_texture_bind(struct texture t)
 {
-    glBindTexture(GL_TEXTURE_CUBE_MAP, t.id);
+    /* samplers read unit 0 unless they're set otherwise */
+    gl_state_active_texture(0);
+    gl_state_bind_texture(GL_TEXTURE_CUBE_MAP, t.id);
 }
 
 
 /* n should be defaulted to 0 if only using 1 uniform texture */
 void texture_bind(struct texture t, size_t n_texture_unit)
 {
-    SASSERT(n_texture_unit < 16);
-    glActiveTexture(GL_TEXTURE0 + n_texture_unit);
-    glBindTexture(GL_TEXTURE_2D, t.id);
+    SASSERT(n_texture_unit < GL_STATE_MAX_TEXTURE_UNITS);
+    gl_state_active_texture((uint32_t) n_texture_unit);
+    gl_state_bind_texture(GL_TEXTURE_2D, t.id);
 }
 
 void texture_destroy(struct texture *t)
@@ -241,8 +413,11 @@ void texture_destroy(struct texture *t)
 
 void texture_destroy_id(uint32_t *id)
 {
-    if (*id > 1)
+    texture_residency_forget(*id);
+    if (*id > 1) {
+        gl_state_forget_texture(*id);
         glDeleteTextures(1, id);
+    }
     *id = 0;
 }
 
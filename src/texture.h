@@ -11,11 +11,63 @@ struct texture {
     int32_t height;
 };
 
+/* What a texture is sampled for, decides the format it's compressed to */
+enum texture_role {
+    TEXTURE_ROLE_COLOR,     /* diffuse maps */
+    TEXTURE_ROLE_MASK,      /* specular maps & the like, only rgb is read */
+    TEXTURE_ROLE_PACKED,    /* two masks in r & g, see texture_create_packed() */
+};
+
+/* How the pixels of a texture_image are laid out, see texture_compress.h */
+enum texture_format {
+    TEXTURE_FORMAT_RGBA8,
+    TEXTURE_FORMAT_BC1,
+    TEXTURE_FORMAT_BC3,
+    TEXTURE_FORMAT_BC4,
+    TEXTURE_FORMAT_BC5,
+    TEXTURE_FORMAT_R8,      /* grayscale masks when not compressed */
+    TEXTURE_FORMAT_RG8,     /* packed masks when not compressed */
+};
+
+/* Pixels of an image decoded by texture_decode(), always 4 channels, or of a
+   level of a texture in any format */
+struct texture_image {
+    uint8_t *pixels;
+    int32_t width;
+    int32_t height;
+    int32_t channels;   /* of the file */
+    enum texture_format format;
+    size_t size;        /* bytes of pixels */
+};
+
 struct texture texture_create_default(void);
-struct texture texture_create(const char *path);
+/* 1x1 pixel texture of a single color, for materials without an image */
+struct texture texture_create_color(const uint8_t rgba[4]);
+struct texture texture_create(const char *path, enum texture_role role);
+/* Packs two grayscale masks of the same size into the r & g of one texture,
+   like a specular & an occlusion map, so they're sampled from a single unit.
+   Either path can be NULL for a mask of white. Color images are averaged
+   down to gray. Always decoded on this thread, the id is 0 if it failed */
+struct texture texture_create_packed(const char *red_path, const char *green_path);
+/* Decodes an image file already in memory (png, jpeg, ...) without flipping
+   it, for formats whose uvs start at the top of the image like glTF. Wraps
+   around with GL_REPEAT. The id is 0 if it failed to decode */
+struct texture texture_create_from_memory(const uint8_t *data, size_t size);
 /* Same function as texture_create() except it returns the ID instead of a
    texture struct */
 uint32_t texture_create_id(const char *path, bool flip);
+/* Decodes an image file in memory without touching GL so it can run on any
+   thread, returns false if it can't. texture_create() goes through the
+   decoded texture cache instead, see texture_cache.h */
+bool texture_decode(const uint8_t *data, size_t size, bool flip, struct texture_image *image);
+/* Replaces the image of the texture 'id' with mips computed ahead of time
+   instead of by the driver, each level half the size of the one before */
+void texture_upload_levels(uint32_t id, const struct texture_image *levels, uint32_t n_levels);
+/* Looks for S3TC support once the GL context exists, textures stay RGBA8
+   without it. texture_compression_supported() is true until then */
+void texture_detect_compression(void);
+bool texture_compression_supported(void);
+void texture_image_free(struct texture_image *image);
 /* Wrapper around glBindTexture() */
 void texture_bind(struct texture t, size_t texture_unit);
 /* Wrapper around texture_destroy_id */
@@ -23,6 +75,8 @@ void texture_destroy(struct texture *t);
 void texture_destroy_id(uint32_t *id);
 
 struct texture cubemap_texture_create(const char *cubemap_faces[6]);
+/* Replaces a face (0 to 5, +x -x +y -y +z -z) of a cubemap */
+void cubemap_texture_upload_face(uint32_t id, uint32_t face, const struct texture_image *image);
 void cubemap_texture_bind(struct texture t);
 
 #endif /* SAGE_TEXTURE_H */
@@ -0,0 +1,463 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "texture_cache.h"
+#include "texture_compress.h"
+#include "config.h"
+#include "hash.h"
+#include "logger.h"
+
+/* <cache dir>/<16 hex digits of the hash><suffixes>.stex */
+#define STEX_PATH_BUFFER_SIZE 512
+
+static bool texture_cache_matches(const struct mapped_file *file, uint64_t source_hash,
+                                  uint64_t source_size, uint32_t flags, const char *name);
+static bool texture_cache_path(uint64_t source_hash, uint32_t flags,
+                               char out[STEX_PATH_BUFFER_SIZE]);
+static bool texture_cache_finish(const struct texture_image *image, uint32_t flags,
+                                 uint64_t source_hash, uint64_t source_size, bool cacheable,
+                                 const char *cache_path, struct texture_cache_file *cache);
+static void texture_cache_pack(struct texture_image *red, struct texture_image *green,
+                               struct texture_image *packed);
+static uint8_t texture_cache_gray(const uint8_t *pixel);
+static void texture_cache_extract(const uint8_t *rgba, size_t n_pixels, uint32_t n_channels,
+                                  uint8_t *out);
+static void texture_cache_store(const char *cache_path, const void *data, size_t size);
+static void texture_cache_downsample(const uint8_t *src, uint32_t src_width, uint32_t src_height,
+                                     uint8_t *dst, uint32_t dst_width, uint32_t dst_height);
+static uint32_t texture_cache_n_levels(uint32_t width, uint32_t height, bool mips);
+static uint32_t texture_cache_level_size(uint32_t size, uint32_t level);
+static size_t stex_align(size_t offset);
+static double texture_cache_elapsed_ms(struct timespec start);
+
+uint32_t texture_cache_flags(bool flip, bool mips, enum texture_role role)
+{
+    uint32_t flags = 0;
+    if (flip) flags |= STEX_FLIPPED;
+    if (mips) flags |= STEX_MIPS;
+    if (role == TEXTURE_ROLE_MASK) flags |= STEX_MASK;
+    if (role == TEXTURE_ROLE_PACKED) flags |= STEX_PACKED;
+    if (SAGE_TEXTURE_COMPRESSION && texture_compression_supported()) flags |= STEX_COMPRESSED;
+
+    return flags;
+}
+
+bool texture_cache_load(const char *path, uint32_t flags, struct texture_cache_file *cache)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* hashing the encoded file is much cheaper than decoding it */
+    struct mapped_file source;
+    if (!file_map(path, &source)) return false;
+
+    uint64_t source_hash = hash_64(source.data, source.size, STEX_MAGIC);
+
+    char cache_path[STEX_PATH_BUFFER_SIZE];
+    bool cacheable = texture_cache_path(source_hash, flags, cache_path);
+
+    if (cacheable && file_map(cache_path, &cache->file)) {
+        if (texture_cache_matches(&cache->file, source_hash, source.size, flags, cache_path)) {
+            file_unmap(&source);
+            SDEBUG("Loaded '%s' from the texture cache in %.2f ms", path,
+                   texture_cache_elapsed_ms(start));
+            return true;
+        }
+        file_unmap(&cache->file);
+    }
+
+    struct texture_image image;
+    bool decoded = texture_decode(source.data, source.size, flags & STEX_FLIPPED, &image);
+    uint64_t source_size = source.size;
+    file_unmap(&source);
+    if (!decoded) return false;
+
+    bool built = texture_cache_finish(&image, flags, source_hash, source_size, cacheable,
+                                      cache_path, cache);
+    texture_image_free(&image);
+    if (!built) {
+        SERROR("Failed to alloc memory for the levels of '%s'", path);
+        return false;
+    }
+
+    SDEBUG("Decoded '%s' in %.2f ms", path, texture_cache_elapsed_ms(start));
+    return true;
+}
+
+bool texture_cache_load_packed(const char *red_path, const char *green_path, uint32_t flags,
+                               struct texture_cache_file *cache)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    const char *paths[2] = {red_path, green_path};
+    struct mapped_file sources[2];
+    memset(sources, 0, sizeof(sources));
+
+    /* chained so swapping the masks or leaving either out is another entry */
+    uint64_t source_hash = STEX_MAGIC;
+    uint64_t source_size = 0;
+    for (uint32_t i = 0; i < 2; i++) {
+        if (paths[i] != NULL && !file_map(paths[i], &sources[i])) {
+            file_unmap(&sources[0]);
+            return false;
+        }
+        source_hash = hash_64(sources[i].data, sources[i].size, source_hash + i);
+        source_size += sources[i].size;
+    }
+
+    char cache_path[STEX_PATH_BUFFER_SIZE];
+    bool cacheable = texture_cache_path(source_hash, flags, cache_path);
+
+    if (cacheable && file_map(cache_path, &cache->file)) {
+        if (texture_cache_matches(&cache->file, source_hash, source_size, flags, cache_path)) {
+            file_unmap(&sources[0]);
+            file_unmap(&sources[1]);
+            SDEBUG("Loaded '%s' & '%s' from the texture cache in %.2f ms",
+                   red_path ? red_path : "white", green_path ? green_path : "white",
+                   texture_cache_elapsed_ms(start));
+            return true;
+        }
+        file_unmap(&cache->file);
+    }
+
+    struct texture_image images[2];
+    memset(images, 0, sizeof(images));
+    bool decoded = true;
+    for (uint32_t i = 0; i < 2; i++) {
+        if (paths[i] != NULL && decoded)
+            decoded = texture_decode(sources[i].data, sources[i].size, flags & STEX_FLIPPED, &images[i]);
+        file_unmap(&sources[i]);
+    }
+
+    if (decoded && images[0].pixels != NULL && images[1].pixels != NULL &&
+        (images[0].width != images[1].width || images[0].height != images[1].height)) {
+        SERROR("Can't pack '%s' (%dx%d) with '%s' (%dx%d), they aren't the same size",
+               red_path, images[0].width, images[0].height,
+               green_path, images[1].width, images[1].height);
+        decoded = false;
+    }
+
+    bool built = false;
+    if (decoded && (images[0].pixels != NULL || images[1].pixels != NULL)) {
+        struct texture_image packed;
+        texture_cache_pack(&images[0], &images[1], &packed);
+        built = texture_cache_finish(&packed, flags, source_hash, source_size, cacheable,
+                                     cache_path, cache);
+        if (!built)
+            SERROR("Failed to alloc memory for the levels of '%s'", red_path ? red_path : green_path);
+    }
+
+    texture_image_free(&images[0]);
+    texture_image_free(&images[1]);
+    if (!built) return false;
+
+    SDEBUG("Decoded & packed '%s' & '%s' in %.2f ms",
+           red_path ? red_path : "white", green_path ? green_path : "white",
+           texture_cache_elapsed_ms(start));
+    return true;
+}
+
+void texture_cache_upload(struct texture_cache_file *cache, uint32_t id)
+{
+    struct texture_image levels[STEX_MAX_LEVELS];
+    uint32_t n_levels = texture_cache_levels(cache->file.data, levels);
+    texture_upload_levels(id, levels, n_levels);
+
+    /* glTexImage2D has copied the levels so the mapping isn't needed anymore */
+    texture_cache_close(cache);
+}
+
+void texture_cache_upload_face(struct texture_cache_file *cache, uint32_t id, uint32_t face)
+{
+    struct texture_image levels[STEX_MAX_LEVELS];
+    texture_cache_levels(cache->file.data, levels);
+    cubemap_texture_upload_face(id, face, &levels[0]);
+
+    texture_cache_close(cache);
+}
+
+void texture_cache_close(struct texture_cache_file *cache)
+{
+    file_unmap(&cache->file);
+}
+
+/* The pixels point into the .stex, texture_image_free() isn't called on them */
+uint32_t texture_cache_levels(const struct stex_header *header,
+                              struct texture_image levels[STEX_MAX_LEVELS])
+{
+    for (uint32_t i = 0; i < header->n_levels; i++) {
+        levels[i].pixels = (uint8_t *) header + header->level_offsets[i];
+        levels[i].width = (int32_t) texture_cache_level_size(header->width, i);
+        levels[i].height = (int32_t) texture_cache_level_size(header->height, i);
+        levels[i].channels = (int32_t) header->channels;
+        levels[i].format = (enum texture_format) header->format;
+        levels[i].size = texture_format_level_size(levels[i].format, (uint32_t) levels[i].width,
+                                                   (uint32_t) levels[i].height);
+    }
+
+    return header->n_levels;
+}
+
+void *texture_cache_build(const struct texture_image *image, uint32_t flags,
+                          uint64_t source_hash, uint64_t source_size, size_t *size)
+{
+    struct stex_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = STEX_MAGIC;
+    header.version = STEX_VERSION;
+    header.source_hash = source_hash;
+    header.source_size = source_size;
+    header.width = (uint32_t) image->width;
+    header.height = (uint32_t) image->height;
+    header.channels = (uint32_t) image->channels;
+    header.n_levels = texture_cache_n_levels(header.width, header.height, flags & STEX_MIPS);
+    header.flags = flags;
+
+    /* the mips are built from the uncompressed level before them */
+    size_t rgba_offsets[STEX_MAX_LEVELS];
+    size_t rgba_size = 0;
+    for (uint32_t i = 0; i < header.n_levels; i++) {
+        rgba_offsets[i] = rgba_size;
+        rgba_size += texture_format_level_size(TEXTURE_FORMAT_RGBA8,
+                                               texture_cache_level_size(header.width, i),
+                                               texture_cache_level_size(header.height, i));
+    }
+
+    uint8_t *rgba = malloc(rgba_size);
+    if (rgba == NULL) return NULL;
+
+    memcpy(rgba, image->pixels, (size_t) header.width * header.height * 4);
+    for (uint32_t i = 1; i < header.n_levels; i++) {
+        texture_cache_downsample(rgba + rgba_offsets[i - 1],
+                                 texture_cache_level_size(header.width, i - 1),
+                                 texture_cache_level_size(header.height, i - 1),
+                                 rgba + rgba_offsets[i],
+                                 texture_cache_level_size(header.width, i),
+                                 texture_cache_level_size(header.height, i));
+    }
+
+    enum texture_role role = TEXTURE_ROLE_COLOR;
+    if (flags & STEX_MASK) role = TEXTURE_ROLE_MASK;
+    if (flags & STEX_PACKED) role = TEXTURE_ROLE_PACKED;
+    enum texture_format format = texture_format_pick(rgba, (size_t) header.width * header.height,
+                                                     role, flags & STEX_COMPRESSED);
+    header.format = format;
+
+    size_t offset = stex_align(sizeof(header));
+    for (uint32_t i = 0; i < header.n_levels; i++) {
+        header.level_offsets[i] = offset;
+        offset = stex_align(offset + texture_format_level_size(format,
+                                                               texture_cache_level_size(header.width, i),
+                                                               texture_cache_level_size(header.height, i)));
+    }
+
+    uint8_t *data = calloc(1, offset);
+    if (data == NULL) {
+        free(rgba);
+        return NULL;
+    }
+
+    memcpy(data, &header, sizeof(header));
+    for (uint32_t i = 0; i < header.n_levels; i++) {
+        uint32_t width = texture_cache_level_size(header.width, i);
+        uint32_t height = texture_cache_level_size(header.height, i);
+        uint8_t *level = data + header.level_offsets[i];
+        if (format == TEXTURE_FORMAT_RGBA8)
+            memcpy(level, rgba + rgba_offsets[i], (size_t) width * height * 4);
+        else if (format == TEXTURE_FORMAT_R8 || format == TEXTURE_FORMAT_RG8)
+            texture_cache_extract(rgba + rgba_offsets[i], (size_t) width * height,
+                                  format == TEXTURE_FORMAT_R8 ? 1 : 2, level);
+        else
+            texture_compress(rgba + rgba_offsets[i], width, height, format, level);
+    }
+    free(rgba);
+
+    *size = offset;
+    return data;
+}
+
+bool texture_cache_validate(const void *data, size_t size, const char *name)
+{
+    const struct stex_header *header = data;
+    if (size < sizeof(struct stex_header)) {
+        SWARN("Texture cache '%s' is truncated", name);
+        return false;
+    }
+
+    if (header->magic != STEX_MAGIC || header->version != STEX_VERSION) {
+        SDEBUG("Texture cache '%s' is from another version of sage", name);
+        return false;
+    }
+
+    if (header->n_levels == 0 || header->n_levels > STEX_MAX_LEVELS ||
+        header->width == 0 || header->height == 0 || header->format > TEXTURE_FORMAT_RG8) {
+        SWARN("Texture cache '%s' is corrupt", name);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header->n_levels; i++) {
+        uint64_t level_size = texture_format_level_size(header->format,
+                                                        texture_cache_level_size(header->width, i),
+                                                        texture_cache_level_size(header->height, i));
+        uint64_t offset = header->level_offsets[i];
+        if (offset > size || level_size > size - offset) {
+            SWARN("Texture cache '%s' is truncated", name);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* The hash decides, the size only guards against a collision */
+static bool texture_cache_matches(const struct mapped_file *file, uint64_t source_hash,
+                                  uint64_t source_size, uint32_t flags, const char *name)
+{
+    if (!texture_cache_validate(file->data, file->size, name)) return false;
+
+    const struct stex_header *header = file->data;
+    return header->source_hash == source_hash &&
+           header->source_size == source_size &&
+           header->flags == flags;
+}
+
+/* The same image can be built with different flags, each is its own entry */
+static bool texture_cache_path(uint64_t source_hash, uint32_t flags,
+                               char out[STEX_PATH_BUFFER_SIZE])
+{
+    int n = snprintf(out, STEX_PATH_BUFFER_SIZE, "%s/%016" PRIx64 "%s%s%s%s%s.stex",
+                     SAGE_CACHE_DIR, source_hash,
+                     (flags & STEX_FLIPPED) ? "-flipped" : "",
+                     (flags & STEX_MIPS) ? "-mips" : "",
+                     (flags & STEX_MASK) ? "-mask" : "",
+                     (flags & STEX_PACKED) ? "-packed" : "",
+                     (flags & STEX_COMPRESSED) ? "-bc" : "");
+    return n > 0 && n < STEX_PATH_BUFFER_SIZE;
+}
+
+/* Builds the levels of a decoded image into a buffer 'cache' points at &
+   stores them, false if there is no memory for them */
+static bool texture_cache_finish(const struct texture_image *image, uint32_t flags,
+                                 uint64_t source_hash, uint64_t source_size, bool cacheable,
+                                 const char *cache_path, struct texture_cache_file *cache)
+{
+    size_t size;
+    void *data = texture_cache_build(image, flags, source_hash, source_size, &size);
+    if (data == NULL) return false;
+
+    if (cacheable) texture_cache_store(cache_path, data, size);
+
+    /* the levels are uploaded from the buffer, file_unmap() frees it */
+    memset(&cache->file, 0, sizeof(cache->file));
+    cache->file.data = data;
+    cache->file.size = size;
+    cache->file.copied = true;
+
+    return true;
+}
+
+/* Packs the gray of 'red' & 'green' into the pixels of whichever was decoded,
+   white for the one that wasn't. 'packed' borrows those pixels */
+static void texture_cache_pack(struct texture_image *red, struct texture_image *green,
+                               struct texture_image *packed)
+{
+    *packed = (red->pixels != NULL) ? *red : *green;
+    packed->channels = 2;
+
+    size_t n_pixels = (size_t) packed->width * packed->height;
+    for (size_t i = 0; i < n_pixels; i++) {
+        uint8_t r = red->pixels ? texture_cache_gray(red->pixels + i * 4) : 255;
+        uint8_t g = green->pixels ? texture_cache_gray(green->pixels + i * 4) : 255;
+
+        uint8_t *out = packed->pixels + i * 4;
+        out[0] = r;
+        out[1] = g;
+        out[2] = 0;
+        out[3] = 255;
+    }
+}
+
+/* Average of rgb, grayscale images have them all the same anyway */
+static uint8_t texture_cache_gray(const uint8_t *pixel)
+{
+    return (uint8_t) ((pixel[0] + pixel[1] + pixel[2] + 1) / 3);
+}
+
+/* The first 'n_channels' of every RGBA8 pixel, for R8 & RG8 levels */
+static void texture_cache_extract(const uint8_t *rgba, size_t n_pixels, uint32_t n_channels,
+                                  uint8_t *out)
+{
+    for (size_t i = 0; i < n_pixels; i++) {
+        for (uint32_t c = 0; c < n_channels; c++)
+            out[i * n_channels + c] = rgba[i * 4 + c];
+    }
+}
+
+/* Failing to write the cache only costs decoding the image again next time */
+static void texture_cache_store(const char *cache_path, const void *data, size_t size)
+{
+    if (!file_make_dir(SAGE_CACHE_DIR) || !file_write_atomic(cache_path, data, size)) {
+        SWARN("Failed to write texture cache '%s'", cache_path);
+        return;
+    }
+
+    SDEBUG("Wrote texture cache '%s'", cache_path);
+}
+
+/* 2x2 box filter like glGenerateMipmap, the odd last row or column of a
+   level is averaged with itself */
+static void texture_cache_downsample(const uint8_t *src, uint32_t src_width, uint32_t src_height,
+                                     uint8_t *dst, uint32_t dst_width, uint32_t dst_height)
+{
+    for (uint32_t y = 0; y < dst_height; y++) {
+        uint32_t y0 = 2 * y < src_height ? 2 * y : src_height - 1;
+        uint32_t y1 = 2 * y + 1 < src_height ? 2 * y + 1 : src_height - 1;
+        const uint8_t *row0 = src + (size_t) y0 * src_width * 4;
+        const uint8_t *row1 = src + (size_t) y1 * src_width * 4;
+
+        for (uint32_t x = 0; x < dst_width; x++) {
+            uint32_t x0 = (2 * x < src_width ? 2 * x : src_width - 1) * 4;
+            uint32_t x1 = (2 * x + 1 < src_width ? 2 * x + 1 : src_width - 1) * 4;
+            uint8_t *out = dst + ((size_t) y * dst_width + x) * 4;
+
+            for (uint32_t c = 0; c < 4; c++) {
+                uint32_t sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+                out[c] = (uint8_t) ((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+/* Down to 1x1 with mips */
+static uint32_t texture_cache_n_levels(uint32_t width, uint32_t height, bool mips)
+{
+    uint32_t largest = width > height ? width : height;
+    uint32_t n_levels = 1;
+    while (mips && n_levels < STEX_MAX_LEVELS && (largest >> n_levels) > 0)
+        n_levels++;
+
+    return n_levels;
+}
+
+static uint32_t texture_cache_level_size(uint32_t size, uint32_t level)
+{
+    return size >> level ? size >> level : 1;
+}
+
+static size_t stex_align(size_t offset)
+{
+    return (offset + STEX_ALIGNMENT - 1) & ~((size_t) STEX_ALIGNMENT - 1);
+}
+
+static double texture_cache_elapsed_ms(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start.tv_sec) * 1000.0 +
+           (double) (now.tv_nsec - start.tv_nsec) / 1000000.0;
+}
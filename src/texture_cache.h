@@ -0,0 +1,88 @@
+#ifndef SAGE_TEXTURE_CACHE_H
+#define SAGE_TEXTURE_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "file.h"
+#include "texture.h"
+
+/*
+ * Decoded texture cache (.stex)
+ *
+ * Decoding an image, building its mips & compressing them is most of what
+ * creating a texture costs, so the result is kept in SAGE_CACHE_DIR as the
+ * pixels of every level, each ready to be handed to GL from the mapping. The
+ * cache is keyed by a hash of the encoded file rather than its path, so an
+ * edited image is decoded again & identical images share one entry.
+ * Cooked archives store their textures in the same layout, see pak.h.
+ */
+
+#define STEX_MAGIC   0x58455453 /* "STEX" */
+/* Bumped whenever the layout or how the levels are built changes */
+#define STEX_VERSION 3
+
+#define STEX_MAX_LEVELS 16
+/* levels start on this boundary so they can be read in place */
+#define STEX_ALIGNMENT 16
+
+/* How an image was built, part of what the cache is keyed by */
+#define STEX_FLIPPED    0x1     /* rows flipped like texture_create() does */
+#define STEX_MIPS       0x2     /* every level down to 1x1 */
+#define STEX_MASK       0x4     /* built for TEXTURE_ROLE_MASK */
+#define STEX_COMPRESSED 0x8     /* block compressed, see texture_compress.h */
+#define STEX_PACKED     0x10    /* two masks in r & g, see texture_cache_load_packed() */
+
+struct stex_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_hash;   /* of the encoded image */
+    uint64_t source_size;
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;      /* of the encoded image */
+    uint32_t n_levels;      /* 1 without mips, else down to 1x1 */
+    uint32_t flags;         /* STEX_* */
+    uint32_t format;        /* enum texture_format of every level */
+    uint64_t level_offsets[STEX_MAX_LEVELS]; /* from the start of the header */
+};
+
+/* The levels of an image, either a mapped cache file or built right after
+   decoding on a miss. Made on any thread, uploaded on the one with GL */
+struct texture_cache_file {
+    struct mapped_file file;
+};
+
+/* The STEX_* flags an image is built with, compressed when sage is built with
+   SAGE_TEXTURE_COMPRESSION & the GPU supports it. 'mips' builds every level
+   down to 1x1, cubemap faces go without */
+uint32_t texture_cache_flags(bool flip, bool mips, enum texture_role role);
+
+/* Loads the levels of the image at 'path' from the cache, decoding it & adding
+   it to the cache on a miss. Returns false if the image can't be read or
+   decoded */
+bool texture_cache_load(const char *path, uint32_t flags, struct texture_cache_file *cache);
+/* Same as texture_cache_load() for the masks at 'red_path' & 'green_path'
+   packed into one image, keyed by both files. A NULL path is a mask of white.
+   False if either can't be decoded or they aren't the same size */
+bool texture_cache_load_packed(const char *red_path, const char *green_path, uint32_t flags,
+                               struct texture_cache_file *cache);
+/* Replaces every level of the texture 'id', or a face of the cubemap 'id', &
+   closes the cache file. Needs the GL context */
+void texture_cache_upload(struct texture_cache_file *cache, uint32_t id);
+void texture_cache_upload_face(struct texture_cache_file *cache, uint32_t id, uint32_t face);
+void texture_cache_close(struct texture_cache_file *cache);
+
+/* Views into the levels of a .stex, returns how many there are */
+uint32_t texture_cache_levels(const struct stex_header *header,
+                              struct texture_image levels[STEX_MAX_LEVELS]);
+
+/* Builds the .stex of a decoded image, malloc'd, NULL on failure */
+void *texture_cache_build(const struct texture_image *image, uint32_t flags,
+                          uint64_t source_hash, uint64_t source_size, size_t *size);
+/* Checks that 'size' bytes at 'data' are a complete .stex of this version,
+   'name' is for the logs */
+bool texture_cache_validate(const void *data, size_t size, const char *name);
+
+#endif /* SAGE_TEXTURE_CACHE_H */
@@ -0,0 +1,344 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "texture_compress.h"
+#include "config.h"
+
+/* Upper bound on the threads compressing a single image */
+#define TEXTURE_COMPRESS_MAX_THREADS 8
+/* Rows of blocks a thread gets atleast, smaller images aren't worth spawning
+   threads for */
+#define TEXTURE_COMPRESS_MIN_ROWS 32
+/* Largest difference between the channels of a pixel of a grayscale image,
+   jpeg leaves some noise in the chroma */
+#define TEXTURE_GRAY_TOLERANCE 8
+
+/* The rows of blocks one thread compresses */
+struct texture_compress_job {
+    const uint8_t *rgba;
+    uint32_t width;
+    uint32_t height;
+    enum texture_format format;
+    uint8_t *out;
+    uint32_t first_row;
+    uint32_t end_row;
+};
+
+static void *texture_compress_rows(void *arg);
+static void texture_fetch_block(const uint8_t *rgba, uint32_t width, uint32_t height,
+                                uint32_t block_x, uint32_t block_y, uint8_t block[64]);
+static void texture_encode_bc1(const uint8_t block[64], uint8_t out[8]);
+static void texture_encode_bc4(const uint8_t block[64], uint32_t channel, uint8_t out[8]);
+static uint16_t texture_pack_565(const uint8_t color[3]);
+static void texture_unpack_565(uint16_t packed, uint8_t color[3]);
+static uint32_t texture_block_size(enum texture_format format);
+static uint32_t texture_compress_thread_count(uint32_t block_rows);
+
+size_t texture_format_level_size(enum texture_format format, uint32_t width, uint32_t height)
+{
+    if (format == TEXTURE_FORMAT_RGBA8) return (size_t) width * height * 4;
+    if (format == TEXTURE_FORMAT_RG8) return (size_t) width * height * 2;
+    if (format == TEXTURE_FORMAT_R8) return (size_t) width * height;
+
+    size_t blocks_x = (width + 3) / 4;
+    size_t blocks_y = (height + 3) / 4;
+    return blocks_x * blocks_y * texture_block_size(format);
+}
+
+enum texture_format texture_format_pick(const uint8_t *rgba, size_t n_pixels,
+                                        enum texture_role role, bool compressed)
+{
+    /* only r & g are read, whatever the images were */
+    if (role == TEXTURE_ROLE_PACKED) return compressed ? TEXTURE_FORMAT_BC5 : TEXTURE_FORMAT_RG8;
+
+    bool opaque = true;
+    bool gray = true;
+    for (size_t i = 0; i < n_pixels; i++) {
+        const uint8_t *p = rgba + i * 4;
+        if (p[3] != 255) opaque = false;
+        if (abs(p[0] - p[1]) > TEXTURE_GRAY_TOLERANCE || abs(p[0] - p[2]) > TEXTURE_GRAY_TOLERANCE)
+            gray = false;
+    }
+
+    /* masks are sampled as rgb, their alpha is never read */
+    if (!compressed)
+        return (role == TEXTURE_ROLE_MASK && gray) ? TEXTURE_FORMAT_R8 : TEXTURE_FORMAT_RGBA8;
+    if (role == TEXTURE_ROLE_MASK) return gray ? TEXTURE_FORMAT_BC4 : TEXTURE_FORMAT_BC1;
+
+    return opaque ? TEXTURE_FORMAT_BC1 : TEXTURE_FORMAT_BC3;
+}
+
+void texture_compress(const uint8_t *rgba, uint32_t width, uint32_t height,
+                      enum texture_format format, uint8_t *out)
+{
+    uint32_t block_rows = (height + 3) / 4;
+    uint32_t n_threads = texture_compress_thread_count(block_rows);
+
+    struct texture_compress_job jobs[TEXTURE_COMPRESS_MAX_THREADS];
+    for (uint32_t i = 0; i < n_threads; i++) {
+        jobs[i] = (struct texture_compress_job) {
+            .rgba = rgba,
+            .width = width,
+            .height = height,
+            .format = format,
+            .out = out,
+            .first_row = (uint32_t) ((uint64_t) block_rows * i / n_threads),
+            .end_row = (uint32_t) ((uint64_t) block_rows * (i + 1) / n_threads),
+        };
+    }
+
+    /* the first rows are compressed on the calling thread, a thread that
+       can't be spawned has its rows compressed there too */
+    pthread_t threads[TEXTURE_COMPRESS_MAX_THREADS];
+    bool spawned[TEXTURE_COMPRESS_MAX_THREADS] = {0};
+    for (uint32_t i = 1; i < n_threads; i++)
+        spawned[i] = pthread_create(&threads[i], NULL, texture_compress_rows, &jobs[i]) == 0;
+
+    texture_compress_rows(&jobs[0]);
+
+    for (uint32_t i = 1; i < n_threads; i++) {
+        if (spawned[i])
+            pthread_join(threads[i], NULL);
+        else
+            texture_compress_rows(&jobs[i]);
+    }
+}
+
+static void *texture_compress_rows(void *arg)
+{
+    const struct texture_compress_job *job = arg;
+    uint32_t blocks_x = (job->width + 3) / 4;
+    uint32_t block_size = texture_block_size(job->format);
+
+    uint8_t block[64];
+    for (uint32_t y = job->first_row; y < job->end_row; y++) {
+        uint8_t *out = job->out + (size_t) y * blocks_x * block_size;
+
+        for (uint32_t x = 0; x < blocks_x; x++, out += block_size) {
+            texture_fetch_block(job->rgba, job->width, job->height, x, y, block);
+
+            switch (job->format) {
+            case TEXTURE_FORMAT_BC1:
+                texture_encode_bc1(block, out);
+                break;
+            case TEXTURE_FORMAT_BC3:
+                texture_encode_bc4(block, 3, out);
+                texture_encode_bc1(block, out + 8);
+                break;
+            case TEXTURE_FORMAT_BC4:
+                texture_encode_bc4(block, 0, out);
+                break;
+            case TEXTURE_FORMAT_BC5:
+                texture_encode_bc4(block, 0, out);
+                texture_encode_bc4(block, 1, out + 8);
+                break;
+            case TEXTURE_FORMAT_RGBA8:
+            case TEXTURE_FORMAT_R8:
+            case TEXTURE_FORMAT_RG8:
+                break;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void texture_fetch_block(const uint8_t *rgba, uint32_t width, uint32_t height,
+                                uint32_t block_x, uint32_t block_y, uint8_t block[64])
+{
+    for (uint32_t y = 0; y < 4; y++) {
+        uint32_t src_y = block_y * 4 + y < height ? block_y * 4 + y : height - 1;
+
+        for (uint32_t x = 0; x < 4; x++) {
+            uint32_t src_x = block_x * 4 + x < width ? block_x * 4 + x : width - 1;
+            memcpy(block + (y * 4 + x) * 4, rgba + ((size_t) src_y * width + src_x) * 4, 4);
+        }
+    }
+}
+
+/* Two 565 endpoints & a 2 bit index per pixel into them & the two colors
+   between them. The first endpoint is always the bigger one, which is what
+   makes it 4 colors without any transparent one */
+static void texture_encode_bc1(const uint8_t block[64], uint8_t out[8])
+{
+    uint8_t min[3] = {255, 255, 255};
+    uint8_t max[3] = {0, 0, 0};
+    for (uint32_t i = 0; i < 16; i++) {
+        for (uint32_t c = 0; c < 3; c++) {
+            if (block[i * 4 + c] < min[c]) min[c] = block[i * 4 + c];
+            if (block[i * 4 + c] > max[c]) max[c] = block[i * 4 + c];
+        }
+    }
+
+    /* the outliers that made the box are rarely worth an endpoint on their own */
+    for (uint32_t c = 0; c < 3; c++) {
+        uint8_t inset = (uint8_t) ((max[c] - min[c]) >> 4);
+        min[c] = (uint8_t) (min[c] + inset);
+        max[c] = (uint8_t) (max[c] - inset);
+    }
+
+    /* the endpoints go along one of the 4 diagonals of the box, the one green
+       & blue follow red on, like Ignacio Castano's select diagonal */
+    int32_t center[3];
+    for (uint32_t c = 0; c < 3; c++) center[c] = (min[c] + max[c]) / 2;
+
+    int32_t covariance[3] = {0, 0, 0};
+    for (uint32_t i = 0; i < 16; i++) {
+        int32_t r = block[i * 4] - center[0];
+        covariance[1] += r * (block[i * 4 + 1] - center[1]);
+        covariance[2] += r * (block[i * 4 + 2] - center[2]);
+    }
+
+    for (uint32_t c = 1; c < 3; c++) {
+        if (covariance[c] >= 0) continue;
+        uint8_t swap = min[c];
+        min[c] = max[c];
+        max[c] = swap;
+    }
+
+    uint16_t color0 = texture_pack_565(max);
+    uint16_t color1 = texture_pack_565(min);
+    if (color0 < color1) {
+        uint16_t swap = color0;
+        color0 = color1;
+        color1 = swap;
+    }
+
+    uint8_t palette[4][3];
+    texture_unpack_565(color0, palette[0]);
+    texture_unpack_565(color1, palette[1]);
+    for (uint32_t c = 0; c < 3; c++) {
+        palette[2][c] = (uint8_t) ((2 * palette[0][c] + palette[1][c] + 1) / 3);
+        palette[3][c] = (uint8_t) ((palette[0][c] + 2 * palette[1][c] + 1) / 3);
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        for (uint32_t i = 0; i < 16; i++) {
+            uint32_t best = 0;
+            int32_t best_distance = INT32_MAX;
+            for (uint32_t j = 0; j < 4; j++) {
+                int32_t distance = 0;
+                for (uint32_t c = 0; c < 3; c++) {
+                    int32_t d = block[i * 4 + c] - palette[j][c];
+                    distance += d * d;
+                }
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best = j;
+                }
+            }
+            indices |= best << (i * 2);
+        }
+    }
+
+    out[0] = (uint8_t) (color0 & 0xFF);
+    out[1] = (uint8_t) (color0 >> 8);
+    out[2] = (uint8_t) (color1 & 0xFF);
+    out[3] = (uint8_t) (color1 >> 8);
+    for (uint32_t i = 0; i < 4; i++) out[4 + i] = (uint8_t) (indices >> (i * 8));
+}
+
+/* Two 8 bit endpoints & a 3 bit index per pixel into them & the six values
+   between them, of one channel of the block */
+static void texture_encode_bc4(const uint8_t block[64], uint32_t channel, uint8_t out[8])
+{
+    uint8_t min = 255;
+    uint8_t max = 0;
+    for (uint32_t i = 0; i < 16; i++) {
+        uint8_t value = block[i * 4 + channel];
+        if (value < min) min = value;
+        if (value > max) max = value;
+    }
+
+    uint8_t inset = (uint8_t) ((max - min) >> 5);
+    min = (uint8_t) (min + inset);
+    max = (uint8_t) (max - inset);
+
+    /* max > min picks the mode with 8 values, a flat block has only index 0 */
+    uint8_t palette[8];
+    palette[0] = max;
+    palette[1] = min;
+    for (uint32_t i = 2; i < 8; i++)
+        palette[i] = (uint8_t) (((8 - i) * max + (i - 1) * min + 3) / 7);
+
+    uint64_t indices = 0;
+    if (max != min) {
+        for (uint32_t i = 0; i < 16; i++) {
+            uint8_t value = block[i * 4 + channel];
+            uint64_t best = 0;
+            int32_t best_distance = INT32_MAX;
+            for (uint32_t j = 0; j < 8; j++) {
+                int32_t distance = abs(value - palette[j]);
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best = j;
+                }
+            }
+            indices |= best << (i * 3);
+        }
+    }
+
+    out[0] = max;
+    out[1] = min;
+    for (uint32_t i = 0; i < 6; i++) out[2 + i] = (uint8_t) (indices >> (i * 8));
+}
+
+/* Rounds to the nearest 565 color rather than truncating */
+static uint16_t texture_pack_565(const uint8_t color[3])
+{
+    uint32_t r = ((uint32_t) color[0] * 31 + 127) / 255;
+    uint32_t g = ((uint32_t) color[1] * 63 + 127) / 255;
+    uint32_t b = ((uint32_t) color[2] * 31 + 127) / 255;
+    return (uint16_t) ((r << 11) | (g << 5) | b);
+}
+
+/* The way the GPU expands the endpoints, bits repeated into the low ones */
+static void texture_unpack_565(uint16_t packed, uint8_t color[3])
+{
+    uint32_t r = (packed >> 11) & 31;
+    uint32_t g = (packed >> 5) & 63;
+    uint32_t b = packed & 31;
+    color[0] = (uint8_t) ((r << 3) | (r >> 2));
+    color[1] = (uint8_t) ((g << 2) | (g >> 4));
+    color[2] = (uint8_t) ((b << 3) | (b >> 2));
+}
+
+static uint32_t texture_block_size(enum texture_format format)
+{
+    switch (format) {
+    case TEXTURE_FORMAT_BC1:
+    case TEXTURE_FORMAT_BC4:
+        return 8;
+    case TEXTURE_FORMAT_BC3:
+    case TEXTURE_FORMAT_BC5:
+        return 16;
+    case TEXTURE_FORMAT_RGBA8:
+    case TEXTURE_FORMAT_R8:
+    case TEXTURE_FORMAT_RG8:
+        break;
+    }
+
+    return 64;
+}
+
+/* SAGE_TEXTURE_COMPRESS_THREADS, 0 picks one per core */
+static uint32_t texture_compress_thread_count(uint32_t block_rows)
+{
+    uint32_t n_threads = SAGE_TEXTURE_COMPRESS_THREADS;
+    if (n_threads == 0) {
+        long n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = (n_cores > 0) ? (uint32_t) n_cores : 1;
+    }
+
+    uint32_t n_useful = block_rows / TEXTURE_COMPRESS_MIN_ROWS;
+    if (n_useful < n_threads) n_threads = n_useful;
+
+    if (n_threads < 1) n_threads = 1;
+    if (n_threads > TEXTURE_COMPRESS_MAX_THREADS) n_threads = TEXTURE_COMPRESS_MAX_THREADS;
+
+    return n_threads;
+}
@@ -0,0 +1,42 @@
+#ifndef SAGE_TEXTURE_COMPRESS_H
+#define SAGE_TEXTURE_COMPRESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "texture.h"
+
+/*
+ * Block compression
+ *
+ * A CPU encoder for the BCn formats every desktop GPU samples natively. Each
+ * 4x4 block of pixels is stored in 8 or 16 bytes instead of 64, which is what
+ * the texture takes up in VRAM & what sampling it reads:
+ *     BC1    rgb, 8 bytes a block             colors without alpha
+ *     BC3    rgba, BC1 + a BC4 alpha block    colors with alpha
+ *     BC4    r, 8 bytes a block               grayscale masks like specular maps
+ *     BC5    rg, two BC4 blocks               two channel maps
+ * The endpoints of a block are the ends of the diagonal of its bounding box
+ * the colors lie along, inset a little like J.M.P. van Waveren's real-time
+ * DXT compressor, which is fast enough to run the first time an image is
+ * loaded. Rows of blocks are spread over threads.
+ */
+
+/* Bytes of a level of 'width' x 'height' pixels in 'format' */
+size_t texture_format_level_size(enum texture_format format, uint32_t width, uint32_t height);
+
+/* The smallest format an image of 'n_pixels' RGBA8 pixels keeps what its
+   role samples in: BC1 or BC3 if any pixel isn't opaque, BC4 for grayscale
+   masks & BC5 for packed ones. Without 'compressed' grayscale masks are R8,
+   packed ones RG8 & the rest stays RGBA8 */
+enum texture_format texture_format_pick(const uint8_t *rgba, size_t n_pixels,
+                                        enum texture_role role, bool compressed);
+
+/* Compresses 'width' x 'height' RGBA8 pixels into the blocks of 'format',
+   which has to be a BCn one. 'out' holds texture_format_level_size() bytes.
+   Blocks over the edge of the image repeat its last row & column */
+void texture_compress(const uint8_t *rgba, uint32_t width, uint32_t height,
+                      enum texture_format format, uint8_t *out);
+
+#endif /* SAGE_TEXTURE_COMPRESS_H */
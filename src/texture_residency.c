@@ -0,0 +1,325 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "texture_residency.h"
+#include "texture_stream.h"
+#include "darray.h"
+#include "logger.h"
+#include "config.h"
+
+#define RESIDENCY_MB (1024.0 * 1024.0)
+
+struct residency_texture {
+    uint32_t id;
+    struct texture_cache_file cache;    /* every level, to stream them back in */
+    uint32_t n_levels;
+    uint32_t smallest;      /* finest of the mips it starts out with */
+    uint32_t resident;      /* finest level on the GPU */
+    uint32_t size;          /* larger side of level 0 */
+    uint64_t bytes[STEX_MAX_LEVELS + 1];    /* of the levels from each one on */
+
+    float screen_size;      /* largest the current frame draws it */
+    uint64_t last_used;     /* frame it was last drawn in */
+};
+
+struct texture_residency {
+    darray *textures;       /* struct residency_texture */
+    uint32_t *slots;        /* index + 1 into 'textures' by texture id, 0 if unmanaged */
+    uint32_t n_slots;
+    uint64_t frame;
+    float viewport_height;
+    struct texture_residency_stats stats;
+};
+
+static struct texture_residency residency;
+
+static bool residency_track(uint32_t id, size_t index);
+static uint32_t residency_wanted_level(const struct residency_texture *texture);
+static uint32_t residency_floor_level(const struct residency_texture *texture);
+static bool residency_make_room(uint64_t bytes, const struct residency_texture *keep);
+static bool residency_upload(struct residency_texture *texture, uint32_t level, bool stream);
+static int residency_compare_demand(const void *a, const void *b);
+
+bool texture_residency_manage(struct texture_cache_file *cache, uint32_t id)
+{
+#if SAGE_TEXTURE_BUDGET_MB == 0
+    (void) cache;
+    (void) id;
+    return false;
+#else
+    struct texture_image levels[STEX_MAX_LEVELS];
+    uint32_t n_levels = texture_cache_levels(cache->file.data, levels);
+
+    uint32_t smallest = 0;
+    while (smallest + 1 < n_levels &&
+           (levels[smallest].width > SAGE_TEXTURE_RESIDENT_SIZE ||
+            levels[smallest].height > SAGE_TEXTURE_RESIDENT_SIZE))
+        smallest++;
+    if (smallest == 0) return false;
+
+    if (residency.textures == NULL) {
+        residency.textures = darray_alloc(sizeof(struct residency_texture), 64);
+        if (residency.textures == NULL) {
+            SERROR("Failed to alloc memory for the texture residency, uploading every mip");
+            return false;
+        }
+    }
+
+    texture_residency_forget(id);
+
+    struct residency_texture texture;
+    memset(&texture, 0, sizeof(texture));
+    texture.id = id;
+    texture.cache = *cache;
+    texture.n_levels = n_levels;
+    texture.smallest = smallest;
+    texture.resident = n_levels;
+    texture.size = (uint32_t) ((levels[0].width > levels[0].height) ? levels[0].width : levels[0].height);
+    texture.last_used = residency.frame;
+
+    uint64_t bytes = 0;
+    for (uint32_t i = n_levels; i-- > 0;) {
+        bytes += levels[i].size;
+        texture.bytes[i] = bytes;
+    }
+
+    if (!residency_track(id, residency.textures->len)) return false;
+    darray_push(residency.textures, &texture);
+
+    /* nothing is resident yet, its smallest mips go up regardless of the budget */
+    struct residency_texture *managed = darray_at(residency.textures, residency.textures->len - 1);
+    residency_upload(managed, smallest, false);
+
+    residency.stats.n_textures++;
+    residency.stats.full_bytes += texture.bytes[0];
+
+    return true;
+#endif
+}
+
+void texture_residency_forget(uint32_t id)
+{
+    if (id >= residency.n_slots || residency.slots[id] == 0) return;
+
+    size_t index = residency.slots[id] - 1;
+    struct residency_texture *textures = residency.textures->items;
+    struct residency_texture *texture = &textures[index];
+
+    residency.stats.n_textures--;
+    residency.stats.full_bytes -= texture->bytes[0];
+    residency.stats.resident_bytes -= texture->bytes[texture->resident];
+    texture_cache_close(&texture->cache);
+    residency.slots[id] = 0;
+
+    /* the last one takes its place */
+    struct residency_texture *last = darray_pop(residency.textures);
+    if (index < residency.textures->len) {
+        textures[index] = *last;
+        residency.slots[textures[index].id] = (uint32_t) index + 1;
+    }
+}
+
+void texture_residency_use(struct texture texture, float screen_size)
+{
+    if (texture.id >= residency.n_slots || residency.slots[texture.id] == 0) return;
+
+    struct residency_texture *managed = darray_at(residency.textures, residency.slots[texture.id] - 1);
+    if (screen_size > managed->screen_size) managed->screen_size = screen_size;
+    managed->last_used = residency.frame;
+}
+
+void texture_residency_update(float viewport_height)
+{
+    if (residency.textures == NULL || residency.textures->len == 0) {
+        residency.frame++;
+        return;
+    }
+
+    residency.viewport_height = viewport_height;
+    struct residency_texture *textures = residency.textures->items;
+    size_t n_textures = residency.textures->len;
+
+    /* the ones seen biggest compared to the mips they have go first */
+    uint32_t *order = malloc(n_textures * sizeof(uint32_t));
+    if (order == NULL) {
+        SERROR("Failed to alloc memory for streaming the mips of %zu textures", n_textures);
+        residency.frame++;
+        return;
+    }
+    for (size_t i = 0; i < n_textures; i++) order[i] = (uint32_t) i;
+    qsort(order, n_textures, sizeof(uint32_t), residency_compare_demand);
+
+    uint64_t quota = (uint64_t) (SAGE_TEXTURE_STREAM_MB_PER_FRAME * RESIDENCY_MB);
+    uint64_t streamed = 0;
+    for (size_t i = 0; i < n_textures; i++) {
+        struct residency_texture *texture = &textures[order[i]];
+        if (texture->last_used != residency.frame) break;
+
+        uint32_t wanted = residency_wanted_level(texture);
+        if (wanted >= texture->resident) continue;
+
+        /* the whole chain is uploaded again, not just the new mips */
+        if (streamed > 0 && streamed + texture->bytes[wanted] > quota) continue;
+
+        /* the finest mips that fit in the budget if the wanted ones don't */
+        while (wanted < texture->resident &&
+               !residency_make_room(texture->bytes[wanted] - texture->bytes[texture->resident], texture))
+            wanted++;
+        if (wanted == texture->resident) continue;
+
+        /* the pixel buffers are all in flight, the rest waits for next frame */
+        if (!residency_upload(texture, wanted, true)) break;
+        streamed += texture->bytes[wanted];
+        residency.stats.n_streamed++;
+    }
+    free(order);
+
+    for (size_t i = 0; i < n_textures; i++) textures[i].screen_size = 0.0f;
+    residency.frame++;
+}
+
+struct texture_residency_stats texture_residency_stats(void)
+{
+    return residency.stats;
+}
+
+void texture_residency_shutdown(void)
+{
+    if (residency.textures == NULL) return;
+
+    if (residency.stats.n_streamed > 0 || residency.stats.n_evicted > 0)
+        SINFO("Texture residency peaked at %.2f MB of %.2f MB with every mip, "
+              "streamed in mips %u times & evicted them %u times",
+              (double) residency.stats.peak_bytes / RESIDENCY_MB,
+              (double) residency.stats.full_bytes / RESIDENCY_MB,
+              residency.stats.n_streamed, residency.stats.n_evicted);
+
+    struct residency_texture *textures = residency.textures->items;
+    for (size_t i = 0; i < residency.textures->len; i++)
+        texture_cache_close(&textures[i].cache);
+
+    darray_free(residency.textures);
+    free(residency.slots);
+    memset(&residency, 0, sizeof(residency));
+}
+
+/* Points the slot of 'id' at 'index', growing the slots to fit it */
+static bool residency_track(uint32_t id, size_t index)
+{
+    if (id >= residency.n_slots) {
+        uint32_t n_slots = (residency.n_slots > 0) ? residency.n_slots : 64;
+        while (n_slots <= id) n_slots *= 2;
+
+        uint32_t *slots = realloc(residency.slots, n_slots * sizeof(uint32_t));
+        if (slots == NULL) {
+            SERROR("Failed to alloc memory for the texture residency, uploading every mip");
+            return false;
+        }
+        memset(slots + residency.n_slots, 0, (n_slots - residency.n_slots) * sizeof(uint32_t));
+        residency.slots = slots;
+        residency.n_slots = n_slots;
+    }
+
+    residency.slots[id] = (uint32_t) index + 1;
+    return true;
+}
+
+/* The coarsest level that still has a texel for every pixel it covers */
+static uint32_t residency_wanted_level(const struct residency_texture *texture)
+{
+    float pixels = texture->screen_size * residency.viewport_height;
+
+    uint32_t level = 0;
+    while (level < texture->smallest && (float) (texture->size >> (level + 1)) >= pixels)
+        level++;
+
+    return level;
+}
+
+/* How far the mips of a texture can be evicted, what the last frame needed
+   if it was drawn */
+static uint32_t residency_floor_level(const struct residency_texture *texture)
+{
+    return (texture->last_used == residency.frame) ? residency_wanted_level(texture)
+                                                   : texture->smallest;
+}
+
+/* Evicts the mips of the least recently drawn textures other than 'keep'
+   until 'bytes' more fit in the budget. Nothing is evicted if they wouldn't */
+static bool residency_make_room(uint64_t bytes, const struct residency_texture *keep)
+{
+    uint64_t budget = (uint64_t) (SAGE_TEXTURE_BUDGET_MB * RESIDENCY_MB);
+    if (residency.stats.resident_bytes + bytes <= budget) return true;
+
+    struct residency_texture *textures = residency.textures->items;
+    size_t n_textures = residency.textures->len;
+
+    uint64_t evictable = 0;
+    for (size_t i = 0; i < n_textures; i++) {
+        if (&textures[i] == keep) continue;
+        uint32_t floor = residency_floor_level(&textures[i]);
+        if (textures[i].resident < floor)
+            evictable += textures[i].bytes[textures[i].resident] - textures[i].bytes[floor];
+    }
+    if (residency.stats.resident_bytes - evictable + bytes > budget) return false;
+
+    while (residency.stats.resident_bytes + bytes > budget) {
+        struct residency_texture *victim = NULL;
+        for (size_t i = 0; i < n_textures; i++) {
+            if (&textures[i] == keep || textures[i].resident >= residency_floor_level(&textures[i]))
+                continue;
+            if (victim == NULL || textures[i].last_used < victim->last_used) victim = &textures[i];
+        }
+        if (victim == NULL) return false;
+
+        /* smaller levels are uploaded directly, they're never held up by the ring */
+        residency_upload(victim, residency_floor_level(victim), false);
+        residency.stats.n_evicted++;
+        SDEBUG("Evicted the mips of texture %u down to level %u", victim->id, victim->resident);
+    }
+
+    return true;
+}
+
+/* Replaces the levels of the texture with the ones from 'level' on, false
+   if they're streamed & the pixel buffers are busy */
+static bool residency_upload(struct residency_texture *texture, uint32_t level, bool stream)
+{
+    struct texture_image levels[STEX_MAX_LEVELS];
+    texture_cache_levels(texture->cache.file.data, levels);
+
+    uint32_t n_levels = texture->n_levels - level;
+    if (stream) {
+        if (!texture_stream_upload_levels(texture->id, levels + level, n_levels)) return false;
+    } else {
+        texture_upload_levels(texture->id, levels + level, n_levels);
+    }
+
+    /* bytes[n_levels] is 0, for when nothing was resident yet */
+    residency.stats.resident_bytes -= texture->bytes[texture->resident];
+    residency.stats.resident_bytes += texture->bytes[level];
+    if (residency.stats.resident_bytes > residency.stats.peak_bytes)
+        residency.stats.peak_bytes = residency.stats.resident_bytes;
+
+    texture->resident = level;
+    return true;
+}
+
+/* Drawn this frame first, then by how many times too small their resident
+   mips are for what they cover */
+static int residency_compare_demand(const void *a, const void *b)
+{
+    const struct residency_texture *textures = residency.textures->items;
+    const struct residency_texture *ta = &textures[*(const uint32_t *) a];
+    const struct residency_texture *tb = &textures[*(const uint32_t *) b];
+
+    bool used_a = (ta->last_used == residency.frame);
+    bool used_b = (tb->last_used == residency.frame);
+    if (used_a != used_b) return used_a ? -1 : 1;
+
+    float demand_a = ta->screen_size * (float) (1u << ta->resident) / (float) ta->size;
+    float demand_b = tb->screen_size * (float) (1u << tb->resident) / (float) tb->size;
+    if (demand_a != demand_b) return (demand_a > demand_b) ? -1 : 1;
+
+    return 0;
+}
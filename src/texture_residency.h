@@ -0,0 +1,54 @@
+#ifndef SAGE_TEXTURE_RESIDENCY_H
+#define SAGE_TEXTURE_RESIDENCY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "texture.h"
+#include "texture_cache.h"
+
+/*
+ * Texture residency
+ *
+ * Keeps the VRAM textures take under SAGE_TEXTURE_BUDGET_MB by only having
+ * the mips on the GPU that are seen. A texture starts out with its mips of
+ * atmost SAGE_TEXTURE_RESIDENT_SIZE pixels & keeps its .stex mapped, the
+ * draws of a frame report how big each texture is on screen & the next frame
+ * streams in the finer mips they need through the pixel buffers of
+ * texture_stream.h. Past the budget the least recently seen textures drop
+ * back to the mips they need, or to their smallest ones if they weren't seen.
+ *
+ * The resident mips are uploaded as the levels of the texture starting from
+ * 0, so uvs & the id stay the same whichever are on the GPU. Only the render
+ * thread uses it.
+ */
+
+/* What the managed textures take up */
+struct texture_residency_stats {
+    uint32_t n_textures;
+    uint64_t resident_bytes;
+    uint64_t peak_bytes;
+    uint64_t full_bytes;        /* with every mip resident */
+    uint32_t n_streamed;        /* times mips were streamed in */
+    uint32_t n_evicted;         /* times mips were given back */
+};
+
+/* Takes over 'cache' & uploads only its smallest mips into the texture 'id'.
+   False if the texture is too small to be worth it or residency is off, the
+   caller uploads & closes 'cache' itself then */
+bool texture_residency_manage(struct texture_cache_file *cache, uint32_t id);
+/* Stops managing 'id', before the texture is deleted */
+void texture_residency_forget(uint32_t id);
+
+/* Records that 'texture' was drawn covering 'screen_size' of the screen's
+   height, for the frame after this one */
+void texture_residency_use(struct texture texture, float screen_size);
+/* Streams in & evicts mips for what the last frame drew onto a screen of
+   'viewport_height' pixels, once at the start of a frame */
+void texture_residency_update(float viewport_height);
+
+struct texture_residency_stats texture_residency_stats(void);
+/* Closes the .stex of the textures still managed */
+void texture_residency_shutdown(void);
+
+#endif /* SAGE_TEXTURE_RESIDENCY_H */
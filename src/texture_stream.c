@@ -0,0 +1,196 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <glad/gl.h>
+
+#include "texture_stream.h"
+#include "config.h"
+#include "gl_state.h"
+
+#define TEXTURE_STREAM_BUFFER_SIZE ((size_t) SAGE_TEXTURE_PBO_SIZE_MB * 1024 * 1024)
+/* levels start on this boundary within a buffer */
+#define TEXTURE_STREAM_ALIGNMENT 16
+
+struct texture_stream_buffer {
+    uint32_t pbo;
+    GLsync fence;           /* of the last upload from it, NULL once done */
+};
+
+struct texture_stream {
+    bool active;
+    struct texture_stream_buffer buffers[SAGE_TEXTURE_PBO_COUNT];
+    uint32_t next;
+    struct texture_stream_stats stats;
+};
+
+/* only touched on the render thread */
+static struct texture_stream stream;
+
+static bool texture_stream_stage(struct texture_image *levels, uint32_t n_levels,
+                                 struct texture_stream_buffer **staged);
+static void texture_stream_finish(struct texture_stream_buffer *staged,
+                                  const struct texture_image *levels, uint32_t n_levels,
+                                  struct timespec start);
+static double texture_stream_elapsed_ms(struct timespec start);
+
+void texture_stream_init(void)
+{
+    if (stream.active) return;
+    memset(&stream, 0, sizeof(stream));
+
+    for (uint32_t i = 0; i < SAGE_TEXTURE_PBO_COUNT; i++) {
+        glGenBuffers(1, &stream.buffers[i].pbo);
+        gl_state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, stream.buffers[i].pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, TEXTURE_STREAM_BUFFER_SIZE, NULL, GL_STREAM_DRAW);
+    }
+    gl_state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    stream.active = true;
+}
+
+void texture_stream_shutdown(void)
+{
+    if (!stream.active) return;
+
+    for (uint32_t i = 0; i < SAGE_TEXTURE_PBO_COUNT; i++) {
+        if (stream.buffers[i].fence) glDeleteSync(stream.buffers[i].fence);
+        gl_state_forget_buffer(stream.buffers[i].pbo);
+        glDeleteBuffers(1, &stream.buffers[i].pbo);
+    }
+
+    stream.active = false;
+}
+
+bool texture_stream_upload(struct texture_cache_file *cache, uint32_t id)
+{
+    struct texture_image levels[STEX_MAX_LEVELS];
+    uint32_t n_levels = texture_cache_levels(cache->file.data, levels);
+    if (!texture_stream_upload_levels(id, levels, n_levels)) return false;
+
+    texture_cache_close(cache);
+    return true;
+}
+
+bool texture_stream_upload_levels(uint32_t id, const struct texture_image *levels, uint32_t n_levels)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct texture_image staged_levels[STEX_MAX_LEVELS];
+    memcpy(staged_levels, levels, n_levels * sizeof(struct texture_image));
+
+    struct texture_stream_buffer *staged;
+    if (!texture_stream_stage(staged_levels, n_levels, &staged)) return false;
+
+    texture_upload_levels(id, staged_levels, n_levels);
+    texture_stream_finish(staged, levels, n_levels, start);
+
+    return true;
+}
+
+bool texture_stream_upload_face(struct texture_cache_file *cache, uint32_t id, uint32_t face)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* cubemaps are sampled without mips */
+    struct texture_image levels[STEX_MAX_LEVELS];
+    texture_cache_levels(cache->file.data, levels);
+
+    struct texture_stream_buffer *staged;
+    if (!texture_stream_stage(levels, 1, &staged)) return false;
+
+    cubemap_texture_upload_face(id, face, &levels[0]);
+    texture_stream_finish(staged, levels, 1, start);
+    texture_cache_close(cache);
+
+    return true;
+}
+
+struct texture_stream_stats texture_stream_stats(void)
+{
+    return stream.stats;
+}
+
+/* Copies the levels into the next buffer of the ring & points them at their
+   offsets in it, which stays bound for the upload. 'staged' is NULL if they
+   are uploaded directly. False if the buffer is still being read */
+static bool texture_stream_stage(struct texture_image *levels, uint32_t n_levels,
+                                 struct texture_stream_buffer **staged)
+{
+    *staged = NULL;
+    if (!stream.active) return true;
+
+    size_t offsets[STEX_MAX_LEVELS];
+    size_t size = 0;
+    for (uint32_t i = 0; i < n_levels; i++) {
+        offsets[i] = size;
+        size = (size + levels[i].size + TEXTURE_STREAM_ALIGNMENT - 1) &
+               ~((size_t) TEXTURE_STREAM_ALIGNMENT - 1);
+    }
+    if (size > TEXTURE_STREAM_BUFFER_SIZE) return true;
+
+    struct texture_stream_buffer *buffer = &stream.buffers[stream.next];
+    if (buffer->fence) {
+        GLenum status = glClientWaitSync(buffer->fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            stream.stats.n_deferred++;
+            return false;
+        }
+        glDeleteSync(buffer->fence);
+        buffer->fence = NULL;
+    }
+
+    /* the fence has signaled, nothing reads the buffer anymore */
+    gl_state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, buffer->pbo);
+    uint8_t *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr) size,
+                                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+                                       GL_MAP_UNSYNCHRONIZED_BIT);
+    if (mapped == NULL) {
+        gl_state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return true;
+    }
+
+    for (uint32_t i = 0; i < n_levels; i++)
+        memcpy(mapped + offsets[i], levels[i].pixels, levels[i].size);
+
+    /* the contents are undefined if the buffer got lost while mapped */
+    if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE) {
+        gl_state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return true;
+    }
+
+    /* with a buffer bound the pointers are offsets into it */
+    for (uint32_t i = 0; i < n_levels; i++)
+        levels[i].pixels = (uint8_t *) (uintptr_t) offsets[i];
+
+    *staged = buffer;
+    return true;
+}
+
+static void texture_stream_finish(struct texture_stream_buffer *staged,
+                                  const struct texture_image *levels, uint32_t n_levels,
+                                  struct timespec start)
+{
+    if (staged) {
+        gl_state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        staged->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        stream.next = (stream.next + 1) % SAGE_TEXTURE_PBO_COUNT;
+        stream.stats.n_buffered++;
+    }
+
+    stream.stats.n_uploads++;
+    for (uint32_t i = 0; i < n_levels; i++)
+        stream.stats.bytes += levels[i].size;
+
+    stream.stats.ms += texture_stream_elapsed_ms(start);
+}
+
+static double texture_stream_elapsed_ms(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start.tv_sec) * 1000.0 +
+           (double) (now.tv_nsec - start.tv_nsec) / 1000000.0;
+}
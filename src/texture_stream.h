@@ -0,0 +1,45 @@
+#ifndef SAGE_TEXTURE_STREAM_H
+#define SAGE_TEXTURE_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "texture_cache.h"
+
+/*
+ * Streamed texture uploads
+ *
+ * glTexImage2D from client memory has the driver copy the pixels before it
+ * returns. Streamed textures are copied into a ring of pixel buffer objects
+ * instead & uploaded from there, so the driver transfers a buffer while the
+ * next one is filled. Each buffer gets a fence once its upload is issued &
+ * isn't written again until the fence signals, an upload that would have to
+ * wait on it is put off to the next frame instead of stalling this one.
+ * Levels bigger than a buffer are uploaded directly.
+ */
+
+/* What was uploaded since texture_stream_init() */
+struct texture_stream_stats {
+    uint32_t n_uploads;
+    uint32_t n_buffered;    /* of n_uploads, through the ring */
+    uint32_t n_deferred;    /* uploads put off since the next buffer was busy */
+    uint64_t bytes;
+    double ms;              /* spent on the render thread */
+};
+
+/* Creates the ring, needs the GL context. Uploads are direct without it */
+void texture_stream_init(void);
+void texture_stream_shutdown(void);
+
+/* Uploads every level of 'cache' into the texture 'id', or level 0 into a face
+   of the cubemap 'id', & closes it. False if the ring is busy, 'cache' is
+   untouched then & the upload is tried again later */
+bool texture_stream_upload(struct texture_cache_file *cache, uint32_t id);
+bool texture_stream_upload_face(struct texture_cache_file *cache, uint32_t id, uint32_t face);
+/* Replaces the levels of the texture 'id' with 'levels', false if the ring is
+   busy */
+bool texture_stream_upload_levels(uint32_t id, const struct texture_image *levels, uint32_t n_levels);
+
+struct texture_stream_stats texture_stream_stats(void);
+
+#endif /* SAGE_TEXTURE_STREAM_H */
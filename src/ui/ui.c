@@ -24,6 +24,8 @@
 #include "ui_util.h"
 #include "../darray.h"
 #include "../logger.h"
+#include "../asset_loader.h"
+#include "../gl_state.h"
 
 void ui_init(struct ui *ui, struct platform platform)
 {
@@ -62,6 +64,8 @@ void ui_begin_frame(struct ui *ui, struct scene *scene, struct platform *platfor
         snprintf(info_buffer, 128, "%d fps (%.2f ms)", platform->fps, platform->frame_time * 1000);
         nk_layout_row_dynamic(ctx, 25, 1);
         nk_label(ctx, info_buffer, NK_TEXT_LEFT);
+        if (asset_loader_pending() > 0)
+            nk_labelf(ctx, NK_TEXT_LEFT, "Streaming %u assets", asset_loader_pending());
 
         if (nk_tree_push(ctx, NK_TREE_TAB, "Lighting Parameters", NK_MINIMIZED)) {
             nk_bool ambient = scene->lighting_params.enable_ambient;
@@ -86,6 +90,41 @@ void ui_begin_frame(struct ui *ui, struct scene *scene, struct platform *platfor
             ui_vec3_editor_rgb(ctx, scene->clear_color, 0.0f, 255.0f, 1.0f, 0.1f);
             nk_tree_pop(ctx);
         }
+        if (nk_tree_push(ctx, NK_TREE_TAB, "Rendering", NK_MINIMIZED)) {
+            /* the stats are of the last frame since the scene renders after
+               the UI is built */
+            const struct meshlet_stats *stats = &scene->meshlet_stats;
+            float meshlets = stats->meshlets ? (float) stats->meshlets : 1.0f;
+            float triangles = stats->triangles ? (float) stats->triangles : 1.0f;
+
+            nk_bool cone_culling = scene->cone_culling;
+            nk_layout_row_dynamic(ctx, 25, 1);
+            nk_checkbox_label(ctx, "Cull back facing meshlets", &cone_culling);
+            scene->cone_culling = cone_culling;
+
+            nk_labelf(ctx, NK_TEXT_LEFT, "Submeshes culled: %u / %u",
+                      stats->culled_submeshes, stats->submeshes);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Meshlets: %u", stats->meshlets);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Culled back facing: %.1f%%",
+                      stats->culled_backface / meshlets * 100.0f);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Culled by frustum: %.1f%%",
+                      stats->culled_frustum / meshlets * 100.0f);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Triangles drawn: %u / %u (%.1f%%)",
+                      stats->triangles_drawn, stats->triangles,
+                      stats->triangles_drawn / triangles * 100.0f);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Draw ranges: %u", stats->draw_ranges);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Draws queued: %u", scene->render_stats.n_items);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Draw calls: %u", scene->n_batches);
+            nk_labelf(ctx, NK_TEXT_LEFT, "State switches: %u unsorted, %u sorted",
+                      scene->render_stats.unsorted_switches, scene->render_stats.sorted_switches);
+
+            /* since launch, the avoided calls were redundant binds & state */
+            struct gl_state_stats gl_stats = gl_state_stats();
+            double gl_calls = (double) (gl_stats.n_issued + gl_stats.n_avoided);
+            nk_labelf(ctx, NK_TEXT_LEFT, "GL calls avoided: %.1f%%",
+                      gl_calls > 0.0 ? (double) gl_stats.n_avoided / gl_calls * 100.0 : 0.0);
+            nk_tree_pop(ctx);
+        }
     }
     nk_end(ctx);
 
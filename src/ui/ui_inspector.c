@@ -122,6 +122,28 @@ static void model_inspector(struct nk_context *ctx, struct model *model)
         nk_property_float(ctx, "#Shininess:", 1, &model->material.shininess, 2048, 1, 1);
         nk_tree_pop(ctx);
     }
+    if (nk_tree_push(ctx, NK_TREE_TAB, "Mesh", NK_MINIMIZED)) {
+        struct mesh *mesh = &model->mesh;
+        uint32_t lod = (model->lod < mesh->n_lods) ? model->lod : mesh->n_lods - 1;
+        nk_labelf(ctx, NK_TEXT_LEFT, "LOD: %u / %u", lod, mesh->n_lods - 1);
+        uint32_t n_triangles = mesh->buffer.vertex_count / 3;
+        if (mesh->buffer.ibo) {
+            n_triangles = 0;
+            for (uint32_t i = 0; i < mesh->n_submeshes; i++) {
+                const struct mesh_submesh *submesh = &mesh->submeshes[i];
+                uint32_t submesh_lod = (lod < submesh->n_lods) ? lod : submesh->n_lods - 1;
+                n_triangles += submesh->lods[submesh_lod].index_count / 3;
+            }
+        }
+        nk_labelf(ctx, NK_TEXT_LEFT, "Triangles: %u", n_triangles);
+        nk_labelf(ctx, NK_TEXT_LEFT, "Submeshes: %u", mesh->n_submeshes);
+        for (uint32_t i = 0; i < mesh->n_submeshes && mesh->n_submeshes > 1; i++) {
+            const struct mesh_submesh *submesh = &mesh->submeshes[i];
+            nk_labelf(ctx, NK_TEXT_LEFT, "  %s (%s)", submesh->name,
+                      submesh->material[0] ? submesh->material : "no material");
+        }
+        nk_tree_pop(ctx);
+    }
 }
 
 static void environment_light_inspector(struct nk_context *ctx, struct directional_light *light)
@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <glad/gl.h>
+
+#include "uniform_buffer.h"
+#include "gl_state.h"
+#include "logger.h"
+
+static const char *uniform_block_names[UNIFORM_BLOCK_COUNT] = {
+    [UNIFORM_BLOCK_CAMERA] = "camera_block",
+    [UNIFORM_BLOCK_LIGHTING] = "lighting_block",
+    [UNIFORM_BLOCK_MATERIAL] = "material_block",
+};
+
+const char *uniform_block_name(enum uniform_block block)
+{
+    return uniform_block_names[block];
+}
+
+struct uniform_buffer uniform_buffer_create(enum uniform_block block, size_t size)
+{
+    struct uniform_buffer buffer = {0};
+    buffer.block = block;
+    buffer.size = size;
+    buffer.uploaded = malloc(size);
+    if (buffer.uploaded == NULL) {
+        SERROR("Failed to alloc memory for uniform block '%s'", uniform_block_name(block));
+        return buffer;
+    }
+
+    glGenBuffers(1, &buffer.handle);
+    gl_state_bind_buffer(GL_UNIFORM_BUFFER, buffer.handle);
+    glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr) size, NULL, GL_DYNAMIC_DRAW);
+    gl_state_bind_buffer(GL_UNIFORM_BUFFER, 0);
+
+    /* stays bound for as long as the buffer lives */
+    gl_state_bind_buffer_base(GL_UNIFORM_BUFFER, block, buffer.handle);
+
+    return buffer;
+}
+
+bool uniform_buffer_update(struct uniform_buffer *buffer, const void *data)
+{
+    if (buffer->handle == 0) return false;
+    if (buffer->written && memcmp(buffer->uploaded, data, buffer->size) == 0) return false;
+
+    memcpy(buffer->uploaded, data, buffer->size);
+    gl_state_bind_buffer(GL_UNIFORM_BUFFER, buffer->handle);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, (GLsizeiptr) buffer->size, data);
+    gl_state_bind_buffer(GL_UNIFORM_BUFFER, 0);
+
+    buffer->written = true;
+    buffer->n_writes++;
+    return true;
+}
+
+void uniform_buffer_destroy(struct uniform_buffer *buffer)
+{
+    if (buffer->handle != 0) {
+        SDEBUG("Uniform block '%s' was written %u times", uniform_block_name(buffer->block),
+               buffer->n_writes);
+        gl_state_forget_buffer(buffer->handle);
+        glDeleteBuffers(1, &buffer->handle);
+    }
+
+    free(buffer->uploaded);
+    memset(buffer, 0, sizeof(*buffer));
+}
@@ -0,0 +1,49 @@
+#ifndef SAGE_UNIFORM_BUFFER_H
+#define SAGE_UNIFORM_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Uniform buffers
+ *
+ * Uniforms every shader of a frame reads the same, like the camera & the
+ * lights, live in std140 uniform blocks instead of being set on each program
+ * & for each model. A buffer is bound to the binding point of its block once,
+ * shader_create() points the blocks of a program with the same name at it,
+ * & it's rewritten atmost once a frame if what it holds changed.
+ *
+ * The C structs written into them mirror the blocks in the .glsl files by
+ * hand, see camera.h, lighting.h & instance_buffer.h.
+ */
+
+/* Binding points of the blocks, shared by every program */
+enum uniform_block {
+    UNIFORM_BLOCK_CAMERA,   /* camera_block, struct camera_block */
+    UNIFORM_BLOCK_LIGHTING, /* lighting_block, struct lighting_block */
+    UNIFORM_BLOCK_MATERIAL, /* material_block, struct instance_material_block */
+    UNIFORM_BLOCK_COUNT,
+};
+
+struct uniform_buffer {
+    uint32_t handle;
+    enum uniform_block block;
+    size_t size;
+    void *uploaded;         /* what the buffer holds, to skip writes that change nothing */
+    bool written;
+    uint32_t n_writes;
+};
+
+/* Name of the block in the .glsl files */
+const char *uniform_block_name(enum uniform_block block);
+
+/* Creates a buffer of 'size' bytes bound to the binding point of 'block', the
+   handle is 0 if it failed */
+struct uniform_buffer uniform_buffer_create(enum uniform_block block, size_t size);
+/* Writes 'size' bytes of 'data' if they differ from what the buffer holds,
+   returns whether it was written */
+bool uniform_buffer_update(struct uniform_buffer *buffer, const void *data);
+void uniform_buffer_destroy(struct uniform_buffer *buffer);
+
+#endif /* SAGE_UNIFORM_BUFFER_H */
@@ -0,0 +1,272 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/pak.h"
+#include "../src/obj_loader.h"
+#include "../src/mesh.h"
+#include "../src/mesh_cache.h"
+#include "../src/texture_cache.h"
+#include "../src/file.h"
+#include "../src/hash.h"
+#include "../src/darray.h"
+
+/* An entry of the archive being cooked, 'data' is malloc'd */
+struct cook_entry {
+    struct pak_entry entry;
+    void *data;
+};
+
+static bool cook_asset(darray *entries, const char *path, bool cubemap_face);
+static bool cook_mesh(const char *path, void **data, size_t *size,
+                      char material_library[MESH_PATH_MAX_SIZE]);
+static bool cook_texture(const char *path, bool flip, void **data, size_t *size);
+static bool cook_file(const char *path, void **data, size_t *size);
+static bool cook_has_entry(const darray *entries, const char *name);
+static bool cook_is_image(const char *path);
+static bool cook_write(const char *path, darray *entries);
+static int cook_compare_entries(const void *a, const void *b);
+static size_t cook_align(size_t offset);
+static double cook_elapsed_ms(struct timespec start);
+
+/* Cooks the assets passed as arguments into a .sagepak, run through
+   `make cook`:
+       sage_cook -o <archive> [-c <cubemap face>]... <asset>...
+   .obj files become meshes & images become compressed textures with their
+   mips, flipped like texture_create() does unless they're passed as a face of
+   a cubemap.
+   Anything else, & the .mtl of the .obj files, is stored as is */
+int main(int argc, char **argv)
+{
+    const char *output = NULL;
+    darray *entries = darray_alloc(sizeof(struct cook_entry), 64);
+    if (entries == NULL) {
+        fprintf(stderr, "Failed to alloc memory for the archive\n");
+        return 1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int failures = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            failures += !cook_asset(entries, argv[++i], true);
+        } else {
+            failures += !cook_asset(entries, argv[i], false);
+        }
+    }
+
+    if (output == NULL) {
+        fprintf(stderr, "usage: %s -o <archive> [-c <cubemap face>]... <asset>...\n", argv[0]);
+        return 1;
+    }
+
+    bool written = cook_write(output, entries);
+
+    struct cook_entry *cooked = entries->items;
+    for (size_t i = 0; i < entries->len; i++) free(cooked[i].data);
+    darray_free(entries);
+
+    if (!written) return 1;
+    printf("Cooked '%s' in %.2f ms\n", output, cook_elapsed_ms(start));
+
+    return failures > 0;
+}
+
+static bool cook_asset(darray *entries, const char *path, bool cubemap_face)
+{
+    if (strlen(path) >= PAK_NAME_MAX_SIZE) {
+        fprintf(stderr, "Skipping '%s', the path is too long\n", path);
+        return false;
+    }
+    /* assets shared by several scenes are passed more than once */
+    if (cook_has_entry(entries, path)) return true;
+
+    struct cook_entry cooked;
+    memset(&cooked, 0, sizeof(cooked));
+    strcpy(cooked.entry.name, path);
+
+    bool ok;
+    size_t size = 0;
+    char material_library[MESH_PATH_MAX_SIZE] = {0};
+    const char *extension = strrchr(path, '.');
+    if (extension && strcmp(extension, ".obj") == 0) {
+        cooked.entry.type = PAK_ENTRY_MESH;
+        ok = cook_mesh(path, &cooked.data, &size, material_library);
+    } else if (cubemap_face || cook_is_image(path)) {
+        cooked.entry.type = PAK_ENTRY_TEXTURE;
+        ok = cook_texture(path, !cubemap_face, &cooked.data, &size);
+    } else {
+        cooked.entry.type = PAK_ENTRY_FILE;
+        ok = cook_file(path, &cooked.data, &size);
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Failed to cook '%s'\n", path);
+        return false;
+    }
+
+    cooked.entry.size = size;
+    cooked.entry.hash = hash_64(cooked.data, size, PAK_MAGIC);
+    darray_push(entries, &cooked);
+
+    printf("%-48s %8.2f KB\n", path, (double) size / 1024.0);
+
+    /* the submeshes of the mesh look their materials up in it at runtime */
+    struct file_info info;
+    if (material_library[0] != '\0' && file_stat(material_library, &info))
+        return cook_asset(entries, material_library, false);
+
+    return true;
+}
+
+/* The .smesh the mesh cache would hold, without the modification time of the
+   source so cooking the same files gives the same archive */
+static bool cook_mesh(const char *path, void **data, size_t *size,
+                      char material_library[MESH_PATH_MAX_SIZE])
+{
+    darray *vertices = NULL;
+    darray *indices = NULL;
+    darray *submeshes = NULL;
+    obj_load_model(path, &vertices, &indices, &submeshes, material_library);
+
+    struct mesh_pending pending = mesh_prepare(vertices, indices, submeshes->items, submeshes->len);
+    memcpy(pending.mesh.material_library, material_library, MESH_PATH_MAX_SIZE);
+    darray_free(submeshes);
+
+    struct smesh_header *header = mesh_cache_serialize(path, &pending.mesh, size);
+    mesh_pending_destroy(&pending);
+    if (header == NULL) return false;
+
+    header->source_mtime_sec = 0;
+    header->source_mtime_nsec = 0;
+
+    *data = header;
+    return true;
+}
+
+/* The .stex the texture cache holds, which is also where it comes from when
+   the image was loaded or cooked before */
+static bool cook_texture(const char *path, bool flip, void **data, size_t *size)
+{
+    /* cooked as colors, cubemaps are sampled without mips */
+    struct texture_cache_file cache;
+    if (!texture_cache_load(path, texture_cache_flags(flip, flip, TEXTURE_ROLE_COLOR), &cache))
+        return false;
+
+    *data = malloc(cache.file.size);
+    if (*data) memcpy(*data, cache.file.data, cache.file.size);
+    *size = cache.file.size;
+    texture_cache_close(&cache);
+
+    return *data != NULL;
+}
+
+/* An empty file has no data */
+static bool cook_file(const char *path, void **data, size_t *size)
+{
+    struct mapped_file file;
+    if (!file_map(path, &file)) return false;
+
+    bool copied = true;
+    *size = file.size;
+    if (file.size > 0) {
+        *data = malloc(file.size);
+        if (*data) memcpy(*data, file.data, file.size);
+        else copied = false;
+    }
+
+    file_unmap(&file);
+    return copied;
+}
+
+static bool cook_has_entry(const darray *entries, const char *name)
+{
+    const struct cook_entry *cooked = entries->items;
+    for (size_t i = 0; i < entries->len; i++) {
+        if (strcmp(cooked[i].entry.name, name) == 0) return true;
+    }
+
+    return false;
+}
+
+static bool cook_is_image(const char *path)
+{
+    static const char *extensions[] = {".png", ".jpg", ".jpeg", ".tga", ".bmp"};
+
+    const char *extension = strrchr(path, '.');
+    if (extension == NULL) return false;
+
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++) {
+        if (strcmp(extension, extensions[i]) == 0) return true;
+    }
+
+    return false;
+}
+
+/* Header, the entries sorted by name & their table of contents at the end */
+static bool cook_write(const char *path, darray *entries)
+{
+    qsort(entries->items, entries->len, sizeof(struct cook_entry), cook_compare_entries);
+
+    struct cook_entry *cooked = entries->items;
+    size_t offset = cook_align(sizeof(struct pak_header));
+    for (size_t i = 0; i < entries->len; i++) {
+        cooked[i].entry.offset = offset;
+        offset = cook_align(offset + cooked[i].entry.size);
+    }
+
+    struct pak_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = PAK_MAGIC;
+    header.version = PAK_VERSION;
+    header.n_entries = (uint32_t) entries->len;
+    header.toc_offset = offset;
+
+    size_t size = offset + entries->len * sizeof(struct pak_entry);
+    uint8_t *data = calloc(1, size);
+    if (data == NULL) {
+        fprintf(stderr, "Failed to alloc memory for '%s'\n", path);
+        return false;
+    }
+
+    memcpy(data, &header, sizeof(header));
+    struct pak_entry *toc = (struct pak_entry *) (data + header.toc_offset);
+    for (size_t i = 0; i < entries->len; i++) {
+        if (cooked[i].entry.size > 0)
+            memcpy(data + cooked[i].entry.offset, cooked[i].data, cooked[i].entry.size);
+        toc[i] = cooked[i].entry;
+    }
+
+    bool written = file_write_atomic(path, data, size);
+    free(data);
+
+    if (!written) fprintf(stderr, "Failed to write '%s'\n", path);
+    else printf("%zu assets, %.2f MB\n", entries->len, (double) size / (1024.0 * 1024.0));
+
+    return written;
+}
+
+static int cook_compare_entries(const void *a, const void *b)
+{
+    return strcmp(((const struct cook_entry *) a)->entry.name,
+                  ((const struct cook_entry *) b)->entry.name);
+}
+
+static size_t cook_align(size_t offset)
+{
+    return (offset + PAK_ALIGNMENT - 1) & ~((size_t) PAK_ALIGNMENT - 1);
+}
+
+static double cook_elapsed_ms(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start.tv_sec) * 1000.0 +
+           (double) (now.tv_nsec - start.tv_nsec) / 1000000.0;
+}
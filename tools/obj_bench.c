@@ -0,0 +1,142 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../src/obj_loader.h"
+#include "../src/darray.h"
+
+/* Each file is loaded this many times and the fastest run is reported so
+   that a cold page cache doesn't skew the numbers */
+#define BENCH_ITERATIONS 5
+
+static double bench_load(const char *path, uint32_t n_threads,
+                         darray **vertices, darray **indices);
+static int darray_equal(const darray *a, const darray *b);
+static double bench_elapsed_ms(struct timespec start);
+
+/* Reports the .obj parsing throughput in MB/s of every file passed as an
+   argument for 1 up to the amount of cores, run through `make bench`. Every
+   threaded result is checked against the single threaded one */
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file.obj>...\n", argv[0]);
+        return 1;
+    }
+
+    long n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t max_threads = (n_cores > 0) ? (uint32_t) n_cores : 1;
+    if (max_threads > OBJ_LOADER_MAX_THREADS) max_threads = OBJ_LOADER_MAX_THREADS;
+
+    /* 1, 2, 4, ... up to the amount of cores */
+    uint32_t thread_counts[OBJ_LOADER_MAX_THREADS];
+    size_t n_thread_counts = 0;
+    for (uint32_t n = 1; n < max_threads; n *= 2)
+        thread_counts[n_thread_counts++] = n;
+    thread_counts[n_thread_counts++] = max_threads;
+
+    double total_mb = 0.0;
+    double total_ms[OBJ_LOADER_MAX_THREADS] = {0};
+    int mismatches = 0;
+
+    char header[32];
+    printf("%-32s %8s %9s", "file", "MB", "vertices");
+    for (size_t i = 0; i < n_thread_counts; i++) {
+        snprintf(header, sizeof(header), "%ut MB/s", thread_counts[i]);
+        printf(" %10s", header);
+    }
+    printf("\n");
+
+    for (int i = 1; i < argc; i++) {
+        struct stat info;
+        if (stat(argv[i], &info) < 0) {
+            fprintf(stderr, "Skipping '%s', it doesn't exist\n", argv[i]);
+            continue;
+        }
+
+        double mb = (double) info.st_size / (1024.0 * 1024.0);
+        total_mb += mb;
+
+        darray *serial_vertices = NULL;
+        darray *serial_indices = NULL;
+        double ms[OBJ_LOADER_MAX_THREADS];
+        for (size_t j = 0; j < n_thread_counts; j++) {
+            darray *vertices = NULL;
+            darray *indices = NULL;
+            ms[j] = bench_load(argv[i], thread_counts[j], &vertices, &indices);
+            total_ms[j] += ms[j];
+
+            if (j == 0) {
+                serial_vertices = vertices;
+                serial_indices = indices;
+                continue;
+            }
+
+            if (!darray_equal(vertices, serial_vertices) ||
+                !darray_equal(indices, serial_indices)) {
+                fprintf(stderr, "'%s' loaded with %u threads differs from 1 thread\n",
+                        argv[i], thread_counts[j]);
+                mismatches++;
+            }
+            darray_free(vertices);
+            darray_free(indices);
+        }
+
+        printf("%-32s %8.2f %9zu", argv[i], mb, serial_vertices->len);
+        for (size_t j = 0; j < n_thread_counts; j++)
+            printf(" %10.1f", mb / (ms[j] / 1000.0));
+        printf("\n");
+
+        darray_free(serial_vertices);
+        darray_free(serial_indices);
+    }
+
+    printf("%-32s %8.2f %9s", "total", total_mb, "");
+    for (size_t j = 0; j < n_thread_counts; j++)
+        printf(" %10.1f", (total_ms[j] > 0.0) ? total_mb / (total_ms[j] / 1000.0) : 0.0);
+    printf("\n");
+
+    return mismatches > 0;
+}
+
+/* Returns the fastest of BENCH_ITERATIONS loads, keeping the last result */
+static double bench_load(const char *path, uint32_t n_threads,
+                         darray **vertices, darray **indices)
+{
+    double best_ms = -1.0;
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        if (*vertices) darray_free(*vertices);
+        if (*indices) darray_free(*indices);
+        *vertices = NULL;
+        *indices = NULL;
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        obj_load_mesh_threaded(path, vertices, indices, n_threads);
+        double ms = bench_elapsed_ms(start);
+
+        if (best_ms < 0.0 || ms < best_ms) best_ms = ms;
+    }
+
+    return best_ms;
+}
+
+static int darray_equal(const darray *a, const darray *b)
+{
+    return a->len == b->len &&
+           a->item_size == b->item_size &&
+           memcmp(a->items, b->items, a->len * a->item_size) == 0;
+}
+
+static double bench_elapsed_ms(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start.tv_sec) * 1000.0 +
+           (double) (now.tv_nsec - start.tv_nsec) / 1000000.0;
+}